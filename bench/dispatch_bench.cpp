@@ -0,0 +1,124 @@
+// Dispatch microbenchmark for the Iodicium VM.
+//
+// Builds a synthetic chunk dominated by short arithmetic, global and call
+// sequences and times VirtualMachine::run over it. The same source is built
+// twice by CMake: once with the computed-goto dispatcher and once with
+// IODICIUM_VM_SWITCH_DISPATCH defined, so the two loops can be compared.
+//
+// Configure with -DIODICIUM_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release.
+// Usage: iodicium_dispatch_bench [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <streambuf>
+
+#include "common/logger.h"
+#include "common/opcode.h"
+#include "executable/ioe_reader.h"
+#include "vm/vm.h"
+
+namespace {
+
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return c; }
+    };
+
+    constexpr int BLOCKS = 2000;
+
+    // Returns the number of instructions one run of the chunk dispatches.
+    size_t buildChunk(Iodicium::Executable::Chunk& chunk) {
+        // Constant pool: the empty return value and a few small integers.
+        using Iodicium::Executable::Constant;
+        chunk.constants = {Constant::fromString(""), Constant::fromInt(0), Constant::fromInt(1), Constant::fromInt(2),
+                           Constant::fromInt(3), Constant::fromInt(5), Constant::fromInt(7)};
+        const uint8_t EMPTY = 0, ZERO = 1, ONE = 2, TWO = 3, THREE = 4, FIVE = 5, SEVEN = 6;
+        // Global slots, as big-endian uint16 operands.
+        chunk.global_count = 2;
+        chunk.global_names = {"acc", "tmp"};
+        const uint8_t ACC = 0, TMP = 1;
+
+        auto& code = chunk.code;
+        size_t executed = 0;
+        auto emit = [&](std::initializer_list<uint8_t> bytes, size_t instructions = 1) {
+            code.insert(code.end(), bytes);
+            executed += instructions;
+        };
+
+        emit({OP_CONST, ZERO});
+        emit({OP_DEFINE_GLOBAL, 0, ACC});
+
+        std::vector<size_t> call_sites;
+        for (int i = 0; i < BLOCKS; i++) {
+            // acc = acc + f(3)
+            emit({OP_GET_GLOBAL, 0, ACC});
+            emit({OP_CONST, THREE});
+            call_sites.push_back(code.size() + 2);
+            emit({OP_CALL, 1, 0, 0}, 1 + 6); // The call plus the six instructions of f
+            emit({OP_ADD_INT});
+            emit({OP_DEFINE_GLOBAL, 0, ACC});
+            // tmp = (5 + 7) * 2 - 1
+            emit({OP_CONST, FIVE});
+            emit({OP_CONST, SEVEN});
+            emit({OP_ADD_INT});
+            emit({OP_CONST, TWO});
+            emit({OP_MULTIPLY_INT});
+            emit({OP_CONST, ONE});
+            emit({OP_SUBTRACT_INT});
+            emit({OP_DEFINE_GLOBAL, 0, TMP});
+        }
+        emit({OP_CONST, EMPTY});
+        emit({OP_RETURN});
+
+        // f(x) = x * 2 + 1
+        uint16_t f_address = static_cast<uint16_t>(code.size());
+        code.insert(code.end(), {OP_GET_LOCAL, 0, OP_CONST, TWO, OP_MULTIPLY_INT, OP_CONST, ONE, OP_ADD_INT, OP_RETURN});
+        for (size_t site : call_sites) {
+            code[site] = (f_address >> 8) & 0xFF;
+            code[site + 1] = f_address & 0xFF;
+        }
+        // Entry, arity and stack depth of the top level and of f.
+        chunk.functions = {{0, 0, 2}, {f_address, 1, 3}};
+        return executed;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 500;
+
+    Iodicium::Executable::Chunk chunk;
+    size_t instructions_per_run = buildChunk(chunk);
+
+    Iodicium::Common::Logger logger;
+    Iodicium::VM::VirtualMachine vm(logger);
+    Iodicium::VM::Loader loader(logger);
+    Iodicium::VM::Program program = loader.load(chunk); // Decoding is not part of the timed loop
+
+    // The VM and logger both write to std::cout; silence them while timing.
+    NullBuffer null_buffer;
+    std::streambuf* original = std::cout.rdbuf(&null_buffer);
+
+    vm.run(program); // Warm-up
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        vm.run(program);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout.rdbuf(original);
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double total = static_cast<double>(instructions_per_run) * iterations;
+#if defined(IODICIUM_VM_SWITCH_DISPATCH)
+    const char* mode = "switch";
+#else
+    const char* mode = "threaded";
+#endif
+    std::cout << "dispatch=" << mode
+              << " instructions=" << static_cast<size_t>(total)
+              << " time=" << seconds << "s"
+              << " ns/instruction=" << (seconds * 1e9 / total) << std::endl;
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Per-call overhead of the embedding API.
+ *
+ * Loads the bench/embed library, creates a context and then calls each of
+ * its functions many times through iod_call(), reporting the best time per
+ * call over several rounds. The functions do next to nothing, so the time
+ * is what a host pays to call into a script: checking and converting the
+ * arguments, entering the interpreter and returning the result. The time
+ * to load the image and create a context, paid once per host rather than
+ * once per call as with a process per invocation, is reported too.
+ *
+ * Configure with -DIODICIUM_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release.
+ * Usage: iodicium_embed_bench [calls] [library.iodl]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "iodicium.h"
+
+#define ROUNDS 5
+
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void check(IodStatus status, const char* what) {
+    if (status != IOD_OK) {
+        fprintf(stderr, "%s: %s\n", what, iod_error());
+        exit(1);
+    }
+}
+
+/* Best seconds per call of 'calls' calls to 'name' with 'args'. */
+static double measure(IodContext* context, const IodImage* image, const char* name, const IodValue* args, size_t argc, long calls) {
+    const IodFunction* function = iod_image_find(image, name);
+    double best = 0.0;
+    IodValue result;
+    int round;
+    long i;
+    if (!function) {
+        fprintf(stderr, "The library exports no function '%s'.\n", name);
+        exit(1);
+    }
+    for (round = 0; round < ROUNDS; round++) {
+        double start = now();
+        for (i = 0; i < calls; i++) {
+            if (iod_call(context, function, args, argc, &result) != IOD_OK) check(IOD_ERROR, name);
+        }
+        double seconds = (now() - start) / (double)calls;
+        if (round == 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    long calls = argc > 1 ? atol(argv[1]) : 1000000;
+    const char* path = argc > 2 ? argv[2] : IODICIUM_EMBED_LIBRARY;
+    IodImage* image;
+    IodContext* context;
+    IodValue args[2];
+    double start, loaded, created;
+
+    start = now();
+    check(iod_image_load(path, &image), "Loading the library");
+    loaded = now();
+    check(iod_context_new(image, 0, &context), "Creating a context");
+    created = now();
+
+    printf("%-28s %12.1f us\n", "load image", (loaded - start) * 1e6);
+    printf("%-28s %12.1f us\n", "create context", (created - loaded) * 1e6);
+
+    args[0] = iod_int(42);
+    printf("%-28s %12.1f ns\n", "identity(Int)", measure(context, image, "identity", args, 1, calls) * 1e9);
+    args[1] = iod_int(58);
+    printf("%-28s %12.1f ns\n", "add(Int, Int)", measure(context, image, "add", args, 2, calls) * 1e9);
+    args[0] = iod_double(1.5);
+    args[1] = iod_double(2.0);
+    printf("%-28s %12.1f ns\n", "scale(Double, Double)", measure(context, image, "scale", args, 2, calls) * 1e9);
+    args[0] = iod_string("world");
+    printf("%-28s %12.1f ns\n", "greet(String): String", measure(context, image, "greet", args, 1, calls) * 1e9);
+
+    iod_context_free(context);
+    iod_image_free(image);
+    return 0;
+}
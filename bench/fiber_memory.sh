@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+# Runs the fibers workload, which creates 2^16 fibers one after another, under
+# a small memory limit. The records and stacks of fibers that have returned
+# are reused, so it must finish and print the number of fibers it ran.
+#
+# Usage: bench/fiber_memory.sh <path to iodicium>
+# Environment: MEMORY (default 4M).
+set -euo pipefail
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 <path to iodicium>" >&2
+    exit 2
+fi
+IODICIUM=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+MEMORY=${MEMORY:-4M}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+
+"$IODICIUM" compile "$BENCH_DIR/fibers/Iodicium.toml" > /dev/null
+for flags in "" --no-jit; do
+    output=$("$IODICIUM" run Fibers.iode --memory "$MEMORY" $flags 2>&1 | grep -v '^\[' || true)
+    if [ "$output" != 65536 ]; then
+        echo "fibers${flags:+ ($flags)}: expected 65536 under --memory $MEMORY, got: $output" >&2
+        exit 1
+    fi
+done
+echo "fibers: ok under --memory $MEMORY"
@@ -0,0 +1,107 @@
+// Instruction-set A/B benchmark for the Iodicium compiler and VM.
+//
+// Compiles each source file once per code generator (stack without and with
+// superinstructions, stack with inlining too, and register), then reports the static code size, the
+// number of instructions dispatched by one run (counted with
+// CountingInstrumentation) and the best wall time over several uninstrumented
+// runs. Program output is discarded.
+//
+// Configure with -DIODICIUM_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release.
+// Usage: iodicium_isa_bench [runs] [file.iodc ...]
+// Without files, the bench/calls and bench/arith workloads are used.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "common/logger.h"
+#include "common/opcode.h"
+#include "compiler/linker.h"
+#include "vm/instrumentation.h"
+#include "vm/loader.h"
+#include "vm/vm.h"
+
+namespace {
+
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return c; }
+    };
+
+    struct Result {
+        size_t code_bytes;
+        size_t instructions;
+        uint64_t dispatched;
+        double best_seconds;
+    };
+
+    struct Variant {
+        const char* name;
+        uint8_t isa;
+        bool fuse;
+        bool inline_calls;
+    };
+
+    Result measure(const std::string& path, const Variant& variant, int runs, Iodicium::Common::Logger& logger) {
+        Iodicium::Compiler::Linker linker(logger, false, variant.isa, variant.fuse, variant.inline_calls);
+        Iodicium::Executable::Chunk chunk = linker.link({path});
+        Iodicium::VM::Loader loader(logger);
+        Iodicium::VM::Program program = loader.load(chunk);
+        Iodicium::VM::VirtualMachine vm(logger);
+        vm.setJitEnabled(false); // Compare the interpreters, not native code
+
+        Result result{chunk.code.size(), program.code.size(), 0, 0.0};
+
+        Iodicium::VM::CountingInstrumentation counter;
+        vm.run(program, counter);
+        result.dispatched = counter.instructions;
+
+        for (int i = 0; i < runs; i++) {
+            auto start = std::chrono::steady_clock::now();
+            vm.run(program);
+            auto end = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(end - start).count();
+            result.best_seconds = i == 0 ? seconds : std::min(result.best_seconds, seconds);
+        }
+        return result;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    int runs = argc > 1 ? std::atoi(argv[1]) : 5;
+    std::vector<std::string> sources;
+    for (int i = 2; i < argc; i++) sources.push_back(argv[i]);
+    if (sources.empty()) {
+        sources = {IODICIUM_BENCH_DIR "/calls/calls.iodc", IODICIUM_BENCH_DIR "/arith/arith.iodc"};
+    }
+
+    Iodicium::Common::Logger logger;
+
+    std::cout << std::left << std::setw(40) << "program" << std::setw(10) << "code"
+              << std::right << std::setw(12) << "bytes" << std::setw(14) << "instructions"
+              << std::setw(16) << "dispatched" << std::setw(12) << "best (s)" << std::endl;
+
+    for (const auto& source : sources) {
+        for (const Variant& variant : {Variant{"unfused", ISA_STACK, false, false}, Variant{"stack", ISA_STACK, true, false},
+                                       Variant{"inlined", ISA_STACK, true, true}, Variant{"register", ISA_REGISTER, false, false}}) {
+            // The VM and logger both write to std::cout; silence them while measuring.
+            NullBuffer null_buffer;
+            std::streambuf* original = std::cout.rdbuf(&null_buffer);
+            Result result = measure(source, variant, runs, logger);
+            std::cout.rdbuf(original);
+
+            std::cout << std::left << std::setw(40) << source.substr(source.find_last_of('/') + 1)
+                      << std::setw(10) << variant.name
+                      << std::right << std::setw(12) << result.code_bytes << std::setw(14) << result.instructions
+                      << std::setw(16) << result.dispatched << std::setw(12) << std::fixed << std::setprecision(4)
+                      << result.best_seconds << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#!/usr/bin/env bash
+# Compares the bench/ workloads run by the VM with the same programs
+# translated to C by `iodicium compile --emit=c` and built with the system
+# C compiler. Each configuration is run RUNS times and the best time is kept.
+# Before timing, the two builds' standard output and standard error, captured
+# together through a pipe, must match; the output workload interleaves them.
+#
+# Usage: bench/native_bench.sh <path to iodicium> [workload...]
+# Environment: CC (default cc), CFLAGS (default -O2), RUNS (default 5).
+set -euo pipefail
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <path to iodicium> [workload...]" >&2
+    exit 2
+fi
+IODICIUM=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+shift
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+WORKLOADS=("$@")
+[ ${#WORKLOADS[@]} -gt 0 ] || WORKLOADS=(calls arith output)
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+RUNS=${RUNS:-5}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+
+# Prints the best wall time of RUNS runs of the command, in seconds.
+best_time() {
+    local best="" start end elapsed
+    for _ in $(seq "$RUNS"); do
+        start=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        end=$(date +%s%N)
+        elapsed=$((end - start))
+        if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then best=$elapsed; fi
+    done
+    awk -v ns="$best" 'BEGIN { printf "%.4f", ns / 1e9 }'
+}
+
+# The VM's own log lines start with '['; the program's output is the rest.
+# Standard error is merged in so the order of the two streams is compared too.
+program_output() {
+    "$@" 2>&1 | grep -v '^\[' || true
+}
+
+printf "%-10s %12s %12s %12s %10s\n" workload "vm (s)" "vm no-jit" "native (s)" speedup
+for workload in "${WORKLOADS[@]}"; do
+    project="$BENCH_DIR/$workload/Iodicium.toml"
+    name=$(sed -n 's/^name *= *"\(.*\)"/\1/p' "$project")
+
+    "$IODICIUM" compile "$project" > /dev/null
+    "$IODICIUM" compile "$project" --emit=c > /dev/null
+    $CC $CFLAGS "$name.c" -o "$name"
+
+    if [ "$(program_output "$IODICIUM" run "$name.iode")" != "$(program_output "./$name")" ]; then
+        echo "$workload: the native build's output differs from the VM's" >&2
+        exit 1
+    fi
+
+    vm=$(best_time "$IODICIUM" run "$name.iode")
+    interpreted=$(best_time "$IODICIUM" run "$name.iode" --no-jit)
+    native=$(best_time "./$name")
+    speedup=$(awk -v a="$interpreted" -v b="$native" 'BEGIN { if (b > 0) printf "%.1fx", a / b; else print "-" }')
+    printf "%-10s %12s %12s %12s %10s\n" "$workload" "$vm" "$interpreted" "$native" "$speedup"
+done
@@ -0,0 +1,142 @@
+// Throughput and latency of `iodicium serve`.
+//
+// Opens 'connections' connections to a server of the bench/embed library
+// and has each send 'requests' calls of add(), 'pipeline' at a time: it
+// sends that many requests and then waits for all of their responses.
+// Reports the requests answered per second across all connections and
+// the percentiles of the time from sending a batch to its last response.
+// With a pipeline of 1 that is the round trip of a single call.
+//
+// With --spawn, times `iodicium run` of an executable instead, one process
+// per request: the cost a resident server saves.
+//
+// Configure with -DIODICIUM_BUILD_BENCHMARKS=ON -DCMAKE_BUILD_TYPE=Release, then:
+//     Iodicium serve Embed.iodl --socket /tmp/embed.sock --workers 4 &
+//     iodicium_serve_bench /tmp/embed.sock [connections] [requests] [pipeline]
+//     iodicium_serve_bench --spawn Iodicium file.iode [runs]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "vm/server.h"
+
+extern char** environ;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    double microseconds(Clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+    double percentile(const std::vector<double>& sorted, double fraction) {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * static_cast<double>(sorted.size())))];
+    }
+
+    // Sends 'requests' calls over one connection; appends the time of each batch to 'latencies'.
+    void drive(const std::string& socket_path, long requests, long pipeline, std::vector<double>& latencies) {
+        Iodicium::VM::Client client(socket_path);
+        if (client.call("add\t1\t2") != "ok\t3") throw std::runtime_error("The server does not serve bench/embed.");
+        latencies.reserve(static_cast<size_t>(requests / pipeline + 1));
+        for (long sent = 0; sent < requests;) {
+            long batch = std::min(pipeline, requests - sent);
+            Clock::time_point start = Clock::now();
+            for (long i = 0; i < batch; i++) client.send("add\t" + std::to_string(sent + i) + "\t1");
+            for (long i = 0; i < batch; i++) {
+                std::string response = client.receive();
+                if (response.compare(0, 3, "ok\t") != 0) throw std::runtime_error("Request failed: " + response);
+            }
+            latencies.push_back(microseconds(Clock::now() - start));
+            sent += batch;
+        }
+    }
+
+    int benchServer(const std::string& socket_path, long connections, long requests, long pipeline) {
+        std::vector<std::vector<double>> latencies(static_cast<size_t>(connections));
+        std::vector<std::string> errors(static_cast<size_t>(connections));
+        std::vector<std::thread> threads;
+        Clock::time_point start = Clock::now();
+        for (long i = 0; i < connections; i++) {
+            threads.emplace_back([&, i] {
+                try {
+                    drive(socket_path, requests, pipeline, latencies[static_cast<size_t>(i)]);
+                } catch (const std::exception& e) {
+                    errors[static_cast<size_t>(i)] = e.what();
+                }
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        for (const std::string& error : errors) {
+            if (!error.empty()) {
+                std::fprintf(stderr, "Error: %s\n", error.c_str());
+                return 1;
+            }
+        }
+        std::vector<double> all;
+        for (const std::vector<double>& connection : latencies) all.insert(all.end(), connection.begin(), connection.end());
+        std::sort(all.begin(), all.end());
+
+        std::printf("%ld connections, %ld requests each, %ld per batch\n", connections, requests, pipeline);
+        std::printf("%-20s %12.0f requests/s\n", "throughput", static_cast<double>(connections * requests) / seconds);
+        std::printf("%-20s %12.1f us\n", "batch latency p50", percentile(all, 0.50));
+        std::printf("%-20s %12.1f us\n", "batch latency p99", percentile(all, 0.99));
+        std::printf("%-20s %12.1f us\n", "batch latency max", all.back());
+        return 0;
+    }
+
+    int benchSpawn(const char* iodicium, const char* file, long runs) {
+        std::vector<double> times;
+        double total = 0.0;
+        char run[] = "run";
+        char* argv[] = {const_cast<char*>(iodicium), run, const_cast<char*>(file), nullptr};
+        for (long i = 0; i < runs; i++) {
+            Clock::time_point start = Clock::now();
+            pid_t pid;
+            int status = 0;
+            if (posix_spawnp(&pid, iodicium, nullptr, nullptr, argv, environ) != 0 || waitpid(pid, &status, 0) < 0 || status != 0) {
+                std::fprintf(stderr, "Error: Could not run %s run %s\n", iodicium, file);
+                return 1;
+            }
+            times.push_back(microseconds(Clock::now() - start));
+            total += times.back();
+        }
+        std::sort(times.begin(), times.end());
+        std::printf("%ld runs of %s run %s\n", runs, iodicium, file);
+        std::printf("%-20s %12.0f requests/s\n", "throughput", 1e6 * static_cast<double>(runs) / total);
+        std::printf("%-20s %12.1f us\n", "latency p50", percentile(times, 0.50));
+        std::printf("%-20s %12.1f us\n", "latency p99", percentile(times, 0.99));
+        return 0;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    bool spawn = argc > 1 && std::string(argv[1]) == "--spawn";
+    if (argc < 2 || (spawn && argc < 4)) {
+        std::fprintf(stderr, "Usage: %s <socket> [connections] [requests] [pipeline]\n       %s --spawn <iodicium> <file.iode> [runs]\n", argv[0], argv[0]);
+        return 2;
+    }
+    if (spawn) {
+        return benchSpawn(argv[2], argv[3], argc > 4 ? std::max(1L, std::atol(argv[4])) : 200);
+    }
+    long connections = argc > 2 ? std::max(1L, std::atol(argv[2])) : 4;
+    long requests = argc > 3 ? std::max(1L, std::atol(argv[3])) : 100000;
+    long pipeline = argc > 4 ? std::max(1L, std::atol(argv[4])) : 1;
+    try {
+        return benchServer(argv[1], connections, requests, pipeline);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+}
@@ -81,6 +81,20 @@ void Parser::check_required_arguments() {
 void Parser::parse_args(int argc, char* argv[]) {
     std::vector<std::string> raw_args(argv + 1, argv + argc);
 
+    // Accept "--flag=value" for this parser's options that take a value
+    for (size_t i = 0; i < raw_args.size(); ++i) {
+        size_t equals = raw_args[i].find('=');
+        if (raw_args[i].rfind("--", 0) != 0 || equals == std::string::npos) continue;
+        auto flag_it = m_flag_map.find(raw_args[i].substr(0, equals));
+        if (flag_it == m_flag_map.end()) continue;
+        const Argument& argument = m_arguments[flag_it->second];
+        if (!argument.m_takes_value && argument.m_nargs != 1) continue;
+        std::string value = raw_args[i].substr(equals + 1);
+        raw_args[i].resize(equals);
+        raw_args.insert(raw_args.begin() + i + 1, value);
+        ++i;
+    }
+
     // Handle global help flag first (before any other parsing logic)
     for (const auto& arg : raw_args) {
         if (arg == "-h" || arg == "--help") {
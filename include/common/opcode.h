@@ -3,6 +3,12 @@
 
 #include <cstdint>
 
+// The instruction set a code section is written in, recorded in the image header.
+enum InstructionSet : uint8_t {
+    ISA_STACK = 0x00,    // Operands are passed on the VM stack (below OP_REG_ENTER)
+    ISA_REGISTER = 0x01, // Operands name registers in the current frame (OP_REG_*)
+};
+
 enum OpCode : uint8_t {
     // --- Core Operations ---
     OP_RETURN = 0x00,
@@ -24,14 +30,275 @@ enum OpCode : uint8_t {
     OP_DIVIDE = 0x0A,
 
     // --- Variable Operations ---
-    OP_DEFINE_GLOBAL = 0x0B,
-    OP_GET_GLOBAL = 0x0C,
-    OP_SET_GLOBAL = 0x0D,
+    OP_DEFINE_GLOBAL = 0x0B, // Defines a global variable. Operand: <uint16_t global_slot>
+    OP_GET_GLOBAL = 0x0C,    // Reads a global variable. Operand: <uint16_t global_slot>
+    OP_SET_GLOBAL = 0x0D,    // Writes to a global variable. Operand: <uint16_t global_slot>
     OP_GET_LOCAL = 0x0E, // Reads a local variable. Operand: <uint8_t slot_index>
     OP_SET_LOCAL = 0x0F, // Writes to a local variable. Operand: <uint8_t slot_index>
 
     // --- Type Operations ---
     OP_CONVERT = 0x10,
+
+    // --- Typed Arithmetic Operations ---
+    // Emitted when the SemanticAnalyzer has resolved both operand types. The
+    // untyped OP_ADD..OP_DIVIDE above remain for images built without types.
+    OP_ADD_INT = 0x11,
+    OP_SUBTRACT_INT = 0x12,
+    OP_MULTIPLY_INT = 0x13,
+    OP_DIVIDE_INT = 0x14,
+    OP_ADD_DOUBLE = 0x15,
+    OP_SUBTRACT_DOUBLE = 0x16,
+    OP_MULTIPLY_DOUBLE = 0x17,
+    OP_DIVIDE_DOUBLE = 0x18,
+    OP_CONCAT = 0x19, // Concatenates two strings.
+    OP_CONCAT_N = 0x1A, // Concatenates the top <uint8_t count> strings (at least two) into one.
+
+    // --- Stack Operations ---
+    OP_POP = 0x1B, // Discards the top of the stack, such as the value of an expression statement.
+    OP_TAIL_CALL = 0x1C, // Calls a function in place of the current one, whose frame it reuses. Operands as OP_CALL.
+    OP_SLIDE = 0x1D, // Keeps the top of the stack and discards the <uint8_t count> values below it.
+
+    // --- Native Calls ---
+    // Calls a function implemented in C++ (see vm/natives.h), named by a
+    // string constant; its result replaces the arguments. Operands: <uint8_t arg_count>, <uint8_t name_const>
+    OP_CALL_NATIVE = 0x1E,
+
+    // --- Type Checks ---
+    // Raises an error unless the top of the stack is of the <uint8_t type>
+    // (a DataType). Emitted where a value whose type is only known when it
+    // runs, such as what resume() returns, takes a declared type.
+    OP_CHECK_TYPE = 0x1F,
+
+    // --- Superinstructions ---
+    // Written only by the compiler's SuperinstructionPass. Each one does the
+    // work of the listed sequence and its operands are theirs, concatenated.
+    OP_GET_LOCAL_2 = 0x20,      // OP_GET_LOCAL, OP_GET_LOCAL. Operands: <uint8_t slot>, <uint8_t slot>
+    OP_GET_LOCAL_CONST = 0x21,  // OP_GET_LOCAL, OP_CONST. Operands: <uint8_t slot>, <uint8_t const_index>
+    OP_GET_LOCAL_CALL = 0x22,   // OP_GET_LOCAL, OP_CALL. Operands: <uint8_t slot>, <uint8_t arg_count>, <uint16_t address>
+    OP_ADD_INT_RETURN = 0x23,   // OP_ADD_INT, OP_RETURN
+
+    // --- Fibers ---
+    // A fiber runs a function on stacks of its own; see VirtualMachine::resumeFiber.
+    OP_FIBER = 0x30,  // Creates a fiber that will call a function and pushes its handle. Operands as OP_CALL.
+    OP_RESUME = 0x31, // Runs the fiber whose handle is on top until it yields or returns, and pushes that value.
+    OP_YIELD = 0x32,  // Passes the top of the stack back to the fiber's resumer; evaluates to nil once resumed.
+
+    // --- Tasks ---
+    // A task is a function call that may run on another thread; see vm/tasks.h.
+    OP_SPAWN = 0x33, // Queues a task that will call a function and pushes its handle. Operands as OP_CALL.
+    OP_JOIN = 0x34,  // Waits for the task whose handle is on top, running it here if no thread has, and pushes its result.
+
+    // --- Register Instruction Set ---
+    // Registers are the slots of the current frame: parameters first, then
+    // locals, then temporaries. <r> operands are uint8_t register indices.
+    OP_REG_ENTER = 0x40,         // First instruction of every function. Operand: <uint8_t register_count>
+    OP_REG_LOAD_CONST = 0x41,    // r[dst] = constant. Operands: <r dst>, <uint8_t const_index>
+    OP_REG_MOVE = 0x42,          // r[dst] = r[src]. Operands: <r dst>, <r src>
+    OP_REG_GET_GLOBAL = 0x43,    // Operands: <r dst>, <uint16_t global_slot>
+    OP_REG_DEFINE_GLOBAL = 0x44, // Operands: <r src>, <uint16_t global_slot>
+    OP_REG_SET_GLOBAL = 0x45,    // Operands: <r src>, <uint16_t global_slot>
+    OP_REG_CALL = 0x46,          // Arguments in r[first]..; the result replaces r[first]. Operands: <r first>, <uint8_t arg_count>, <uint16_t address>
+    OP_REG_RETURN = 0x47,        // Operand: <r src>
+    OP_REG_CONVERT = 0x48,       // Operands: <r dst>, <r src>, <uint8_t target_type>
+    OP_REG_WRITE_OUT = 0x49,     // Operand: <r src>
+    OP_REG_WRITE_ERR = 0x4A,     // Operand: <r src>
+    OP_REG_CALL_NATIVE = 0x4B,   // As OP_REG_CALL, for OP_CALL_NATIVE. Operands: <r first>, <uint8_t arg_count>, <uint8_t name_const>
+
+    // Three-address arithmetic, r[dst] = r[a] op r[b]. Operands: <r dst>, <r a>, <r b>
+    OP_REG_ADD = 0x50,
+    OP_REG_SUBTRACT = 0x51,
+    OP_REG_MULTIPLY = 0x52,
+    OP_REG_DIVIDE = 0x53,
+    OP_REG_ADD_INT = 0x54,
+    OP_REG_SUBTRACT_INT = 0x55,
+    OP_REG_MULTIPLY_INT = 0x56,
+    OP_REG_DIVIDE_INT = 0x57,
+    OP_REG_ADD_DOUBLE = 0x58,
+    OP_REG_SUBTRACT_DOUBLE = 0x59,
+    OP_REG_MULTIPLY_DOUBLE = 0x5A,
+    OP_REG_DIVIDE_DOUBLE = 0x5B,
+    OP_REG_CONCAT = 0x5C,
 };
 
+// Returns the number of operand bytes that follow 'op' in a code section, or
+// -1 if 'op' is not an opcode the VM can execute.
+inline int getOperandLength(uint8_t op) {
+    switch (op) {
+        case OP_CALL:
+        case OP_TAIL_CALL:
+        case OP_FIBER:
+        case OP_SPAWN:
+        case OP_REG_CONVERT:
+        case OP_REG_GET_GLOBAL:
+        case OP_REG_DEFINE_GLOBAL:
+        case OP_REG_SET_GLOBAL:
+        case OP_REG_ADD:
+        case OP_REG_SUBTRACT:
+        case OP_REG_MULTIPLY:
+        case OP_REG_DIVIDE:
+        case OP_REG_ADD_INT:
+        case OP_REG_SUBTRACT_INT:
+        case OP_REG_MULTIPLY_INT:
+        case OP_REG_DIVIDE_INT:
+        case OP_REG_ADD_DOUBLE:
+        case OP_REG_SUBTRACT_DOUBLE:
+        case OP_REG_MULTIPLY_DOUBLE:
+        case OP_REG_DIVIDE_DOUBLE:
+        case OP_REG_CONCAT:
+        case OP_REG_CALL_NATIVE:
+            return 3;
+        case OP_REG_CALL:
+        case OP_GET_LOCAL_CALL:
+            return 4;
+        case OP_DEFINE_GLOBAL:
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_REG_LOAD_CONST:
+        case OP_REG_MOVE:
+        case OP_GET_LOCAL_2:
+        case OP_GET_LOCAL_CONST:
+        case OP_CALL_NATIVE:
+            return 2;
+        case OP_CONST:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_CONVERT:
+        case OP_CHECK_TYPE:
+        case OP_CONCAT_N:
+        case OP_SLIDE:
+        case OP_REG_ENTER:
+        case OP_REG_RETURN:
+        case OP_REG_WRITE_OUT:
+        case OP_REG_WRITE_ERR:
+            return 1;
+        case OP_RETURN:
+        case OP_WRITE_OUT:
+        case OP_WRITE_ERR:
+        case OP_FLUSH:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_ADD_INT:
+        case OP_SUBTRACT_INT:
+        case OP_MULTIPLY_INT:
+        case OP_DIVIDE_INT:
+        case OP_ADD_DOUBLE:
+        case OP_SUBTRACT_DOUBLE:
+        case OP_MULTIPLY_DOUBLE:
+        case OP_DIVIDE_DOUBLE:
+        case OP_CONCAT:
+        case OP_POP:
+        case OP_ADD_INT_RETURN:
+        case OP_RESUME:
+        case OP_YIELD:
+        case OP_JOIN:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+// Returns whether 'op' may appear in a code section written in 'isa'.
+// OP_FLUSH takes no operands and is shared by both instruction sets.
+inline bool isOpcodeInSet(uint8_t op, uint8_t isa) {
+    if (op == OP_FLUSH) return true;
+    bool is_register_op = op >= OP_REG_ENTER;
+    return isa == ISA_REGISTER ? is_register_op : !is_register_op;
+}
+
+// Returns the position of the uint16_t call address among the operands of
+// 'op', or -1 if it does not call. Passes that move code use this to remap
+// call targets. OP_FIBER and OP_SPAWN count: their function is called later.
+inline int getCallAddressOperand(uint8_t op) {
+    switch (op) {
+        case OP_CALL: return 1;
+        case OP_TAIL_CALL: return 1;
+        case OP_FIBER: return 1;
+        case OP_SPAWN: return 1;
+        case OP_REG_CALL: return 2;
+        case OP_GET_LOCAL_CALL: return 2;
+        default: return -1;
+    }
+}
+
+// Returns true if 'op' returns from the current function. A tail call
+// counts: its callee returns in the function's place.
+inline bool isReturn(uint8_t op) {
+    return op == OP_RETURN || op == OP_REG_RETURN || op == OP_ADD_INT_RETURN || op == OP_TAIL_CALL;
+}
+
+// Returns true if execution does not simply continue with the next
+// instruction after 'op'.
+inline bool isControlTransfer(uint8_t op) {
+    return isReturn(op) || getCallAddressOperand(op) >= 0;
+}
+
+// Applies the operand stack effect of the stack instruction 'op', whose
+// operands follow at 'operands', to 'depth': the number of slots in use in
+// the current frame, arguments and locals included. 'max_depth' is raised
+// to the highest depth reached; superinstructions count as the sequence
+// they replace. Returns false if 'op' would pop below the frame.
+inline bool applyStackEffect(uint8_t op, const uint8_t* operands, uint32_t& depth, uint32_t& max_depth) {
+    auto step = [&](uint32_t pops, uint32_t pushes) {
+        if (depth < pops) return false;
+        depth = depth - pops + pushes;
+        if (depth > max_depth) max_depth = depth;
+        return true;
+    };
+    switch (op) {
+        case OP_CONST:
+        case OP_GET_GLOBAL:
+        case OP_GET_LOCAL:
+            return step(0, 1);
+        case OP_RETURN:
+        case OP_WRITE_OUT:
+        case OP_WRITE_ERR:
+        case OP_DEFINE_GLOBAL:
+        case OP_POP:
+            return step(1, 0);
+        case OP_SET_GLOBAL:
+        case OP_SET_LOCAL:
+        case OP_CONVERT:
+        case OP_CHECK_TYPE:
+        case OP_RESUME:
+        case OP_YIELD:
+        case OP_JOIN:
+            return step(1, 1);
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_ADD_INT:
+        case OP_SUBTRACT_INT:
+        case OP_MULTIPLY_INT:
+        case OP_DIVIDE_INT:
+        case OP_ADD_DOUBLE:
+        case OP_SUBTRACT_DOUBLE:
+        case OP_MULTIPLY_DOUBLE:
+        case OP_DIVIDE_DOUBLE:
+        case OP_CONCAT:
+            return step(2, 1);
+        case OP_CALL:
+        case OP_CALL_NATIVE:
+        case OP_FIBER:
+        case OP_SPAWN:
+        case OP_CONCAT_N:
+            return step(operands[0], 1);
+        case OP_TAIL_CALL:
+            return step(operands[0], 0); // The arguments become the callee's frame
+        case OP_SLIDE:
+            return step(operands[0] + 1, 1);
+        case OP_GET_LOCAL_2:
+        case OP_GET_LOCAL_CONST:
+            return step(0, 1) && step(0, 1);
+        case OP_GET_LOCAL_CALL:
+            return step(0, 1) && step(operands[1], 1);
+        case OP_ADD_INT_RETURN:
+            return step(2, 1) && step(1, 0);
+        default:
+            return true; // OP_FLUSH, and register instructions, which do not use the operand stack
+    }
+}
+
 #endif //IODICIUM_COMMON_OPCODE_H
@@ -0,0 +1,39 @@
+#ifndef IODICIUM_COMPILER_C_TRANSLATOR_H
+#define IODICIUM_COMPILER_C_TRANSLATOR_H
+
+#include <map>
+#include <string>
+#include "common/logger.h"
+#include "executable/ioe_reader.h" // For Chunk
+
+namespace Iodicium {
+    namespace Compiler {
+
+        // Translates a linked stack-code chunk into a C program that behaves
+        // like the VM running it. Each function becomes a C function with one
+        // local variable per operand stack slot, which the stack depth at every
+        // instruction determines statically, so the system C compiler sees
+        // plain values and can keep them in registers. The program includes
+        // RUNTIME_HEADER, which the translator writes next to it and which
+        // holds the value representation and the untyped operations.
+        class CTranslator {
+        public:
+            static constexpr const char* RUNTIME_HEADER = "iodicium_runtime.h";
+
+            explicit CTranslator(Common::Logger& logger);
+
+            // Returns the C source for 'chunk'. 'function_ips' names the
+            // functions, as returned by Linker::getFunctionIPs.
+            std::string translate(const Executable::Chunk& chunk, const std::map<std::string, size_t>& function_ips);
+
+            // Writes the translation of 'chunk' to 'path' and the runtime header beside it.
+            void writeToFile(const Executable::Chunk& chunk, const std::map<std::string, size_t>& function_ips, const std::string& path);
+
+        private:
+            Common::Logger& m_logger;
+        };
+
+    }
+}
+
+#endif //IODICIUM_COMPILER_C_TRANSLATOR_H
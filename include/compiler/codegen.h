@@ -32,16 +32,18 @@ namespace Iodicium {
             Executable::Chunk compile(const std::vector<std::unique_ptr<Codeparser::Stmt>>& statements);
 
             const std::map<std::string, size_t>& getFunctionIPs() const { return m_function_ips; }
+            const std::map<std::string, uint8_t>& getFunctionArities() const { return m_function_arities; }
 
-        private:
+        protected:
             Common::Logger& m_logger;
             SemanticAnalyzer& m_analyzer;
             Executable::Chunk m_chunk;
-            bool m_obfuscate_enabled;
-            std::map<std::string, std::string> m_obfuscation_map;
-            int m_obfuscation_counter = 0;
+            bool m_obfuscate_enabled; // Omits global names from the image's debug section
+            std::map<std::string, uint16_t> m_global_slots;
             std::map<std::string, size_t> m_function_ips;
+            std::map<std::string, uint8_t> m_function_arities;
             std::map<std::string, std::vector<size_t>> m_call_fixups;
+            std::vector<const Codeparser::FunctionStmt*> m_deferred_functions;
             
             // Scope management
             std::vector<Local> m_locals;
@@ -50,6 +52,16 @@ namespace Iodicium {
             void beginScope();
             void endScope();
             int resolveLocal(const Codeparser::Token& name);
+            uint16_t resolveGlobal(const std::string& name);
+            void compileFunction(const Codeparser::FunctionStmt& stmt);
+            void compileConcatenation(const Codeparser::BinaryExpr& expr);
+            void collectConcatOperands(const Codeparser::Expr& expr, std::vector<const Codeparser::Expr*>& operands);
+            void compileCall(const Codeparser::CallExpr& expr);
+            void emitTypeCheck(const Codeparser::Expr& expr);
+            // Emits the arguments of 'expr', then 'opcode' (OP_CALL or OP_TAIL_CALL) to the function 'callee'.
+            void emitCall(const Codeparser::CallExpr& expr, const std::string& callee, uint8_t opcode);
+            // Emits the entry address of 'function', or a placeholder fixed up once it is known.
+            void emitAddress(const std::string& function);
 
             // Visitor methods
             void visit(const Codeparser::FunctionStmt& stmt) override;
@@ -70,9 +82,19 @@ namespace Iodicium {
             void emitBytes(uint8_t byte1, uint8_t byte2);
             void emitShort(uint16_t value);
             void patchShort(size_t offset, uint16_t value);
-            uint8_t makeConstant(const std::string& value);
+            uint8_t makeConstant(const Executable::Constant& value);
+            uint8_t makeConstant(const std::string& text) { return makeConstant(Executable::Constant::fromString(text)); }
+            uint8_t makeLiteralConstant(const Codeparser::Token& literal);
+            // The zero of the type 'type_expr' names (0, 0.0 or ""), which a
+            // declaration without an initializer, or a function that ends
+            // without a return, produces. The empty string if there is no type.
+            uint8_t makeZeroConstant(const Codeparser::Expr* type_expr);
+            void backpatchCalls();
+            void finishChunk();
 
-            std::string getObfuscatedName(const std::string& original_name);
+            static DataType stringToDataType(const std::string& type_str);
+            bool leavesValue(const Codeparser::Expr& expr) const;
+            bool isBuiltin(const std::string& name) const;
         };
 
     }
@@ -0,0 +1,39 @@
+#ifndef IODICIUM_COMPILER_INLINER_H
+#define IODICIUM_COMPILER_INLINER_H
+
+#include <map>
+#include <string>
+#include "common/logger.h"
+#include "executable/ioe_reader.h" // For Chunk
+
+namespace Iodicium {
+    namespace Compiler {
+
+        // Replaces calls to small functions in linked stack code with a copy
+        // of the callee's body. The arguments a call pushes are already where
+        // the callee would find its locals, so the copy reads them in place
+        // and an OP_SLIDE drops them from under the result; a tail call is
+        // replaced by the body and an OP_RETURN. Only functions of
+        // at most MAX_INSTRUCTIONS that end in an OP_RETURN and cannot reach
+        // themselves through calls are inlined. The callee itself is kept, so
+        // every function stays callable at its address and a library's
+        // exports are unchanged. Runs before the SuperinstructionPass;
+        // register code is left as it is.
+        class InlinePass {
+        public:
+            static constexpr size_t MAX_INSTRUCTIONS = 8; // Largest body inlined, its return not counted
+
+            explicit InlinePass(Common::Logger& logger);
+
+            // Rewrites chunk.code in place; 'function_ips' is updated to match.
+            // 'arities' is as returned by the BytecodeCompiler.
+            void run(Executable::Chunk& chunk, std::map<std::string, size_t>& function_ips, const std::map<std::string, uint8_t>& arities);
+
+        private:
+            Common::Logger& m_logger;
+        };
+
+    }
+}
+
+#endif //IODICIUM_COMPILER_INLINER_H
@@ -7,6 +7,9 @@
 #include <map>
 #include "common/logger.h"
 #include "executable/ioe_reader.h" // For Chunk
+#include "common/opcode.h"
+#include "vm/natives.h"
+#include "compiler/semantics.h"
 
 namespace Iodicium {
     namespace Compiler {
@@ -15,17 +18,35 @@ namespace Iodicium {
         // source files into a single, statically-linked executable chunk.
         class Linker {
         public:
-            explicit Linker(Common::Logger& logger);
+            // With 'obfuscate_enabled', global names are left out of the image's debug section.
+            // 'isa' selects the code generator: ISA_STACK or ISA_REGISTER.
+            // With 'inline_enabled', calls to small functions in stack code are
+            // inlined by the InlinePass, and with 'fuse_enabled' the code is then
+            // run through the SuperinstructionPass. The StackDepthPass finally
+            // records the stack use of every function.
+            explicit Linker(Common::Logger& logger, bool obfuscate_enabled = false, uint8_t isa = ISA_STACK, bool fuse_enabled = true, bool inline_enabled = true);
 
             // Takes a list of source file paths and produces a single, linked chunk.
             Executable::Chunk link(const std::vector<std::string>& source_paths);
 
+            // The natives the sources may call; NativeRegistry::standard() by
+            // default. The registry must outlive the calls to link().
+            void setNatives(const VM::NativeRegistry& natives) { m_natives = &natives; }
+
             // Returns the map of function names to their instruction pointer addresses.
             const std::map<std::string, size_t>& getFunctionIPs() const { return m_function_ips; }
+            // Returns the declared types of each function, by name.
+            const std::map<std::string, FunctionSignature>& getFunctionSignatures() const { return m_function_signatures; }
 
         private:
             Common::Logger& m_logger;
+            bool m_obfuscate_enabled;
+            uint8_t m_isa;
+            bool m_fuse_enabled;
+            bool m_inline_enabled;
+            const VM::NativeRegistry* m_natives = &VM::NativeRegistry::standard();
             std::map<std::string, size_t> m_function_ips;
+            std::map<std::string, FunctionSignature> m_function_signatures;
         };
 
     }
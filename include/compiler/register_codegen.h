@@ -0,0 +1,48 @@
+#ifndef IODICIUM_COMPILER_REGISTER_CODEGEN_H
+#define IODICIUM_COMPILER_REGISTER_CODEGEN_H
+
+#include "compiler/codegen.h"
+
+namespace Iodicium {
+    namespace Compiler {
+
+        // Emits the register instruction set (OP_REG_*). Parameters and locals
+        // are given fixed registers in the order resolveLocal would number their
+        // stack slots; temporaries are allocated above them and released at the
+        // end of each statement. Constants, global slots and call fixups are
+        // shared with the stack backend.
+        class RegisterCompiler : public BytecodeCompiler {
+        public:
+            explicit RegisterCompiler(Common::Logger& logger, SemanticAnalyzer& analyzer, bool obfuscate_enabled = false);
+            Executable::Chunk compile(const std::vector<std::unique_ptr<Codeparser::Stmt>>& statements);
+
+        private:
+            int m_next_register = 0;     // First free register in the current frame
+            int m_register_count = 0;    // High-water mark, written into OP_REG_ENTER
+            size_t m_enter_offset = 0;   // Operand of the current frame's OP_REG_ENTER
+            uint8_t m_target = 0;        // Register the expression being visited writes to
+
+            void beginFrame(int fixed_registers);
+            void endFrame();
+            uint8_t allocateRegister();
+            void compileInto(const Codeparser::Expr& expr, uint8_t target);
+            uint8_t compileOperand(const Codeparser::Expr& expr);
+            void compileFunction(const Codeparser::FunctionStmt& stmt);
+            void emitReturnEmpty(const Codeparser::Expr* type_expr = nullptr);
+
+            // Visitor methods
+            void visit(const Codeparser::ReturnStmt& stmt) override;
+            void visit(const Codeparser::ExprStmt& stmt) override;
+            void visit(const Codeparser::VarStmt& stmt) override;
+            void visit(const Codeparser::BinaryExpr& expr) override;
+            void visit(const Codeparser::GroupingExpr& expr) override;
+            void visit(const Codeparser::LiteralExpr& expr) override;
+            void visit(const Codeparser::VariableExpr& expr) override;
+            void visit(const Codeparser::CallExpr& expr) override;
+            void visit(const Codeparser::AssignExpr& expr) override;
+        };
+
+    }
+}
+
+#endif //IODICIUM_COMPILER_REGISTER_CODEGEN_H
@@ -0,0 +1,49 @@
+#ifndef IODICIUM_COMPILER_REWRITER_H
+#define IODICIUM_COMPILER_REWRITER_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Iodicium {
+    namespace Compiler {
+
+        // An editable view of a finished code section for passes that run after
+        // code generation. The code is decoded into a list of instructions that
+        // a pass may replace, merge or remove; encode() lays the list out again
+        // and moves every call address and function address along with the
+        // instruction it referred to.
+        class BytecodeRewriter {
+        public:
+            static constexpr size_t NEW_INSTRUCTION = SIZE_MAX;
+
+            struct Instruction {
+                uint8_t opcode;
+                std::vector<uint8_t> operands;
+                // Offset of the instruction in the original code, or NEW_INSTRUCTION.
+                // Call operands keep holding original offsets until encode().
+                size_t origin;
+            };
+
+            BytecodeRewriter(const std::vector<uint8_t>& code, const std::map<std::string, size_t>& function_ips);
+
+            std::vector<Instruction>& getInstructions() { return m_instructions; }
+
+            // Returns true if the instruction originally at 'origin' starts a
+            // function. Anything that replaces it must begin with it.
+            bool isEntry(size_t origin) const { return m_entries.count(origin) > 0; }
+
+            // Encodes the instructions into 'code' and updates 'function_ips'.
+            void encode(std::vector<uint8_t>& code, std::map<std::string, size_t>& function_ips) const;
+
+        private:
+            std::vector<Instruction> m_instructions;
+            std::set<size_t> m_entries;
+        };
+
+    }
+}
+
+#endif //IODICIUM_COMPILER_REWRITER_H
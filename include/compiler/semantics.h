@@ -2,6 +2,7 @@
 #define IODICIUM_COMPILER_SEMANTICS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <memory>
@@ -9,6 +10,7 @@
 #include "codeparser/ast.h"
 #include "common/logger.h"
 #include "common/error.h"
+#include "vm/natives.h"
 
 // Force recompile
 
@@ -22,6 +24,7 @@ namespace Iodicium {
 namespace Iodicium {
     namespace Compiler {
 
+        // Numbered as VM::DataType, which native signatures use.
         enum class DataType {
             UNKNOWN,
             NIL,
@@ -39,6 +42,37 @@ namespace Iodicium {
             bool is_exported = false;
             bool is_external = false;
             int module_index = -1;
+            bool is_native = false; // A function in the NativeRegistry
+            // For functions defined or declared in the code: the declared
+            // parameter types, UNKNOWN where a declaration gives none.
+            std::vector<DataType> parameters;
+        };
+
+        // A call the compiler turns into an instruction of its own. Unlike a
+        // native, a builtin is not a function with a signature: convert()
+        // takes a type name, fiber() and spawn() a function to call later,
+        // and what resume() and join() return is only known when they run.
+        struct Builtin {
+            enum Kind : uint8_t {
+                CONVERT, // (value, Type): the value converted to Type
+                START,   // (function, arguments...): a handle to a call of the function
+                UNARY,   // (argument): the instruction applied to one value
+            };
+            const char* name;
+            Kind kind;
+            uint8_t instruction;  // The stack instruction the call compiles to
+            DataType parameter;   // UNARY: the type of its argument, or UNKNOWN for any
+            DataType return_type; // UNKNOWN if only known when it runs; CONVERT: its target
+        };
+
+        // Returns the builtin called 'name', or null.
+        const Builtin* findBuiltin(std::string_view name);
+
+        // The declared types of a function defined in the analyzed code.
+        struct FunctionSignature {
+            std::vector<DataType> parameters;
+            DataType return_type = DataType::NIL;
+            bool is_exported = false; // Marked @export, or after @exportall
         };
 
         class SymbolTable {
@@ -61,11 +95,22 @@ namespace Iodicium {
 
         class SemanticAnalyzer : public Codeparser::StmtVisitor, public Codeparser::ExprVisitor {
         public:
-            explicit SemanticAnalyzer(Common::Logger& logger, std::string base_path);
+            // Every native in 'natives' is defined as a global function.
+            explicit SemanticAnalyzer(Common::Logger& logger, std::string base_path, const VM::NativeRegistry& natives = VM::NativeRegistry::standard());
             void analyze(const std::vector<std::unique_ptr<Codeparser::Stmt>>& statements);
 
             SymbolTable& getSymbolTable() { return m_symbol_table; }
             const std::vector<std::string>& getImportedModules() const { return m_imported_modules; }
+            const VM::NativeRegistry& getNatives() const { return m_natives; }
+            // The signature of every function the analyzed code defines, by name.
+            const std::map<std::string, FunctionSignature>& getFunctionSignatures() const { return m_function_signatures; }
+
+            // Returns the type resolved for an expression during analysis, or UNKNOWN.
+            DataType getExprType(const Codeparser::Expr& expr) const;
+            // For a call or arithmetic whose result's type is only known when
+            // it runs, the type the place it is used in declares, which the
+            // compiled code must check the result against; otherwise UNKNOWN.
+            DataType getCheckedType(const Codeparser::Expr& expr) const;
 
             void visit(const Codeparser::ImportStmt& stmt) override;
             void visit(const Codeparser::VarStmt& stmt) override;
@@ -83,16 +128,30 @@ namespace Iodicium {
 
         private:
             Common::Logger& m_logger;
+            const VM::NativeRegistry& m_natives;
             SymbolTable m_symbol_table;
             std::string m_base_path;
             volatile DataType m_current_expr_type = DataType::UNKNOWN;
             std::vector<std::string> m_imported_modules;
+            std::map<const Codeparser::Expr*, DataType> m_expr_types;
+            std::map<const Codeparser::Expr*, DataType> m_checked_types;
+            std::map<std::string, FunctionSignature> m_function_signatures;
             std::set<std::string> m_processed_imports;
             bool m_is_importing = false; // Flag to indicate if we are processing an imported file
+            DataType m_return_type = DataType::UNKNOWN; // Declared return type of the function being analyzed, if any
 
             void resolve(const std::unique_ptr<Codeparser::Stmt>& stmt);
             void resolve(const std::unique_ptr<Codeparser::Expr>& expr);
             DataType typeOf(const std::unique_ptr<Codeparser::Expr>& expr);
+            std::vector<DataType> parameterTypes(const std::vector<Codeparser::Parameter>& params);
+            // Returns whether 'expr', of type 'actual', may be used where a
+            // value of type 'expected' is. An UNKNOWN type on either side
+            // may; where only 'actual' is, the value is checked when it runs.
+            bool accepts(DataType expected, DataType actual, const std::unique_ptr<Codeparser::Expr>& expr);
+            // Resolves the arguments of a call to 'name' from 'first' on and
+            // checks them against 'parameters', which must match in number.
+            void checkArguments(const std::string& name, const Codeparser::Token& at, const std::vector<DataType>& parameters,
+                                const std::vector<std::unique_ptr<Codeparser::Expr>>& arguments, size_t first = 0);
             DataType stringToDataType(const std::string& type_str);
         };
 
@@ -0,0 +1,33 @@
+#ifndef IODICIUM_COMPILER_STACK_DEPTH_H
+#define IODICIUM_COMPILER_STACK_DEPTH_H
+
+#include <map>
+#include <string>
+#include "common/logger.h"
+#include "executable/ioe_reader.h" // For Chunk
+
+namespace Iodicium {
+    namespace Compiler {
+
+        // Fills in the function table of a finished stack-code chunk: the
+        // entry, arity and maximum operand stack depth of the top-level code
+        // and of every function. The language has no branches, so each
+        // function is one straight run of instructions up to its first
+        // return and its stack depth is known at every instruction. Runs
+        // last, after any pass that changes the code; register code has no
+        // operand stack and gets an empty table.
+        class StackDepthPass {
+        public:
+            explicit StackDepthPass(Common::Logger& logger);
+
+            // 'function_ips' and 'arities' are as returned by the BytecodeCompiler.
+            void run(Executable::Chunk& chunk, const std::map<std::string, size_t>& function_ips, const std::map<std::string, uint8_t>& arities);
+
+        private:
+            Common::Logger& m_logger;
+        };
+
+    }
+}
+
+#endif //IODICIUM_COMPILER_STACK_DEPTH_H
@@ -0,0 +1,30 @@
+#ifndef IODICIUM_COMPILER_SUPERINSTRUCTIONS_H
+#define IODICIUM_COMPILER_SUPERINSTRUCTIONS_H
+
+#include <map>
+#include <string>
+#include "common/logger.h"
+#include "executable/ioe_reader.h" // For Chunk
+
+namespace Iodicium {
+    namespace Compiler {
+
+        // Replaces frequent instruction sequences of the stack instruction set
+        // with superinstructions (OP_GET_LOCAL_2 .. OP_ADD_INT_RETURN), so that
+        // the VM dispatches once per sequence. Runs on the finished chunk;
+        // register code is left as it is.
+        class SuperinstructionPass {
+        public:
+            explicit SuperinstructionPass(Common::Logger& logger);
+
+            // Rewrites chunk.code in place; 'function_ips' is updated to match.
+            void run(Executable::Chunk& chunk, std::map<std::string, size_t>& function_ips);
+
+        private:
+            Common::Logger& m_logger;
+        };
+
+    }
+}
+
+#endif //IODICIUM_COMPILER_SUPERINSTRUCTIONS_H
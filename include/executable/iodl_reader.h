@@ -18,10 +18,18 @@ namespace Iodicium {
                 : Common::IodiciumError(message, line, column) {}
         };
 
+        // An entry of the export table: where a function starts and the
+        // types it declares, numbered as VM::DataType.
+        struct Export {
+            size_t ip = 0;
+            std::vector<uint8_t> parameters;
+            uint8_t return_type = 0;
+        };
+
         // Represents the contents of a loaded .iodl library file.
         struct LibraryChunk {
             Chunk code_chunk; // Re-use the existing Chunk for code and constants
-            std::map<std::string, size_t> exports; // The map of exported function names to their IPs
+            std::map<std::string, Export> exports; // The exported functions, by name
         };
 
         class IodlReader {
@@ -7,6 +7,7 @@
 #include <map>
 #include "common/logger.h"
 #include "common/error.h"
+#include "executable/iodl_reader.h" // For Constant and Export
 
 namespace Iodicium {
     namespace Executable {
@@ -22,8 +23,11 @@ namespace Iodicium {
         public:
             explicit IodlWriter(Common::Logger& logger);
             void setCode(std::vector<uint8_t> code);
-            void addConstant(const std::string& constant);
-            void setExports(const std::map<std::string, size_t>& exports);
+            void addConstant(const Constant& constant);
+            void setExports(const std::map<std::string, Export>& exports);
+            void setGlobals(uint32_t global_count, const std::vector<std::string>& debug_names);
+            void setInstructionSet(uint8_t isa);
+            void setFunctions(const std::vector<FunctionInfo>& functions);
 
             // Writes the complete .iodl file to the specified path.
             void writeToFile(const std::string& path);
@@ -31,8 +35,12 @@ namespace Iodicium {
         private:
             Common::Logger& m_logger;
             std::vector<uint8_t> m_code_section;
-            std::vector<std::string> m_data_section; // Constant pool
-            std::map<std::string, size_t> m_export_section; // Export table (function name -> IP)
+            std::vector<Constant> m_data_section; // Constant pool
+            std::map<std::string, Export> m_export_section; // Export table (function name -> IP and types)
+            uint32_t m_global_count = 0;
+            uint8_t m_isa = 0; // ISA_STACK
+            std::vector<std::string> m_debug_section; // Global slot names, optional
+            std::vector<FunctionInfo> m_function_section; // Function table
         };
 
     }
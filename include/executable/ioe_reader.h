@@ -1,20 +1,88 @@
 #ifndef IODICIUM_EXECUTABLE_IOE_READER_H
 #define IODICIUM_EXECUTABLE_IOE_READER_H
 
+#include <bit>
 #include <string>
 #include <vector>
 #include <cstdint>
 #include "common/logger.h"
 #include "common/error.h"
+#include "common/opcode.h"
 
 namespace Iodicium {
     namespace Executable {
 
+        // A constant pool entry. Numbers are kept as binary values; the text
+        // of a string constant is stored once in the image's string table.
+        struct Constant {
+            enum Type : uint8_t {
+                STRING = 0x00,
+                INT = 0x01,
+                DOUBLE = 0x02,
+            };
+
+            Type type = STRING;
+            int64_t integer = 0; // INT
+            double number = 0.0; // DOUBLE
+            std::string text;    // STRING
+
+            static Constant fromString(std::string text) { Constant c; c.type = STRING; c.text = std::move(text); return c; }
+            static Constant fromInt(int64_t value) { Constant c; c.type = INT; c.integer = value; return c; }
+            static Constant fromDouble(double value) { Constant c; c.type = DOUBLE; c.number = value; return c; }
+
+            // Doubles compare by representation, so 0.0 and -0.0 stay distinct entries.
+            bool operator==(const Constant& other) const {
+                if (type != other.type) return false;
+                if (type == INT) return integer == other.integer;
+                if (type == DOUBLE) return std::bit_cast<uint64_t>(number) == std::bit_cast<uint64_t>(other.number);
+                return text == other.text;
+            }
+        };
+
+        // A function table entry, computed by the compiler's StackDepthPass.
+        // The top-level code is the function at entry 0, with no parameters.
+        struct FunctionInfo {
+            uint32_t entry = 0;     // Byte offset of the function's first instruction
+            uint8_t arity = 0;      // Parameters, which occupy the first slots of the frame
+            uint32_t max_stack = 0; // Most stack slots the function uses, parameters included
+        };
+
+        // A global's value in a snapshot. Strings are stored in the image's
+        // string table, like the text of string constants.
+        struct SnapshotValue {
+            enum Type : uint8_t {
+                NIL = 0x00, // Not defined yet
+                BOOL = 0x01,
+                INT = 0x02,
+                DOUBLE = 0x03,
+                STRING = 0x04,
+            };
+
+            Type type = NIL;
+            bool boolean = false; // BOOL
+            int64_t integer = 0;  // INT
+            double number = 0.0;  // DOUBLE
+            std::string text;     // STRING
+        };
+
+        // The state the top-level code is in when it reaches 'resume', as
+        // recorded by `iodicium snapshot`. A run restores it and starts
+        // there rather than at offset 0. Stack code only.
+        struct Snapshot {
+            uint32_t resume = 0;                // Byte offset of the first instruction to run; 0 for no snapshot
+            std::vector<SnapshotValue> globals; // The value of every global slot
+        };
+
         // Represents a compiled chunk of bytecode
         struct Chunk {
             std::vector<uint8_t> code;
-            std::vector<std::string> constants;
+            std::vector<Constant> constants;
             std::vector<std::string> external_references; // New: For imported function signatures
+            uint8_t isa = ISA_STACK;                      // The instruction set 'code' is written in
+            uint32_t global_count = 0;                    // Number of global variable slots the code uses
+            std::vector<std::string> global_names;        // Debug section: the name of each global slot, empty if stripped
+            std::vector<FunctionInfo> functions;          // Stack code only: the stack use of every function
+            Snapshot snapshot;                            // The initialized state to start from, if resume is not 0
         };
 
         class IoeReaderError : public Common::IodiciumError {
@@ -7,6 +7,7 @@
 #include "iod_executable_export.h"
 #include "common/logger.h" // Include logger header
 #include "common/error.h"   // Include the base error class
+#include "executable/ioe_reader.h" // For Constant
 
 namespace Iodicium {
     namespace Executable {
@@ -23,8 +24,12 @@ namespace Iodicium {
         public:
             explicit IoeWriter(Common::Logger& logger); // Added logger parameter
             void setCode(std::vector<uint8_t> code);
-            void addConstant(const std::string& constant);
+            void addConstant(const Constant& constant);
             void setImports(const std::vector<std::string>& imports);
+            void setGlobals(uint32_t global_count, const std::vector<std::string>& debug_names);
+            void setInstructionSet(uint8_t isa);
+            void setFunctions(const std::vector<FunctionInfo>& functions);
+            void setSnapshot(const Snapshot& snapshot);
 
             // Writes the complete .iode file to the specified path.
             void writeToFile(const std::string& path);
@@ -32,8 +37,13 @@ namespace Iodicium {
         private:
             Common::Logger& m_logger; // Added logger member
             std::vector<uint8_t> m_code_section;
-            std::vector<std::string> m_data_section; // Constant pool
+            std::vector<Constant> m_data_section; // Constant pool
             std::vector<std::string> m_import_section; // Import table
+            uint32_t m_global_count = 0;
+            uint8_t m_isa = 0; // ISA_STACK
+            std::vector<std::string> m_debug_section; // Global slot names, optional
+            std::vector<FunctionInfo> m_function_section; // Function table
+            Snapshot m_snapshot_section; // Written only if its resume offset is set
         };
 
     }
@@ -0,0 +1,159 @@
+#ifndef IODICIUM_H
+#define IODICIUM_H
+
+/*
+ * The embedding API of libiodicium, for calling the functions of a compiled
+ * Iodicium library (.iodl) from C or any language that can call C.
+ *
+ * An IodImage is a loaded library. It is only read once loaded, so any
+ * number of threads may share it. An IodContext runs the library's
+ * top-level code once, when it is created, and then calls its exported
+ * functions with the globals that code left. A context is used by one
+ * thread at a time; give each thread its own.
+ *
+ *     IodImage* image;
+ *     IodContext* context;
+ *     if (iod_image_load("Greeter.iodl", &image) != IOD_OK) fail(iod_error());
+ *     if (iod_context_new(image, 0, &context) != IOD_OK) fail(iod_error());
+ *     const IodFunction* greet = iod_image_find(image, "greet");
+ *     IodValue arg = iod_string("world"), result;
+ *     if (iod_call(context, greet, &arg, 1, &result) != IOD_OK) fail(iod_error());
+ *
+ * The API only grows: IODICIUM_API_VERSION goes up when something is
+ * added, and nothing declared here changes its meaning or layout.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+    #if defined(IODICIUM_BUILD_DLL)
+        #define IODICIUM_API __declspec(dllexport)
+    #else
+        #define IODICIUM_API
+    #endif
+#else
+    #define IODICIUM_API
+#endif
+
+#define IODICIUM_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct IodImage IodImage;
+typedef struct IodContext IodContext;
+typedef struct IodFunction IodFunction; /* An exported function; owned by its image */
+
+typedef enum IodStatus {
+    IOD_OK = 0,
+    IOD_ERROR = 1 /* iod_error() says what went wrong */
+} IodStatus;
+
+typedef enum IodType {
+    IOD_NIL = 0,
+    IOD_BOOL = 1,
+    IOD_INT = 2,
+    IOD_DOUBLE = 3,
+    IOD_STRING = 4
+} IodType;
+
+/*
+ * An argument or result. A string argument is copied by the call; it need
+ * not be NUL-terminated. A string result is NUL-terminated and belongs to
+ * the context, and lasts until its next call or until it is freed.
+ */
+typedef struct IodValue {
+    IodType type;
+    union {
+        int boolean;
+        int64_t integer;
+        double number;
+        struct {
+            const char* chars;
+            size_t length;
+        } string;
+    } as;
+} IodValue;
+
+/* Returns IODICIUM_API_VERSION as the library was built. */
+IODICIUM_API int iod_api_version(void);
+
+/*
+ * The message of the last call on this thread that returned IOD_ERROR. It
+ * lasts until the next failing call on this thread.
+ */
+IODICIUM_API const char* iod_error(void);
+
+/* Reads and verifies the library at 'path'. Only stack code libraries can be loaded. */
+IODICIUM_API IodStatus iod_image_load(const char* path, IodImage** image);
+/* Frees 'image', whose contexts must have been freed first. Null is ignored. */
+IODICIUM_API void iod_image_free(IodImage* image);
+
+/* Returns the function 'image' exports as 'name', or null if there is none. */
+IODICIUM_API const IodFunction* iod_image_find(const IodImage* image, const char* name);
+/* The number of arguments 'function' takes. */
+IODICIUM_API size_t iod_function_arity(const IodFunction* function);
+
+/*
+ * Creates a context for 'image' and runs the library's top-level code in
+ * it. 'memory_limit' bounds the bytes the context's VM may take, 0 for no limit.
+ */
+IODICIUM_API IodStatus iod_context_new(const IodImage* image, size_t memory_limit, IodContext** context);
+/* Frees 'context'. Null is ignored. */
+IODICIUM_API void iod_context_free(IodContext* context);
+
+/*
+ * Calls 'function' of the context's image with the 'argc' values at
+ * 'args' and stores what it returns in 'result', which may be null.
+ * 'argc' must be the function's arity, and each argument must have the
+ * type its parameter declares; nothing is converted, so an IOD_DOUBLE is
+ * refused for an Int parameter.
+ */
+IODICIUM_API IodStatus iod_call(IodContext* context, const IodFunction* function, const IodValue* args, size_t argc, IodValue* result);
+
+static inline IodValue iod_nil(void) {
+    IodValue value;
+    value.type = IOD_NIL;
+    value.as.integer = 0;
+    return value;
+}
+
+static inline IodValue iod_bool(int boolean) {
+    IodValue value;
+    value.type = IOD_BOOL;
+    value.as.boolean = boolean != 0;
+    return value;
+}
+
+static inline IodValue iod_int(int64_t integer) {
+    IodValue value;
+    value.type = IOD_INT;
+    value.as.integer = integer;
+    return value;
+}
+
+static inline IodValue iod_double(double number) {
+    IodValue value;
+    value.type = IOD_DOUBLE;
+    value.as.number = number;
+    return value;
+}
+
+/* A NUL-terminated string; see IodValue for strings with a length. */
+static inline IodValue iod_string(const char* chars) {
+    IodValue value;
+    size_t length = 0;
+    while (chars[length]) length++;
+    value.type = IOD_STRING;
+    value.as.string.chars = chars;
+    value.as.string.length = length;
+    return value;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IODICIUM_H */
@@ -0,0 +1,180 @@
+#ifndef IODICIUM_VM_ARENA_H
+#define IODICIUM_VM_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "common/error.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        class OutOfMemoryError : public Common::IodiciumError {
+        public:
+            OutOfMemoryError(const std::string& message, int line = -1, int column = -1)
+                : Common::IodiciumError(message, line, column) {}
+        };
+
+        // A bump allocator for everything a VirtualMachine stores while it runs.
+        // Memory is taken from the system in blocks of at least BLOCK_SIZE and
+        // only given back all at once by reset(), so an allocation is a pointer
+        // bump and the bytes a VM holds are known exactly. With a limit, no more
+        // than 'limit' bytes are ever taken from the system; an allocation that
+        // does not fit throws OutOfMemoryError. Arenas can share a limit, in
+        // which case it bounds the bytes all of them take together. What the
+        // VM keeps on the C++ heap instead, such as its fiber records, is
+        // charged to the arena and counts against the same limit.
+        class Arena {
+        public:
+            static constexpr size_t BLOCK_SIZE = size_t(1) << 20;
+            static constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+            explicit Arena(size_t limit = 0); // 0 means no limit
+            // An arena whose blocks count against the limit of 'owner', which
+            // must outlive it. It takes huge pages if 'owner' does.
+            explicit Arena(Arena& owner);
+            ~Arena();
+            Arena(const Arena&) = delete;
+            Arena& operator=(const Arena&) = delete;
+
+            void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+            // Uninitialized storage for 'count' objects of type T.
+            template <typename T>
+            T* allocateArray(size_t count) {
+                if (count > SIZE_MAX / sizeof(T)) fail(SIZE_MAX);
+                return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+            }
+
+            // Returns every block to the system. Pointers into the arena become invalid.
+            void reset();
+
+            // A point in the arena's allocations, to rewind() to later.
+            struct Mark {
+                size_t blocks;
+                std::byte* cursor;
+                size_t used;
+            };
+            Mark mark() const { return {m_blocks.size(), m_cursor, m_used}; }
+            // Frees everything allocated since 'mark', returning blocks taken
+            // since then to the system, except that the first of them is kept
+            // for the arena's next block. Pointers into that memory become invalid.
+            void rewind(const Mark& mark);
+
+            // Exchanges the blocks of this arena and 'other', which must share its limit.
+            void swap(Arena& other);
+
+            // Asks for transparent huge pages for blocks taken from now on
+            // (Linux only; elsewhere this has no effect). Blocks are then
+            // rounded up to HUGE_PAGE_SIZE where the limit allows.
+            void setHugePages(bool enabled) { m_huge_pages = enabled; }
+
+            // Counts 'size' bytes held on the C++ heap as if the arena had
+            // taken them: against the limit, which they may not pass, and in
+            // getCharged(). Arenas that share a limit share these counts.
+            void charge(size_t size);
+            void uncharge(size_t size) { m_charged->fetch_sub(size, std::memory_order_relaxed); }
+
+            // Bytes charged to an arena until the Charge is destroyed, which
+            // may be on another thread after the arena is gone.
+            class Charge {
+            public:
+                Charge() = default;
+                Charge(Arena& arena, size_t size);
+                Charge(Charge&& other) noexcept
+                    : m_charged(std::move(other.m_charged)), m_size(std::exchange(other.m_size, 0)) {}
+                Charge& operator=(Charge&& other) noexcept {
+                    if (this != &other) {
+                        release();
+                        m_charged = std::move(other.m_charged);
+                        m_size = std::exchange(other.m_size, 0);
+                    }
+                    return *this;
+                }
+                ~Charge() { release(); }
+
+            private:
+                std::shared_ptr<std::atomic<size_t>> m_charged;
+                size_t m_size = 0;
+
+                void release() {
+                    if (m_charged) m_charged->fetch_sub(m_size, std::memory_order_relaxed);
+                    m_charged.reset();
+                    m_size = 0;
+                }
+            };
+
+            size_t getLimit() const { return m_limit; }
+            size_t getUsed() const { return m_used; }         // Bytes handed out, including alignment padding
+            size_t getReserved() const { return m_reserved; } // Bytes taken from the system
+            size_t getCharged() const { return m_charged->load(std::memory_order_relaxed); }
+
+            struct Block {
+                std::byte* memory;
+                size_t size;
+            };
+            // The blocks taken so far, in the order they were taken.
+            const std::vector<Block>& getBlocks() const { return m_blocks; }
+
+        private:
+            size_t m_limit;
+            size_t m_shared_reserved = 0; // Bytes taken by this arena and those that share its limit
+            size_t* m_limit_reserved;     // m_shared_reserved of the arena whose limit this one shares
+            std::shared_ptr<std::atomic<size_t>> m_charged; // Shared with the arenas that share the limit, and with Charges
+            bool m_huge_pages = false;
+            std::vector<Block> m_blocks;
+            Block m_spare{nullptr, 0}; // Kept by rewind() for grow(); counted in m_reserved
+            std::byte* m_cursor = nullptr;
+            std::byte* m_end = nullptr;
+            size_t m_used = 0;
+            size_t m_reserved = 0;
+
+            void grow(size_t size, size_t alignment);
+            static void release(const Block& block);
+            size_t available() const; // Bytes the limit still allows
+            [[noreturn]] void fail(size_t requested) const;
+        };
+
+        // A standard allocator whose allocations are charged to an arena, for
+        // containers the VM keeps on the C++ heap. The arena must outlive them.
+        template <typename T>
+        class ChargedAllocator {
+        public:
+            using value_type = T;
+
+            ChargedAllocator(Arena& arena) : m_arena(&arena) {}
+            template <typename U>
+            ChargedAllocator(const ChargedAllocator<U>& other) : m_arena(other.m_arena) {}
+
+            T* allocate(size_t count) {
+                m_arena->charge(count * sizeof(T));
+                try {
+                    return std::allocator<T>().allocate(count);
+                } catch (...) {
+                    m_arena->uncharge(count * sizeof(T));
+                    throw;
+                }
+            }
+            void deallocate(T* pointer, size_t count) {
+                std::allocator<T>().deallocate(pointer, count);
+                m_arena->uncharge(count * sizeof(T));
+            }
+            bool operator==(const ChargedAllocator& other) const { return m_arena == other.m_arena; }
+
+        private:
+            template <typename U>
+            friend class ChargedAllocator;
+            Arena* m_arena;
+        };
+
+        template <typename T>
+        using ChargedVector = std::vector<T, ChargedAllocator<T>>;
+
+    }
+}
+
+#endif //IODICIUM_VM_ARENA_H
@@ -0,0 +1,70 @@
+#ifndef IODICIUM_VM_INSTRUMENTATION_H
+#define IODICIUM_VM_INSTRUMENTATION_H
+
+#include <cstdint>
+#include <vector>
+#include "executable/ioe_reader.h"
+#include "vm/value.h"
+#include "vm/loader.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // Instrumentation policies for VirtualMachine::execute. The interpreter
+        // loop is instantiated once per policy; hooks are only compiled in when
+        // the policy's 'enabled' flag is set, so the production loop carries no
+        // tracing code at all. The hook sees the next instruction and the
+        // running fiber's operand stack, from its bottom up to 'sp'.
+
+        struct NoInstrumentation {
+            static constexpr bool enabled = false;
+            void beforeInstruction(const Instruction*, const Value*, const Value*) {}
+        };
+
+        // Counts dispatched instructions, for comparing code generators.
+        struct CountingInstrumentation {
+            static constexpr bool enabled = true;
+            uint64_t instructions = 0;
+            void beforeInstruction(const Instruction*, const Value*, const Value*) { instructions++; }
+        };
+
+        // Counts how often each decoded instruction executes (run --profile).
+        // The counts are indexed like Program::code and are turned into an
+        // opcode n-gram report by printOpcodeProfile.
+        class ProfilingInstrumentation {
+        public:
+            static constexpr bool enabled = true;
+            explicit ProfilingInstrumentation(const Program& program) : m_code(program.code.data()), m_counts(program.code.size(), 0) {}
+            void beforeInstruction(const Instruction* ip, const Value*, const Value*) { m_counts[ip - m_code]++; }
+            const std::vector<uint64_t>& getCounts() const { return m_counts; }
+
+        private:
+            const Instruction* m_code;
+            std::vector<uint64_t> m_counts;
+        };
+
+        // Prints the most executed opcode sequences of 2 to 'max_length'
+        // instructions. Only straight-line sequences are counted: no call
+        // target may fall inside one and only its last instruction may
+        // transfer control, so every sequence listed is a fusion candidate.
+        void printOpcodeProfile(const Program& program, const std::vector<uint64_t>& counts, size_t max_length = 4, size_t limit = 12);
+
+        // Prints the operand stack and the next instruction before each dispatch (-d).
+        struct TracingInstrumentation {
+            static constexpr bool enabled = true;
+            void beforeInstruction(const Instruction* ip, const Value* stack_bottom, const Value* sp);
+        };
+
+        // Prints a single instruction at 'offset' and returns the offset of the next one.
+        size_t disassembleInstruction(const Executable::Chunk& chunk, size_t offset);
+
+        // Prints a decoded instruction, showing its resolved operand.
+        void disassembleInstruction(const Instruction& instruction);
+
+        // Returns the mnemonic for 'opcode', e.g. "OP_CALL".
+        const char* getOpcodeName(uint8_t opcode);
+
+    }
+}
+
+#endif //IODICIUM_VM_INSTRUMENTATION_H
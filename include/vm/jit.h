@@ -0,0 +1,90 @@
+#ifndef IODICIUM_VM_JIT_H
+#define IODICIUM_VM_JIT_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "common/logger.h"
+#include "vm/value.h"
+#include "vm/loader.h"
+
+// The baseline JIT emits x86-64 machine code for the System V ABI and maps it
+// with mmap, so it is only built on x86-64 Linux. Elsewhere every function is
+// interpreted. Define IODICIUM_VM_NO_JIT to leave it out of a build.
+#if defined(__x86_64__) && defined(__linux__) && !defined(IODICIUM_VM_NO_JIT)
+#define IODICIUM_VM_JIT 1
+#else
+#define IODICIUM_VM_JIT 0
+#endif
+
+namespace Iodicium {
+    namespace VM {
+
+        // Where native code handed control back. 'resume' is null once the
+        // function has returned, with its result in base[0]. Otherwise the
+        // frame is exactly as the interpreter would have it before executing
+        // 'resume', with its top at 'sp'.
+        struct NativeExit {
+            const Instruction* resume;
+            Value* sp;
+        };
+
+        // Compiled form of a function, called with its frame; the arguments are in base[0..argc).
+        using NativeFunction = NativeExit (*)(Value* base);
+
+        // What the VM knows about one call target (see op_call).
+        struct JitFunction {
+            uint64_t calls = 0;
+            NativeFunction native = nullptr;
+            uint32_t frame_size = 0; // Stack slots the native code and its native callees use, from base
+            ValueType result = ValueType::NIL; // Type of the value the native code returns
+        };
+
+        // A template JIT for stack code. Each instruction is translated on its
+        // own into a fixed machine code sequence that works on the VM stack in
+        // memory, so native and interpreted code can hand a frame back and
+        // forth at any instruction boundary.
+        //
+        // Compiled functions are straight-line code over locals, constants,
+        // typed Int/Double arithmetic, numeric conversions and calls to
+        // functions that are already compiled. Anything else (globals, output,
+        // strings, calls into the interpreter) keeps a function interpreted.
+        // The code is specialized on the argument types of the call that made
+        // it hot; a call with other types fails the entry guard and is
+        // interpreted, as is an Int division by zero or by -1. When a native
+        // callee bails out, its caller stops before the call and the
+        // interpreter repeats it, which is safe because compiled code never
+        // writes to a parameter slot.
+        class JitCompiler {
+        public:
+            static constexpr uint64_t HOT_CALLS = 1000; // Calls before a function is compiled
+
+            explicit JitCompiler(Common::Logger& logger);
+            ~JitCompiler();
+            JitCompiler(const JitCompiler&) = delete;
+            JitCompiler& operator=(const JitCompiler&) = delete;
+
+            // Prepares to compile functions of 'program', whose JIT state is
+            // 'functions' (indexed like program.code).
+            void attach(const Program& program, const JitFunction* functions);
+
+            // Compiles the function starting at 'entry' for the 'argc' arguments
+            // at 'args' and fills in 'function'. Returns false, leaving it
+            // unchanged, if the function uses something the JIT cannot translate.
+            bool compile(const Instruction* entry, const Value* args, uint8_t argc, JitFunction& function);
+
+            // Unmaps all code compiled so far and detaches from the program.
+            void reset();
+
+        private:
+            Common::Logger& m_logger;
+            const Instruction* m_code = nullptr;
+            const Instruction* m_end = nullptr;
+            const JitFunction* m_functions = nullptr;
+            std::vector<std::pair<void*, size_t>> m_regions; // mmap'd code, one mapping per function
+        };
+
+    }
+}
+
+#endif //IODICIUM_VM_JIT_H
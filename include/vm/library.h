@@ -0,0 +1,58 @@
+#ifndef IODICIUM_VM_LIBRARY_H
+#define IODICIUM_VM_LIBRARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "common/logger.h"
+#include "vm/loader.h"
+#include "vm/tasks.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // A function a library exports, ready to be given to VirtualMachine::call.
+        struct ExportedFunction {
+            std::string name;
+            const Instruction* entry;
+            std::vector<uint8_t> parameters; // As DataType
+            uint8_t return_type;
+        };
+
+        // A library (.iodl) loaded to have its exported functions called
+        // by a host: the C API and `iodicium serve`. Once loaded it is only
+        // read, so VMs on any number of threads may share it; each runs the
+        // library's top-level code itself before calling into it.
+        class Library {
+        public:
+            // Reads and verifies the library at 'path'. Raises a
+            // VirtualMachineError unless it holds stack code whose exports
+            // agree with its function table.
+            Library(Common::Logger& logger, const std::string& path);
+
+            // The program is bound to the interpreter loop by the first run, then only read.
+            Program& getProgram() const { return m_program; }
+            // The function exported as 'name', or null if there is none.
+            const ExportedFunction* find(std::string_view name) const;
+            const std::map<std::string, ExportedFunction, std::less<>>& getFunctions() const { return m_functions; }
+
+            // Raises a VirtualMachineError unless the 'argc' values at 'args'
+            // are as many as 'function' takes, each of its parameter's type.
+            // Compiled code trusts the types its function declares, so a
+            // host must check what it passes before calling.
+            static void checkArguments(const ExportedFunction& function, const PortableValue* args, size_t argc);
+            // The first of those checks: raises a VirtualMachineError unless 'function' takes 'argc' arguments.
+            static void checkArity(const ExportedFunction& function, size_t argc);
+
+        private:
+            mutable Program m_program;
+            std::map<std::string, ExportedFunction, std::less<>> m_functions;
+        };
+
+    }
+}
+
+#endif //IODICIUM_VM_LIBRARY_H
@@ -0,0 +1,89 @@
+#ifndef IODICIUM_VM_LOADER_H
+#define IODICIUM_VM_LOADER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "common/logger.h"
+#include "common/error.h"
+#include "executable/ioe_reader.h"
+#include "vm/value.h"
+#include "vm/natives.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        class LoaderError : public Common::IodiciumError {
+        public:
+            LoaderError(const std::string& message, int line = -1, int column = -1)
+                : Common::IodiciumError(message, line, column) {}
+        };
+
+        // A single decoded instruction. Every operand is resolved when the
+        // image is loaded, so the interpreter never parses bytecode.
+        struct Instruction {
+            const void* handler; // Dispatch target; bound by the interpreter loop that runs the program
+            uint8_t opcode;
+            uint8_t arg;         // Argument count (OP_CALL), slot index (locals) or target type (OP_CONVERT);
+                                 // for register instructions, the destination (or sole) register
+            uint8_t a;           // Register instructions: first source register, or the argument count (OP_REG_CALL)
+            uint8_t b;           // Register instructions: second source register, the target type (OP_REG_CONVERT)
+                                 // or the callee's register count (OP_REG_CALL)
+            uint32_t offset;     // Byte offset of this instruction in the original code section
+            union {
+                const Value* constant;      // OP_CONST
+                uint32_t slot;              // Global variable slot
+                const Instruction* target;  // OP_CALL entry point
+                const Native* native;       // OP_CALL_NATIVE callee
+            } operand;
+        };
+
+        static_assert(sizeof(Instruction) <= 24, "VM::Instruction is expected to stay within 24 bytes.");
+
+        // An executable image in the form the VM runs it. Instructions point
+        // into this object, so it can be moved but not copied.
+        struct Program {
+            std::vector<Instruction> code;
+            uint8_t isa = 0; // ISA_STACK or ISA_REGISTER
+            std::vector<Value> constants;      // The image's constant pool materialized as values
+            std::vector<uint64_t> string_storage; // The String objects of the string constants
+            uint32_t global_count = 0;
+            std::vector<std::string> global_names; // Debug names for the global slots; may be empty
+            uint32_t max_frame_size = 0; // Stack code: the most operand stack slots any one call uses
+            size_t start = 0;                 // Index of the instruction a run starts at
+            std::vector<Value> start_globals; // The globals a run starts with, from a snapshot; empty for all nil
+            const void* dispatch_binding = nullptr; // Identifies the loop whose handlers 'code' is bound to
+
+            Program() = default;
+            Program(Program&&) = default;
+            Program& operator=(Program&&) = default;
+            Program(const Program&) = delete;
+            Program& operator=(const Program&) = delete;
+        };
+
+        // Decodes and validates a chunk read by IoeReader. Bad opcodes, truncated
+        // operands, call targets that do not land on an instruction and native
+        // calls that do not match a registered native are rejected here rather
+        // than at run time. For register code, every
+        // register operand is also checked against its function's OP_REG_ENTER.
+        // Stack code is checked against its function table: no function pops
+        // below its frame, uses a local it does not have, calls with the
+        // wrong number of arguments or goes deeper than its table entry says.
+        class Loader {
+        public:
+            // Native calls are resolved by name against 'natives'.
+            explicit Loader(Common::Logger& logger, const NativeRegistry& natives = NativeRegistry::standard());
+            Program load(const Executable::Chunk& chunk);
+
+        private:
+            Common::Logger& m_logger;
+            const NativeRegistry& m_natives;
+
+            // Returns the largest stack depth of any function in 'chunk'.
+            uint32_t verifyStackCode(const Executable::Chunk& chunk);
+        };
+
+    }
+}
+
+#endif //IODICIUM_VM_LOADER_H
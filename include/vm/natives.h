@@ -0,0 +1,89 @@
+#ifndef IODICIUM_VM_NATIVES_H
+#define IODICIUM_VM_NATIVES_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "common/error.h"
+#include "common/opcode.h"
+#include "vm/value.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        class VirtualMachine;
+
+        // Value types as the compiler names them: the conversion targets of
+        // OP_CONVERT and the types in native signatures. Mirrors Compiler::DataType.
+        enum DataType : uint8_t {
+            UNKNOWN,
+            NIL,
+            BOOL,
+            INT,
+            DOUBLE,
+            STRING,
+            FUNCTION
+        };
+
+        // The DataType of 'value'.
+        DataType dataTypeOf(const Value& value);
+        // The name of a DataType as scripts write it, such as "Int".
+        const char* dataTypeName(uint8_t type);
+
+        class NativeError : public Common::IodiciumError {
+        public:
+            NativeError(const std::string& message, int line = -1, int column = -1)
+                : Common::IodiciumError(message, line, column) {}
+        };
+
+        // Called with the 'argc' arguments of the call, first argument first.
+        // The result replaces them; a native that returns nothing returns nil.
+        // A handler reports errors by throwing VirtualMachineError.
+        using NativeHandler = Value (*)(VirtualMachine& vm, const Value* args, uint8_t argc);
+
+        // A function implemented in C++ and called from Iodicium code by name.
+        struct Native {
+            std::string name;
+            // The compiler rejects an argument whose type it knows to differ;
+            // UNKNOWN accepts a value of any type.
+            std::vector<DataType> parameters;
+            DataType return_type = NIL;       // NIL if the call produces no value
+            NativeHandler handler = nullptr;
+            // The stack instruction the compiler emits in place of the call.
+            // Only builtins the VM has an instruction for set this.
+            uint8_t instruction = OP_CALL_NATIVE;
+        };
+
+        // The natives a program may call. Images refer to a native by name,
+        // so the registry used to run a program must hold every native the
+        // registry it was compiled against did, with the same parameters.
+        //
+        // A registry starts out with the builtins (writeOut, writeErr, flush
+        // and job); an embedding host adds its own natives to it and hands it to
+        // the Linker and to the Loader or VirtualMachine.
+        class NativeRegistry {
+        public:
+            NativeRegistry();
+
+            // Throws NativeError if a native of the same name exists or
+            // 'native' has no handler or more than 255 parameters.
+            void add(Native native);
+
+            // Returns the native called 'name', or null.
+            const Native* find(std::string_view name) const;
+
+            const std::deque<Native>& getFunctions() const { return m_functions; }
+
+            // The registry with just the builtins.
+            static const NativeRegistry& standard();
+
+        private:
+            std::deque<Native> m_functions; // A deque, so that adding keeps earlier entries in place
+        };
+
+    }
+}
+
+#endif //IODICIUM_VM_NATIVES_H
@@ -1,15 +1,123 @@
 #ifndef IODICIUM_VM_OPC_ARITHMETIC_H
 #define IODICIUM_VM_OPC_ARITHMETIC_H
 
+#include "vm/vm.h"
+
 namespace Iodicium {
     namespace VM {
-        class VirtualMachine; // Forward declaration
 
-        // Opcode handler functions for arithmetic operations
-        bool op_add(VirtualMachine& vm);
-        bool op_subtract(VirtualMachine& vm);
-        bool op_multiply(VirtualMachine& vm);
-        bool op_divide(VirtualMachine& vm);
+        // Int arithmetic wraps on overflow rather than invoking undefined behaviour.
+        inline int64_t addInt(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b)); }
+        inline int64_t subtractInt(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b)); }
+        inline int64_t multiplyInt(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b)); }
+        inline int64_t divideInt(int64_t a, int64_t b) {
+            if (b == 0) throw VirtualMachineError("Integer division by zero.");
+            if (b == -1) return subtractInt(0, a);
+            return a / b;
+        }
+
+        // Untyped arithmetic on values, shared by the stack and register
+        // instruction sets. These inspect the operand tags at runtime.
+        IODICIUM_VM_HANDLER Value addValues(VirtualMachine& vm, const Value& a, const Value& b) {
+            if (a.isInt() && b.isInt()) return Value::fromInt(addInt(a.as.integer, b.as.integer));
+            if (a.isNumber() && b.isNumber()) return Value::fromDouble(a.asNumber() + b.asNumber());
+            return vm.concat(a, b);
+        }
+
+        template <typename IntOp, typename DoubleOp>
+        IODICIUM_VM_HANDLER Value numericValues(const Value& a, const Value& b, IntOp int_op, DoubleOp double_op) {
+            if (!a.isNumber() || !b.isNumber()) {
+                throw VirtualMachineError("Operands must be numbers.");
+            }
+            if (a.isInt() && b.isInt()) return Value::fromInt(int_op(a.as.integer, b.as.integer));
+            return Value::fromDouble(double_op(a.asNumber(), b.asNumber()));
+        }
+
+        inline double addDouble(double a, double b) { return a + b; }
+        inline double subtractDouble(double a, double b) { return a - b; }
+        inline double multiplyDouble(double a, double b) { return a * b; }
+        inline double divideDouble(double a, double b) { return a / b; }
+
+        // Opcode handler functions for arithmetic operations.
+        IODICIUM_VM_HANDLER bool op_add(VirtualMachine& vm, ExecutionState& state) {
+            Value b = state.pop();
+            state.peek() = addValues(vm, state.peek(), b);
+            return true;
+        }
+
+        template <typename IntOp, typename DoubleOp>
+        IODICIUM_VM_HANDLER bool numericBinary(ExecutionState& state, IntOp int_op, DoubleOp double_op) {
+            Value b = state.pop();
+            state.peek() = numericValues(state.peek(), b, int_op, double_op);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_subtract(VirtualMachine&, ExecutionState& state) {
+            return numericBinary(state, subtractInt, subtractDouble);
+        }
+        IODICIUM_VM_HANDLER bool op_multiply(VirtualMachine&, ExecutionState& state) {
+            return numericBinary(state, multiplyInt, multiplyDouble);
+        }
+        IODICIUM_VM_HANDLER bool op_divide(VirtualMachine&, ExecutionState& state) {
+            return numericBinary(state, divideInt, divideDouble);
+        }
+
+        // Typed forms, emitted when the compiler has proven the operand types.
+        // They read the payload without looking at the tag, but write the
+        // whole value, so a mistyped operand never leaves a stale tag behind.
+        IODICIUM_VM_HANDLER bool op_add_int(VirtualMachine&, ExecutionState& state) {
+            int64_t b = state.pop().as.integer;
+            state.peek() = Value::fromInt(addInt(state.peek().as.integer, b));
+            return true;
+        }
+        IODICIUM_VM_HANDLER bool op_subtract_int(VirtualMachine&, ExecutionState& state) {
+            int64_t b = state.pop().as.integer;
+            state.peek() = Value::fromInt(subtractInt(state.peek().as.integer, b));
+            return true;
+        }
+        IODICIUM_VM_HANDLER bool op_multiply_int(VirtualMachine&, ExecutionState& state) {
+            int64_t b = state.pop().as.integer;
+            state.peek() = Value::fromInt(multiplyInt(state.peek().as.integer, b));
+            return true;
+        }
+        IODICIUM_VM_HANDLER bool op_divide_int(VirtualMachine&, ExecutionState& state) {
+            int64_t b = state.pop().as.integer;
+            state.peek() = Value::fromInt(divideInt(state.peek().as.integer, b));
+            return true;
+        }
+        IODICIUM_VM_HANDLER bool op_add_double(VirtualMachine&, ExecutionState& state) {
+            double b = state.pop().as.number;
+            state.peek() = Value::fromDouble(state.peek().as.number + b);
+            return true;
+        }
+        IODICIUM_VM_HANDLER bool op_subtract_double(VirtualMachine&, ExecutionState& state) {
+            double b = state.pop().as.number;
+            state.peek() = Value::fromDouble(state.peek().as.number - b);
+            return true;
+        }
+        IODICIUM_VM_HANDLER bool op_multiply_double(VirtualMachine&, ExecutionState& state) {
+            double b = state.pop().as.number;
+            state.peek() = Value::fromDouble(state.peek().as.number * b);
+            return true;
+        }
+        IODICIUM_VM_HANDLER bool op_divide_double(VirtualMachine&, ExecutionState& state) {
+            double b = state.pop().as.number;
+            state.peek() = Value::fromDouble(state.peek().as.number / b);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_concat(VirtualMachine& vm, ExecutionState& state) {
+            Value b = state.pop();
+            state.peek() = vm.concat(state.peek(), b);
+            return true;
+        }
+        IODICIUM_VM_HANDLER bool op_concat_n(VirtualMachine& vm, ExecutionState& state) {
+            size_t count = state.current().arg;
+            Value* first = state.sp - count;
+            *first = vm.concat(first, count);
+            state.sp = first + 1;
+            return true;
+        }
 
     }
 }
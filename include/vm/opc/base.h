@@ -1,12 +1,133 @@
 #ifndef IODICIUM_VM_OPC_BASE_H
 #define IODICIUM_VM_OPC_BASE_H
 
+#include "vm/vm.h"
+#include <algorithm>
+
 namespace Iodicium {
     namespace VM {
-        class VirtualMachine; // Forward declaration
 
-        // Opcode handler functions
-        bool op_return(VirtualMachine& vm);
+        // Opcode handler functions. Each returns false when execution should stop.
+
+        IODICIUM_VM_HANDLER bool op_return(VirtualMachine& vm, ExecutionState& state) {
+            Value result = state.pop();
+            CallFrame caller;
+            if (!vm.popFrame(caller)) {
+                return vm.finishFiber(state, result);
+            }
+            state.sp = state.base;
+            *state.sp++ = result;
+            state.ip = caller.ip;
+            state.base = caller.stack_base;
+            return true;
+        }
+
+        // Operands: <uint8_t arg_count>, <uint16_t address>, resolved by the Loader.
+        // With the JIT on, calls are counted per target; a target that becomes
+        // hot is compiled and from then on runs natively when its frame fits.
+        // Calls are where the VM collects strings (see VirtualMachine::shouldCollect).
+        IODICIUM_VM_HANDLER bool op_call(VirtualMachine& vm, ExecutionState& state) {
+            if (vm.shouldCollect()) [[unlikely]] vm.collectStrings(state);
+            const Instruction& call = state.current();
+            Value* base = state.sp - call.arg;
+            if (state.functions) {
+                JitFunction& function = state.functions[call.operand.target - state.code];
+                if (function.native && base + function.frame_size <= state.stack_limit) {
+                    NativeExit exit = function.native(base);
+                    if (!exit.resume) {
+                        state.sp = base + 1;
+                        return true;
+                    }
+                    // A guard failed: finish the call in the interpreter from where native code stopped.
+                    vm.pushFrame({state.ip, state.base});
+                    state.base = base;
+                    state.sp = exit.sp;
+                    state.ip = exit.resume;
+                    return true;
+                }
+                if (++function.calls == JitCompiler::HOT_CALLS) {
+                    vm.compileHot(call.operand.target, base, call.arg, function);
+                }
+            }
+            vm.pushFrame({state.ip, state.base});
+            state.base = base;
+            state.ip = call.operand.target;
+            return true;
+        }
+
+        // Operands as OP_CALL. The arguments replace the current frame and
+        // the callee returns straight to this function's caller, so no call
+        // frame is pushed and a chain of tail calls runs in constant space.
+        IODICIUM_VM_HANDLER bool op_tail_call(VirtualMachine& vm, ExecutionState& state) {
+            if (vm.shouldCollect()) [[unlikely]] vm.collectStrings(state);
+            const Instruction& call = state.current();
+            Value* args = state.sp - call.arg;
+            std::copy(args, state.sp, state.base);
+            state.sp = state.base + call.arg;
+            if (state.functions) {
+                JitFunction& function = state.functions[call.operand.target - state.code];
+                if (function.native && state.base + function.frame_size <= state.stack_limit) {
+                    NativeExit exit = function.native(state.base);
+                    if (!exit.resume) {
+                        state.sp = state.base + 1;
+                        return op_return(vm, state);
+                    }
+                    state.sp = exit.sp;
+                    state.ip = exit.resume;
+                    return true;
+                }
+                if (++function.calls == JitCompiler::HOT_CALLS) {
+                    vm.compileHot(call.operand.target, state.base, call.arg, function);
+                }
+            }
+            state.ip = call.operand.target;
+            return true;
+        }
+
+        // The Loader has checked the argument count against the native's signature.
+        IODICIUM_VM_HANDLER bool op_call_native(VirtualMachine& vm, ExecutionState& state) {
+            const Instruction& call = state.current();
+            Value* args = state.sp - call.arg;
+            Value result = call.operand.native->handler(vm, args, call.arg);
+            state.sp = args;
+            state.push(result);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_get_local(VirtualMachine&, ExecutionState& state) {
+            uint8_t slot_index = state.current().arg;
+            state.push(state.base[slot_index]);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_set_local(VirtualMachine&, ExecutionState& state) {
+            uint8_t slot_index = state.current().arg;
+            state.base[slot_index] = state.peek();
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_pop(VirtualMachine&, ExecutionState& state) {
+            state.sp--;
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_slide(VirtualMachine&, ExecutionState& state) {
+            Value* result = state.sp - 1 - state.current().arg;
+            *result = state.peek();
+            state.sp = result + 1;
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_convert(VirtualMachine& vm, ExecutionState& state) {
+            uint8_t target_type = state.current().arg;
+            state.peek() = vm.convert(state.peek(), target_type);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_check_type(VirtualMachine& vm, ExecutionState& state) {
+            vm.checkType(state.peek(), state.current().arg);
+            return true;
+        }
 
     }
 }
@@ -0,0 +1,36 @@
+#ifndef IODICIUM_VM_OPC_FIBERS_H
+#define IODICIUM_VM_OPC_FIBERS_H
+
+#include "vm/vm.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // Opcode handler functions for fibers. Switching fibers swaps the
+        // whole ExecutionState, so the loop continues in the other fiber.
+
+        // Operands as OP_CALL: the arguments stay with the new fiber.
+        IODICIUM_VM_HANDLER bool op_fiber(VirtualMachine& vm, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            Value handle = vm.createFiber(state, instruction.operand.target, instruction.arg);
+            state.sp -= instruction.arg;
+            state.push(handle);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_resume(VirtualMachine& vm, ExecutionState& state) {
+            Value handle = state.pop();
+            vm.resumeFiber(state, handle);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_yield(VirtualMachine& vm, ExecutionState& state) {
+            Value value = state.pop();
+            vm.yieldFiber(state, value);
+            return true;
+        }
+
+    }
+}
+
+#endif //IODICIUM_VM_OPC_FIBERS_H
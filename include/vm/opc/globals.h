@@ -1,14 +1,31 @@
 #ifndef IODICIUM_VM_OPC_GLOBALS_H
 #define IODICIUM_VM_OPC_GLOBALS_H
 
+#include "vm/vm.h"
+
 namespace Iodicium {
     namespace VM {
-        class VirtualMachine; // Forward declaration
 
-        // Opcode handler functions for global variables
-        bool op_define_global(VirtualMachine& vm);
-        bool op_get_global(VirtualMachine& vm);
-        bool op_set_global(VirtualMachine& vm);
+        // Opcode handler functions for global variables. Operand: <uint16_t global_slot>
+        // A slot holds nil until its definition has run; no value the language can produce is nil.
+        IODICIUM_VM_HANDLER bool op_define_global(VirtualMachine&, ExecutionState& state) {
+            state.globals[state.current().operand.slot] = state.pop();
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_get_global(VirtualMachine& vm, ExecutionState& state) {
+            uint32_t slot = state.current().operand.slot;
+            if (state.globals[slot].isNil()) vm.undefinedGlobal(slot);
+            state.push(state.globals[slot]);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_set_global(VirtualMachine& vm, ExecutionState& state) {
+            uint32_t slot = state.current().operand.slot;
+            if (state.globals[slot].isNil()) vm.undefinedGlobal(slot);
+            state.globals[slot] = state.peek();
+            return true;
+        }
 
     }
 }
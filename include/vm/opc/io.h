@@ -1,13 +1,31 @@
 #ifndef IODICIUM_VM_OPC_IO_H
 #define IODICIUM_VM_OPC_IO_H
 
+#include "vm/vm.h"
+
 namespace Iodicium {
     namespace VM {
-        class VirtualMachine; // Forward declaration
 
-        // Opcode handler functions
-        bool op_const(VirtualMachine& vm);
-        bool op_println(VirtualMachine& vm);
+        // Opcode handler functions for constants and output.
+        IODICIUM_VM_HANDLER bool op_const(VirtualMachine&, ExecutionState& state) {
+            state.push(*state.current().operand.constant);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_write_out(VirtualMachine& vm, ExecutionState& state) {
+            vm.write(OUTPUT_OUT, state.pop());
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_write_err(VirtualMachine& vm, ExecutionState& state) {
+            vm.write(OUTPUT_ERR, state.pop());
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_flush(VirtualMachine& vm, ExecutionState&) {
+            vm.flushOutput();
+            return true;
+        }
 
     }
 }
@@ -0,0 +1,162 @@
+#ifndef IODICIUM_VM_OPC_REGISTERS_H
+#define IODICIUM_VM_OPC_REGISTERS_H
+
+#include <iostream>
+#include "vm/vm.h"
+#include "vm/opc/arithmetic.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // Opcode handler functions for the register instruction set. Registers
+        // are the current frame's slots, addressed from state.base; the operand
+        // stack is not used, and state.sp only marks the top of the frame.
+
+        IODICIUM_VM_HANDLER Value& reg(ExecutionState& state, uint8_t index) { return state.base[index]; }
+
+        // Operand: <uint8_t register_count>
+        IODICIUM_VM_HANDLER bool op_reg_enter(VirtualMachine&, ExecutionState& state) {
+            Value* top = state.base + state.current().arg;
+            if (top > state.stack_limit) throw VirtualMachineError("VM Stack Overflow");
+            state.sp = top;
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_load_const(VirtualMachine&, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            reg(state, instruction.arg) = *instruction.operand.constant;
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_move(VirtualMachine&, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            reg(state, instruction.arg) = reg(state, instruction.a);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_get_global(VirtualMachine& vm, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            uint32_t slot = instruction.operand.slot;
+            if (state.globals[slot].isNil()) vm.undefinedGlobal(slot);
+            reg(state, instruction.arg) = state.globals[slot];
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_define_global(VirtualMachine&, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            state.globals[instruction.operand.slot] = reg(state, instruction.arg);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_set_global(VirtualMachine& vm, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            uint32_t slot = instruction.operand.slot;
+            if (state.globals[slot].isNil()) vm.undefinedGlobal(slot);
+            state.globals[slot] = reg(state, instruction.arg);
+            return true;
+        }
+
+        // The callee's frame starts at the first argument register, so its
+        // parameters are already in place and its result lands in r[first].
+        // The Loader resolves the target past the callee's OP_REG_ENTER and
+        // stores its register count in 'b', so the frame is checked here.
+        IODICIUM_VM_HANDLER bool op_reg_call(VirtualMachine& vm, ExecutionState& state) {
+            if (vm.shouldCollect()) [[unlikely]] vm.collectStrings(state);
+            const Instruction& call = state.current();
+            Value* base = state.base + call.arg;
+            if (base + call.b > state.stack_limit) throw VirtualMachineError("VM Stack Overflow");
+            vm.pushFrame({state.ip, state.base});
+            state.base = base;
+            state.sp = base + call.b;
+            state.ip = call.operand.target;
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_call_native(VirtualMachine& vm, ExecutionState& state) {
+            const Instruction& call = state.current();
+            Value* args = state.base + call.arg;
+            *args = call.operand.native->handler(vm, args, call.a);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_return(VirtualMachine& vm, ExecutionState& state) {
+            Value result = reg(state, state.current().arg);
+            CallFrame caller;
+            if (!vm.popFrame(caller)) {
+                return false;
+            }
+            state.base[0] = result;
+            state.sp = state.base + 1;
+            state.ip = caller.ip;
+            state.base = caller.stack_base;
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_convert(VirtualMachine& vm, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            reg(state, instruction.arg) = vm.convert(reg(state, instruction.a), instruction.b);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_write_out(VirtualMachine& vm, ExecutionState& state) {
+            vm.write(OUTPUT_OUT, reg(state, state.current().arg));
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_write_err(VirtualMachine& vm, ExecutionState& state) {
+            vm.write(OUTPUT_ERR, reg(state, state.current().arg));
+            return true;
+        }
+
+        // Three-address arithmetic: r[arg] = r[a] op r[b].
+        IODICIUM_VM_HANDLER bool op_reg_add(VirtualMachine& vm, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            reg(state, instruction.arg) = addValues(vm, reg(state, instruction.a), reg(state, instruction.b));
+            return true;
+        }
+
+        template <typename IntOp, typename DoubleOp>
+        IODICIUM_VM_HANDLER bool registerNumeric(ExecutionState& state, IntOp int_op, DoubleOp double_op) {
+            const Instruction& instruction = state.current();
+            reg(state, instruction.arg) = numericValues(reg(state, instruction.a), reg(state, instruction.b), int_op, double_op);
+            return true;
+        }
+
+        template <typename IntOp>
+        IODICIUM_VM_HANDLER bool registerInt(ExecutionState& state, IntOp int_op) {
+            const Instruction& instruction = state.current();
+            reg(state, instruction.arg) = Value::fromInt(int_op(reg(state, instruction.a).as.integer, reg(state, instruction.b).as.integer));
+            return true;
+        }
+
+        template <typename DoubleOp>
+        IODICIUM_VM_HANDLER bool registerDouble(ExecutionState& state, DoubleOp double_op) {
+            const Instruction& instruction = state.current();
+            reg(state, instruction.arg) = Value::fromDouble(double_op(reg(state, instruction.a).as.number, reg(state, instruction.b).as.number));
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_reg_subtract(VirtualMachine&, ExecutionState& state) { return registerNumeric(state, subtractInt, subtractDouble); }
+        IODICIUM_VM_HANDLER bool op_reg_multiply(VirtualMachine&, ExecutionState& state) { return registerNumeric(state, multiplyInt, multiplyDouble); }
+        IODICIUM_VM_HANDLER bool op_reg_divide(VirtualMachine&, ExecutionState& state) { return registerNumeric(state, divideInt, divideDouble); }
+
+        IODICIUM_VM_HANDLER bool op_reg_add_int(VirtualMachine&, ExecutionState& state) { return registerInt(state, addInt); }
+        IODICIUM_VM_HANDLER bool op_reg_subtract_int(VirtualMachine&, ExecutionState& state) { return registerInt(state, subtractInt); }
+        IODICIUM_VM_HANDLER bool op_reg_multiply_int(VirtualMachine&, ExecutionState& state) { return registerInt(state, multiplyInt); }
+        IODICIUM_VM_HANDLER bool op_reg_divide_int(VirtualMachine&, ExecutionState& state) { return registerInt(state, divideInt); }
+
+        IODICIUM_VM_HANDLER bool op_reg_add_double(VirtualMachine&, ExecutionState& state) { return registerDouble(state, addDouble); }
+        IODICIUM_VM_HANDLER bool op_reg_subtract_double(VirtualMachine&, ExecutionState& state) { return registerDouble(state, subtractDouble); }
+        IODICIUM_VM_HANDLER bool op_reg_multiply_double(VirtualMachine&, ExecutionState& state) { return registerDouble(state, multiplyDouble); }
+        IODICIUM_VM_HANDLER bool op_reg_divide_double(VirtualMachine&, ExecutionState& state) { return registerDouble(state, divideDouble); }
+
+        IODICIUM_VM_HANDLER bool op_reg_concat(VirtualMachine& vm, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            reg(state, instruction.arg) = vm.concat(reg(state, instruction.a), reg(state, instruction.b));
+            return true;
+        }
+
+    }
+}
+
+#endif //IODICIUM_VM_OPC_REGISTERS_H
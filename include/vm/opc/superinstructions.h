@@ -0,0 +1,43 @@
+#ifndef IODICIUM_VM_OPC_SUPERINSTRUCTIONS_H
+#define IODICIUM_VM_OPC_SUPERINSTRUCTIONS_H
+
+#include "vm/vm.h"
+#include "vm/opc/base.h"
+#include "vm/opc/arithmetic.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // Opcode handler functions for superinstructions. Each one performs a
+        // sequence the compiler fused in a single dispatch; where the last step
+        // is an existing handler it is reused, with the Loader laying out the
+        // operands it expects.
+
+        IODICIUM_VM_HANDLER bool op_get_local_2(VirtualMachine&, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            state.push(state.base[instruction.arg]);
+            state.push(state.base[instruction.a]);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_get_local_const(VirtualMachine&, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            state.push(state.base[instruction.arg]);
+            state.push(*instruction.operand.constant);
+            return true;
+        }
+
+        IODICIUM_VM_HANDLER bool op_get_local_call(VirtualMachine& vm, ExecutionState& state) {
+            state.push(state.base[state.current().a]);
+            return op_call(vm, state);
+        }
+
+        IODICIUM_VM_HANDLER bool op_add_int_return(VirtualMachine& vm, ExecutionState& state) {
+            op_add_int(vm, state);
+            return op_return(vm, state);
+        }
+
+    }
+}
+
+#endif //IODICIUM_VM_OPC_SUPERINSTRUCTIONS_H
@@ -0,0 +1,30 @@
+#ifndef IODICIUM_VM_OPC_TASKS_H
+#define IODICIUM_VM_OPC_TASKS_H
+
+#include "vm/vm.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // Opcode handler functions for tasks (see vm/tasks.h).
+
+        // Operands as OP_CALL: the arguments are copied into the task.
+        IODICIUM_VM_HANDLER bool op_spawn(VirtualMachine& vm, ExecutionState& state) {
+            const Instruction& instruction = state.current();
+            Value handle = vm.spawnTask(state, instruction.operand.target, instruction.arg);
+            state.sp -= instruction.arg;
+            state.push(handle);
+            return true;
+        }
+
+        // May switch to a fiber that runs the task here.
+        IODICIUM_VM_HANDLER bool op_join(VirtualMachine& vm, ExecutionState& state) {
+            Value handle = state.pop();
+            vm.joinTask(state, handle);
+            return true;
+        }
+
+    }
+}
+
+#endif //IODICIUM_VM_OPC_TASKS_H
@@ -0,0 +1,74 @@
+#ifndef IODICIUM_VM_OUTPUT_H
+#define IODICIUM_VM_OUTPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "vm/value.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // The streams OP_WRITE_OUT and OP_WRITE_ERR write to.
+        enum OutputStream : uint8_t {
+            OUTPUT_OUT, // Standard output
+            OUTPUT_ERR, // Standard error
+        };
+
+        // Collects what a run writes to one standard stream and hands it to
+        // the system in as few calls as possible. Short values are copied
+        // into the buffer; strings of at least WRITEV_MIN_LENGTH are not
+        // copied but queued by address, and the queue goes out in a single
+        // writev once the buffered bytes reach the capacity or flush() is
+        // called. A capacity of 0 writes every value as soon as it arrives.
+        //
+        // Queued strings must stay alive until the next flush; the VM
+        // flushes before anything it wrote can be freed. Output written
+        // through std::cout or std::cerr is flushed before each write, so
+        // the two stay in order. Where writev is not available the buffer is
+        // written with stdio instead.
+        class OutputBuffer {
+        public:
+            static constexpr size_t DEFAULT_CAPACITY = size_t(64) << 10;
+            static constexpr size_t WRITEV_MIN_LENGTH = 4096; // Shortest string queued instead of copied
+
+            explicit OutputBuffer(OutputStream stream, size_t capacity = DEFAULT_CAPACITY);
+            ~OutputBuffer();
+            OutputBuffer(const OutputBuffer&) = delete;
+            OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+            // Writes the string form of 'value', as Value's operator<< would.
+            void write(const Value& value);
+            void write(const char* data, size_t length);
+
+            // Writes everything pending. A failed write discards the output;
+            // nothing more is written to the stream after one.
+            void flush();
+
+            // Flushes, then sets the bytes buffered before a write is made.
+            void setCapacity(size_t capacity);
+            size_t getCapacity() const { return m_capacity; }
+
+        private:
+            struct Piece {
+                const char* data;
+                size_t length;
+            };
+
+            OutputStream m_stream;
+            size_t m_capacity;
+            std::vector<char> m_buffer;
+            size_t m_used = 0;        // Bytes of m_buffer holding output
+            size_t m_queued = 0;      // Bytes of m_buffer already covered by m_pieces
+            size_t m_pending = 0;     // Bytes waiting to be written, buffered or queued
+            std::vector<Piece> m_pieces; // What flush() writes, in order
+            bool m_failed = false;
+
+            void queueBuffered();
+            void writePieces();
+        };
+
+    }
+}
+
+#endif //IODICIUM_VM_OUTPUT_H
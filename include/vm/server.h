@@ -0,0 +1,150 @@
+#ifndef IODICIUM_VM_SERVER_H
+#define IODICIUM_VM_SERVER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "common/logger.h"
+#include "vm/library.h"
+#include "vm/vm.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // Serves the exported functions of a library to local clients over a
+        // Unix domain socket (iodicium serve), so that a call costs a round
+        // trip instead of starting a process and loading the image. Each
+        // worker thread owns a VirtualMachine that has run the library's
+        // top-level code once, before the first client connects; every call
+        // then sees the globals it left, as with VirtualMachine::call.
+        //
+        // serve() polls every open connection and hands one with input to a
+        // free worker. The worker answers its requests for as long as the
+        // client keeps sending them, and hands the connection back once it
+        // has been idle for HANDBACK_MS, or has been served that long while
+        // another connection waits. So a client that is idle holds no
+        // worker, and up to 'workers' requests are answered at once. A client may send any
+        // number of requests, and may send more before the responses to the
+        // earlier ones arrive; responses come in the order of the requests.
+        // A last request without its newline is answered once the client
+        // shuts down its side of the connection.
+        //
+        // The protocol is one line per request and one per response, in order:
+        //
+        //     name<TAB>argument<TAB>...<NL>    ->    ok<TAB>result<NL>
+        //                                      or    error<TAB>message<NL>
+        //
+        // Arguments are parsed as the types their parameters declare: an Int
+        // or Double as a number, a Bool as true or false, a String as its
+        // text. The result is written as its string form, as writeOut would
+        // print it. In arguments, results and messages, a backslash, tab,
+        // newline or carriage return is written \\, \t, \n or \r.
+        class Server {
+        public:
+            // Called on each worker's VirtualMachine before it runs the library.
+            using Configure = std::function<void(VirtualMachine&)>;
+
+            // The longest request line a server reads; a longer one ends its connection.
+            static constexpr size_t MAX_REQUEST_LENGTH = 1 << 20;
+            // A client that takes no part of a response for this long is disconnected.
+            static constexpr int SEND_TIMEOUT_MS = 10000;
+            // How long a worker waits for a client's next request before it
+            // hands the connection back, and serves one while others wait.
+            // Long enough for a client that sends as soon as it has its
+            // response, even on a busy machine.
+            static constexpr int HANDBACK_MS = 10;
+
+            Server(Common::Logger& logger, const Library& library, size_t workers, size_t memory_limit = 0);
+            ~Server();
+
+            void setConfigure(Configure configure) { m_configure = std::move(configure); }
+
+            // Listens on 'socket_path' and serves until stop() is called.
+            // A stale socket left at the path by a server that did not stop
+            // is replaced. Raises a VirtualMachineError if the path is in
+            // use or the library's top-level code fails in a worker.
+            void serve(const std::string& socket_path);
+            // Makes serve() return once the requests it has read are
+            // answered, and removes the socket. Safe in a signal handler;
+            // a server stopped before it serves returns at once.
+            void stop();
+
+            static std::string escape(std::string_view text);
+            static std::string unescape(std::string_view text);
+
+        private:
+            struct Connection {
+                int socket;
+                std::string input; // Received, but not yet a whole request
+
+                explicit Connection(int socket) : socket(socket) {}
+                ~Connection();
+                Connection(const Connection&) = delete;
+                Connection& operator=(const Connection&) = delete;
+            };
+
+            void work(size_t worker);
+            // Answers the requests that have arrived on 'connection'.
+            // Returns false once the connection is to be closed.
+            bool serveConnection(VirtualMachine& vm, std::vector<PortableValue>& args, Connection& connection);
+            // Whether more input arrives on 'connection' within HANDBACK_MS,
+            // unless it has been served since 'taken' for that long already
+            // and another connection is waiting for a worker.
+            bool awaitInput(const Connection& connection, std::chrono::steady_clock::time_point taken);
+            // Answers one request line, appending the response to 'response'.
+            void answer(VirtualMachine& vm, std::vector<PortableValue>& args, std::string_view request, std::string& response);
+
+            Common::Logger& m_logger;
+            const Library& m_library;
+            size_t m_workers;
+            size_t m_memory_limit; // Per worker
+            Configure m_configure;
+            int m_stop_pipe[2] = {-1, -1}; // stop() writes to [1]; serve() polls [0]
+            int m_wake_pipe[2] = {-1, -1}; // Workers write to [1] when they hand a connection back
+
+            std::mutex m_mutex;
+            std::condition_variable m_ready; // A connection was queued, or the server is stopping
+            std::condition_variable m_initialized_changed;
+            size_t m_initialized = 0;        // Workers that have run the library, or failed to
+            std::deque<std::unique_ptr<Connection>> m_pending; // Connections with input no worker has taken
+            std::vector<std::unique_ptr<Connection>> m_idle;   // Handed back by workers, for serve() to poll again
+            std::vector<int> m_active;       // Per worker, the socket it serves or -1
+            bool m_stopping = false;
+            std::string m_error;             // The first failure of a worker's top-level code
+        };
+
+        // A connection to a Server, as used by `iodicium call`. Requests
+        // and responses are lines of the Server's protocol, without their newlines.
+        class Client {
+        public:
+            // Raises a VirtualMachineError if nothing is serving at 'socket_path'.
+            explicit Client(const std::string& socket_path);
+            ~Client();
+            Client(const Client&) = delete;
+            Client& operator=(const Client&) = delete;
+
+            // Sends a request without waiting for its response.
+            void send(std::string_view request);
+            // Returns the next response; raises a VirtualMachineError if the server closed the connection.
+            std::string receive();
+            std::string call(std::string_view request) {
+                send(request);
+                return receive();
+            }
+
+        private:
+            int m_socket = -1;
+            std::string m_buffer; // Received, but not yet returned by receive()
+        };
+
+    }
+}
+
+#endif //IODICIUM_VM_SERVER_H
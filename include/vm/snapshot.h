@@ -0,0 +1,29 @@
+#ifndef IODICIUM_VM_SNAPSHOT_H
+#define IODICIUM_VM_SNAPSHOT_H
+
+#include "common/logger.h"
+#include "executable/ioe_reader.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // Runs the initialization of an executable once and returns the
+        // state it leaves, for a run to start from (iodicium snapshot).
+        //
+        // Initialization is the longest run of whole statements at the start
+        // of the top-level code that only compute values and store them:
+        // no output, no natives, no fibers or tasks, and calls only to
+        // functions that keep to the same. That code reads nothing from
+        // outside the image, so every run computes the same globals from it,
+        // and a run that starts after it with those globals does what a run
+        // from the start would.
+        //
+        // Raises a VirtualMachineError for register code or code that starts
+        // with something else, and whatever the initialization raises, which
+        // every run would raise as well.
+        Executable::Snapshot takeSnapshot(Common::Logger& logger, const Executable::Chunk& chunk);
+
+    }
+}
+
+#endif //IODICIUM_VM_SNAPSHOT_H
@@ -0,0 +1,122 @@
+#ifndef IODICIUM_VM_TASKS_H
+#define IODICIUM_VM_TASKS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vm/arena.h"
+#include "vm/loader.h"
+#include "vm/value.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        class VirtualMachine;
+
+        // A value taken out of one VM so that another can have it. Strings
+        // owned by the program are shared; any other string is copied into
+        // 'text', and value.as.string is null.
+        struct PortableValue {
+            Value value;
+            std::string text;
+
+            // Bytes it takes on the C++ heap, as charged to a VM's arena.
+            size_t footprint() const { return sizeof(PortableValue) + text.size(); }
+        };
+
+        // A call made with spawn(). Everything it needs is copied out of the
+        // spawning VM, so it can run on any thread: its arguments, and the
+        // globals as they were when it was spawned. What the task does to
+        // globals stays with the task. The copies are charged to the arena of
+        // the VM that made them, until the task lets go of them.
+        struct Task {
+            enum Status : uint8_t {
+                QUEUED,
+                RUNNING,
+                DONE,
+                FAILED,
+            };
+
+            const Instruction* entry = nullptr;
+            std::vector<PortableValue> args;
+            std::shared_ptr<const std::vector<PortableValue>> globals;
+            Arena::Charge args_charge; // For 'args', to the spawning VM
+            std::atomic<Status> status{QUEUED};
+            PortableValue result;        // Once DONE
+            Arena::Charge result_charge; // For 'result', to the VM that ran the task
+            std::string error;           // Once FAILED
+        };
+
+        // Runs spawned tasks on a set of worker threads, one VM each.
+        // Worker 0 is the thread of the run that spawned the first task;
+        // the others are started here. Each worker keeps a deque of the
+        // tasks it spawned: it takes its own newest task first, and a worker
+        // with nothing to do steals the oldest task of another.
+        //
+        // Whoever first claims a queued task runs it. A join of a task
+        // nobody has claimed runs it right away on the joining VM, so a
+        // task that joins what it spawned never waits for a free thread. A
+        // join of a task another thread is running waits for it to finish.
+        // A task is forgotten once it has been joined; its handle cannot be
+        // joined twice.
+        class TaskScheduler {
+        public:
+            // Makes the VM of worker 'worker' (from 1); called before any thread starts.
+            using MakeWorker = std::function<std::unique_ptr<VirtualMachine>(TaskScheduler& scheduler, size_t worker)>;
+
+            // Starts 'helpers' threads, each with a VM made by 'make_worker'.
+            TaskScheduler(Program& program, size_t helpers, const MakeWorker& make_worker);
+            // Waits for the tasks being run to finish; queued tasks are dropped.
+            ~TaskScheduler();
+            TaskScheduler(const TaskScheduler&) = delete;
+            TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+            // Queues 'task' on 'worker's deque and returns its handle. With
+            // no helper threads nothing is queued: joins run every task.
+            int64_t spawn(size_t worker, std::shared_ptr<Task> task);
+            // Returns the task with 'handle', or null if there is none or it has been joined.
+            std::shared_ptr<Task> find(int64_t handle);
+            // Forgets the task with 'handle', once its join has its result.
+            void release(int64_t handle);
+            // Moves 'task' from QUEUED to RUNNING. Returns false if someone else did.
+            static bool claim(Task& task);
+            // Stores 'result', charged by 'charge', and lets go of the task's arguments and globals.
+            void finish(Task& task, PortableValue result, Arena::Charge charge);
+            void fail(Task& task, const std::string& error);
+            // Blocks until 'task' is DONE or FAILED. Returns false if the
+            // scheduler is stopped first.
+            bool wait(Task& task);
+
+        private:
+            struct Worker {
+                std::mutex mutex;
+                std::deque<std::shared_ptr<Task>> tasks; // Newest at the back; may hold tasks a join has claimed
+            };
+
+            Program& m_program;
+            std::mutex m_mutex; // Guards m_tasks, m_queued and m_stopping, and goes with both condition variables
+            std::vector<std::shared_ptr<Task>> m_tasks; // Indexed by handle
+            std::deque<Worker> m_workers;
+            size_t m_queued = 0; // Entries in all the deques
+            bool m_stopping = false;
+            std::condition_variable m_work;     // Signalled when a task is queued
+            std::condition_variable m_finished; // Signalled when a task finishes
+            std::vector<std::unique_ptr<VirtualMachine>> m_vms; // Of the helper threads, by worker - 1
+            std::vector<std::thread> m_threads;
+
+            std::shared_ptr<Task> take(size_t worker);
+            void work(size_t worker);
+        };
+
+    }
+}
+
+#endif //IODICIUM_VM_TASKS_H
@@ -2,58 +2,145 @@
 #define IODICIUM_VM_VALUE_H
 
 #include <string>
-#include <variant>
+#include <string_view>
+#include <cstdint>
 #include <iostream>
 #include <stdexcept>
+#include <vector>
 
 namespace Iodicium {
     namespace VM {
 
-        // Our multi-type Value struct for the VM stack and variables.
-        // It can hold a boolean, a double (for all numbers), or a string.
+        enum class ValueType : uint8_t {
+            NIL,
+            BOOL,
+            INT,
+            DOUBLE,
+            STRING
+        };
+
+        // An immutable string. A flat string holds its characters, followed by
+        // a NUL, in the same allocation. A rope is the concatenation of two
+        // other strings and has no characters of its own until something needs
+        // them contiguously and flattens it (see VirtualMachine::flatten).
+        // Values refer to strings by pointer, so copies share the string. The
+        // VM that made it may move it when it collects strings (see
+        // VirtualMachine::collectStrings); constants belong to the Program.
+        struct String {
+            // A concatenation shorter than this is copied into a flat string,
+            // which is smaller than a rope node and its pieces.
+            static constexpr size_t ROPE_MIN_LENGTH = 64;
+
+            size_t length;
+            mutable const char* chars; // NUL-terminated; null for a rope that has not been flattened
+            const String* left;        // A rope's halves; null for a flat string
+            const String* right;
+
+            bool isFlat() const { return chars != nullptr; }
+            // The characters of a flat string.
+            const char* data() const { return chars; }
+            std::string_view view() const { return {chars, length}; }
+
+            // Calls piece(const char*, size_t) on each flat part of the string
+            // in order, without flattening it. Ropes are walked iteratively, so
+            // any depth is fine.
+            template <typename Piece>
+            void forEachPiece(Piece piece) const {
+                if (isFlat()) {
+                    piece(chars, length);
+                    return;
+                }
+                std::vector<const String*> pending{this};
+                while (!pending.empty()) {
+                    const String* string = pending.back();
+                    pending.pop_back();
+                    if (string->isFlat()) {
+                        if (string->length > 0) piece(string->chars, string->length);
+                        continue;
+                    }
+                    pending.push_back(string->right);
+                    pending.push_back(string->left);
+                }
+            }
+
+            // Copies the characters into 'out', which holds 'length' bytes.
+            void copyTo(char* out) const;
+            std::string toStdString() const;
+
+            // Bytes needed to hold a flat String of 'length' characters.
+            static size_t sizeFor(size_t length) { return sizeof(String) + length + 1; }
+            // Builds a flat String from 'text' in 'memory', which holds sizeFor(text.size()) bytes.
+            static const String* create(void* memory, std::string_view text);
+            // Builds a flat String of 'length' characters in 'memory', which
+            // holds sizeFor(length) bytes, and returns the characters to fill in.
+            static char* createUninitialized(void* memory, size_t length);
+            // Builds the rope 'left' + 'right' in 'memory', which holds sizeof(String) bytes.
+            static const String* concat(void* memory, const String* left, const String* right);
+        };
+
+        // A compact tagged value for the VM stack and variables.
+        // Numbers and booleans are stored unboxed; strings are handles to
+        // immutable storage owned by the VirtualMachine that created them
+        // (or by the Program, for string constants).
         struct Value {
-            std::variant<bool, double, std::string> data;
+            ValueType type;
+            union {
+                bool boolean;
+                int64_t integer;
+                double number;
+                const String* string;
+            } as;
 
             // Constructors for easy initialization
-            Value() : data(false) {} // Default to boolean false
-            explicit Value(bool b) : data(b) {}
-            explicit Value(double d) : data(d) {}
-            explicit Value(std::string s) : data(std::move(s)) {}
+            Value() : type(ValueType::NIL) { as.integer = 0; }
+            static Value fromBool(bool b) { Value v; v.type = ValueType::BOOL; v.as.boolean = b; return v; }
+            static Value fromInt(int64_t i) { Value v; v.type = ValueType::INT; v.as.integer = i; return v; }
+            static Value fromDouble(double d) { Value v; v.type = ValueType::DOUBLE; v.as.number = d; return v; }
+            static Value fromString(const String* s) { Value v; v.type = ValueType::STRING; v.as.string = s; return v; }
 
             // Type checking helpers
-            bool isBool() const { return std::holds_alternative<bool>(data); }
-            bool isNumber() const { return std::holds_alternative<double>(data); }
-            bool isString() const { return std::holds_alternative<std::string>(data); }
+            bool isNil() const { return type == ValueType::NIL; }
+            bool isBool() const { return type == ValueType::BOOL; }
+            bool isInt() const { return type == ValueType::INT; }
+            bool isDouble() const { return type == ValueType::DOUBLE; }
+            bool isNumber() const { return type == ValueType::INT || type == ValueType::DOUBLE; }
+            bool isString() const { return type == ValueType::STRING; }
 
             // Value access helpers (with error checking)
             bool asBool() const {
                 if (!isBool()) throw std::runtime_error("Value is not a boolean.");
-                return std::get<bool>(data);
+                return as.boolean;
+            }
+            int64_t asInt() const {
+                if (!isInt()) throw std::runtime_error("Value is not an integer.");
+                return as.integer;
             }
             double asNumber() const {
-                if (!isNumber()) throw std::runtime_error("Value is not a number.");
-                return std::get<double>(data);
+                if (isInt()) return static_cast<double>(as.integer);
+                if (!isDouble()) throw std::runtime_error("Value is not a number.");
+                return as.number;
             }
-            const std::string& asString() const {
+            const String& asString() const {
                 if (!isString()) throw std::runtime_error("Value is not a string.");
-                return std::get<std::string>(data);
+                return *as.string;
             }
 
             // Helper to get the type as a string (for debugging)
-            std::string getTypeString() const {
-                if (std::holds_alternative<bool>(data)) return "bool";
-                if (std::holds_alternative<double>(data)) return "double";
-                if (std::holds_alternative<std::string>(data)) return "string";
-                return "unknown";
-            }
+            std::string getTypeString() const;
 
             // Overload for easy printing/debugging
             friend std::ostream& operator<<(std::ostream& os, const Value& value);
 
-            // toString method for logging
+            // toString method for logging and string conversion
             std::string toString() const;
         };
 
+        static_assert(sizeof(Value) == 16, "VM::Value is expected to be a 16-byte tagged union.");
+
+        // Parse the whole of 'text' as an integer or a decimal number.
+        bool parseInt(const std::string& text, int64_t& out);
+        bool parseDouble(const std::string& text, double& out);
+
     }
 }
 
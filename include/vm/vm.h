@@ -1,37 +1,308 @@
 #ifndef IODICIUM_VM_VM_H
 #define IODICIUM_VM_VM_H
 
+#include <memory>
 #include <vector>
 #include <string>
-#include <map>
 #include "common/logger.h"
+#include "common/error.h"
 #include "executable/ioe_reader.h"
+#include "vm/value.h"
+#include "vm/loader.h"
+#include "vm/jit.h"
+#include "vm/arena.h"
+#include "vm/output.h"
+#include "vm/tasks.h"
+
+// Opcode handlers must be inlined into every instantiation of the interpreter
+// loop, or ip and sp are forced out of registers at each dispatch.
+#if defined(__GNUC__) || defined(__clang__)
+#define IODICIUM_VM_HANDLER inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define IODICIUM_VM_HANDLER __forceinline
+#else
+#define IODICIUM_VM_HANDLER inline
+#endif
 
 namespace Iodicium {
     namespace VM {
 
-        // Represents a single frame on the call stack.
+        class VirtualMachineError : public Common::IodiciumError {
+        public:
+            VirtualMachineError(const std::string& message, int line = -1, int column = -1)
+                : Common::IodiciumError(message, line, column) {}
+        };
+
+        // Represents a suspended caller on the call stack.
         struct CallFrame {
-            Executable::Chunk* chunk; // The chunk this frame is executing
-            size_t ip;                // The instruction pointer for this frame
-            size_t stack_base;        // The base index on the VM stack for this frame's locals
+            const Instruction* ip; // Where to resume once the callee returns
+            Value* stack_base;     // Slot 0 of this frame's locals on the VM stack
+        };
+
+        // The interpreter registers. The dispatch loop keeps this in a local so
+        // that the ip and stack top live in machine registers; the opcode
+        // handlers in vm/opc/ receive it by reference and are inlined into the loop.
+        struct ExecutionState {
+            const Instruction* ip; // The next instruction to execute
+            Value* sp;             // One past the top of the operand stack
+            Value* base;           // Slot 0 of the current frame's locals
+            Value* globals;        // The global variable slots; nil until defined
+            Value* stack_bottom;
+            Value* stack_limit;
+            const Instruction* code;   // The program's first instruction
+            JitFunction* functions;    // JIT state, indexed like 'code'; null when the JIT is off
+
+            // The instruction being executed; ip has already moved past it.
+            const Instruction& current() const { return ip[-1]; }
+
+            // Unchecked: the Loader has verified that stack code never pops
+            // below its frame, and the VM sizes the stack for the deepest
+            // frame at the deepest call nesting it allows.
+            void push(const Value& value) { *sp++ = value; }
+            Value pop() { return *--sp; }
+            Value& peek() { return sp[-1]; }
+        };
+
+        // A line of execution with its own operand and call stacks. Fibers
+        // share the program, its globals and its strings. A run starts in
+        // fiber 0; scripts create others with fiber() and switch between them
+        // with resume() and yield().
+        struct Fiber {
+            enum Status : uint8_t {
+                SUSPENDED, // Not started yet, or stopped at a yield
+                RUNNING,
+                RESUMING,  // Waiting for a fiber it resumed to yield or return
+                DEAD,      // Its function has returned
+            };
+
+            Status status;
+            uint32_t generation;  // How often this record has been reused; part of the fiber's handle
+            uint32_t resumer;     // The fiber that resumed this one, while it runs
+            ExecutionState state; // Saved while another fiber runs
+            CallFrame* frames;
+            CallFrame* frame_top;
+            CallFrame* frame_limit;
+            std::shared_ptr<Task> task; // The task a join is running here, with globals of its own
         };
 
         class VirtualMachine {
         public:
+            static constexpr size_t STACK_MAX = 1 << 16; // Register code: operand and call stack capacity, in entries
+            static constexpr size_t DEFAULT_MAX_CALL_DEPTH = 10000;
+            static constexpr size_t DEFAULT_FIBER_CALL_DEPTH = 256;
+            static constexpr size_t MIN_COLLECTION_SIZE = size_t(4) << 20; // Bytes of strings before the first collection
+
+            // Everything the VM stores while running comes from its arenas, so
+            // 'memory_limit' (in bytes, 0 for none) bounds the memory a run
+            // takes. With a limit, the operand and call stacks get at most half of it.
             explicit VirtualMachine(Common::Logger& logger, size_t memory_limit = 0);
-            void run(Executable::Chunk& chunk);
+            void run(Program& program);
+            void run(const Executable::Chunk& chunk); // Loads the chunk, then runs it
+
+            // Runs 'program' under a caller-supplied policy from vm/instrumentation.h.
+            // Instantiated in vm.cpp for CountingInstrumentation.
+            template <typename Instrumentation>
+            void run(Program& program, Instrumentation& instrumentation);
+
+            // --- Runtime services for the opcode handlers in vm/opc/ ---
+            [[noreturn]] void undefinedGlobal(uint32_t slot) const;
+            [[noreturn]] void callStackOverflow() const;
+            void pushFrame(const CallFrame& frame) {
+                if (m_frame_top == m_frame_limit) callStackOverflow();
+                *m_frame_top++ = frame;
+            }
+            bool popFrame(CallFrame& frame) {
+                if (m_frame_top == m_frames) return false;
+                frame = *--m_frame_top;
+                return true;
+            }
+
+            // Fibers are scheduled cooperatively: a fiber runs from resume()
+            // until it yields or returns, and then its resumer continues.
+            // The records and stacks of fibers that have returned are reused
+            // by new ones. A handle holds the record's index in its low 32
+            // bits and its generation above them, so a handle to a fiber
+            // that has returned never reaches the one that reused its record.
+
+            // Creates a suspended fiber that calls 'entry' with the 'argc' values below
+            // state.sp, and returns its handle.
+            Value createFiber(const ExecutionState& state, const Instruction* entry, uint8_t argc);
+            // Switches 'state' to the fiber 'handle'; the value it yields or
+            // returns is pushed here when it does. Raises a VirtualMachineError
+            // unless 'handle' is a suspended fiber.
+            void resumeFiber(ExecutionState& state, const Value& handle);
+            // Switches back to the current fiber's resumer, passing it 'value'.
+            void yieldFiber(ExecutionState& state, const Value& value);
+            // Called when a fiber's function returns 'result'. Returns false
+            // for fiber 0, whose return ends the run.
+            bool finishFiber(ExecutionState& state, const Value& result);
+
+            // Queues a task that calls 'entry' with the 'argc' values below
+            // state.sp, and returns its handle. The first spawn of a run
+            // starts the task threads (see setTaskThreads).
+            Value spawnTask(const ExecutionState& state, const Instruction* entry, uint8_t argc);
+            // Pushes the result of the task 'handle'. A task no thread has
+            // started is run here, in a fiber; one another thread is running
+            // is waited for. Raises a VirtualMachineError if the task failed.
+            void joinTask(ExecutionState& state, const Value& handle);
+            // Runs 'task' as the whole of a run of 'program', on a task thread.
+            void runTask(Program& program, Task& task);
+
+            // Calls the stack code function at 'entry' with the 'argc' values
+            // at 'args', which must match its parameters, and returns its
+            // result. The call sees the globals the last run left, which must
+            // have finished. What a call allocates is freed by the next call,
+            // unless it changed a global: a string it returns lasts until then.
+            Value call(const Instruction* entry, const PortableValue* args, size_t argc);
 
+            // Strings come from an arena of their own. Once it has grown past
+            // a threshold, the next call collects it: the strings the run can
+            // still reach are copied to a fresh arena and the old one is
+            // returned to the system. Calls are the only safe points, as no
+            // handler holds a string in a local then, and every run of
+            // unbounded length makes them.
+            bool shouldCollect() const { return m_strings.getUsed() >= m_collect_at; }
+            // Collects the strings, with 'state' as the running fiber's registers.
+            void collectStrings(ExecutionState& state);
+
+            Value makeString(std::string_view text);
+            // Concatenates the string forms of 'a' and 'b', as a rope unless the result is short.
+            Value concat(const Value& a, const Value& b);
+            // Concatenates the string forms of 'count' values, replacing any
+            // that are not strings with their string form. Each run of short
+            // pieces is copied once into a String sized for the whole run;
+            // pieces of at least String::ROPE_MIN_LENGTH are linked as ropes.
+            Value concat(Value* values, size_t count);
+            // Returns the characters of 'string' contiguously, flattening it first if it is a rope.
+            const char* flatten(const String* string);
+            // Standard output is buffered (see setOutputBuffer); standard
+            // error is not, and flushes standard output first so the two
+            // appear in the order they were written.
+            void write(OutputStream stream, const Value& value);
+            void flushOutput(); // Writes all buffered output, including std::cout's and std::cerr's
+            Value convert(const Value& value, uint8_t target_type);
+            // Raises a VirtualMachineError unless 'value' is of the DataType 'type'.
+            void checkType(const Value& value, uint8_t type);
+            void compileHot(const Instruction* entry, const Value* args, uint8_t argc, JitFunction& function);
+
+            // The most calls that may be in progress at once; one more raises
+            // a VirtualMachineError. Stack code gets an operand stack of
+            // (max_call_depth + 1) * Program::max_frame_size entries.
+            void setMaxCallDepth(size_t depth) { m_max_call_depth = depth; }
+            // The same for every fiber but the first. Fibers are cheap to the
+            // extent that their stacks are small, so this limit is lower.
+            void setFiberCallDepth(size_t depth) { m_fiber_call_depth = depth; }
+
+            // Bytes of standard output buffered before it is written. Runs
+            // with debug logging write every value at once, so their output
+            // stays in order with the trace.
+            void setOutputBuffer(size_t size) { m_output_buffer = size; }
+
+            // The natives run(const Executable::Chunk&) resolves calls
+            // against; NativeRegistry::standard() by default.
+            void setNatives(const NativeRegistry& natives) { m_natives = &natives; }
+
+            // Threads that run spawned tasks, this VM's own included; each
+            // other thread gets a VM set up like this one. 0, the default,
+            // means one per core. Instrumented runs other than tracing run
+            // every task on their own thread, when it is joined.
+            void setTaskThreads(size_t threads) { m_task_threads = threads; }
+
+            // What the job() native returns: the job a WorkerPool runs the
+            // program for, or an empty string.
+            void setJob(std::string job) { m_job = std::move(job); }
+            const std::string& getJob() const { return m_job; }
+
+            // The JIT is on by default where it is supported (see vm/jit.h).
+            void setJitEnabled(bool enabled) { m_jit_enabled = enabled; }
+
+            // Backs the VM's memory with transparent huge pages where available.
+            void setHugePages(bool enabled) {
+                m_arena.setHugePages(enabled);
+                m_strings.setHugePages(enabled);
+            }
+
+            // Bytes of VM memory in use by the current (or last) run,
+            // including what is charged to it on the C++ heap.
+            size_t getMemoryUsed() const { return m_arena.getUsed() + m_strings.getUsed() + m_arena.getCharged(); }
+
+            // What the last run's top-level code returned, and the global
+            // slots it left; both last until the next run.
+            const Value& getResult() const { return m_result; }
+            const Value* getGlobals() const { return m_start.globals; }
         private:
             Common::Logger& m_logger;
             size_t m_memory_limit;
-            std::vector<std::string> m_stack;
-            std::map<std::string, std::string> m_globals;
-            std::vector<CallFrame> m_call_stack;
+            size_t m_max_call_depth = DEFAULT_MAX_CALL_DEPTH;
+            size_t m_fiber_call_depth = DEFAULT_FIBER_CALL_DEPTH;
+            const NativeRegistry* m_natives = &NativeRegistry::standard();
+            std::string m_job;
+            Arena m_arena; // The operand stack, call frames and globals of the current run
+            Arena m_strings{m_arena}; // The run's strings, under m_arena's limit
+            size_t m_collect_at = MIN_COLLECTION_SIZE; // Bytes of m_strings in use that make the next call collect
+            size_t m_output_buffer = OutputBuffer::DEFAULT_CAPACITY;
+            OutputBuffer m_stdout{OUTPUT_OUT}; // May refer to strings in m_strings until flushed
+            OutputBuffer m_stderr{OUTPUT_ERR, 0};
+            Program* m_program = nullptr; // The program being run
+            CallFrame* m_frames = nullptr;      // The call stack, from the arena
+            CallFrame* m_frame_top = nullptr;
+            CallFrame* m_frame_limit = nullptr;
+            bool m_jit_enabled = IODICIUM_VM_JIT;
+            JitCompiler m_jit;
+            std::vector<JitFunction> m_jit_functions;
+
+            struct FiberStacks {
+                Value* stack;
+                CallFrame* frames;
+                Value* globals; // Null until a task runs on these stacks
+            };
+            // The containers below are charged to m_arena, as they grow with the run.
+            ChargedVector<Fiber> m_fibers{m_arena}; // Indexed by handle; fiber 0 is the one the run started in
+            uint32_t m_fiber = 0;          // The running fiber, whose call stack is m_frames
+            size_t m_fiber_stack_size = 0; // Operand stack entries of every fiber but the first
+            size_t m_fiber_frame_count = 0;
+            ChargedVector<FiberStacks> m_free_fiber_stacks{m_arena}; // Left by fibers that have returned
+            ChargedVector<uint32_t> m_free_fibers{m_arena}; // Records of fibers that have returned, to reuse
+
+            // Makes 'state', on the call stack at m_frames, the only fiber.
+            void startFiber(const ExecutionState& state);
+            void switchFiber(ExecutionState& state, uint32_t fiber);
+            FiberStacks takeFiberStacks();
+            // Stores 'fiber' in a free record, or a new one, and returns its index.
+            uint32_t addFiber(Fiber fiber);
+
+            Value m_result; // What the run's first function returned
+            bool m_tracing = false; // The run uses TracingInstrumentation, and so must its task threads
+            bool m_task_threads_allowed = true;
+            size_t m_task_threads = 0;
+            std::unique_ptr<TaskScheduler> m_task_scheduler; // Started by the first spawn of a run on this VM
+            TaskScheduler* m_scheduler = nullptr; // The scheduler this VM's tasks go to, its own or its owner's
+            size_t m_worker = 0;                  // This VM's worker index in m_scheduler
+            ChargedVector<Value> m_snapshot_source{m_arena}; // The globals m_snapshot was taken from
+            std::shared_ptr<const std::vector<PortableValue>> m_snapshot; // Globals for tasks spawned here, charged to m_arena
+
+            PortableValue toPortable(const Value& value) const;
+            Value fromPortable(const PortableValue& value);
+            // Fails the tasks this VM's fibers were running for joins when a run ends with 'error'.
+            void failTaskFibers(const std::string& error);
+            void stopTasks();
+
+            ExecutionState m_start; // The registers prepare() set up for the last run
+            bool m_call_marked = false;
+            Arena::Mark m_call_mark;           // Where the arena stood before the last call
+            Arena::Mark m_call_strings_mark;   // And the strings; a collection during the call clears m_call_marked
+            ChargedVector<Value> m_call_globals{m_arena}; // The globals as they were then
+
+            // Sets m_collect_at from the bytes of strings 'live' after a collection.
+            void scheduleCollection(size_t live);
+
+            ExecutionState prepare(Program& program);
+            // Runs 'state' to its end under the instrumentation m_tracing selects.
+            void execute(Program& program, ExecutionState& state);
 
-            // Helper methods
-            void push(const std::string& value);
-            std::string pop();
+            // The interpreter loop, specialized per instrumentation policy (see vm/instrumentation.h).
+            template <typename Instrumentation>
+            void execute(Program& program, ExecutionState& state, Instrumentation& instrumentation);
         };
 
     }
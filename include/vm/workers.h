@@ -0,0 +1,50 @@
+#ifndef IODICIUM_VM_WORKERS_H
+#define IODICIUM_VM_WORKERS_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "common/logger.h"
+#include "vm/loader.h"
+#include "vm/vm.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        // Runs one program for many jobs at once (run --workers). Each worker
+        // thread owns a VirtualMachine, and with it its own stacks, globals,
+        // strings and JIT code; the decoded program is shared and only read.
+        // Workers take the next job as they finish one, so uneven jobs
+        // still keep every thread busy.
+        //
+        // A job is a run of the whole program, with the job() native
+        // returning the job's text. Each worker writes its output as its
+        // run flushes it, so jobs that write more than the output buffer
+        // holds may interleave with one another.
+        class WorkerPool {
+        public:
+            // Called on each worker's VirtualMachine before its first job.
+            using Configure = std::function<void(VirtualMachine&)>;
+
+            WorkerPool(Common::Logger& logger, Program& program, size_t workers, size_t memory_limit = 0);
+
+            void setConfigure(Configure configure) { m_configure = std::move(configure); }
+
+            // Runs every job and returns once all have finished. A job that
+            // fails is reported on standard error, and the others still run.
+            // Returns the number of jobs that failed.
+            size_t run(const std::vector<std::string>& jobs);
+
+        private:
+            Common::Logger& m_logger;
+            Program& m_program;
+            size_t m_workers;
+            size_t m_memory_limit; // Per worker
+            Configure m_configure;
+        };
+
+    }
+}
+
+#endif //IODICIUM_VM_WORKERS_H
@@ -0,0 +1,133 @@
+#include "iodicium.h"
+#include <exception>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "common/logger.h"
+#include "vm/library.h"
+#include "vm/vm.h"
+
+using namespace Iodicium;
+
+struct IodFunction {
+    const VM::ExportedFunction* exported; // Owned by the image's library
+};
+
+struct IodImage {
+    mutable Common::Logger logger;
+    VM::Library library;
+    std::map<std::string, IodFunction, std::less<>> functions;
+
+    explicit IodImage(const char* path) : library(logger, path) {
+        for (const auto& [name, exported] : library.getFunctions()) functions.emplace(name, IodFunction{&exported});
+    }
+};
+
+struct IodContext {
+    const IodImage* image;
+    VM::VirtualMachine vm;
+    std::vector<VM::PortableValue> args; // Kept from call to call, so that their strings keep their capacity
+
+    IodContext(const IodImage* image, size_t memory_limit) : image(image), vm(image->logger, memory_limit) {}
+};
+
+namespace {
+
+    thread_local std::string t_error;
+
+    IodStatus fail(std::string message) {
+        t_error = std::move(message);
+        return IOD_ERROR;
+    }
+
+}
+
+extern "C" {
+
+int iod_api_version(void) {
+    return IODICIUM_API_VERSION;
+}
+
+const char* iod_error(void) {
+    return t_error.c_str();
+}
+
+IodStatus iod_image_load(const char* path, IodImage** image) {
+    try {
+        *image = new IodImage(path);
+        return IOD_OK;
+    } catch (const std::exception& e) {
+        return fail(e.what());
+    }
+}
+
+void iod_image_free(IodImage* image) {
+    delete image;
+}
+
+const IodFunction* iod_image_find(const IodImage* image, const char* name) {
+    auto it = image->functions.find(std::string_view(name));
+    return it != image->functions.end() ? &it->second : nullptr;
+}
+
+size_t iod_function_arity(const IodFunction* function) {
+    return function->exported->parameters.size();
+}
+
+IodStatus iod_context_new(const IodImage* image, size_t memory_limit, IodContext** context) {
+    try {
+        auto created = std::make_unique<IodContext>(image, memory_limit);
+        created->vm.run(image->library.getProgram());
+        *context = created.release();
+        return IOD_OK;
+    } catch (const std::exception& e) {
+        return fail(e.what());
+    }
+}
+
+void iod_context_free(IodContext* context) {
+    delete context;
+}
+
+IodStatus iod_call(IodContext* context, const IodFunction* handle, const IodValue* args, size_t argc, IodValue* result) {
+    const VM::ExportedFunction* function = handle->exported;
+    context->args.resize(argc);
+    for (size_t i = 0; i < argc; i++) {
+        const IodValue& arg = args[i];
+        VM::PortableValue& value = context->args[i];
+        switch (arg.type) {
+            case IOD_NIL: value.value = VM::Value(); break;
+            case IOD_BOOL: value.value = VM::Value::fromBool(arg.as.boolean != 0); break;
+            case IOD_INT: value.value = VM::Value::fromInt(arg.as.integer); break;
+            case IOD_DOUBLE: value.value = VM::Value::fromDouble(arg.as.number); break;
+            case IOD_STRING:
+                value.value = VM::Value::fromString(nullptr);
+                value.text.assign(arg.as.string.chars, arg.as.string.length);
+                break;
+            default: return fail("Argument " + std::to_string(i + 1) + " of '" + function->name + "' is not an IodValue.");
+        }
+    }
+
+    try {
+        VM::Library::checkArguments(*function, context->args.data(), argc);
+        VM::Value value = context->vm.call(function->entry, context->args.data(), argc);
+        if (!result) return IOD_OK;
+        switch (value.type) {
+            case VM::ValueType::NIL: *result = iod_nil(); break;
+            case VM::ValueType::BOOL: *result = iod_bool(value.as.boolean); break;
+            case VM::ValueType::INT: *result = iod_int(value.as.integer); break;
+            case VM::ValueType::DOUBLE: *result = iod_double(value.as.number); break;
+            case VM::ValueType::STRING:
+                result->type = IOD_STRING;
+                result->as.string.chars = context->vm.flatten(value.as.string);
+                result->as.string.length = value.as.string->length;
+                break;
+        }
+        return IOD_OK;
+    } catch (const std::exception& e) {
+        return fail(e.what());
+    }
+}
+
+}
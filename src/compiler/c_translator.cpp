@@ -0,0 +1,649 @@
+#include "compiler/c_translator.h"
+#include "compiler/codegen.h"
+#include "compiler/rewriter.h"
+#include "common/opcode.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <sstream>
+#include <vector>
+
+namespace Iodicium {
+    namespace Compiler {
+
+        namespace {
+
+            // Written out as CTranslator::RUNTIME_HEADER. Everything here
+            // mirrors the VM: the value layout, the untyped arithmetic in
+            // vm/opc/arithmetic.h, VirtualMachine::convert and the error messages.
+            const char* const RUNTIME_SOURCE = R"IODC(/* Runtime support for C translated from Iodicium bytecode by `iodicium compile --emit=c`. */
+#ifndef IODICIUM_RUNTIME_H
+#define IODICIUM_RUNTIME_H
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum { IOD_NIL, IOD_BOOL, IOD_INT, IOD_DOUBLE, IOD_STRING } iod_type;
+
+typedef struct {
+    iod_type type;
+    union {
+        int boolean;
+        int64_t integer;
+        double number;
+        const char* string;
+    } as;
+} iod_value;
+
+/* Conversion targets of OP_CONVERT. */
+enum { IOD_CONVERT_INT = 3, IOD_CONVERT_DOUBLE = 4, IOD_CONVERT_STRING = 5 };
+
+/* Every call cycle recurses until the stack runs out, as the language has no
+   branches. Functions on one count their depth to fail like the VM does. */
+#define IOD_MAX_DEPTH 10000
+
+static inline void iod_fail(const char* message) {
+    fflush(stdout);
+    fprintf(stderr, "Error: %s\n", message);
+    exit(1);
+}
+
+static inline void iod_fail_with(const char* before, const char* text, const char* after) {
+    fflush(stdout);
+    fprintf(stderr, "Error: %s%s%s\n", before, text, after);
+    exit(1);
+}
+
+/* Strings live until the program exits, like the VM's. */
+static inline char* iod_alloc(size_t size) {
+    char* memory = (char*)malloc(size);
+    if (!memory) iod_fail("Out of memory.");
+    return memory;
+}
+
+static inline iod_value iod_nil(void) { iod_value v; v.type = IOD_NIL; v.as.integer = 0; return v; }
+static inline iod_value iod_int(int64_t i) { iod_value v; v.type = IOD_INT; v.as.integer = i; return v; }
+static inline iod_value iod_double(double d) { iod_value v; v.type = IOD_DOUBLE; v.as.number = d; return v; }
+static inline iod_value iod_string(const char* s) { iod_value v; v.type = IOD_STRING; v.as.string = s; return v; }
+
+static inline int iod_is_number(iod_value v) { return v.type == IOD_INT || v.type == IOD_DOUBLE; }
+static inline double iod_as_number(iod_value v) { return v.type == IOD_INT ? (double)v.as.integer : v.as.number; }
+
+static inline const char* iod_to_string(iod_value v) {
+    int length;
+    char* text;
+    switch (v.type) {
+        case IOD_BOOL: return v.as.boolean ? "true" : "false";
+        case IOD_STRING: return v.as.string;
+        case IOD_INT:
+            length = snprintf(NULL, 0, "%" PRId64, v.as.integer);
+            text = iod_alloc((size_t)length + 1);
+            snprintf(text, (size_t)length + 1, "%" PRId64, v.as.integer);
+            return text;
+        case IOD_DOUBLE:
+            length = snprintf(NULL, 0, "%f", v.as.number);
+            text = iod_alloc((size_t)length + 1);
+            snprintf(text, (size_t)length + 1, "%f", v.as.number);
+            return text;
+        default: return "";
+    }
+}
+
+static inline void iod_write(FILE* out, iod_value v) {
+    switch (v.type) {
+        case IOD_INT: fprintf(out, "%" PRId64, v.as.integer); break;
+        case IOD_DOUBLE: fprintf(out, "%f", v.as.number); break;
+        default: fputs(iod_to_string(v), out); break;
+    }
+}
+
+/* Int arithmetic wraps on overflow rather than invoking undefined behaviour. */
+static inline int64_t iod_add_int(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static inline int64_t iod_subtract_int(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static inline int64_t iod_multiply_int(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+static inline int64_t iod_divide_int(int64_t a, int64_t b) {
+    if (b == 0) iod_fail("Integer division by zero.");
+    if (b == -1) return iod_subtract_int(0, a);
+    return a / b;
+}
+
+static inline iod_value iod_concat(iod_value a, iod_value b) {
+    const char* left = iod_to_string(a);
+    const char* right = iod_to_string(b);
+    size_t left_length = strlen(left), right_length = strlen(right);
+    char* text = iod_alloc(left_length + right_length + 1);
+    memcpy(text, left, left_length);
+    memcpy(text + left_length, right, right_length + 1);
+    return iod_string(text);
+}
+
+/* OP_CONCAT_N: joins 'count' values into one string sized up front. */
+static inline iod_value iod_concat_n(const iod_value* values, size_t count) {
+    const char* pieces[255];
+    size_t lengths[255];
+    size_t length = 0, i;
+    char* text;
+    for (i = 0; i < count; i++) {
+        pieces[i] = iod_to_string(values[i]);
+        lengths[i] = strlen(pieces[i]);
+        length += lengths[i];
+    }
+    text = iod_alloc(length + 1);
+    for (length = 0, i = 0; i < count; i++) {
+        memcpy(text + length, pieces[i], lengths[i]);
+        length += lengths[i];
+    }
+    text[length] = '\0';
+    return iod_string(text);
+}
+
+/* Untyped arithmetic inspects the operand tags, as OP_ADD..OP_DIVIDE do. */
+static inline iod_value iod_add(iod_value a, iod_value b) {
+    if (a.type == IOD_INT && b.type == IOD_INT) return iod_int(iod_add_int(a.as.integer, b.as.integer));
+    if (iod_is_number(a) && iod_is_number(b)) return iod_double(iod_as_number(a) + iod_as_number(b));
+    return iod_concat(a, b);
+}
+
+static inline void iod_check_numbers(iod_value a, iod_value b) {
+    if (!iod_is_number(a) || !iod_is_number(b)) iod_fail("Operands must be numbers.");
+}
+
+static inline iod_value iod_subtract(iod_value a, iod_value b) {
+    iod_check_numbers(a, b);
+    if (a.type == IOD_INT && b.type == IOD_INT) return iod_int(iod_subtract_int(a.as.integer, b.as.integer));
+    return iod_double(iod_as_number(a) - iod_as_number(b));
+}
+
+static inline iod_value iod_multiply(iod_value a, iod_value b) {
+    iod_check_numbers(a, b);
+    if (a.type == IOD_INT && b.type == IOD_INT) return iod_int(iod_multiply_int(a.as.integer, b.as.integer));
+    return iod_double(iod_as_number(a) * iod_as_number(b));
+}
+
+static inline iod_value iod_divide(iod_value a, iod_value b) {
+    iod_check_numbers(a, b);
+    if (a.type == IOD_INT && b.type == IOD_INT) return iod_int(iod_divide_int(a.as.integer, b.as.integer));
+    return iod_double(iod_as_number(a) / iod_as_number(b));
+}
+
+/* Parse the whole of 'text' as an integer or a decimal number. */
+static inline int iod_parse_int(const char* text, int64_t* out) {
+    char* end;
+    long long parsed;
+    if (!*text) return 0;
+    errno = 0;
+    parsed = strtoll(text, &end, 10);
+    if (errno != 0 || *end != '\0') return 0;
+    *out = (int64_t)parsed;
+    return 1;
+}
+
+static inline int iod_parse_double(const char* text, double* out) {
+    char* end;
+    double parsed;
+    if (!*text) return 0;
+    parsed = strtod(text, &end);
+    if (*end != '\0') return 0;
+    *out = parsed;
+    return 1;
+}
+
+static inline iod_value iod_convert(iod_value v, int target) {
+    int64_t int_value;
+    double double_value;
+    switch (target) {
+        case IOD_CONVERT_INT:
+            if (v.type == IOD_INT) return v;
+            if (v.type == IOD_DOUBLE) return iod_int((int64_t)v.as.number);
+            if (v.type == IOD_STRING && iod_parse_int(v.as.string, &int_value)) return iod_int(int_value);
+            if (v.type == IOD_STRING && iod_parse_double(v.as.string, &double_value)) return iod_int((int64_t)double_value);
+            break;
+        case IOD_CONVERT_DOUBLE:
+            if (iod_is_number(v)) return iod_double(iod_as_number(v));
+            if (v.type == IOD_STRING && iod_parse_double(v.as.string, &double_value)) return iod_double(double_value);
+            break;
+        case IOD_CONVERT_STRING:
+            return v.type == IOD_STRING ? v : iod_string(iod_to_string(v));
+        default:
+            iod_fail("Unsupported conversion type requested in VM.");
+    }
+    iod_fail_with("Cannot convert '", iod_to_string(v), "' to the requested numeric type.");
+    return v;
+}
+
+#endif /* IODICIUM_RUNTIME_H */
+)IODC";
+
+            // The top-level code or one function of the program.
+            struct Function {
+                size_t origin;      // Offset of the entry instruction
+                size_t first;       // Index of the entry instruction
+                size_t end;         // One past the last instruction that can run
+                int argc = -1;      // Argument count at every call site; 0 for the top-level code
+                std::set<size_t> callees; // Indices into the function list
+                bool reachable = false;
+                bool recursive = false;
+                std::string symbol;
+            };
+
+            uint16_t readShort(const std::vector<uint8_t>& operands, size_t at) {
+                return static_cast<uint16_t>((operands[at] << 8) | operands[at + 1]);
+            }
+
+            bool isIdentifier(const std::string& name) {
+                if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) return false;
+                for (char c : name) {
+                    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+                }
+                return true;
+            }
+
+            std::string quote(const std::string& text) {
+                std::string quoted = "\"";
+                for (unsigned char c : text) {
+                    if (c == '"' || c == '\\') {
+                        quoted += '\\';
+                        quoted += static_cast<char>(c);
+                    } else if (c >= 0x20 && c < 0x7F && c != '?') {
+                        quoted += static_cast<char>(c);
+                    } else {
+                        char escaped[5];
+                        std::snprintf(escaped, sizeof(escaped), "\\%03o", c);
+                        quoted += escaped;
+                    }
+                }
+                return quoted + "\"";
+            }
+
+            // The value the Loader makes of a constant pool entry, as a C expression.
+            std::string constantExpression(const Executable::Constant& constant) {
+                switch (constant.type) {
+                    case Executable::Constant::INT:
+                        if (constant.integer == INT64_MIN) return "iod_int(INT64_MIN)";
+                        return "iod_int(INT64_C(" + std::to_string(constant.integer) + "))";
+                    case Executable::Constant::DOUBLE: {
+                        if (std::isnan(constant.number)) return "iod_double(NAN)";
+                        if (std::isinf(constant.number)) return constant.number > 0 ? "iod_double(HUGE_VAL)" : "iod_double(-HUGE_VAL)";
+                        char hex[64];
+                        std::snprintf(hex, sizeof(hex), "%a", constant.number);
+                        return std::string("iod_double(") + hex + ")";
+                    }
+                    default:
+                        return "iod_string(" + quote(constant.text) + ")";
+                }
+            }
+
+        }
+
+        CTranslator::CTranslator(Common::Logger& logger) : m_logger(logger) {}
+
+        std::string CTranslator::translate(const Executable::Chunk& chunk, const std::map<std::string, size_t>& function_ips) {
+            if (chunk.isa != ISA_STACK) {
+                throw BytecodeCompilerError("C translation supports stack code only; compile without --isa=register.");
+            }
+            BytecodeRewriter rewriter(chunk.code, function_ips);
+            const std::vector<BytecodeRewriter::Instruction>& code = rewriter.getInstructions();
+            if (code.empty()) {
+                throw BytecodeCompilerError("Cannot translate an empty program.");
+            }
+
+            std::map<size_t, std::string> names;
+            for (const auto& [name, address] : function_ips) names[address] = name;
+
+            // Split the code at function entries. Only the instructions up to a
+            // function's first return can run; the rest is never translated.
+            std::vector<Function> functions;
+            std::map<size_t, size_t> function_at; // Entry offset -> index into 'functions'
+            for (size_t i = 0; i < code.size(); i++) {
+                if (i > 0 && !rewriter.isEntry(code[i].origin)) continue;
+                Function function;
+                function.origin = code[i].origin;
+                function.first = i;
+                function.end = i;
+                while (function.end < code.size() && (function.end == i || !rewriter.isEntry(code[function.end].origin))) {
+                    uint8_t opcode = code[function.end++].opcode;
+                    if (isReturn(opcode)) break;
+                }
+                auto name = names.find(function.origin);
+                if (function.origin == 0) function.symbol = "iod_main";
+                else if (name != names.end() && isIdentifier(name->second)) function.symbol = "iod_fn_" + name->second;
+                else function.symbol = "iod_fn_" + std::to_string(function.origin);
+                function_at[function.origin] = functions.size();
+                functions.push_back(std::move(function));
+            }
+            functions[0].argc = 0;
+
+            for (auto& function : functions) {
+                for (size_t i = function.first; i < function.end; i++) {
+                    int address_at = getCallAddressOperand(code[i].opcode);
+                    if (address_at < 0) continue;
+                    size_t target = readShort(code[i].operands, address_at);
+                    int argc = code[i].operands[address_at - 1];
+                    auto callee = function_at.find(target);
+                    if (callee == function_at.end() || callee->second == 0) {
+                        throw BytecodeCompilerError("Cannot translate the call at offset " + std::to_string(code[i].origin) + ": it does not target a function.");
+                    }
+                    Function& target_function = functions[callee->second];
+                    if (target_function.argc >= 0 && target_function.argc != argc) {
+                        throw BytecodeCompilerError("Cannot translate function '" + target_function.symbol + "': it is called with both " +
+                                                    std::to_string(target_function.argc) + " and " + std::to_string(argc) + " arguments.");
+                    }
+                    target_function.argc = argc;
+                    function.callees.insert(callee->second);
+                }
+            }
+
+            // Only functions the top-level code can reach are translated.
+            std::vector<size_t> pending = {0};
+            functions[0].reachable = true;
+            while (!pending.empty()) {
+                size_t index = pending.back();
+                pending.pop_back();
+                for (size_t callee : functions[index].callees) {
+                    if (!functions[callee].reachable) {
+                        functions[callee].reachable = true;
+                        pending.push_back(callee);
+                    }
+                }
+            }
+            for (size_t index = 0; index < functions.size(); index++) {
+                std::set<size_t> seen;
+                std::vector<size_t> stack(functions[index].callees.begin(), functions[index].callees.end());
+                while (!stack.empty() && !functions[index].recursive) {
+                    size_t callee = stack.back();
+                    stack.pop_back();
+                    if (callee == index) functions[index].recursive = true;
+                    if (!seen.insert(callee).second) continue;
+                    stack.insert(stack.end(), functions[callee].callees.begin(), functions[callee].callees.end());
+                }
+            }
+
+            auto signature = [&](const Function& function) {
+                std::string parameters;
+                for (int i = 0; i < function.argc; i++) {
+                    parameters += (i > 0 ? ", " : "") + std::string("iod_value v") + std::to_string(i);
+                }
+                return "static iod_value " + function.symbol + "(" + (parameters.empty() ? "void" : parameters) + ")";
+            };
+
+            std::ostringstream out;
+            out << "/* Translated from Iodicium bytecode by `iodicium compile --emit=c`. */\n";
+            out << "#include \"" << RUNTIME_HEADER << "\"\n\n";
+
+            if (chunk.global_count > 0) {
+                out << "static iod_value iod_globals[" << chunk.global_count << "];\n\n";
+                out << "static void iod_undefined_global(unsigned slot) {\n";
+                if (chunk.global_names.size() == chunk.global_count) {
+                    out << "    static const char* const names[] = {";
+                    for (size_t i = 0; i < chunk.global_names.size(); i++) out << (i > 0 ? ", " : "") << quote(chunk.global_names[i]);
+                    out << "};\n";
+                    out << "    iod_fail_with(\"Undefined global variable '\", names[slot], \"'.\");\n";
+                } else {
+                    out << "    char slot_text[16];\n";
+                    out << "    snprintf(slot_text, sizeof(slot_text), \"%u\", slot);\n";
+                    out << "    iod_fail_with(\"Undefined global variable in slot \", slot_text, \".\");\n";
+                }
+                out << "}\n\n";
+            }
+
+            bool recursive = false;
+            for (const auto& function : functions) {
+                if (function.reachable && function.origin != 0) out << signature(function) << ";\n";
+                recursive = recursive || (function.reachable && function.recursive);
+            }
+            out << "\n";
+            if (recursive) out << "static unsigned iod_depth;\n\n";
+
+            size_t translated = 0;
+            for (const auto& function : functions) {
+                if (!function.reachable) continue;
+                translated++;
+
+                // Every instruction has a fixed stack depth, so each stack slot
+                // becomes a local variable v<slot> and each instruction a
+                // statement on them; v0..v<argc-1> are the parameters. Separate
+                // variables, unlike an array, are kept in registers by the C compiler.
+                std::ostringstream body;
+                size_t depth = static_cast<size_t>(function.argc);
+                size_t max_depth = depth;
+                bool returned = false;
+
+                auto fail = [&](size_t origin, const std::string& message) {
+                    throw BytecodeCompilerError("Cannot translate the instruction at offset " + std::to_string(origin) + ": " + message);
+                };
+                auto v = [](size_t index) { return "v" + std::to_string(index); };
+
+                std::function<void(size_t, uint8_t, const uint8_t*)> emit = [&](size_t origin, uint8_t opcode, const uint8_t* operands) {
+                    auto pop = [&](size_t count) {
+                        if (depth < count) fail(origin, "the stack underflows.");
+                        depth -= count;
+                    };
+                    auto push = [&]() {
+                        size_t slot = depth++;
+                        if (depth > max_depth) max_depth = depth;
+                        return v(slot);
+                    };
+                    auto local = [&](uint8_t slot) {
+                        if (slot >= depth) fail(origin, "local slot " + std::to_string(slot) + " is above the stack.");
+                        return v(slot);
+                    };
+                    auto global = [&](size_t at) {
+                        uint16_t slot = static_cast<uint16_t>((operands[at] << 8) | operands[at + 1]);
+                        if (slot >= chunk.global_count) fail(origin, "global slot " + std::to_string(slot) + " is out of range.");
+                        return std::to_string(slot);
+                    };
+                    auto binary = [&](const std::string& function_name) {
+                        pop(1);
+                        body << "    " << v(depth - 1) << " = " << function_name << "(" << v(depth - 1) << ", " << v(depth) << ");\n";
+                    };
+                    // Typed forms work on the payloads; the result keeps the left operand's tag.
+                    auto integer = [&](const std::string& function_name) {
+                        pop(1);
+                        std::string a = v(depth - 1) + ".as.integer", b = v(depth) + ".as.integer";
+                        body << "    " << a << " = " << function_name << "(" << a << ", " << b << ");\n";
+                    };
+                    auto number = [&](const char* assignment) {
+                        pop(1);
+                        body << "    " << v(depth - 1) << ".as.number " << assignment << " " << v(depth) << ".as.number;\n";
+                    };
+
+                    switch (opcode) {
+                        case OP_RETURN: {
+                            pop(1);
+                            if (function.recursive) body << "    iod_depth--;\n";
+                            body << "    return " << v(depth) << ";\n";
+                            returned = true;
+                            break;
+                        }
+                        case OP_CALL: {
+                            uint8_t argc = operands[0];
+                            const Function& callee = functions[function_at.at(static_cast<size_t>((operands[1] << 8) | operands[2]))];
+                            pop(argc);
+                            std::string arguments;
+                            for (size_t i = 0; i < argc; i++) arguments += (i > 0 ? ", " : "") + v(depth + i);
+                            std::string result = push();
+                            body << "    " << result << " = " << callee.symbol << "(" << arguments << ");\n";
+                            break;
+                        }
+                        case OP_TAIL_CALL: {
+                            // Written as a return of the call, which C compilers turn into a jump.
+                            uint8_t argc = operands[0];
+                            const Function& callee = functions[function_at.at(static_cast<size_t>((operands[1] << 8) | operands[2]))];
+                            pop(argc);
+                            std::string arguments;
+                            for (size_t i = 0; i < argc; i++) arguments += (i > 0 ? ", " : "") + v(depth + i);
+                            if (function.recursive) body << "    iod_depth--;\n";
+                            body << "    return " << callee.symbol << "(" << arguments << ");\n";
+                            returned = true;
+                            break;
+                        }
+                        case OP_CONST: {
+                            if (operands[0] >= chunk.constants.size()) fail(origin, "constant " + std::to_string(operands[0]) + " is out of range.");
+                            body << "    " << push() << " = " << constantExpression(chunk.constants[operands[0]]) << ";\n";
+                            break;
+                        }
+                        case OP_WRITE_OUT:
+                            pop(1);
+                            body << "    iod_write(stdout, " << v(depth) << ");\n";
+                            break;
+                        case OP_WRITE_ERR:
+                            // Standard output still buffered goes out first, as the VM does.
+                            pop(1);
+                            body << "    fflush(stdout);\n    iod_write(stderr, " << v(depth) << ");\n";
+                            break;
+                        case OP_FLUSH:
+                            body << "    fflush(stdout);\n    fflush(stderr);\n";
+                            break;
+                        case OP_ADD: binary("iod_add"); break;
+                        case OP_SUBTRACT: binary("iod_subtract"); break;
+                        case OP_MULTIPLY: binary("iod_multiply"); break;
+                        case OP_DIVIDE: binary("iod_divide"); break;
+                        case OP_CONCAT: binary("iod_concat"); break;
+                        case OP_CONCAT_N: {
+                            uint8_t count = operands[0];
+                            if (count < 2) fail(origin, "OP_CONCAT_N needs at least two operands.");
+                            pop(count);
+                            std::string pieces;
+                            for (size_t i = 0; i < count; i++) pieces += (i > 0 ? ", " : "") + v(depth + i);
+                            body << "    { const iod_value pieces[] = {" << pieces << "}; " << v(depth) << " = iod_concat_n(pieces, " << static_cast<int>(count) << "); }\n";
+                            push();
+                            break;
+                        }
+                        case OP_POP:
+                            pop(1);
+                            break;
+                        case OP_SLIDE: {
+                            pop(operands[0] + 1);
+                            body << "    " << v(depth) << " = " << v(depth + operands[0]) << ";\n";
+                            push();
+                            break;
+                        }
+                        case OP_DEFINE_GLOBAL: {
+                            std::string slot = global(0);
+                            pop(1);
+                            body << "    iod_globals[" << slot << "] = " << v(depth) << ";\n";
+                            break;
+                        }
+                        case OP_GET_GLOBAL: {
+                            std::string slot = global(0);
+                            body << "    if (iod_globals[" << slot << "].type == IOD_NIL) iod_undefined_global(" << slot << ");\n";
+                            body << "    " << push() << " = iod_globals[" << slot << "];\n";
+                            break;
+                        }
+                        case OP_SET_GLOBAL: {
+                            std::string slot = global(0);
+                            if (depth == 0) fail(origin, "the stack underflows.");
+                            body << "    if (iod_globals[" << slot << "].type == IOD_NIL) iod_undefined_global(" << slot << ");\n";
+                            body << "    iod_globals[" << slot << "] = " << v(depth - 1) << ";\n";
+                            break;
+                        }
+                        case OP_GET_LOCAL: {
+                            std::string source = local(operands[0]);
+                            body << "    " << push() << " = " << source << ";\n";
+                            break;
+                        }
+                        case OP_SET_LOCAL: {
+                            if (depth == 0) fail(origin, "the stack underflows.");
+                            body << "    " << local(operands[0]) << " = " << v(depth - 1) << ";\n";
+                            break;
+                        }
+                        case OP_CONVERT:
+                            if (depth == 0) fail(origin, "the stack underflows.");
+                            body << "    " << v(depth - 1) << " = iod_convert(" << v(depth - 1) << ", " << static_cast<int>(operands[0]) << ");\n";
+                            break;
+                        case OP_ADD_INT: integer("iod_add_int"); break;
+                        case OP_SUBTRACT_INT: integer("iod_subtract_int"); break;
+                        case OP_MULTIPLY_INT: integer("iod_multiply_int"); break;
+                        case OP_DIVIDE_INT: integer("iod_divide_int"); break;
+                        case OP_ADD_DOUBLE: number("+="); break;
+                        case OP_SUBTRACT_DOUBLE: number("-="); break;
+                        case OP_MULTIPLY_DOUBLE: number("*="); break;
+                        case OP_DIVIDE_DOUBLE: number("/="); break;
+                        // Superinstructions are translated as the sequences they replace.
+                        case OP_GET_LOCAL_2: {
+                            emit(origin, OP_GET_LOCAL, operands);
+                            emit(origin, OP_GET_LOCAL, operands + 1);
+                            break;
+                        }
+                        case OP_GET_LOCAL_CONST: {
+                            emit(origin, OP_GET_LOCAL, operands);
+                            emit(origin, OP_CONST, operands + 1);
+                            break;
+                        }
+                        case OP_GET_LOCAL_CALL: {
+                            emit(origin, OP_GET_LOCAL, operands);
+                            emit(origin, OP_CALL, operands + 1);
+                            break;
+                        }
+                        case OP_ADD_INT_RETURN: {
+                            emit(origin, OP_ADD_INT, operands);
+                            emit(origin, OP_RETURN, operands);
+                            break;
+                        }
+                        case OP_CALL_NATIVE: {
+                            const std::string name = operands[1] < chunk.constants.size() ? chunk.constants[operands[1]].text : "?";
+                            fail(origin, "the native function '" + name + "' is only available in the VM.");
+                            break;
+                        }
+                        case OP_FIBER:
+                        case OP_RESUME:
+                        case OP_YIELD:
+                            fail(origin, "fibers are only available in the VM.");
+                            break;
+                        case OP_SPAWN:
+                        case OP_JOIN:
+                            fail(origin, "tasks are only available in the VM.");
+                            break;
+                        default:
+                            fail(origin, "opcode " + std::to_string(opcode) + " has no C translation.");
+                    }
+                };
+
+                for (size_t i = function.first; i < function.end; i++) {
+                    emit(code[i].origin, code[i].opcode, code[i].operands.data());
+                }
+                if (!returned) {
+                    throw BytecodeCompilerError("Cannot translate function '" + function.symbol + "': it does not end in a return.");
+                }
+
+                out << "/* " << (function.origin == 0 ? std::string("Top-level code") : "'" + names[function.origin] + "'") << " at offset " << function.origin << " */\n";
+                out << signature(function) << " {\n";
+                if (max_depth > static_cast<size_t>(function.argc)) {
+                    out << "    iod_value ";
+                    for (size_t i = function.argc; i < max_depth; i++) out << (i > static_cast<size_t>(function.argc) ? ", " : "") << v(i);
+                    out << ";\n";
+                }
+                if (function.recursive) out << "    if (++iod_depth > IOD_MAX_DEPTH) iod_fail(\"VM Stack Overflow\");\n";
+                out << body.str() << "}\n\n";
+            }
+
+            out << "int main(void) {\n    iod_main();\n    return 0;\n}\n";
+            m_logger.debug("CTranslator: Translated " + std::to_string(translated) + " of " + std::to_string(functions.size()) + " functions.");
+            return out.str();
+        }
+
+        void CTranslator::writeToFile(const Executable::Chunk& chunk, const std::map<std::string, size_t>& function_ips, const std::string& path) {
+            std::string source = translate(chunk, function_ips);
+
+            size_t separator = path.find_last_of("/\\");
+            std::string header_path = (separator == std::string::npos ? std::string() : path.substr(0, separator + 1)) + RUNTIME_HEADER;
+
+            std::ofstream source_file(path, std::ios::binary);
+            if (!source_file) throw BytecodeCompilerError("Could not open " + path + " for writing.");
+            source_file << source;
+            std::ofstream header_file(header_path, std::ios::binary);
+            if (!header_file) throw BytecodeCompilerError("Could not open " + header_path + " for writing.");
+            header_file << RUNTIME_SOURCE;
+            m_logger.debug("CTranslator: Wrote " + path + " and " + header_path + ".");
+        }
+
+    }
+}
@@ -1,13 +1,34 @@
 #include "compiler/codegen.h"
 #include <stdexcept>
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 
 namespace Iodicium {
     namespace Compiler {
 
         using Executable::Chunk;
 
-        static DataType stringToDataType(const std::string& type_str) {
+        // Builtins and natives are not functions in the image, so they
+        // cannot be tail called.
+        bool BytecodeCompiler::isBuiltin(const std::string& name) const {
+            return findBuiltin(name) || m_analyzer.getNatives().find(name);
+        }
+
+        // A native compiled to its own instruction leaves nothing on the stack
+        // if it returns nothing (writeOut, writeErr and flush); every other
+        // expression, OP_CALL_NATIVE included, leaves its value.
+        bool BytecodeCompiler::leavesValue(const Codeparser::Expr& expr) const {
+            const Codeparser::Expr* inner = &expr;
+            while (auto* grouping = dynamic_cast<const Codeparser::GroupingExpr*>(inner)) inner = grouping->expression.get();
+            auto* call = dynamic_cast<const Codeparser::CallExpr*>(inner);
+            auto* callee = call ? dynamic_cast<const Codeparser::VariableExpr*>(call->callee.get()) : nullptr;
+            if (!callee) return true;
+            const VM::Native* native = m_analyzer.getNatives().find(callee->name.lexeme);
+            return !native || native->instruction == OP_CALL_NATIVE || native->return_type != VM::NIL;
+        }
+
+        DataType BytecodeCompiler::stringToDataType(const std::string& type_str) {
             if (type_str == "String") return DataType::STRING;
             if (type_str == "Int") return DataType::INT;
             if (type_str == "Double") return DataType::DOUBLE;
@@ -22,7 +43,10 @@ namespace Iodicium {
             m_logger.debug("BytecodeCompiler: Starting compilation.");
             m_chunk = Executable::Chunk();
             m_function_ips.clear();
+            m_function_arities.clear();
             m_call_fixups.clear();
+            m_deferred_functions.clear();
+            m_global_slots.clear();
             m_locals.clear();
             m_scope_depth = 0;
 
@@ -30,6 +54,25 @@ namespace Iodicium {
                 statement->accept(*this);
             }
 
+            emitBytes(OP_CONST, makeConstant(""));
+            emitByte(OP_RETURN);
+
+            // Function bodies are laid out after the top-level code so that
+            // executing the script from IP 0 never falls through into them.
+            for (size_t i = 0; i < m_deferred_functions.size(); i++) {
+                compileFunction(*m_deferred_functions[i]);
+            }
+            m_deferred_functions.clear();
+
+            backpatchCalls();
+            finishChunk();
+
+            m_logger.debug("BytecodeCompiler: Finished compilation.");
+            return m_chunk;
+        }
+
+        // Resolves every recorded call site to its callee's address.
+        void BytecodeCompiler::backpatchCalls() {
             m_logger.debug("BytecodeCompiler: Starting backpatching pass.");
             for (const auto& [func_name, offsets] : m_call_fixups) {
                 auto it = m_function_ips.find(func_name);
@@ -41,10 +84,17 @@ namespace Iodicium {
                     patchShort(offset, static_cast<uint16_t>(address));
                 }
             }
+        }
 
-            emitByte(OP_RETURN);
-            m_logger.debug("BytecodeCompiler: Finished compilation.");
-            return m_chunk;
+        // Records the global slot table in the finished chunk.
+        void BytecodeCompiler::finishChunk() {
+            m_chunk.global_count = static_cast<uint32_t>(m_global_slots.size());
+            if (!m_obfuscate_enabled) {
+                m_chunk.global_names.resize(m_global_slots.size());
+                for (const auto& [name, slot] : m_global_slots) {
+                    m_chunk.global_names[slot] = name;
+                }
+            }
         }
 
         void BytecodeCompiler::beginScope() { m_scope_depth++; }
@@ -57,9 +107,14 @@ namespace Iodicium {
         }
 
         void BytecodeCompiler::visit(const Codeparser::FunctionStmt& stmt) {
+            m_deferred_functions.push_back(&stmt);
+        }
+
+        void BytecodeCompiler::compileFunction(const Codeparser::FunctionStmt& stmt) {
             m_logger.debug("BytecodeCompiler: Defining function '" + stmt.name.lexeme + "'.");
             size_t function_ip = m_chunk.code.size();
             m_function_ips[stmt.name.lexeme] = function_ip;
+            m_function_arities[stmt.name.lexeme] = static_cast<uint8_t>(stmt.params.size());
 
             beginScope();
 
@@ -71,7 +126,7 @@ namespace Iodicium {
                 statement->accept(*this);
             }
             
-            emitBytes(OP_CONST, makeConstant(""));
+            emitBytes(OP_CONST, makeZeroConstant(stmt.return_type_expr.get()));
             emitByte(OP_RETURN);
 
             endScope();
@@ -81,7 +136,7 @@ namespace Iodicium {
             if (stmt.initializer) {
                 stmt.initializer->accept(*this);
             } else {
-                emitBytes(OP_CONST, makeConstant(""));
+                emitBytes(OP_CONST, makeZeroConstant(stmt.type_expr.get()));
             }
 
             if (m_scope_depth > 0) {
@@ -89,8 +144,8 @@ namespace Iodicium {
                 return;
             }
 
-            uint8_t name_index = makeConstant(getObfuscatedName(stmt.name.lexeme));
-            emitBytes(OP_DEFINE_GLOBAL, name_index);
+            emitByte(OP_DEFINE_GLOBAL);
+            emitShort(resolveGlobal(stmt.name.lexeme));
         }
 
         int BytecodeCompiler::resolveLocal(const Codeparser::Token& name) {
@@ -102,13 +157,27 @@ namespace Iodicium {
             return -1;
         }
 
+        // Globals live in a flat array in the VM; each name gets the next free slot.
+        uint16_t BytecodeCompiler::resolveGlobal(const std::string& name) {
+            auto it = m_global_slots.find(name);
+            if (it != m_global_slots.end()) {
+                return it->second;
+            }
+            if (m_global_slots.size() > UINT16_MAX) {
+                throw BytecodeCompilerError("Too many global variables.");
+            }
+            uint16_t slot = static_cast<uint16_t>(m_global_slots.size());
+            m_global_slots[name] = slot;
+            return slot;
+        }
+
         void BytecodeCompiler::visit(const Codeparser::VariableExpr& expr) {
             int local_index = resolveLocal(expr.name);
             if (local_index != -1) {
                 emitBytes(OP_GET_LOCAL, static_cast<uint8_t>(local_index));
             } else {
-                uint8_t name_index = makeConstant(getObfuscatedName(expr.name.lexeme));
-                emitBytes(OP_GET_GLOBAL, name_index);
+                emitByte(OP_GET_GLOBAL);
+                emitShort(resolveGlobal(expr.name.lexeme));
             }
         }
 
@@ -118,62 +187,251 @@ namespace Iodicium {
             if (local_index != -1) {
                 emitBytes(OP_SET_LOCAL, static_cast<uint8_t>(local_index));
             } else {
-                uint8_t name_index = makeConstant(getObfuscatedName(expr.name.lexeme));
-                emitBytes(OP_SET_GLOBAL, name_index);
+                emitByte(OP_SET_GLOBAL);
+                emitShort(resolveGlobal(expr.name.lexeme));
             }
         }
 
         void BytecodeCompiler::visit(const Codeparser::CallExpr& expr) {
+            compileCall(expr);
+            emitTypeCheck(expr);
+        }
+
+        // A result whose type is only known when it runs is checked against
+        // the type the analyzer found its place to declare.
+        void BytecodeCompiler::emitTypeCheck(const Codeparser::Expr& expr) {
+            DataType checked = m_analyzer.getCheckedType(expr);
+            if (checked != DataType::UNKNOWN) emitBytes(OP_CHECK_TYPE, static_cast<uint8_t>(checked));
+        }
+
+        void BytecodeCompiler::compileCall(const Codeparser::CallExpr& expr) {
             if (auto* callee = dynamic_cast<Codeparser::VariableExpr*>(expr.callee.get())) {
-                if (callee->name.lexeme == "writeOut" || callee->name.lexeme == "writeErr") {
-                    expr.arguments[0]->accept(*this);
-                    emitByte(callee->name.lexeme == "writeOut" ? OP_WRITE_OUT : OP_WRITE_ERR);
-                    return;
-                } else if (callee->name.lexeme == "flush") {
-                    emitByte(OP_FLUSH);
+                if (const VM::Native* native = m_analyzer.getNatives().find(callee->name.lexeme)) {
+                    for (const auto& arg : expr.arguments) {
+                        arg->accept(*this);
+                    }
+                    if (native->instruction != OP_CALL_NATIVE) {
+                        emitByte(native->instruction);
+                        return;
+                    }
+                    emitBytes(OP_CALL_NATIVE, static_cast<uint8_t>(expr.arguments.size()));
+                    emitByte(makeConstant(native->name));
                     return;
-                } else if (callee->name.lexeme == "convert") {
-                    expr.arguments[0]->accept(*this);
-                    auto* type_arg = dynamic_cast<Codeparser::VariableExpr*>(expr.arguments[1].get());
-                    if (!type_arg) { throw BytecodeCompilerError("Second arg to convert() must be a type.", expr.token.line, expr.token.column); }
-                    emitBytes(OP_CONVERT, (uint8_t)stringToDataType(type_arg->name.lexeme));
+                } else if (const Builtin* builtin = findBuiltin(callee->name.lexeme)) {
+                    switch (builtin->kind) {
+                        case Builtin::CONVERT: {
+                            expr.arguments[0]->accept(*this);
+                            auto* type_arg = dynamic_cast<Codeparser::VariableExpr*>(expr.arguments[1].get());
+                            if (!type_arg) { throw BytecodeCompilerError("Second arg to convert() must be a type.", expr.token.line, expr.token.column); }
+                            emitBytes(OP_CONVERT, (uint8_t)stringToDataType(type_arg->name.lexeme));
+                            break;
+                        }
+                        case Builtin::START:
+                            // The arguments after the function are those it is called with.
+                            for (size_t i = 1; i < expr.arguments.size(); i++) {
+                                expr.arguments[i]->accept(*this);
+                            }
+                            emitBytes(builtin->instruction, static_cast<uint8_t>(expr.arguments.size() - 1));
+                            emitAddress(static_cast<Codeparser::VariableExpr&>(*expr.arguments[0]).name.lexeme);
+                            break;
+                        case Builtin::UNARY:
+                            expr.arguments[0]->accept(*this);
+                            emitByte(builtin->instruction);
+                            break;
+                    }
                     return;
                 }
 
-                for (const auto& arg : expr.arguments) {
-                    arg->accept(*this);
+                emitCall(expr, callee->name.lexeme, OP_CALL);
+                return;
+            }
+            throw BytecodeCompilerError("Invalid callee expression.", expr.callee->token.line, expr.callee->token.column);
+        }
+
+        void BytecodeCompiler::emitCall(const Codeparser::CallExpr& expr, const std::string& callee, uint8_t opcode) {
+            for (const auto& arg : expr.arguments) {
+                arg->accept(*this);
+            }
+
+            emitByte(opcode);
+            emitByte(static_cast<uint8_t>(expr.arguments.size()));
+            emitAddress(callee);
+        }
+
+        void BytecodeCompiler::emitAddress(const std::string& function) {
+            auto it = m_function_ips.find(function);
+            if (it != m_function_ips.end()) {
+                emitShort(static_cast<uint16_t>(it->second));
+            } else {
+                size_t offset = m_chunk.code.size();
+                emitShort(0xFFFF);
+                m_call_fixups[function].push_back(offset);
+            }
+        }
+
+        void BytecodeCompiler::visit(const Codeparser::BinaryExpr& expr) {
+            DataType result_type = m_analyzer.getExprType(expr);
+            if (result_type == DataType::STRING && expr.op.type == Codeparser::TokenType::PLUS) {
+                compileConcatenation(expr);
+                return;
+            }
+
+            // Operands are coerced to the result type before the typed opcode runs:
+            // Int operands are widened for Double arithmetic, anything is stringified for concatenation.
+            auto emitOperand = [&](const Codeparser::Expr& operand) {
+                operand.accept(*this);
+                DataType operand_type = m_analyzer.getExprType(operand);
+                if (result_type == DataType::STRING && operand_type != DataType::STRING) {
+                    emitBytes(OP_CONVERT, (uint8_t)DataType::STRING);
+                } else if (result_type == DataType::DOUBLE && operand_type == DataType::INT) {
+                    emitBytes(OP_CONVERT, (uint8_t)DataType::DOUBLE);
                 }
+            };
+            emitOperand(*expr.left);
+            emitOperand(*expr.right);
 
-                emitByte(OP_CALL);
-                emitByte(static_cast<uint8_t>(expr.arguments.size()));
+            switch (expr.op.type) {
+                case Codeparser::TokenType::PLUS:
+                    if (result_type == DataType::STRING) emitByte(OP_CONCAT);
+                    else if (result_type == DataType::INT) emitByte(OP_ADD_INT);
+                    else if (result_type == DataType::DOUBLE) emitByte(OP_ADD_DOUBLE);
+                    else emitByte(OP_ADD);
+                    break;
+                case Codeparser::TokenType::MINUS:
+                    if (result_type == DataType::INT) emitByte(OP_SUBTRACT_INT);
+                    else if (result_type == DataType::DOUBLE) emitByte(OP_SUBTRACT_DOUBLE);
+                    else emitByte(OP_SUBTRACT);
+                    break;
+                case Codeparser::TokenType::STAR:
+                    if (result_type == DataType::INT) emitByte(OP_MULTIPLY_INT);
+                    else if (result_type == DataType::DOUBLE) emitByte(OP_MULTIPLY_DOUBLE);
+                    else emitByte(OP_MULTIPLY);
+                    break;
+                case Codeparser::TokenType::SLASH:
+                    if (result_type == DataType::INT) emitByte(OP_DIVIDE_INT);
+                    else if (result_type == DataType::DOUBLE) emitByte(OP_DIVIDE_DOUBLE);
+                    else emitByte(OP_DIVIDE);
+                    break;
+                default:
+                    throw BytecodeCompilerError("Unsupported binary operator.", expr.op.line, expr.op.column);
+            }
+            emitTypeCheck(expr);
+        }
+
+        // A chain of string '+' is compiled as a single OP_CONCAT_N over all of
+        // its operands, so the result is built once rather than once per '+'.
+        // Adjacent string literals in the chain are joined here instead.
+        void BytecodeCompiler::compileConcatenation(const Codeparser::BinaryExpr& expr) {
+            std::vector<const Codeparser::Expr*> operands;
+            collectConcatOperands(expr, operands);
 
-                auto it = m_function_ips.find(callee->name.lexeme);
-                if (it != m_function_ips.end()) {
-                    emitShort(static_cast<uint16_t>(it->second));
+            struct Piece {
+                const Codeparser::Expr* expr; // Null for literal text
+                std::string text;
+            };
+            std::vector<Piece> pieces;
+            for (const Codeparser::Expr* operand : operands) {
+                const Codeparser::Expr* inner = operand;
+                while (auto* grouping = dynamic_cast<const Codeparser::GroupingExpr*>(inner)) inner = grouping->expression.get();
+                auto* literal = dynamic_cast<const Codeparser::LiteralExpr*>(inner);
+                if (!literal || literal->value.type != Codeparser::TokenType::STRING_LITERAL) {
+                    pieces.push_back({operand, ""});
+                } else if (!pieces.empty() && !pieces.back().expr) {
+                    pieces.back().text += literal->value.lexeme;
                 } else {
-                    size_t offset = m_chunk.code.size();
-                    emitShort(0xFFFF);
-                    m_call_fixups[callee->name.lexeme].push_back(offset);
+                    pieces.push_back({nullptr, literal->value.lexeme});
                 }
-                return;
             }
-            throw BytecodeCompilerError("Invalid callee expression.", expr.callee->token.line, expr.callee->token.column);
+            // Empty text adds nothing once there is another piece to stringify.
+            if (pieces.size() > 1) {
+                pieces.erase(std::remove_if(pieces.begin(), pieces.end(), [](const Piece& piece) { return !piece.expr && piece.text.empty(); }), pieces.end());
+            }
+
+            uint8_t pending = 0; // Pieces on the stack, not yet concatenated
+            for (const Piece& piece : pieces) {
+                if (piece.expr) {
+                    piece.expr->accept(*this);
+                    if (m_analyzer.getExprType(*piece.expr) != DataType::STRING) emitBytes(OP_CONVERT, (uint8_t)DataType::STRING);
+                } else {
+                    emitBytes(OP_CONST, makeConstant(piece.text));
+                }
+                if (++pending == UINT8_MAX) {
+                    emitBytes(OP_CONCAT_N, UINT8_MAX);
+                    pending = 1;
+                }
+            }
+            if (pending == 2) emitByte(OP_CONCAT);
+            else if (pending > 2) emitBytes(OP_CONCAT_N, pending);
+        }
+
+        // Flattens nested string '+' (through parentheses, as concatenation is
+        // associative) into its operands, left to right.
+        void BytecodeCompiler::collectConcatOperands(const Codeparser::Expr& expr, std::vector<const Codeparser::Expr*>& operands) {
+            const Codeparser::Expr* inner = &expr;
+            while (auto* grouping = dynamic_cast<const Codeparser::GroupingExpr*>(inner)) inner = grouping->expression.get();
+            auto* binary = dynamic_cast<const Codeparser::BinaryExpr*>(inner);
+            if (binary && binary->op.type == Codeparser::TokenType::PLUS && m_analyzer.getExprType(*binary) == DataType::STRING) {
+                collectConcatOperands(*binary->left, operands);
+                collectConcatOperands(*binary->right, operands);
+            } else {
+                operands.push_back(&expr);
+            }
         }
 
         void BytecodeCompiler::visit(const Codeparser::ImportStmt& stmt) {}
         void BytecodeCompiler::visit(const Codeparser::FunctionDeclStmt& stmt) {}
-        void BytecodeCompiler::visit(const Codeparser::ReturnStmt& stmt) { if (stmt.value) { stmt.value->accept(*this); } emitByte(OP_RETURN); }
-        void BytecodeCompiler::visit(const Codeparser::ExprStmt& stmt) { stmt.expression->accept(*this); }
-        void BytecodeCompiler::visit(const Codeparser::LiteralExpr& expr) { uint8_t const_index = makeConstant(expr.value.lexeme); emitBytes(OP_CONST, const_index); }
-        void BytecodeCompiler::visit(const Codeparser::BinaryExpr& expr) { expr.left->accept(*this); expr.right->accept(*this); switch (expr.op.type) { case Codeparser::TokenType::PLUS: emitByte(OP_ADD); break; case Codeparser::TokenType::MINUS: emitByte(OP_SUBTRACT); break; case Codeparser::TokenType::STAR: emitByte(OP_MULTIPLY); break; case Codeparser::TokenType::SLASH: emitByte(OP_DIVIDE); break; default: throw BytecodeCompilerError("Unsupported binary operator.", expr.op.line, expr.op.column); } }
+        // A function that returns the result of a call hands its frame to the
+        // callee with OP_TAIL_CALL, so recursion in tail position runs in
+        // constant stack space.
+        void BytecodeCompiler::visit(const Codeparser::ReturnStmt& stmt) {
+            const Codeparser::Expr* value = stmt.value.get();
+            while (auto* grouping = dynamic_cast<const Codeparser::GroupingExpr*>(value)) value = grouping->expression.get();
+            auto* call = dynamic_cast<const Codeparser::CallExpr*>(value);
+            auto* callee = call ? dynamic_cast<const Codeparser::VariableExpr*>(call->callee.get()) : nullptr;
+            if (m_scope_depth > 0 && callee && !isBuiltin(callee->name.lexeme)) {
+                emitCall(*call, callee->name.lexeme, OP_TAIL_CALL);
+                return;
+            }
+            if (stmt.value) { stmt.value->accept(*this); }
+            emitByte(OP_RETURN);
+        }
+        // An expression statement must leave the stack as it found it, or the
+        // slots of locals declared after it would be off by one.
+        void BytecodeCompiler::visit(const Codeparser::ExprStmt& stmt) { stmt.expression->accept(*this); if (leavesValue(*stmt.expression)) emitByte(OP_POP); }
+        void BytecodeCompiler::visit(const Codeparser::LiteralExpr& expr) { uint8_t const_index = makeLiteralConstant(expr.value); emitBytes(OP_CONST, const_index); }
         void BytecodeCompiler::visit(const Codeparser::GroupingExpr& expr) { expr.expression->accept(*this); }
 
         void BytecodeCompiler::emitByte(uint8_t byte) { m_chunk.code.push_back(byte); }
         void BytecodeCompiler::emitBytes(uint8_t byte1, uint8_t byte2) { emitByte(byte1); emitByte(byte2); }
         void BytecodeCompiler::emitShort(uint16_t value) { emitByte((value >> 8) & 0xFF); emitByte(value & 0xFF); }
         void BytecodeCompiler::patchShort(size_t offset, uint16_t value) { m_chunk.code[offset] = (value >> 8) & 0xFF; m_chunk.code[offset + 1] = value & 0xFF; }
-        uint8_t BytecodeCompiler::makeConstant(const std::string& value) { auto it = std::find(m_chunk.constants.begin(), m_chunk.constants.end(), value); if (it != m_chunk.constants.end()) { return static_cast<uint8_t>(std::distance(m_chunk.constants.begin(), it)); } if (m_chunk.constants.size() >= 256) { throw BytecodeCompilerError("Too many constants in one chunk."); } m_chunk.constants.push_back(value); return static_cast<uint8_t>(m_chunk.constants.size() - 1); }
-        std::string BytecodeCompiler::getObfuscatedName(const std::string& original_name) { if (!m_obfuscate_enabled) { return original_name; } auto it = m_obfuscation_map.find(original_name); if (it != m_obfuscation_map.end()) { return it->second; } std::string obfuscated_name = "_o" + std::to_string(m_obfuscation_counter++); m_obfuscation_map[original_name] = obfuscated_name; return obfuscated_name; }
+        uint8_t BytecodeCompiler::makeConstant(const Executable::Constant& value) { auto it = std::find(m_chunk.constants.begin(), m_chunk.constants.end(), value); if (it != m_chunk.constants.end()) { return static_cast<uint8_t>(std::distance(m_chunk.constants.begin(), it)); } if (m_chunk.constants.size() >= 256) { throw BytecodeCompilerError("Too many constants in one chunk."); } m_chunk.constants.push_back(value); return static_cast<uint8_t>(m_chunk.constants.size() - 1); }
+
+        // Number literals go into the pool in binary, typed the way the
+        // SemanticAnalyzer types them: a '.' makes a Double, otherwise an Int.
+        uint8_t BytecodeCompiler::makeLiteralConstant(const Codeparser::Token& literal) {
+            if (literal.type != Codeparser::TokenType::NUMBER_LITERAL) {
+                return makeConstant(Executable::Constant::fromString(literal.lexeme));
+            }
+            if (literal.lexeme.find('.') != std::string::npos) {
+                return makeConstant(Executable::Constant::fromDouble(std::strtod(literal.lexeme.c_str(), nullptr)));
+            }
+            errno = 0;
+            long long value = std::strtoll(literal.lexeme.c_str(), nullptr, 10);
+            if (errno == ERANGE) {
+                throw BytecodeCompilerError("Integer literal '" + literal.lexeme + "' is out of range.", literal.line, literal.column);
+            }
+            return makeConstant(Executable::Constant::fromInt(value));
+        }
+
+        uint8_t BytecodeCompiler::makeZeroConstant(const Codeparser::Expr* type_expr) {
+            auto* type_var = dynamic_cast<const Codeparser::VariableExpr*>(type_expr);
+            switch (type_var ? stringToDataType(type_var->name.lexeme) : DataType::UNKNOWN) {
+                case DataType::INT: return makeConstant(Executable::Constant::fromInt(0));
+                case DataType::DOUBLE: return makeConstant(Executable::Constant::fromDouble(0.0));
+                default: return makeConstant("");
+            }
+        }
 
     }
 }
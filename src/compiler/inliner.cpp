@@ -0,0 +1,210 @@
+#include "compiler/inliner.h"
+#include "compiler/rewriter.h"
+#include "common/opcode.h"
+#include <algorithm>
+#include <functional>
+#include <set>
+
+namespace Iodicium {
+    namespace Compiler {
+
+        namespace {
+
+            using Code = std::vector<BytecodeRewriter::Instruction>;
+
+            struct Function {
+                uint8_t arity = 0;
+                size_t first = 0;          // Index of the entry instruction in the original code
+                size_t end = 0;            // Index one past the instruction that ends it
+                std::set<size_t> callees;  // Entry offsets of the functions it calls
+                bool recursive = false;
+                Code body;                 // The function after inlining, ending with its return
+                bool inlinable = false;
+                uint32_t result_depth = 0; // Stack depth just before the final OP_RETURN
+                uint32_t max_local = 0;    // Highest local slot the body uses
+                std::vector<bool> param_written; // Parameters the body assigns to
+            };
+
+            uint16_t readShort(const std::vector<uint8_t>& bytes, size_t at) {
+                return static_cast<uint16_t>((bytes[at] << 8) | bytes[at + 1]);
+            }
+
+            bool isLocalAccess(uint8_t opcode) {
+                return opcode == OP_GET_LOCAL || opcode == OP_SET_LOCAL;
+            }
+
+            // An instruction that only pushes a value it reads from a local
+            // slot or the constant pool can be repeated wherever that value is used.
+            bool isPurePush(const BytecodeRewriter::Instruction& instruction) {
+                return instruction.opcode == OP_GET_LOCAL || instruction.opcode == OP_CONST;
+            }
+
+            // Decides whether 'function' may be copied into its callers, from its body after inlining.
+            void assess(Function& function, size_t max_instructions) {
+                const Code& body = function.body;
+                if (function.recursive || body.size() - 1 > max_instructions || body.back().opcode != OP_RETURN) return;
+                uint32_t depth = function.arity, max_depth = function.arity;
+                function.param_written.assign(function.arity, false);
+                for (size_t i = 0; i + 1 < body.size(); i++) {
+                    const auto& instruction = body[i];
+                    if (instruction.opcode >= OP_GET_LOCAL_2) return; // Superinstructions and register code
+                    if (isLocalAccess(instruction.opcode)) {
+                        uint8_t slot = instruction.operands[0];
+                        function.max_local = std::max<uint32_t>(function.max_local, slot);
+                        if (instruction.opcode == OP_SET_LOCAL && slot < function.arity) function.param_written[slot] = true;
+                    }
+                    if (!applyStackEffect(instruction.opcode, instruction.operands.data(), depth, max_depth)) return;
+                }
+                if (depth <= function.arity) return; // Returns a parameter slot rather than a value it pushed
+                function.result_depth = depth;
+                function.inlinable = true;
+            }
+
+        }
+
+        InlinePass::InlinePass(Common::Logger& logger) : m_logger(logger) {}
+
+        void InlinePass::run(Executable::Chunk& chunk, std::map<std::string, size_t>& function_ips, const std::map<std::string, uint8_t>& arities) {
+            if (chunk.isa != ISA_STACK) return;
+
+            BytecodeRewriter rewriter(chunk.code, function_ips);
+            Code& code = rewriter.getInstructions();
+
+            // Each function is the straight run from its entry to its first return.
+            std::map<size_t, Function> functions{{0, Function()}}; // By entry offset
+            for (const auto& [name, entry] : function_ips) {
+                auto arity = arities.find(name);
+                functions[entry].arity = arity != arities.end() ? arity->second : 0;
+            }
+            std::map<size_t, Function*> function_at; // By index of the entry instruction
+            for (size_t i = 0; i < code.size(); i++) {
+                auto function = functions.find(code[i].origin);
+                if (function == functions.end()) continue;
+                Function& run = function->second;
+                run.first = i;
+                for (run.end = i; run.end < code.size();) {
+                    const auto& instruction = code[run.end++];
+                    int address_at = getCallAddressOperand(instruction.opcode);
+                    if (address_at >= 0) run.callees.insert(readShort(instruction.operands, address_at));
+                    if (isReturn(instruction.opcode)) break;
+                }
+                function_at[i] = &run;
+            }
+
+            // A function that can reach itself through calls is never inlined,
+            // so that copying bodies always comes to an end.
+            for (auto& [entry, function] : functions) {
+                std::set<size_t> seen;
+                std::function<bool(size_t)> reaches = [&](size_t from) {
+                    if (!seen.insert(from).second) return false;
+                    for (size_t callee : functions[from].callees) {
+                        if (callee == entry || reaches(callee)) return true;
+                    }
+                    return false;
+                };
+                function.recursive = reaches(entry);
+            }
+
+            // Copies the callee's body in place of the call at the end of 'out'.
+            // Arguments pushed by pure instructions are not pushed at all: the
+            // body repeats the instruction wherever it reads the parameter.
+            // Otherwise the body reads the arguments where the call left them
+            // and an OP_SLIDE drops them from under the result.
+            size_t sites = 0;
+            auto expand = [&](Code& out, const BytecodeRewriter::Instruction& call, const Function& callee, uint32_t depth) {
+                uint8_t argc = call.operands[0];
+                uint32_t base = depth - argc; // Where the arguments begin
+                bool forward = out.size() >= argc;
+                for (size_t i = 0; forward && i < argc; i++) {
+                    const auto& argument = out[out.size() - argc + i];
+                    forward = isPurePush(argument) && !callee.param_written[i] &&
+                              (argument.opcode != OP_GET_LOCAL || argument.operands[0] < base);
+                }
+                if (base + callee.max_local > UINT8_MAX || callee.result_depth > UINT8_MAX) return false;
+
+                // The first instruction written takes the place of the first one
+                // replaced, which may be a function entry.
+                size_t origin = call.origin;
+                Code arguments;
+                if (forward && argc > 0) {
+                    arguments.assign(out.end() - argc, out.end());
+                    out.resize(out.size() - argc);
+                    origin = arguments.front().origin;
+                }
+                auto write = [&](uint8_t opcode, std::vector<uint8_t> operands) {
+                    out.push_back({opcode, std::move(operands), origin});
+                    origin = BytecodeRewriter::NEW_INSTRUCTION;
+                };
+                for (size_t i = 0; i + 1 < callee.body.size(); i++) {
+                    const auto& instruction = callee.body[i];
+                    if (!isLocalAccess(instruction.opcode)) {
+                        write(instruction.opcode, instruction.operands);
+                        continue;
+                    }
+                    uint8_t slot = instruction.operands[0];
+                    if (!forward) {
+                        write(instruction.opcode, {static_cast<uint8_t>(base + slot)});
+                    } else if (slot < argc) {
+                        write(arguments[slot].opcode, arguments[slot].operands);
+                    } else {
+                        write(instruction.opcode, {static_cast<uint8_t>(base + slot - argc)});
+                    }
+                }
+                uint32_t below = callee.result_depth - 1 - (forward ? argc : 0); // Values left under the result
+                if (call.opcode == OP_TAIL_CALL) {
+                    write(OP_RETURN, {}); // Returns the result and drops the frame itself
+                } else if (below > 0) {
+                    write(OP_SLIDE, {static_cast<uint8_t>(below)});
+                }
+                sites++;
+                return true;
+            };
+
+            // Inline into callees before their callers, so that a body is
+            // copied with the calls it makes already inlined.
+            std::set<size_t> done;
+            std::function<void(size_t)> inlineInto = [&](size_t entry) {
+                if (!done.insert(entry).second) return;
+                Function& function = functions[entry];
+                for (size_t callee : function.callees) {
+                    if (functions.count(callee)) inlineInto(callee);
+                }
+
+                uint32_t depth = function.arity, max_depth = function.arity;
+                for (size_t i = function.first; i < function.end; i++) {
+                    const auto& instruction = code[i];
+                    uint32_t before = depth;
+                    if (!applyStackEffect(instruction.opcode, instruction.operands.data(), depth, max_depth)) {
+                        // Not valid stack code; leave the rest of the function as it is.
+                        function.body.insert(function.body.end(), code.begin() + i, code.begin() + function.end);
+                        break;
+                    }
+                    if (instruction.opcode == OP_CALL || instruction.opcode == OP_TAIL_CALL) {
+                        auto callee = functions.find(readShort(instruction.operands, 1));
+                        if (callee != functions.end() && callee->second.inlinable && expand(function.body, instruction, callee->second, before)) continue;
+                    }
+                    function.body.push_back(instruction);
+                }
+                if (entry != 0) assess(function, MAX_INSTRUCTIONS);
+            };
+            for (const auto& [entry, function] : functions) inlineInto(entry);
+
+            Code inlined;
+            inlined.reserve(code.size());
+            for (size_t i = 0; i < code.size();) {
+                auto function = function_at.find(i);
+                if (function == function_at.end()) {
+                    inlined.push_back(std::move(code[i++])); // Unreachable code after a return
+                    continue;
+                }
+                inlined.insert(inlined.end(), function->second->body.begin(), function->second->body.end());
+                i = function->second->end;
+            }
+            code = std::move(inlined);
+
+            rewriter.encode(chunk.code, function_ips);
+            m_logger.debug("InlinePass: Inlined " + std::to_string(sites) + " call sites.");
+        }
+
+    }
+}
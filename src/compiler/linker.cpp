@@ -3,6 +3,10 @@
 #include "codeparser/parser.h"
 #include "compiler/semantics.h"
 #include "compiler/codegen.h"
+#include "compiler/register_codegen.h"
+#include "compiler/inliner.h"
+#include "compiler/superinstructions.h"
+#include "compiler/stack_depth.h"
 #include <fstream>
 #include <sstream>
 #include <map>
@@ -15,7 +19,8 @@ namespace Iodicium {
             std::map<std::string, size_t> function_ips;
         };
 
-        Linker::Linker(Common::Logger& logger) : m_logger(logger) {}
+        Linker::Linker(Common::Logger& logger, bool obfuscate_enabled, uint8_t isa, bool fuse_enabled, bool inline_enabled)
+            : m_logger(logger), m_obfuscate_enabled(obfuscate_enabled), m_isa(isa), m_fuse_enabled(fuse_enabled), m_inline_enabled(inline_enabled) {}
 
         Executable::Chunk Linker::link(const std::vector<std::string>& source_paths) {
             m_logger.info("Linker: Starting static link process for " + std::to_string(source_paths.size()) + " source files.");
@@ -45,14 +50,36 @@ namespace Iodicium {
             }
 
             m_logger.info("Linker: Performing global semantic analysis...");
-            SemanticAnalyzer analyzer(m_logger, base_path);
+            SemanticAnalyzer analyzer(m_logger, base_path, *m_natives);
             analyzer.analyze(combined_ast);
+            m_function_signatures = analyzer.getFunctionSignatures();
 
             m_logger.info("Linker: Generating bytecode...");
-            BytecodeCompiler compiler(m_logger, analyzer, false);
-            Executable::Chunk final_chunk = compiler.compile(combined_ast);
+            Executable::Chunk final_chunk;
+            std::map<std::string, uint8_t> arities;
+            if (m_isa == ISA_REGISTER) {
+                RegisterCompiler compiler(m_logger, analyzer, m_obfuscate_enabled);
+                final_chunk = compiler.compile(combined_ast);
+                m_function_ips = compiler.getFunctionIPs();
+            } else {
+                BytecodeCompiler compiler(m_logger, analyzer, m_obfuscate_enabled);
+                final_chunk = compiler.compile(combined_ast);
+                m_function_ips = compiler.getFunctionIPs();
+                arities = compiler.getFunctionArities();
+            }
+
+            if (m_inline_enabled) {
+                InlinePass inliner(m_logger);
+                inliner.run(final_chunk, m_function_ips, arities);
+            }
+
+            if (m_fuse_enabled) {
+                SuperinstructionPass fusion(m_logger);
+                fusion.run(final_chunk, m_function_ips);
+            }
 
-            m_function_ips = compiler.getFunctionIPs();
+            StackDepthPass stack_depth(m_logger);
+            stack_depth.run(final_chunk, m_function_ips, arities);
 
             m_logger.info("Linker: Static linking complete.");
             return final_chunk;
@@ -0,0 +1,312 @@
+#include "compiler/register_codegen.h"
+#include <algorithm>
+
+namespace Iodicium {
+    namespace Compiler {
+
+        RegisterCompiler::RegisterCompiler(Common::Logger& logger, SemanticAnalyzer& analyzer, bool obfuscate_enabled)
+            : BytecodeCompiler(logger, analyzer, obfuscate_enabled) {}
+
+        Executable::Chunk RegisterCompiler::compile(const std::vector<std::unique_ptr<Codeparser::Stmt>>& statements) {
+            m_logger.debug("RegisterCompiler: Starting compilation.");
+            m_chunk = Executable::Chunk();
+            m_chunk.isa = ISA_REGISTER;
+            m_function_ips.clear();
+            m_call_fixups.clear();
+            m_deferred_functions.clear();
+            m_global_slots.clear();
+            m_locals.clear();
+            m_scope_depth = 0;
+
+            // The top-level code is a frame of its own with no fixed registers.
+            beginFrame(0);
+            for (const auto& statement : statements) {
+                statement->accept(*this);
+            }
+            emitReturnEmpty();
+            endFrame();
+
+            for (size_t i = 0; i < m_deferred_functions.size(); i++) {
+                compileFunction(*m_deferred_functions[i]);
+            }
+            m_deferred_functions.clear();
+
+            backpatchCalls();
+            finishChunk();
+
+            m_logger.debug("RegisterCompiler: Finished compilation.");
+            return m_chunk;
+        }
+
+        void RegisterCompiler::beginFrame(int fixed_registers) {
+            m_next_register = fixed_registers;
+            m_register_count = std::max(fixed_registers, 1); // Room for the result of a call
+            emitBytes(OP_REG_ENTER, 0);
+            m_enter_offset = m_chunk.code.size() - 1;
+        }
+
+        void RegisterCompiler::endFrame() {
+            m_chunk.code[m_enter_offset] = static_cast<uint8_t>(m_register_count);
+        }
+
+        uint8_t RegisterCompiler::allocateRegister() {
+            if (m_next_register >= UINT8_MAX) {
+                throw BytecodeCompilerError("Too many registers in one function.");
+            }
+            uint8_t index = static_cast<uint8_t>(m_next_register++);
+            m_register_count = std::max(m_register_count, m_next_register);
+            return index;
+        }
+
+        void RegisterCompiler::compileInto(const Codeparser::Expr& expr, uint8_t target) {
+            uint8_t saved_target = m_target;
+            m_target = target;
+            expr.accept(*this);
+            m_target = saved_target;
+        }
+
+        // Returns a register holding the value of 'expr'. Locals are read in
+        // place; anything else is evaluated into a fresh temporary.
+        uint8_t RegisterCompiler::compileOperand(const Codeparser::Expr& expr) {
+            if (auto* variable = dynamic_cast<const Codeparser::VariableExpr*>(&expr)) {
+                int local_index = resolveLocal(variable->name);
+                if (local_index != -1) return static_cast<uint8_t>(local_index);
+            }
+            uint8_t temp = allocateRegister();
+            compileInto(expr, temp);
+            return temp;
+        }
+
+        void RegisterCompiler::emitReturnEmpty(const Codeparser::Expr* type_expr) {
+            uint8_t temp = allocateRegister();
+            emitBytes(OP_REG_LOAD_CONST, temp);
+            emitByte(makeZeroConstant(type_expr));
+            emitBytes(OP_REG_RETURN, temp);
+            m_next_register--;
+        }
+
+        void RegisterCompiler::compileFunction(const Codeparser::FunctionStmt& stmt) {
+            m_logger.debug("RegisterCompiler: Defining function '" + stmt.name.lexeme + "'.");
+            m_function_ips[stmt.name.lexeme] = m_chunk.code.size();
+
+            beginScope();
+            for (const auto& param : stmt.params) {
+                m_locals.push_back({param.name, m_scope_depth});
+            }
+            beginFrame(static_cast<int>(stmt.params.size()));
+
+            for (const auto& statement : stmt.body) {
+                statement->accept(*this);
+            }
+            emitReturnEmpty(stmt.return_type_expr.get());
+
+            endFrame();
+            endScope();
+        }
+
+        void RegisterCompiler::visit(const Codeparser::VarStmt& stmt) {
+            int mark = m_next_register;
+            // A local's register is the next free one, so its initializer is evaluated in place.
+            uint8_t target = allocateRegister();
+            if (stmt.initializer) {
+                compileInto(*stmt.initializer, target);
+            } else {
+                emitBytes(OP_REG_LOAD_CONST, target);
+                emitByte(makeZeroConstant(stmt.type_expr.get()));
+            }
+
+            if (m_scope_depth > 0) {
+                m_locals.push_back({stmt.name, m_scope_depth});
+                m_next_register = mark + 1;
+                return;
+            }
+
+            emitBytes(OP_REG_DEFINE_GLOBAL, target);
+            emitShort(resolveGlobal(stmt.name.lexeme));
+            m_next_register = mark;
+        }
+
+        void RegisterCompiler::visit(const Codeparser::ExprStmt& stmt) {
+            int mark = m_next_register;
+            compileInto(*stmt.expression, allocateRegister());
+            m_next_register = mark;
+        }
+
+        void RegisterCompiler::visit(const Codeparser::ReturnStmt& stmt) {
+            if (!stmt.value) {
+                emitReturnEmpty();
+                return;
+            }
+            int mark = m_next_register;
+            emitBytes(OP_REG_RETURN, compileOperand(*stmt.value));
+            m_next_register = mark;
+        }
+
+        void RegisterCompiler::visit(const Codeparser::LiteralExpr& expr) {
+            emitBytes(OP_REG_LOAD_CONST, m_target);
+            emitByte(makeLiteralConstant(expr.value));
+        }
+
+        void RegisterCompiler::visit(const Codeparser::GroupingExpr& expr) {
+            compileInto(*expr.expression, m_target);
+        }
+
+        void RegisterCompiler::visit(const Codeparser::VariableExpr& expr) {
+            int local_index = resolveLocal(expr.name);
+            if (local_index != -1) {
+                if (local_index != m_target) {
+                    emitBytes(OP_REG_MOVE, m_target);
+                    emitByte(static_cast<uint8_t>(local_index));
+                }
+                return;
+            }
+            emitBytes(OP_REG_GET_GLOBAL, m_target);
+            emitShort(resolveGlobal(expr.name.lexeme));
+        }
+
+        void RegisterCompiler::visit(const Codeparser::AssignExpr& expr) {
+            int local_index = resolveLocal(expr.name);
+            if (local_index != -1) {
+                uint8_t local = static_cast<uint8_t>(local_index);
+                compileInto(*expr.value, local);
+                if (local != m_target) {
+                    emitBytes(OP_REG_MOVE, m_target);
+                    emitByte(local);
+                }
+                return;
+            }
+            compileInto(*expr.value, m_target);
+            emitBytes(OP_REG_SET_GLOBAL, m_target);
+            emitShort(resolveGlobal(expr.name.lexeme));
+        }
+
+        void RegisterCompiler::visit(const Codeparser::CallExpr& expr) {
+            auto* callee = dynamic_cast<Codeparser::VariableExpr*>(expr.callee.get());
+            if (!callee) {
+                throw BytecodeCompilerError("Invalid callee expression.", expr.callee->token.line, expr.callee->token.column);
+            }
+            uint8_t target = m_target;
+            int mark = m_next_register;
+            const std::string& name = callee->name.lexeme;
+
+            const VM::Native* native = m_analyzer.getNatives().find(name);
+            if (native && native->instruction != OP_CALL_NATIVE) {
+                // The builtins' stack instructions and their register forms.
+                if (native->instruction == OP_FLUSH) {
+                    emitByte(OP_FLUSH);
+                    return;
+                }
+                if (native->instruction != OP_WRITE_OUT && native->instruction != OP_WRITE_ERR) {
+                    throw BytecodeCompilerError("'" + name + "' has no register instruction.", expr.token.line, expr.token.column);
+                }
+                emitBytes(native->instruction == OP_WRITE_OUT ? OP_REG_WRITE_OUT : OP_REG_WRITE_ERR, compileOperand(*expr.arguments[0]));
+                m_next_register = mark;
+                return;
+            } else if (const Builtin* builtin = findBuiltin(name)) {
+                if (builtin->kind != Builtin::CONVERT) {
+                    throw BytecodeCompilerError(name + "() needs the stack instruction set; compile without --isa=register.", expr.token.line, expr.token.column);
+                }
+                auto* type_arg = dynamic_cast<Codeparser::VariableExpr*>(expr.arguments[1].get());
+                if (!type_arg) { throw BytecodeCompilerError("Second arg to convert() must be a type.", expr.token.line, expr.token.column); }
+                uint8_t source = compileOperand(*expr.arguments[0]);
+                emitBytes(OP_REG_CONVERT, target);
+                emitBytes(source, (uint8_t)stringToDataType(type_arg->name.lexeme));
+                m_next_register = mark;
+                return;
+            }
+
+            if (m_analyzer.getCheckedType(expr) != DataType::UNKNOWN) {
+                throw BytecodeCompilerError("A value of any type needs the stack instruction set to be checked; compile without --isa=register.", expr.token.line, expr.token.column);
+            }
+
+            // Arguments go in consecutive registers; the callee's frame begins at
+            // the first. When the result is wanted in the newest temporary, the
+            // call can start there and no move is needed.
+            bool in_place = target + 1 == m_next_register && target >= static_cast<int>(m_locals.size());
+            uint8_t first = in_place ? target : allocateRegister();
+            for (size_t i = 0; i < expr.arguments.size(); i++) {
+                uint8_t arg_register = i == 0 ? first : allocateRegister();
+                compileInto(*expr.arguments[i], arg_register);
+                m_next_register = arg_register + 1;
+            }
+
+            if (native) {
+                emitBytes(OP_REG_CALL_NATIVE, first);
+                emitBytes(static_cast<uint8_t>(expr.arguments.size()), makeConstant(native->name));
+            } else {
+                emitBytes(OP_REG_CALL, first);
+                emitByte(static_cast<uint8_t>(expr.arguments.size()));
+                auto it = m_function_ips.find(name);
+                if (it != m_function_ips.end()) {
+                    emitShort(static_cast<uint16_t>(it->second));
+                } else {
+                    size_t offset = m_chunk.code.size();
+                    emitShort(0xFFFF);
+                    m_call_fixups[name].push_back(offset);
+                }
+            }
+            if (first != target) {
+                emitBytes(OP_REG_MOVE, target);
+                emitByte(first);
+            }
+            m_next_register = mark;
+        }
+
+        void RegisterCompiler::visit(const Codeparser::BinaryExpr& expr) {
+            DataType result_type = m_analyzer.getExprType(expr);
+            uint8_t target = m_target;
+            int mark = m_next_register;
+            if (m_analyzer.getCheckedType(expr) != DataType::UNKNOWN) {
+                throw BytecodeCompilerError("A value of any type needs the stack instruction set to be checked; compile without --isa=register.", expr.op.line, expr.op.column);
+            }
+
+            // Same coercions as the stack backend, written to a temporary so
+            // that locals are never converted in place.
+            auto operand = [&](const Codeparser::Expr& operand_expr) {
+                uint8_t source = compileOperand(operand_expr);
+                DataType operand_type = m_analyzer.getExprType(operand_expr);
+                uint8_t conversion;
+                if (result_type == DataType::STRING && operand_type != DataType::STRING) {
+                    conversion = (uint8_t)DataType::STRING;
+                } else if (result_type == DataType::DOUBLE && operand_type == DataType::INT) {
+                    conversion = (uint8_t)DataType::DOUBLE;
+                } else {
+                    return source;
+                }
+                uint8_t converted = source >= static_cast<int>(m_locals.size()) ? source : allocateRegister();
+                emitBytes(OP_REG_CONVERT, converted);
+                emitBytes(source, conversion);
+                return converted;
+            };
+            uint8_t left = operand(*expr.left);
+            uint8_t right = operand(*expr.right);
+
+            OpCode op;
+            switch (expr.op.type) {
+                case Codeparser::TokenType::PLUS:
+                    op = result_type == DataType::STRING ? OP_REG_CONCAT
+                       : result_type == DataType::INT ? OP_REG_ADD_INT
+                       : result_type == DataType::DOUBLE ? OP_REG_ADD_DOUBLE : OP_REG_ADD;
+                    break;
+                case Codeparser::TokenType::MINUS:
+                    op = result_type == DataType::INT ? OP_REG_SUBTRACT_INT
+                       : result_type == DataType::DOUBLE ? OP_REG_SUBTRACT_DOUBLE : OP_REG_SUBTRACT;
+                    break;
+                case Codeparser::TokenType::STAR:
+                    op = result_type == DataType::INT ? OP_REG_MULTIPLY_INT
+                       : result_type == DataType::DOUBLE ? OP_REG_MULTIPLY_DOUBLE : OP_REG_MULTIPLY;
+                    break;
+                case Codeparser::TokenType::SLASH:
+                    op = result_type == DataType::INT ? OP_REG_DIVIDE_INT
+                       : result_type == DataType::DOUBLE ? OP_REG_DIVIDE_DOUBLE : OP_REG_DIVIDE;
+                    break;
+                default:
+                    throw BytecodeCompilerError("Unsupported binary operator.", expr.op.line, expr.op.column);
+            }
+            emitBytes(op, target);
+            emitBytes(left, right);
+            m_next_register = mark;
+        }
+
+    }
+}
@@ -0,0 +1,69 @@
+#include "compiler/rewriter.h"
+#include "compiler/codegen.h"
+#include "common/opcode.h"
+
+namespace Iodicium {
+    namespace Compiler {
+
+        static uint16_t readShort(const std::vector<uint8_t>& bytes, size_t at) {
+            return static_cast<uint16_t>((bytes[at] << 8) | bytes[at + 1]);
+        }
+
+        BytecodeRewriter::BytecodeRewriter(const std::vector<uint8_t>& code, const std::map<std::string, size_t>& function_ips) {
+            for (const auto& [name, address] : function_ips) {
+                m_entries.insert(address);
+            }
+            for (size_t offset = 0; offset < code.size();) {
+                int length = getOperandLength(code[offset]);
+                if (length < 0 || offset + 1 + length > code.size()) {
+                    throw BytecodeCompilerError("Internal Compiler Error: Cannot decode instruction at offset " + std::to_string(offset) + ".");
+                }
+                Instruction instruction{code[offset], std::vector<uint8_t>(code.begin() + offset + 1, code.begin() + offset + 1 + length), offset};
+                int address_at = getCallAddressOperand(instruction.opcode);
+                if (address_at >= 0) {
+                    m_entries.insert(readShort(instruction.operands, address_at));
+                }
+                m_instructions.push_back(std::move(instruction));
+                offset += 1 + length;
+            }
+        }
+
+        void BytecodeRewriter::encode(std::vector<uint8_t>& code, std::map<std::string, size_t>& function_ips) const {
+            std::map<size_t, size_t> moved; // Original offset -> new offset
+            size_t size = 0;
+            for (const auto& instruction : m_instructions) {
+                if (instruction.origin != NEW_INSTRUCTION) moved[instruction.origin] = size;
+                size += 1 + instruction.operands.size();
+            }
+            auto relocate = [&](size_t origin) {
+                auto it = moved.find(origin);
+                if (it == moved.end()) {
+                    throw BytecodeCompilerError("Internal Compiler Error: Rewrite removed the function at offset " + std::to_string(origin) + ".");
+                }
+                if (it->second > UINT16_MAX) {
+                    throw BytecodeCompilerError("Function address " + std::to_string(it->second) + " exceeds the 16-bit call range.");
+                }
+                return static_cast<uint16_t>(it->second);
+            };
+
+            std::vector<uint8_t> rewritten;
+            rewritten.reserve(size);
+            for (const auto& instruction : m_instructions) {
+                rewritten.push_back(instruction.opcode);
+                size_t operands_at = rewritten.size();
+                rewritten.insert(rewritten.end(), instruction.operands.begin(), instruction.operands.end());
+                int address_at = getCallAddressOperand(instruction.opcode);
+                if (address_at >= 0) {
+                    uint16_t address = relocate(readShort(instruction.operands, address_at));
+                    rewritten[operands_at + address_at] = static_cast<uint8_t>(address >> 8);
+                    rewritten[operands_at + address_at + 1] = static_cast<uint8_t>(address & 0xFF);
+                }
+            }
+            for (auto& [name, address] : function_ips) {
+                address = relocate(address);
+            }
+            code = std::move(rewritten);
+        }
+
+    }
+}
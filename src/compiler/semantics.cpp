@@ -18,6 +18,22 @@ namespace Iodicium {
             {DataType::FUNCTION,"Function"}
         };
 
+        static const Builtin BUILTINS[] = {
+            {"convert", Builtin::CONVERT, OP_CONVERT, DataType::UNKNOWN, DataType::UNKNOWN},
+            {"fiber", Builtin::START, OP_FIBER, DataType::UNKNOWN, DataType::INT},
+            {"resume", Builtin::UNARY, OP_RESUME, DataType::INT, DataType::UNKNOWN},
+            {"yield", Builtin::UNARY, OP_YIELD, DataType::UNKNOWN, DataType::NIL},
+            {"spawn", Builtin::START, OP_SPAWN, DataType::UNKNOWN, DataType::INT},
+            {"join", Builtin::UNARY, OP_JOIN, DataType::INT, DataType::UNKNOWN},
+        };
+
+        const Builtin* findBuiltin(std::string_view name) {
+            for (const Builtin& builtin : BUILTINS) {
+                if (name == builtin.name) return &builtin;
+            }
+            return nullptr;
+        }
+
         std::string dataTypeToString(DataType type) {
             auto it = DATA_TYPE_STRINGS.find(type);
             if (it != DATA_TYPE_STRINGS.end()) return it->second;
@@ -62,13 +78,16 @@ namespace Iodicium {
             return nullptr;
         }
 
-        SemanticAnalyzer::SemanticAnalyzer(Common::Logger& logger, std::string base_path) : m_logger(logger), m_base_path(std::move(base_path)), m_symbol_table(logger) {
-            m_logger.debug("[SemanticAnalyzer] Defining built-in functions...");
-            m_symbol_table.define("writeOut", {DataType::FUNCTION, DataType::NIL, false, false, false, -1});
-            m_symbol_table.define("writeErr", {DataType::FUNCTION, DataType::NIL, false, false, false, -1});
-            m_symbol_table.define("flush", {DataType::FUNCTION, DataType::NIL, false, false, false, -1});
-            m_symbol_table.define("convert", {DataType::FUNCTION, DataType::UNKNOWN, false, false, false, -1});
-            m_logger.debug("[SemanticAnalyzer] Built-in functions defined.");
+        static_assert(static_cast<int>(DataType::STRING) == VM::STRING && static_cast<int>(DataType::FUNCTION) == VM::FUNCTION,
+                      "Compiler::DataType must be numbered as VM::DataType.");
+
+        SemanticAnalyzer::SemanticAnalyzer(Common::Logger& logger, std::string base_path, const VM::NativeRegistry& natives)
+            : m_logger(logger), m_natives(natives), m_symbol_table(logger), m_base_path(std::move(base_path)) {
+            m_logger.debug("[SemanticAnalyzer] Defining native functions...");
+            for (const VM::Native& native : m_natives.getFunctions()) {
+                m_symbol_table.define(native.name, {DataType::FUNCTION, static_cast<DataType>(native.return_type), false, false, false, -1, true, {}});
+            }
+            m_logger.debug("[SemanticAnalyzer] Native functions defined.");
         }
 
         void SemanticAnalyzer::analyze(const std::vector<std::unique_ptr<Codeparser::Stmt>>& statements) {
@@ -85,6 +104,29 @@ namespace Iodicium {
         void SemanticAnalyzer::resolve(const std::unique_ptr<Codeparser::Expr>& expr) {
             if (!expr) { m_current_expr_type = DataType::UNKNOWN; return; }
             expr->accept(*this);
+            m_expr_types[expr.get()] = m_current_expr_type;
+        }
+
+        DataType SemanticAnalyzer::getExprType(const Codeparser::Expr& expr) const {
+            auto it = m_expr_types.find(&expr);
+            if (it != m_expr_types.end()) return it->second;
+            return DataType::UNKNOWN;
+        }
+
+        DataType SemanticAnalyzer::getCheckedType(const Codeparser::Expr& expr) const {
+            auto it = m_checked_types.find(&expr);
+            if (it != m_checked_types.end()) return it->second;
+            return DataType::UNKNOWN;
+        }
+
+        bool SemanticAnalyzer::accepts(DataType expected, DataType actual, const std::unique_ptr<Codeparser::Expr>& expr) {
+            if (expected == DataType::UNKNOWN || actual == expected) return true;
+            if (actual != DataType::UNKNOWN) return false;
+            // Only calls, and arithmetic on them, have no type of their own.
+            const Codeparser::Expr* inner = expr.get();
+            while (auto* grouping = dynamic_cast<const Codeparser::GroupingExpr*>(inner)) inner = grouping->expression.get();
+            m_checked_types[inner] = expected;
+            return true;
         }
 
         void SemanticAnalyzer::visit(const Codeparser::ImportStmt& stmt) {
@@ -136,7 +178,7 @@ namespace Iodicium {
                     return_type = stringToDataType(type_var->name.lexeme);
                 }
             }
-            Symbol func_symbol = {DataType::FUNCTION, return_type, false, stmt.is_exported, false, -1};
+            Symbol func_symbol = {DataType::FUNCTION, return_type, false, stmt.is_exported, false, -1, false, parameterTypes(stmt.params)};
             if (!m_symbol_table.define(stmt.name.lexeme, func_symbol)) {
                 m_logger.warn("[SemanticAnalyzer] Ignoring re-declaration of function '" + stmt.name.lexeme + "'.");
                 if (m_is_importing) return;
@@ -146,24 +188,23 @@ namespace Iodicium {
                 return;
             }
 
+            FunctionSignature signature{func_symbol.parameters, return_type, stmt.is_exported};
             m_symbol_table.beginScope();
-            for (const auto& param : stmt.params) {
-                DataType param_type = DataType::UNKNOWN;
-                if (param.type_expr) {
-                    if (auto* type_var = dynamic_cast<Codeparser::VariableExpr*>(param.type_expr.get())) {
-                        param_type = stringToDataType(type_var->name.lexeme);
-                    }
-                }
-                if (param_type == DataType::UNKNOWN) {
+            for (size_t i = 0; i < stmt.params.size(); i++) {
+                const Codeparser::Parameter& param = stmt.params[i];
+                if (signature.parameters[i] == DataType::UNKNOWN) {
                     throw SemanticError("Parameter '" + param.name.lexeme + "' must have a type.", param.name.line, param.name.column);
                 }
-                m_symbol_table.define(param.name.lexeme, {param_type, DataType::NIL, false, false, false, -1});
+                m_symbol_table.define(param.name.lexeme, {signature.parameters[i], DataType::NIL, false, false, false, -1, false, {}});
             }
+            m_function_signatures.emplace(stmt.name.lexeme, std::move(signature));
 
             m_logger.debug("[SemanticAnalyzer] Processing body of function: " + stmt.name.lexeme);
+            m_return_type = stmt.return_type_expr ? return_type : DataType::UNKNOWN;
             for (const auto& body_stmt : stmt.body) {
                 resolve(body_stmt);
             }
+            m_return_type = DataType::UNKNOWN;
 
             m_symbol_table.endScope();
         }
@@ -177,7 +218,7 @@ namespace Iodicium {
                     return_type = stringToDataType(type_var->name.lexeme);
                 }
             }
-            Symbol symbol = {DataType::FUNCTION, return_type, false, stmt.is_exported, false, -1};
+            Symbol symbol = {DataType::FUNCTION, return_type, false, stmt.is_exported, false, -1, false, parameterTypes(stmt.params)};
             if (!m_symbol_table.define(stmt.name.lexeme, symbol)) {
                 m_logger.warn("[SemanticAnalyzer] Ignoring re-declaration of function declaration '" + stmt.name.lexeme + "'.");
             }
@@ -194,16 +235,21 @@ namespace Iodicium {
             }
             
             DataType initializer_type = typeOf(stmt.initializer);
-            if (declared_type != DataType::UNKNOWN && initializer_type != DataType::UNKNOWN && declared_type != initializer_type) {
+            if (stmt.initializer && !accepts(declared_type, initializer_type, stmt.initializer)) {
                 throw SemanticError("Initializer type '" + dataTypeToString(initializer_type) + "' does not match declared type '" + dataTypeToString(declared_type) + "'.", stmt.name.line, stmt.name.column);
             }
             
             DataType final_type = (declared_type != DataType::UNKNOWN) ? declared_type : initializer_type;
             if (final_type == DataType::UNKNOWN) {
-                throw SemanticError("Cannot determine type for variable '" + stmt.name.lexeme + "'.", stmt.name.line, stmt.name.column);
+                throw SemanticError("Cannot determine type for variable '" + stmt.name.lexeme + "'; declare it, as in '" + stmt.name.lexeme + ": Int'.", stmt.name.line, stmt.name.column);
+            }
+            // Without an initializer a variable starts at zero, and only
+            // numbers and strings have one the image can hold.
+            if (!stmt.initializer && final_type != DataType::INT && final_type != DataType::DOUBLE && final_type != DataType::STRING) {
+                throw SemanticError("Variable '" + stmt.name.lexeme + "' of type '" + dataTypeToString(final_type) + "' needs an initializer.", stmt.name.line, stmt.name.column);
             }
             
-            Symbol symbol = {final_type, DataType::NIL, stmt.is_mutable, stmt.is_exported, false, -1};
+            Symbol symbol = {final_type, DataType::NIL, stmt.is_mutable, stmt.is_exported, false, -1, false, {}};
             if (!m_symbol_table.define(stmt.name.lexeme, symbol)) {
                 throw SemanticError("Variable '" + stmt.name.lexeme + "' already declared in this scope.", stmt.name.line, stmt.name.column);
             }
@@ -220,10 +266,10 @@ namespace Iodicium {
             if (!symbol) throw SemanticError("Undefined variable '" + expr.name.lexeme + "'.", expr.name.line, expr.name.column);
             if (!symbol->is_mutable) throw SemanticError("Cannot assign to immutable variable '" + expr.name.lexeme + "'.", expr.name.line, expr.name.column);
             DataType value_type = typeOf(expr.value);
-            if (symbol->type != value_type) {
+            if (!accepts(symbol->type, value_type, expr.value)) {
                 throw SemanticError("Cannot assign value of type '" + dataTypeToString(value_type) + "' to variable '" + expr.name.lexeme + "' of type '" + dataTypeToString(symbol->type) + "'.", expr.name.line, expr.name.column);
             }
-            m_current_expr_type = value_type;
+            m_current_expr_type = symbol->type;
         }
 
         void SemanticAnalyzer::visit(const Codeparser::BinaryExpr& expr) {
@@ -249,12 +295,21 @@ namespace Iodicium {
                 }
             }
 
+            // An operand whose type is only known when it runs makes the
+            // result one too; the untyped instructions check the operands.
+            auto isNumberOrUnknown = [](DataType type) { return type == DataType::INT || type == DataType::DOUBLE || type == DataType::UNKNOWN; };
+            if ((left_type == DataType::UNKNOWN || right_type == DataType::UNKNOWN) && isNumberOrUnknown(left_type) && isNumberOrUnknown(right_type)) {
+                m_current_expr_type = DataType::UNKNOWN;
+                return;
+            }
+
             throw SemanticError("Operator '" + expr.op.lexeme + "' cannot be applied to operands of type '" + dataTypeToString(left_type) + "' and '" + dataTypeToString(right_type) + "'.", expr.op.line, expr.op.column);
         }
 
         void SemanticAnalyzer::visit(const Codeparser::CallExpr& expr) {
             if (auto* callee = dynamic_cast<Codeparser::VariableExpr*>(expr.callee.get())) {
-                if (callee->name.lexeme == "convert") {
+                const Builtin* builtin = findBuiltin(callee->name.lexeme);
+                if (builtin && builtin->kind == Builtin::CONVERT) {
                     if (expr.arguments.size() != 2) {
                         throw SemanticError("convert() requires 2 arguments: the value and the target type.", callee->name.line, callee->name.column);
                     }
@@ -271,12 +326,37 @@ namespace Iodicium {
                     return;
                 }
 
+                // fiber(f, args...) starts no code yet: it returns a handle
+                // that resume() runs f(args...) on until it yields or returns.
+                // spawn(f, args...) returns a handle that join() waits on for
+                // the result of f(args...), which may run on another thread.
+                if (builtin && builtin->kind == Builtin::START) {
+                    auto* function = expr.arguments.empty() ? nullptr : dynamic_cast<Codeparser::VariableExpr*>(expr.arguments[0].get());
+                    Symbol* symbol = function ? m_symbol_table.find(function->name.lexeme) : nullptr;
+                    if (!symbol || symbol->type != DataType::FUNCTION || symbol->is_native) {
+                        throw SemanticError("The first argument to " + callee->name.lexeme + "() must name a function.", callee->name.line, callee->name.column);
+                    }
+                    checkArguments(function->name.lexeme, callee->name, symbol->parameters, expr.arguments, 1);
+                    m_current_expr_type = builtin->return_type;
+                    return;
+                }
+                if (builtin) {
+                    checkArguments(callee->name.lexeme, callee->name, {builtin->parameter}, expr.arguments);
+                    m_current_expr_type = builtin->return_type;
+                    return;
+                }
+
                 Symbol* symbol = m_symbol_table.find(callee->name.lexeme);
                 if (!symbol) { throw SemanticError("Undefined function '" + callee->name.lexeme + "'.", callee->name.line, callee->name.column); }
                 if (symbol->type != DataType::FUNCTION) { throw SemanticError("'" + callee->name.lexeme + "' is not a function.", callee->name.line, callee->name.column); }
 
-                for (const auto& arg : expr.arguments) {
-                    resolve(arg);
+                if (symbol->is_native) {
+                    const VM::Native* native = m_natives.find(callee->name.lexeme);
+                    std::vector<DataType> parameters;
+                    for (VM::DataType parameter : native->parameters) parameters.push_back(static_cast<DataType>(parameter));
+                    checkArguments(callee->name.lexeme, callee->name, parameters, expr.arguments);
+                } else {
+                    checkArguments(callee->name.lexeme, callee->name, symbol->parameters, expr.arguments);
                 }
 
                 m_current_expr_type = symbol->return_type;
@@ -286,12 +366,19 @@ namespace Iodicium {
         }
 
         void SemanticAnalyzer::visit(const Codeparser::ExprStmt& stmt) { resolve(stmt.expression); }
-        void SemanticAnalyzer::visit(const Codeparser::ReturnStmt& stmt) { if (stmt.value) { resolve(stmt.value); } }
+        // The typed instructions trust what a function declares it returns.
+        void SemanticAnalyzer::visit(const Codeparser::ReturnStmt& stmt) {
+            DataType value_type = stmt.value ? typeOf(stmt.value) : DataType::NIL;
+            if (!accepts(m_return_type, value_type, stmt.value)) {
+                throw SemanticError("Cannot return a value of type '" + dataTypeToString(value_type) + "' from a function that returns '" + dataTypeToString(m_return_type) + "'.", stmt.keyword.line, stmt.keyword.column);
+            }
+        }
         void SemanticAnalyzer::visit(const Codeparser::LiteralExpr& expr) { 
             if (expr.token.type == Codeparser::TokenType::STRING_LITERAL) {
                 m_current_expr_type = DataType::STRING;
             } else if (expr.token.type == Codeparser::TokenType::NUMBER_LITERAL) {
-                m_current_expr_type = DataType::DOUBLE;
+                bool is_decimal = expr.token.lexeme.find('.') != std::string::npos;
+                m_current_expr_type = is_decimal ? DataType::DOUBLE : DataType::INT;
             }
         }
         void SemanticAnalyzer::visit(const Codeparser::GroupingExpr& expr) { resolve(expr.expression); }
@@ -302,6 +389,30 @@ namespace Iodicium {
             return m_current_expr_type;
         }
 
+        std::vector<DataType> SemanticAnalyzer::parameterTypes(const std::vector<Codeparser::Parameter>& params) {
+            std::vector<DataType> types;
+            for (const auto& param : params) {
+                auto* type_var = dynamic_cast<Codeparser::VariableExpr*>(param.type_expr.get());
+                types.push_back(type_var ? stringToDataType(type_var->name.lexeme) : DataType::UNKNOWN);
+            }
+            return types;
+        }
+
+        // Natives and the functions the code defines are checked alike.
+        void SemanticAnalyzer::checkArguments(const std::string& name, const Codeparser::Token& at, const std::vector<DataType>& parameters,
+                                              const std::vector<std::unique_ptr<Codeparser::Expr>>& arguments, size_t first) {
+            if (arguments.size() - first != parameters.size()) {
+                throw SemanticError(name + "() takes " + std::to_string(parameters.size()) + " argument(s), not " + std::to_string(arguments.size() - first) + ".", at.line, at.column);
+            }
+            for (size_t i = 0; i < parameters.size(); i++) {
+                DataType expected = parameters[i];
+                DataType actual = typeOf(arguments[first + i]);
+                if (!accepts(expected, actual, arguments[first + i])) {
+                    throw SemanticError("Argument " + std::to_string(i + 1) + " to " + name + "() must be of type '" + dataTypeToString(expected) + "', not '" + dataTypeToString(actual) + "'.", at.line, at.column);
+                }
+            }
+        }
+
         DataType SemanticAnalyzer::stringToDataType(const std::string& type_str) {
             if (type_str == "String") return DataType::STRING;
             if (type_str == "Int") return DataType::INT;
@@ -0,0 +1,50 @@
+#include "compiler/stack_depth.h"
+#include "compiler/codegen.h"
+#include "common/opcode.h"
+#include <algorithm>
+
+namespace Iodicium {
+    namespace Compiler {
+
+        StackDepthPass::StackDepthPass(Common::Logger& logger) : m_logger(logger) {}
+
+        void StackDepthPass::run(Executable::Chunk& chunk, const std::map<std::string, size_t>& function_ips, const std::map<std::string, uint8_t>& arities) {
+            chunk.functions.clear();
+            if (chunk.isa != ISA_STACK) return;
+
+            std::map<size_t, uint8_t> entries{{0, 0}};
+            for (const auto& [name, ip] : function_ips) {
+                auto arity = arities.find(name);
+                if (arity == arities.end()) {
+                    throw BytecodeCompilerError("Internal Compiler Error: No arity recorded for function '" + name + "'.");
+                }
+                entries[ip] = arity->second;
+            }
+
+            const std::vector<uint8_t>& code = chunk.code;
+            for (const auto& [entry, arity] : entries) {
+                uint32_t depth = arity;
+                uint32_t max_depth = arity;
+                size_t offset = entry;
+                for (;;) {
+                    if (offset >= code.size()) {
+                        throw BytecodeCompilerError("Internal Compiler Error: The function at offset " + std::to_string(entry) + " does not return.");
+                    }
+                    uint8_t op = code[offset];
+                    if (!applyStackEffect(op, &code[offset + 1], depth, max_depth)) {
+                        throw BytecodeCompilerError("Internal Compiler Error: The stack underflows at offset " + std::to_string(offset) + ".");
+                    }
+                    if (isReturn(op)) break;
+                    offset += 1 + getOperandLength(op);
+                }
+                chunk.functions.push_back({static_cast<uint32_t>(entry), arity, max_depth});
+            }
+
+            uint32_t deepest = 0;
+            for (const auto& function : chunk.functions) deepest = std::max(deepest, function.max_stack);
+            m_logger.debug("StackDepthPass: " + std::to_string(chunk.functions.size()) + " functions, the deepest using " +
+                           std::to_string(deepest) + " stack slots.");
+        }
+
+    }
+}
@@ -0,0 +1,85 @@
+#include "compiler/superinstructions.h"
+#include "compiler/rewriter.h"
+#include "common/opcode.h"
+
+namespace Iodicium {
+    namespace Compiler {
+
+        namespace {
+
+            struct Fusion {
+                std::vector<uint8_t> sequence;
+                uint8_t opcode;
+            };
+
+            // Chosen from `iodicium run --profile` on bench/calls and bench/arith
+            // (stack code, before fusion). Dynamic counts, share of dispatches:
+            //
+            //   GET_LOCAL CONST      calls 4194304 (10.0%)  arith 2359295 (14.1%)
+            //   GET_LOCAL GET_LOCAL  calls       0          arith 1835008 (10.9%)
+            //   GET_LOCAL CALL       calls 8388606 (20.0%)  arith       0
+            //   ADD_INT RETURN       calls 8388607 (20.0%)  arith  786431  (4.7%)
+            //
+            // Longer sequences were each hot in only one workload and are two
+            // dispatches with these pairs. CONST WRITE_OUT ran at most once per
+            // program and was left out.
+            const std::vector<Fusion>& fusions() {
+                static const std::vector<Fusion> table = {
+                    {{OP_GET_LOCAL, OP_CONST}, OP_GET_LOCAL_CONST},
+                    {{OP_GET_LOCAL, OP_GET_LOCAL}, OP_GET_LOCAL_2},
+                    {{OP_GET_LOCAL, OP_CALL}, OP_GET_LOCAL_CALL},
+                    {{OP_ADD_INT, OP_RETURN}, OP_ADD_INT_RETURN},
+                };
+                return table;
+            }
+
+        }
+
+        SuperinstructionPass::SuperinstructionPass(Common::Logger& logger) : m_logger(logger) {}
+
+        void SuperinstructionPass::run(Executable::Chunk& chunk, std::map<std::string, size_t>& function_ips) {
+            if (chunk.isa != ISA_STACK) return;
+
+            BytecodeRewriter rewriter(chunk.code, function_ips);
+            std::vector<BytecodeRewriter::Instruction>& code = rewriter.getInstructions();
+
+            // A sequence may start a function but not run into one, and only its
+            // last instruction may leave the straight-line path.
+            auto matches = [&](size_t start, const Fusion& fusion) {
+                if (start + fusion.sequence.size() > code.size()) return false;
+                for (size_t i = 0; i < fusion.sequence.size(); i++) {
+                    const auto& instruction = code[start + i];
+                    if (instruction.opcode != fusion.sequence[i]) return false;
+                    if (i > 0 && rewriter.isEntry(instruction.origin)) return false;
+                    if (i + 1 < fusion.sequence.size() && isControlTransfer(instruction.opcode)) return false;
+                }
+                return true;
+            };
+
+            std::vector<BytecodeRewriter::Instruction> fused;
+            fused.reserve(code.size());
+            size_t replaced = 0;
+            for (size_t i = 0; i < code.size();) {
+                const Fusion* match = nullptr;
+                for (const auto& fusion : fusions()) {
+                    if (matches(i, fusion) && (!match || fusion.sequence.size() > match->sequence.size())) match = &fusion;
+                }
+                if (!match) {
+                    fused.push_back(std::move(code[i++]));
+                    continue;
+                }
+                BytecodeRewriter::Instruction instruction{match->opcode, {}, code[i].origin};
+                for (size_t j = 0; j < match->sequence.size(); j++, i++) {
+                    instruction.operands.insert(instruction.operands.end(), code[i].operands.begin(), code[i].operands.end());
+                }
+                fused.push_back(std::move(instruction));
+                replaced++;
+            }
+            code = std::move(fused);
+
+            rewriter.encode(chunk.code, function_ips);
+            m_logger.debug("SuperinstructionPass: Fused " + std::to_string(replaced) + " instruction sequences.");
+        }
+
+    }
+}
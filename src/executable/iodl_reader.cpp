@@ -6,7 +6,7 @@ namespace Iodicium {
 
         // File format constants from writer
         const uint32_t IODL_MAGIC_NUMBER = 0x4C444F49; // 'IODL'
-        const uint8_t IODL_VERSION = 0x01;
+        const uint8_t IODL_VERSION = 0x03;
 
         IodlReader::IodlReader(Common::Logger& logger) : m_logger(logger) {
             m_logger.debug("IodlReader constructor called.");
@@ -34,6 +34,12 @@ namespace Iodicium {
                 throw IodlReaderError("Unsupported .iodl file version: " + std::to_string(version));
             }
 
+            Chunk& chunk = lib_chunk.code_chunk;
+            file.read(reinterpret_cast<char*>(&chunk.isa), sizeof(chunk.isa));
+            if (chunk.isa != ISA_STACK && chunk.isa != ISA_REGISTER) {
+                throw IodlReaderError("Unsupported .iodl instruction set: " + std::to_string(chunk.isa));
+            }
+
             // Read the export section (export table)
             uint32_t export_count;
             file.read(reinterpret_cast<char*>(&export_count), sizeof(export_count));
@@ -44,19 +50,55 @@ namespace Iodicium {
                 file.read(&name[0], name_length);
                 uint64_t ip;
                 file.read(reinterpret_cast<char*>(&ip), sizeof(ip));
-                lib_chunk.exports[name] = static_cast<size_t>(ip);
+                Export& exported = lib_chunk.exports[name];
+                exported.ip = static_cast<size_t>(ip);
+                file.read(reinterpret_cast<char*>(&exported.return_type), sizeof(exported.return_type));
+                uint8_t parameter_count = 0;
+                file.read(reinterpret_cast<char*>(&parameter_count), sizeof(parameter_count));
+                exported.parameters.resize(parameter_count);
+                file.read(reinterpret_cast<char*>(exported.parameters.data()), parameter_count);
+                if (!file) {
+                    throw IodlReaderError("Invalid .iodl file: Corrupt export table.");
+                }
+            }
+
+            // Read the data section (string table, then the typed constant pool)
+            uint32_t string_count;
+            file.read(reinterpret_cast<char*>(&string_count), sizeof(string_count));
+            if (!file) {
+                throw IodlReaderError("Invalid .iodl file: Corrupt data section.");
+            }
+            std::vector<std::string> strings;
+            strings.reserve(string_count);
+            for (uint32_t i = 0; i < string_count; ++i) {
+                uint32_t text_length;
+                file.read(reinterpret_cast<char*>(&text_length), sizeof(text_length));
+                std::string text(text_length, '\0');
+                file.read(&text[0], text_length);
+                strings.push_back(std::move(text));
             }
 
-            // Read the data section (constant pool)
             uint32_t constant_count;
             file.read(reinterpret_cast<char*>(&constant_count), sizeof(constant_count));
             lib_chunk.code_chunk.constants.reserve(constant_count);
             for (uint32_t i = 0; i < constant_count; ++i) {
-                uint32_t constant_length;
-                file.read(reinterpret_cast<char*>(&constant_length), sizeof(constant_length));
-                std::string constant_data(constant_length, '\0');
-                file.read(&constant_data[0], constant_length);
-                lib_chunk.code_chunk.constants.push_back(constant_data);
+                Constant constant;
+                file.read(reinterpret_cast<char*>(&constant.type), sizeof(constant.type));
+                if (constant.type == Constant::INT) {
+                    file.read(reinterpret_cast<char*>(&constant.integer), sizeof(constant.integer));
+                } else if (constant.type == Constant::DOUBLE) {
+                    file.read(reinterpret_cast<char*>(&constant.number), sizeof(constant.number));
+                } else if (constant.type == Constant::STRING) {
+                    uint32_t index;
+                    file.read(reinterpret_cast<char*>(&index), sizeof(index));
+                    if (!file || index >= strings.size()) {
+                        throw IodlReaderError("Invalid .iodl file: Constant " + std::to_string(i) + " refers to a missing string.");
+                    }
+                    constant.text = strings[index];
+                } else {
+                    throw IodlReaderError("Invalid .iodl file: Constant " + std::to_string(i) + " has unknown type " + std::to_string(constant.type) + ".");
+                }
+                lib_chunk.code_chunk.constants.push_back(std::move(constant));
             }
 
             // Read the code section (bytecode)
@@ -67,6 +109,35 @@ namespace Iodicium {
                 file.read(reinterpret_cast<char*>(lib_chunk.code_chunk.code.data()), code_size);
             }
 
+            // Read the function table, the global slot count and the debug section
+            uint32_t function_count;
+            file.read(reinterpret_cast<char*>(&function_count), sizeof(function_count));
+            if (!file || function_count > code_size) {
+                throw IodlReaderError("Invalid .iodl file: Corrupt function table.");
+            }
+            chunk.functions.resize(function_count);
+            for (auto& function : chunk.functions) {
+                file.read(reinterpret_cast<char*>(&function.entry), sizeof(function.entry));
+                file.read(reinterpret_cast<char*>(&function.arity), sizeof(function.arity));
+                file.read(reinterpret_cast<char*>(&function.max_stack), sizeof(function.max_stack));
+            }
+
+            file.read(reinterpret_cast<char*>(&chunk.global_count), sizeof(chunk.global_count));
+
+            uint32_t name_count;
+            file.read(reinterpret_cast<char*>(&name_count), sizeof(name_count));
+            if (!file || (name_count != 0 && name_count != chunk.global_count)) {
+                throw IodlReaderError("Invalid .iodl file: Corrupt globals or debug section.");
+            }
+            chunk.global_names.reserve(name_count);
+            for (uint32_t i = 0; i < name_count; ++i) {
+                uint32_t name_length;
+                file.read(reinterpret_cast<char*>(&name_length), sizeof(name_length));
+                std::string name(name_length, '\0');
+                file.read(&name[0], name_length);
+                chunk.global_names.push_back(name);
+            }
+
             file.close();
             return lib_chunk;
         }
@@ -6,7 +6,9 @@ namespace Iodicium {
 
         // File format constants
         const uint32_t IODL_MAGIC_NUMBER = 0x4C444F49; // 'IODL'
-        const uint8_t IODL_VERSION = 0x01;
+        const uint8_t IODL_VERSION = 0x03; // 0x02: typed constant pool, laid out as in .iode,
+                                           // 0x03: instruction set byte, function table and globals, as in .iode;
+                                           //       the types of each export
 
         IodlWriter::IodlWriter(Common::Logger& logger) : m_logger(logger) {
             m_logger.debug("IodlWriter constructor called.");
@@ -16,14 +18,27 @@ namespace Iodicium {
             m_code_section = std::move(code);
         }
 
-        void IodlWriter::addConstant(const std::string& constant) {
+        void IodlWriter::addConstant(const Constant& constant) {
             m_data_section.push_back(constant);
         }
 
-        void IodlWriter::setExports(const std::map<std::string, size_t>& exports) {
+        void IodlWriter::setExports(const std::map<std::string, Export>& exports) {
             m_export_section = exports;
         }
 
+        void IodlWriter::setGlobals(uint32_t global_count, const std::vector<std::string>& debug_names) {
+            m_global_count = global_count;
+            m_debug_section = debug_names;
+        }
+
+        void IodlWriter::setInstructionSet(uint8_t isa) {
+            m_isa = isa;
+        }
+
+        void IodlWriter::setFunctions(const std::vector<FunctionInfo>& functions) {
+            m_function_section = functions;
+        }
+
         void IodlWriter::writeToFile(const std::string& path) {
             m_logger.debug("IodlWriter: Writing library to: " + path);
             std::ofstream file(path, std::ios::binary);
@@ -34,25 +49,51 @@ namespace Iodicium {
             // Write the .iodl header
             file.write(reinterpret_cast<const char*>(&IODL_MAGIC_NUMBER), sizeof(IODL_MAGIC_NUMBER));
             file.write(reinterpret_cast<const char*>(&IODL_VERSION), sizeof(IODL_VERSION));
+            file.write(reinterpret_cast<const char*>(&m_isa), sizeof(m_isa));
 
             // Write the export section (export table)
             uint32_t export_count = static_cast<uint32_t>(m_export_section.size());
             file.write(reinterpret_cast<const char*>(&export_count), sizeof(export_count));
-            for (const auto& [name, ip] : m_export_section) {
+            for (const auto& [name, exported] : m_export_section) {
                 uint32_t name_length = static_cast<uint32_t>(name.length());
                 file.write(reinterpret_cast<const char*>(&name_length), sizeof(name_length));
                 file.write(name.data(), name_length);
-                uint64_t ip_64 = static_cast<uint64_t>(ip); // Use a fixed-size integer for IP
+                uint64_t ip_64 = static_cast<uint64_t>(exported.ip); // Use a fixed-size integer for IP
                 file.write(reinterpret_cast<const char*>(&ip_64), sizeof(ip_64));
+                file.write(reinterpret_cast<const char*>(&exported.return_type), sizeof(exported.return_type));
+                uint8_t parameter_count = static_cast<uint8_t>(exported.parameters.size());
+                file.write(reinterpret_cast<const char*>(&parameter_count), sizeof(parameter_count));
+                file.write(reinterpret_cast<const char*>(exported.parameters.data()), parameter_count);
+            }
+
+            // Write the data section (string table, then the typed constant pool)
+            std::vector<const std::string*> strings;
+            std::map<std::string, uint32_t> string_indices;
+            for (const auto& constant : m_data_section) {
+                if (constant.type == Constant::STRING && string_indices.emplace(constant.text, static_cast<uint32_t>(strings.size())).second) {
+                    strings.push_back(&constant.text);
+                }
+            }
+            uint32_t string_count = static_cast<uint32_t>(strings.size());
+            file.write(reinterpret_cast<const char*>(&string_count), sizeof(string_count));
+            for (const std::string* text : strings) {
+                uint32_t text_length = static_cast<uint32_t>(text->length());
+                file.write(reinterpret_cast<const char*>(&text_length), sizeof(text_length));
+                file.write(text->data(), text_length);
             }
 
-            // Write the data section (constant pool)
             uint32_t constant_count = static_cast<uint32_t>(m_data_section.size());
             file.write(reinterpret_cast<const char*>(&constant_count), sizeof(constant_count));
             for (const auto& constant : m_data_section) {
-                uint32_t constant_length = static_cast<uint32_t>(constant.length());
-                file.write(reinterpret_cast<const char*>(&constant_length), sizeof(constant_length));
-                file.write(constant.data(), constant_length);
+                file.write(reinterpret_cast<const char*>(&constant.type), sizeof(constant.type));
+                if (constant.type == Constant::INT) {
+                    file.write(reinterpret_cast<const char*>(&constant.integer), sizeof(constant.integer));
+                } else if (constant.type == Constant::DOUBLE) {
+                    file.write(reinterpret_cast<const char*>(&constant.number), sizeof(constant.number));
+                } else {
+                    uint32_t index = string_indices.at(constant.text);
+                    file.write(reinterpret_cast<const char*>(&index), sizeof(index));
+                }
             }
 
             // Write the code section (bytecode)
@@ -62,6 +103,25 @@ namespace Iodicium {
                 file.write(reinterpret_cast<const char*>(m_code_section.data()), code_size);
             }
 
+            // Write the function table, the global slot count and the debug section, as in .iode
+            uint32_t function_count = static_cast<uint32_t>(m_function_section.size());
+            file.write(reinterpret_cast<const char*>(&function_count), sizeof(function_count));
+            for (const auto& function : m_function_section) {
+                file.write(reinterpret_cast<const char*>(&function.entry), sizeof(function.entry));
+                file.write(reinterpret_cast<const char*>(&function.arity), sizeof(function.arity));
+                file.write(reinterpret_cast<const char*>(&function.max_stack), sizeof(function.max_stack));
+            }
+
+            file.write(reinterpret_cast<const char*>(&m_global_count), sizeof(m_global_count));
+
+            uint32_t name_count = static_cast<uint32_t>(m_debug_section.size());
+            file.write(reinterpret_cast<const char*>(&name_count), sizeof(name_count));
+            for (const auto& name : m_debug_section) {
+                uint32_t name_length = static_cast<uint32_t>(name.length());
+                file.write(reinterpret_cast<const char*>(&name_length), sizeof(name_length));
+                file.write(name.data(), name_length);
+            }
+
             file.close();
         }
 
@@ -8,7 +8,7 @@ namespace Iodicium {
 
         // File format constants from writer
         const uint32_t IOE_MAGIC_NUMBER = 0x45444F49; // 'IODE'
-        const uint8_t IOE_VERSION = 0x01;
+        const uint8_t IOE_VERSION = 0x06;
 
         IoeReader::IoeReader(Common::Logger& logger) : m_logger(logger) {
             m_logger.debug("IoeReader constructor called.");
@@ -37,6 +37,11 @@ namespace Iodicium {
                 throw IoeReaderError("Unsupported .iode file version: " + std::to_string(version));
             }
 
+            file.read(reinterpret_cast<char*>(&chunk.isa), sizeof(chunk.isa));
+            if (chunk.isa != ISA_STACK && chunk.isa != ISA_REGISTER) {
+                throw IoeReaderError("Unsupported .iode instruction set: " + std::to_string(chunk.isa));
+            }
+
             // Read the import section (import table)
             uint32_t import_count;
             file.read(reinterpret_cast<char*>(&import_count), sizeof(import_count));
@@ -50,16 +55,43 @@ namespace Iodicium {
                 chunk.external_references.push_back(import_path);
             }
 
-            // Read the data section (constant pool)
+            // Read the data section (string table, then the typed constant pool)
+            uint32_t string_count;
+            file.read(reinterpret_cast<char*>(&string_count), sizeof(string_count));
+            if (!file) {
+                throw IoeReaderError("Invalid .iode file: Corrupt data section.");
+            }
+            std::vector<std::string> strings;
+            strings.reserve(string_count);
+            for (uint32_t i = 0; i < string_count; ++i) {
+                uint32_t text_length;
+                file.read(reinterpret_cast<char*>(&text_length), sizeof(text_length));
+                std::string text(text_length, '\0'); // Pre-allocate string
+                file.read(&text[0], text_length);
+                strings.push_back(std::move(text));
+            }
+
             uint32_t constant_count;
             file.read(reinterpret_cast<char*>(&constant_count), sizeof(constant_count));
             chunk.constants.reserve(constant_count);
             for (uint32_t i = 0; i < constant_count; ++i) {
-                uint32_t constant_length;
-                file.read(reinterpret_cast<char*>(&constant_length), sizeof(constant_length));
-                std::string constant_data(constant_length, '\0'); // Pre-allocate string
-                file.read(&constant_data[0], constant_length);
-                chunk.constants.push_back(constant_data);
+                Constant constant;
+                file.read(reinterpret_cast<char*>(&constant.type), sizeof(constant.type));
+                if (constant.type == Constant::INT) {
+                    file.read(reinterpret_cast<char*>(&constant.integer), sizeof(constant.integer));
+                } else if (constant.type == Constant::DOUBLE) {
+                    file.read(reinterpret_cast<char*>(&constant.number), sizeof(constant.number));
+                } else if (constant.type == Constant::STRING) {
+                    uint32_t index;
+                    file.read(reinterpret_cast<char*>(&index), sizeof(index));
+                    if (!file || index >= strings.size()) {
+                        throw IoeReaderError("Invalid .iode file: Constant " + std::to_string(i) + " refers to a missing string.");
+                    }
+                    constant.text = strings[index];
+                } else {
+                    throw IoeReaderError("Invalid .iode file: Constant " + std::to_string(i) + " has unknown type " + std::to_string(constant.type) + ".");
+                }
+                chunk.constants.push_back(std::move(constant));
             }
 
             // Read the code section (bytecode)
@@ -70,6 +102,71 @@ namespace Iodicium {
                 file.read(reinterpret_cast<char*>(chunk.code.data()), code_size);
             }
 
+            // Read the function table
+            uint32_t function_count;
+            file.read(reinterpret_cast<char*>(&function_count), sizeof(function_count));
+            if (!file || function_count > code_size) {
+                throw IoeReaderError("Invalid .iode file: Corrupt function table.");
+            }
+            chunk.functions.resize(function_count);
+            for (auto& function : chunk.functions) {
+                file.read(reinterpret_cast<char*>(&function.entry), sizeof(function.entry));
+                file.read(reinterpret_cast<char*>(&function.arity), sizeof(function.arity));
+                file.read(reinterpret_cast<char*>(&function.max_stack), sizeof(function.max_stack));
+            }
+
+            file.read(reinterpret_cast<char*>(&chunk.global_count), sizeof(chunk.global_count));
+
+            // Read the debug section (global slot names)
+            uint32_t name_count;
+            file.read(reinterpret_cast<char*>(&name_count), sizeof(name_count));
+            if (!file || (name_count != 0 && name_count != chunk.global_count)) {
+                throw IoeReaderError("Invalid .iode file: Corrupt globals or debug section.");
+            }
+            chunk.global_names.reserve(name_count);
+            for (uint32_t i = 0; i < name_count; ++i) {
+                uint32_t name_length;
+                file.read(reinterpret_cast<char*>(&name_length), sizeof(name_length));
+                std::string name(name_length, '\0');
+                file.read(&name[0], name_length);
+                chunk.global_names.push_back(name);
+            }
+
+            // Read the snapshot section. The Loader checks that the resume
+            // offset is a statement boundary of the top-level code.
+            file.read(reinterpret_cast<char*>(&chunk.snapshot.resume), sizeof(chunk.snapshot.resume));
+            if (!file) {
+                throw IoeReaderError("Invalid .iode file: Missing snapshot section.");
+            }
+            if (chunk.snapshot.resume != 0) {
+                chunk.snapshot.globals.resize(chunk.global_count);
+                for (uint32_t i = 0; i < chunk.global_count; ++i) {
+                    SnapshotValue& global = chunk.snapshot.globals[i];
+                    file.read(reinterpret_cast<char*>(&global.type), sizeof(global.type));
+                    if (global.type == SnapshotValue::BOOL) {
+                        uint8_t boolean = 0;
+                        file.read(reinterpret_cast<char*>(&boolean), sizeof(boolean));
+                        global.boolean = boolean != 0;
+                    } else if (global.type == SnapshotValue::INT) {
+                        file.read(reinterpret_cast<char*>(&global.integer), sizeof(global.integer));
+                    } else if (global.type == SnapshotValue::DOUBLE) {
+                        file.read(reinterpret_cast<char*>(&global.number), sizeof(global.number));
+                    } else if (global.type == SnapshotValue::STRING) {
+                        uint32_t index;
+                        file.read(reinterpret_cast<char*>(&index), sizeof(index));
+                        if (!file || index >= strings.size()) {
+                            throw IoeReaderError("Invalid .iode file: Snapshot global " + std::to_string(i) + " refers to a missing string.");
+                        }
+                        global.text = strings[index];
+                    } else if (global.type != SnapshotValue::NIL) {
+                        throw IoeReaderError("Invalid .iode file: Snapshot global " + std::to_string(i) + " has unknown type " + std::to_string(global.type) + ".");
+                    }
+                }
+                if (!file) {
+                    throw IoeReaderError("Invalid .iode file: Corrupt snapshot section.");
+                }
+            }
+
             file.close();
             m_logger.debug("IoeReader: File closed: " + path);
             return chunk;
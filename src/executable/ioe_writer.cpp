@@ -1,5 +1,6 @@
 #include "executable/ioe_writer.h"
 #include <fstream>
+#include <map>
 #include "common/error.h" // Include base error class
 
 namespace Iodicium {
@@ -7,7 +8,8 @@ namespace Iodicium {
 
         // File format constants
         const uint32_t IOE_MAGIC_NUMBER = 0x45444F49; // 'IODE'
-        const uint8_t IOE_VERSION = 0x01;
+        const uint8_t IOE_VERSION = 0x06; // 0x02: slot-indexed globals, 0x03: instruction set byte, 0x04: typed constant pool,
+                                          // 0x05: function table, 0x06: snapshot section
 
         IoeWriter::IoeWriter(Common::Logger& logger) : m_logger(logger) {
             m_logger.debug("IoeWriter constructor called.");
@@ -18,8 +20,8 @@ namespace Iodicium {
             m_code_section = std::move(code);
         }
 
-        void IoeWriter::addConstant(const std::string& constant) {
-            m_logger.debug("IoeWriter: Adding constant: " + constant);
+        void IoeWriter::addConstant(const Constant& constant) {
+            m_logger.debug("IoeWriter: Adding constant of type " + std::to_string(constant.type) + ".");
             m_data_section.push_back(constant);
         }
 
@@ -28,6 +30,27 @@ namespace Iodicium {
             m_import_section = imports;
         }
 
+        void IoeWriter::setGlobals(uint32_t global_count, const std::vector<std::string>& debug_names) {
+            m_logger.debug("IoeWriter: Setting " + std::to_string(global_count) + " global slots.");
+            m_global_count = global_count;
+            m_debug_section = debug_names;
+        }
+
+        void IoeWriter::setInstructionSet(uint8_t isa) {
+            m_logger.debug("IoeWriter: Setting instruction set " + std::to_string(isa) + ".");
+            m_isa = isa;
+        }
+
+        void IoeWriter::setFunctions(const std::vector<FunctionInfo>& functions) {
+            m_logger.debug("IoeWriter: Setting " + std::to_string(functions.size()) + " function table entries.");
+            m_function_section = functions;
+        }
+
+        void IoeWriter::setSnapshot(const Snapshot& snapshot) {
+            m_logger.debug("IoeWriter: Setting a snapshot that resumes at offset " + std::to_string(snapshot.resume) + ".");
+            m_snapshot_section = snapshot;
+        }
+
         void IoeWriter::writeToFile(const std::string& path) {
             m_logger.debug("IoeWriter: Writing executable to: " + path);
             std::ofstream file(path, std::ios::binary);
@@ -38,6 +61,7 @@ namespace Iodicium {
 
             file.write(reinterpret_cast<const char*>(&IOE_MAGIC_NUMBER), sizeof(IOE_MAGIC_NUMBER));
             file.write(reinterpret_cast<const char*>(&IOE_VERSION), sizeof(IOE_VERSION));
+            file.write(reinterpret_cast<const char*>(&m_isa), sizeof(m_isa));
 
             uint32_t import_count = static_cast<uint32_t>(m_import_section.size());
             file.write(reinterpret_cast<const char*>(&import_count), sizeof(import_count));
@@ -47,12 +71,44 @@ namespace Iodicium {
                 file.write(import_path.data(), path_length);
             }
 
+            // Data section: the string table, then the constant pool. Each
+            // constant is a type byte followed by its binary value (Int,
+            // Double) or the index of its text in the string table (String).
+            // The table also holds the strings of the snapshot's globals.
+            std::vector<const std::string*> strings;
+            std::map<std::string, uint32_t> string_indices;
+            auto addString = [&](const std::string& text) {
+                if (string_indices.emplace(text, static_cast<uint32_t>(strings.size())).second) strings.push_back(&text);
+            };
+            for (const auto& constant : m_data_section) {
+                if (constant.type == Constant::STRING) addString(constant.text);
+            }
+            bool has_snapshot = m_snapshot_section.resume != 0;
+            if (has_snapshot) {
+                for (const auto& global : m_snapshot_section.globals) {
+                    if (global.type == SnapshotValue::STRING) addString(global.text);
+                }
+            }
+            uint32_t string_count = static_cast<uint32_t>(strings.size());
+            file.write(reinterpret_cast<const char*>(&string_count), sizeof(string_count));
+            for (const std::string* text : strings) {
+                uint32_t text_length = static_cast<uint32_t>(text->length());
+                file.write(reinterpret_cast<const char*>(&text_length), sizeof(text_length));
+                file.write(text->data(), text_length);
+            }
+
             uint32_t constant_count = static_cast<uint32_t>(m_data_section.size());
             file.write(reinterpret_cast<const char*>(&constant_count), sizeof(constant_count));
             for (const auto& constant : m_data_section) {
-                uint32_t constant_length = static_cast<uint32_t>(constant.length());
-                file.write(reinterpret_cast<const char*>(&constant_length), sizeof(constant_length));
-                file.write(constant.data(), constant_length);
+                file.write(reinterpret_cast<const char*>(&constant.type), sizeof(constant.type));
+                if (constant.type == Constant::INT) {
+                    file.write(reinterpret_cast<const char*>(&constant.integer), sizeof(constant.integer));
+                } else if (constant.type == Constant::DOUBLE) {
+                    file.write(reinterpret_cast<const char*>(&constant.number), sizeof(constant.number));
+                } else {
+                    uint32_t index = string_indices.at(constant.text);
+                    file.write(reinterpret_cast<const char*>(&index), sizeof(index));
+                }
             }
 
             uint32_t code_size = static_cast<uint32_t>(m_code_section.size());
@@ -61,6 +117,47 @@ namespace Iodicium {
                 file.write(reinterpret_cast<const char*>(m_code_section.data()), code_size);
             }
 
+            // Function table: the entry, arity and maximum stack depth of each function.
+            uint32_t function_count = static_cast<uint32_t>(m_function_section.size());
+            file.write(reinterpret_cast<const char*>(&function_count), sizeof(function_count));
+            for (const auto& function : m_function_section) {
+                file.write(reinterpret_cast<const char*>(&function.entry), sizeof(function.entry));
+                file.write(reinterpret_cast<const char*>(&function.arity), sizeof(function.arity));
+                file.write(reinterpret_cast<const char*>(&function.max_stack), sizeof(function.max_stack));
+            }
+
+            file.write(reinterpret_cast<const char*>(&m_global_count), sizeof(m_global_count));
+
+            // Debug section: names for the global slots, absent in obfuscated builds.
+            uint32_t name_count = static_cast<uint32_t>(m_debug_section.size());
+            file.write(reinterpret_cast<const char*>(&name_count), sizeof(name_count));
+            for (const auto& name : m_debug_section) {
+                uint32_t name_length = static_cast<uint32_t>(name.length());
+                file.write(reinterpret_cast<const char*>(&name_length), sizeof(name_length));
+                file.write(name.data(), name_length);
+            }
+
+            // Snapshot section: the resume offset, 0 if there is no
+            // snapshot, then a type byte and a value for each global slot.
+            uint32_t resume = has_snapshot ? m_snapshot_section.resume : 0;
+            file.write(reinterpret_cast<const char*>(&resume), sizeof(resume));
+            if (has_snapshot) {
+                for (const auto& global : m_snapshot_section.globals) {
+                    file.write(reinterpret_cast<const char*>(&global.type), sizeof(global.type));
+                    if (global.type == SnapshotValue::BOOL) {
+                        uint8_t boolean = global.boolean ? 1 : 0;
+                        file.write(reinterpret_cast<const char*>(&boolean), sizeof(boolean));
+                    } else if (global.type == SnapshotValue::INT) {
+                        file.write(reinterpret_cast<const char*>(&global.integer), sizeof(global.integer));
+                    } else if (global.type == SnapshotValue::DOUBLE) {
+                        file.write(reinterpret_cast<const char*>(&global.number), sizeof(global.number));
+                    } else if (global.type == SnapshotValue::STRING) {
+                        uint32_t index = string_indices.at(global.text);
+                        file.write(reinterpret_cast<const char*>(&index), sizeof(index));
+                    }
+                }
+            }
+
             file.close();
             m_logger.debug("IoeWriter: File closed: " + path);
         }
@@ -3,12 +3,14 @@
 #include <commctrl.h>
 #endif
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <fstream>
 #include <sstream>
 #include <cctype>
+#include <csignal>
 
 #include "cppParse/parser.hpp"
 #include "cppParse/help_formatter.hpp"
@@ -23,7 +25,13 @@
 
 
 #include "compiler/linker.h"
+#include "compiler/c_translator.h"
 #include "vm/vm.h"
+#include "vm/instrumentation.h"
+#include "vm/workers.h"
+#include "vm/library.h"
+#include "vm/server.h"
+#include "vm/snapshot.h"
 
 
 #include "codeparser/lexer.h"
@@ -31,8 +39,11 @@
 #include "compiler/semantics.h"
 #include "compiler/codegen.h"
 
-void compileProject(const std::string& project_path, Iodicium::Common::Logger& logger, bool obfuscate_enabled);
-void runFile(const std::string& path, const std::string& memory, Iodicium::Common::Logger& logger);
+void compileProject(const std::string& project_path, Iodicium::Common::Logger& logger, bool obfuscate_enabled, uint8_t isa, bool fuse_enabled, bool inline_enabled, const std::string& emit);
+void runFile(const std::string& path, const std::string& memory, const std::string& max_depth, const std::string& output_buffer, const std::string& workers, const std::string& jobs, const std::string& threads, bool huge_pages, bool profile, bool jit_enabled, Iodicium::Common::Logger& logger);
+void serveLibrary(const std::string& path, const std::string& socket_path, const std::string& workers, const std::string& memory, const std::string& max_depth, bool jit_enabled, Iodicium::Common::Logger& logger);
+bool callServer(const std::string& socket_path);
+void snapshotFile(const std::string& path, const std::string& output, Iodicium::Common::Logger& logger);
 
 size_t parseMemoryString(const std::string& memory_str) {
     if (memory_str.empty()) {
@@ -67,6 +78,16 @@ size_t parseMemoryString(const std::string& memory_str) {
     }
 }
 
+// Parses a positive count of at most 9 digits, such as a call depth.
+size_t parseCount(const std::string& text, const std::string& what) {
+    bool digits = !text.empty() && text.size() <= 9;
+    for (char c : text) digits = digits && std::isdigit(static_cast<unsigned char>(c));
+    if (!digits || std::stoul(text) == 0) {
+        throw std::runtime_error("Invalid " + what + ": " + text);
+    }
+    return std::stoul(text);
+}
+
 int main(int argc, char** argv) {
 #if defined(_WIN32)
     INITCOMMONCONTROLSEX icc = { sizeof(icc), ICC_STANDARD_CLASSES };
@@ -81,16 +102,52 @@ int main(int argc, char** argv) {
     auto& compile_cmd = parser.add_subparser("compile");
     compile_cmd.add_description("Compile an Iodicium project.");
     compile_cmd.add_argument({"project"}).help("Path to the Iodicium.toml project file.").required(true);
-    compile_cmd.add_argument({"-ob", "--obfuscate"}).help("Obfuscate variable names in the compiled output.").store_true();
+    compile_cmd.add_argument({"-ob", "--obfuscate"}).help("Strip variable names from the compiled output.").store_true();
+    compile_cmd.add_argument({"--isa"}).takes_value().help("Instruction set to generate: stack (default) or register.");
+    compile_cmd.add_argument({"--no-fuse"}).help("Do not fuse common instruction sequences into superinstructions.").store_true();
+    compile_cmd.add_argument({"--no-inline"}).help("Do not inline calls to small functions.").store_true();
+    compile_cmd.add_argument({"--emit"}).takes_value().help("Output to write: ioe (default) or c, a C program to build with the system compiler.");
     compile_cmd.add_argument({"-h", "--help"}).help("Show this help message and exit.").store_true();
 
     // --- Run Command ---
     auto& run_cmd = parser.add_subparser("run");
     run_cmd.add_description("Run an Iodicium executable file.");
     run_cmd.add_argument({"file"}).help("The .iode file to execute.").required(true);
-    run_cmd.add_argument({"--memory"}).help("Set the VM memory limit (e.g., 256M).");
+    run_cmd.add_argument({"--memory"}).takes_value().help("Set the VM memory limit (e.g., 256M).");
+    run_cmd.add_argument({"--max-depth"}).takes_value().help("Set the deepest function call nesting allowed (default 10000).");
+    run_cmd.add_argument({"--output-buffer"}).takes_value().help("Set how much standard output is buffered before it is written (e.g., 1M; default 64K, 0 for none).");
+    run_cmd.add_argument({"--workers"}).takes_value().help("Run the program once per job on this many threads, each with its own VM.");
+    run_cmd.add_argument({"--jobs"}).takes_value().help("With --workers, the file listing one job per line (default: standard input). Scripts read theirs with job().");
+    run_cmd.add_argument({"--threads"}).takes_value().help("Set how many threads run tasks started with spawn() (default: one per core).");
+    run_cmd.add_argument({"--huge-pages"}).help("Back VM memory with transparent huge pages where available.").store_true();
+    run_cmd.add_argument({"--profile"}).help("Report the most executed opcode sequences after the run.").store_true();
+    run_cmd.add_argument({"--no-jit"}).help("Interpret every function instead of compiling hot ones to native code.").store_true();
     run_cmd.add_argument({"-h", "--help"}).help("Show this help message and exit.").store_true();
 
+    // --- Snapshot Command ---
+    auto& snapshot_cmd = parser.add_subparser("snapshot");
+    snapshot_cmd.add_description("Run the initialization of an Iodicium executable once, so that runs start after it.");
+    snapshot_cmd.add_argument({"file"}).help("The .iode file to snapshot.").required(true);
+    snapshot_cmd.add_argument({"-o", "--output"}).takes_value().help("Write the snapshotted executable here instead of over the file.");
+    snapshot_cmd.add_argument({"-h", "--help"}).help("Show this help message and exit.").store_true();
+
+    // --- Serve Command ---
+    auto& serve_cmd = parser.add_subparser("serve");
+    serve_cmd.add_description("Keep an Iodicium library loaded and call its functions for local clients.");
+    serve_cmd.add_argument({"library"}).help("The .iodl file whose exported functions to serve.").required(true);
+    serve_cmd.add_argument({"--socket"}).takes_value().help("The Unix domain socket to listen on.").required(true);
+    serve_cmd.add_argument({"--workers"}).takes_value().help("Answer this many requests at once, each worker with its own VM (default 1).");
+    serve_cmd.add_argument({"--memory"}).takes_value().help("Set the memory limit shared by the workers' VMs (e.g., 256M).");
+    serve_cmd.add_argument({"--max-depth"}).takes_value().help("Set the deepest function call nesting allowed (default 10000).");
+    serve_cmd.add_argument({"--no-jit"}).help("Interpret every function instead of compiling hot ones to native code.").store_true();
+    serve_cmd.add_argument({"-h", "--help"}).help("Show this help message and exit.").store_true();
+
+    // --- Call Command ---
+    auto& call_cmd = parser.add_subparser("call");
+    call_cmd.add_description("Send the requests on standard input, one per line, to a library being served.");
+    call_cmd.add_argument({"--socket"}).takes_value().help("The Unix domain socket the server listens on.").required(true);
+    call_cmd.add_argument({"-h", "--help"}).help("Show this help message and exit.").store_true();
+
     Iodicium::Common::Logger main_logger;
 
     try {
@@ -113,7 +170,15 @@ int main(int argc, char** argv) {
                 return 0;
             }
             bool obfuscate_enabled = sub_parser.get<bool>("-ob");
-            compileProject(sub_parser.get<std::string>("project"), main_logger, obfuscate_enabled);
+            std::string isa = sub_parser.get<std::string>("--isa");
+            if (!isa.empty() && isa != "stack" && isa != "register") {
+                throw std::runtime_error("Unknown instruction set: " + isa + " (expected 'stack' or 'register')");
+            }
+            std::string emit = sub_parser.get<std::string>("--emit");
+            if (!emit.empty() && emit != "ioe" && emit != "c") {
+                throw std::runtime_error("Unknown output kind: " + emit + " (expected 'ioe' or 'c')");
+            }
+            compileProject(sub_parser.get<std::string>("project"), main_logger, obfuscate_enabled, isa == "register" ? ISA_REGISTER : ISA_STACK, !sub_parser.get<bool>("--no-fuse"), !sub_parser.get<bool>("--no-inline"), emit);
         } else if (parser.is_subcommand_used("run")) {
             auto& sub_parser = parser.get_subparser("run");
             if (sub_parser.get<bool>("--help")) {
@@ -121,7 +186,31 @@ int main(int argc, char** argv) {
                 std::cout << formatter.format();
                 return 0;
             }
-            runFile(sub_parser.get<std::string>("file"), sub_parser.get<std::string>("--memory"), main_logger);
+            runFile(sub_parser.get<std::string>("file"), sub_parser.get<std::string>("--memory"), sub_parser.get<std::string>("--max-depth"), sub_parser.get<std::string>("--output-buffer"), sub_parser.get<std::string>("--workers"), sub_parser.get<std::string>("--jobs"), sub_parser.get<std::string>("--threads"), sub_parser.get<bool>("--huge-pages"), sub_parser.get<bool>("--profile"), !sub_parser.get<bool>("--no-jit"), main_logger);
+        } else if (parser.is_subcommand_used("snapshot")) {
+            auto& sub_parser = parser.get_subparser("snapshot");
+            if (sub_parser.get<bool>("--help")) {
+                cppParse::HelpFormatter formatter(sub_parser);
+                std::cout << formatter.format();
+                return 0;
+            }
+            snapshotFile(sub_parser.get<std::string>("file"), sub_parser.get<std::string>("--output"), main_logger);
+        } else if (parser.is_subcommand_used("serve")) {
+            auto& sub_parser = parser.get_subparser("serve");
+            if (sub_parser.get<bool>("--help")) {
+                cppParse::HelpFormatter formatter(sub_parser);
+                std::cout << formatter.format();
+                return 0;
+            }
+            serveLibrary(sub_parser.get<std::string>("library"), sub_parser.get<std::string>("--socket"), sub_parser.get<std::string>("--workers"), sub_parser.get<std::string>("--memory"), sub_parser.get<std::string>("--max-depth"), !sub_parser.get<bool>("--no-jit"), main_logger);
+        } else if (parser.is_subcommand_used("call")) {
+            auto& sub_parser = parser.get_subparser("call");
+            if (sub_parser.get<bool>("--help")) {
+                cppParse::HelpFormatter formatter(sub_parser);
+                std::cout << formatter.format();
+                return 0;
+            }
+            return callServer(sub_parser.get<std::string>("--socket")) ? 0 : 1;
         } else if (argc == 1) {
             std::cout << "No arguments provided. Try --help for help." << std::endl;
         }
@@ -142,7 +231,7 @@ int main(int argc, char** argv) {
     return 0;
 }
 
-void compileProject(const std::string& project_path, Iodicium::Common::Logger& logger, bool obfuscate_enabled) {
+void compileProject(const std::string& project_path, Iodicium::Common::Logger& logger, bool obfuscate_enabled, uint8_t isa, bool fuse_enabled, bool inline_enabled, const std::string& emit) {
     logger.info("Compiling project: " + project_path);
 
     std::ifstream file(project_path);
@@ -167,22 +256,52 @@ void compileProject(const std::string& project_path, Iodicium::Common::Logger& l
 
     bool is_library = (project_type == "library");
 
-    Iodicium::Compiler::Linker linker(logger);
+    Iodicium::Compiler::Linker linker(logger, obfuscate_enabled, isa, fuse_enabled, inline_enabled);
     Iodicium::Executable::Chunk chunk = linker.link(source_files);
 
+    if (emit == "c") {
+        if (is_library) throw std::runtime_error("C output is only available for executable projects.");
+        std::string c_path = project_name + ".c";
+        logger.info("Writing C translation to: " + c_path);
+        Iodicium::Compiler::CTranslator translator(logger);
+        translator.writeToFile(chunk, linker.getFunctionIPs(), c_path);
+        logger.info("Compilation successful. Build " + c_path + " with a C compiler, e.g. cc -O2 " + c_path + " -o " + project_name);
+        return;
+    }
+
     std::string out_path = project_name + (is_library ? ".iodl" : ".iode");
     logger.info("Writing final output to: " + out_path);
 
     if (is_library) {
+        // Only functions marked @export are exported. Each export carries
+        // its declared types, so that hosts can check what they pass.
+        std::map<std::string, Iodicium::Executable::Export> exports;
+        for (const auto& [name, ip] : linker.getFunctionIPs()) {
+            auto found = linker.getFunctionSignatures().find(name);
+            if (found == linker.getFunctionSignatures().end() || !found->second.is_exported) continue;
+            const Iodicium::Compiler::FunctionSignature& signature = found->second;
+            Iodicium::Executable::Export& exported = exports[name];
+            exported.ip = ip;
+            exported.return_type = static_cast<uint8_t>(signature.return_type);
+            for (Iodicium::Compiler::DataType parameter : signature.parameters) exported.parameters.push_back(static_cast<uint8_t>(parameter));
+        }
+        if (exports.empty()) throw std::runtime_error("Library '" + project_name + "' exports no functions; mark the ones hosts may call with @export.");
+
         Iodicium::Executable::IodlWriter writer(logger);
-        writer.setExports(linker.getFunctionIPs());
+        writer.setExports(exports);
+        writer.setInstructionSet(chunk.isa);
+        writer.setGlobals(chunk.global_count, chunk.global_names);
         writer.setCode(chunk.code);
+        writer.setFunctions(chunk.functions);
         for(const auto& constant : chunk.constants) writer.addConstant(constant);
         writer.writeToFile(out_path);
     } else {
         Iodicium::Executable::IoeWriter writer(logger);
         writer.setImports({});
+        writer.setInstructionSet(chunk.isa);
+        writer.setGlobals(chunk.global_count, chunk.global_names);
         writer.setCode(chunk.code);
+        writer.setFunctions(chunk.functions);
         for(const auto& constant : chunk.constants) writer.addConstant(constant);
         writer.writeToFile(out_path);
     }
@@ -190,7 +309,7 @@ void compileProject(const std::string& project_path, Iodicium::Common::Logger& l
     logger.info("Compilation successful. Output written to " + out_path);
 }
 
-void runFile(const std::string& path, const std::string& memory, Iodicium::Common::Logger& logger) {
+void runFile(const std::string& path, const std::string& memory, const std::string& max_depth, const std::string& output_buffer, const std::string& workers, const std::string& jobs, const std::string& threads, bool huge_pages, bool profile, bool jit_enabled, Iodicium::Common::Logger& logger) {
     logger.info("Initializing Iodicium VM...");
 
     size_t memoryLimitBytes = 0;
@@ -203,11 +322,151 @@ void runFile(const std::string& path, const std::string& memory, Iodicium::Commo
         }
     }
 
+    size_t maxCallDepth = Iodicium::VM::VirtualMachine::DEFAULT_MAX_CALL_DEPTH;
+    if (!max_depth.empty()) {
+        maxCallDepth = parseCount(max_depth, "call depth");
+    }
+
+    size_t taskThreads = 0;
+    if (!threads.empty()) {
+        taskThreads = parseCount(threads, "thread count");
+    }
+
+    size_t outputBufferBytes = Iodicium::VM::OutputBuffer::DEFAULT_CAPACITY;
+    if (!output_buffer.empty()) {
+        outputBufferBytes = parseMemoryString(output_buffer);
+    }
+
     Iodicium::Executable::IoeReader reader(logger);
     Iodicium::Executable::Chunk chunk = reader.readFromFile(path);
 
+    Iodicium::VM::Loader loader(logger);
+    Iodicium::VM::Program program = loader.load(chunk);
+
+    auto configure = [&](Iodicium::VM::VirtualMachine& vm) {
+        vm.setJitEnabled(jit_enabled);
+        vm.setMaxCallDepth(maxCallDepth);
+        vm.setOutputBuffer(outputBufferBytes);
+        vm.setHugePages(huge_pages);
+        vm.setTaskThreads(taskThreads);
+    };
+
+    if (!workers.empty()) {
+        if (profile) throw std::runtime_error("--profile cannot be combined with --workers.");
+        size_t workerCount = parseCount(workers, "worker count");
+
+        std::vector<std::string> jobList;
+        std::ifstream jobFile;
+        if (!jobs.empty()) {
+            jobFile.open(jobs);
+            if (!jobFile.is_open()) throw std::runtime_error("Could not open job file: " + jobs);
+        }
+        std::istream& jobStream = jobs.empty() ? std::cin : jobFile;
+        for (std::string line; std::getline(jobStream, line);) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) jobList.push_back(line);
+        }
+
+        // With a limit, each worker gets an equal share of the memory.
+        Iodicium::VM::WorkerPool pool(logger, program, workerCount, memoryLimitBytes / workerCount);
+        pool.setConfigure(configure);
+        size_t failed = pool.run(jobList);
+        if (failed > 0) {
+            throw std::runtime_error(std::to_string(failed) + " of " + std::to_string(jobList.size()) + " jobs failed.");
+        }
+        logger.info("Execution finished.");
+        return;
+    }
+
     Iodicium::VM::VirtualMachine vm(logger, memoryLimitBytes);
-    vm.run(chunk);
+    configure(vm);
+    if (profile) {
+        Iodicium::VM::ProfilingInstrumentation profiler(program);
+        vm.run(program, profiler);
+        Iodicium::VM::printOpcodeProfile(program, profiler.getCounts());
+    } else {
+        vm.run(program);
+    }
 
     logger.info("Execution finished.");
 }
+
+void snapshotFile(const std::string& path, const std::string& output, Iodicium::Common::Logger& logger) {
+    Iodicium::Executable::IoeReader reader(logger);
+    Iodicium::Executable::Chunk chunk = reader.readFromFile(path);
+    chunk.snapshot = Iodicium::VM::takeSnapshot(logger, chunk);
+
+    size_t defined = std::count_if(chunk.snapshot.globals.begin(), chunk.snapshot.globals.end(), [](const Iodicium::Executable::SnapshotValue& global) {
+        return global.type != Iodicium::Executable::SnapshotValue::NIL;
+    });
+    logger.info("Initialization defined " + std::to_string(defined) + " of " + std::to_string(chunk.global_count) + " globals; runs will start at offset " + std::to_string(chunk.snapshot.resume) + ".");
+
+    std::string out_path = output.empty() ? path : output;
+    Iodicium::Executable::IoeWriter writer(logger);
+    writer.setImports(chunk.external_references);
+    writer.setInstructionSet(chunk.isa);
+    writer.setGlobals(chunk.global_count, chunk.global_names);
+    writer.setCode(chunk.code);
+    writer.setFunctions(chunk.functions);
+    for(const auto& constant : chunk.constants) writer.addConstant(constant);
+    writer.setSnapshot(chunk.snapshot);
+    writer.writeToFile(out_path);
+
+    logger.info("Snapshot written to " + out_path);
+}
+
+namespace {
+    Iodicium::VM::Server* g_server = nullptr; // The server SIGINT and SIGTERM stop
+
+    void stopServer(int) {
+        if (g_server) g_server->stop();
+    }
+}
+
+void serveLibrary(const std::string& path, const std::string& socket_path, const std::string& workers, const std::string& memory, const std::string& max_depth, bool jit_enabled, Iodicium::Common::Logger& logger) {
+    size_t workerCount = workers.empty() ? 1 : parseCount(workers, "worker count");
+    size_t memoryLimitBytes = parseMemoryString(memory);
+    size_t maxCallDepth = max_depth.empty() ? Iodicium::VM::VirtualMachine::DEFAULT_MAX_CALL_DEPTH : parseCount(max_depth, "call depth");
+
+    Iodicium::VM::Library library(logger, path);
+
+    // With a limit, each worker gets an equal share of the memory.
+    Iodicium::VM::Server server(logger, library, workerCount, memoryLimitBytes / workerCount);
+    server.setConfigure([&](Iodicium::VM::VirtualMachine& vm) {
+        vm.setJitEnabled(jit_enabled);
+        vm.setMaxCallDepth(maxCallDepth);
+    });
+
+    g_server = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+#if !defined(_WIN32)
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    server.serve(socket_path);
+    g_server = nullptr;
+    logger.info("Server stopped.");
+}
+
+// Sends each line of standard input as a request and prints what it
+// returns, or reports its error. Returns false if any request failed.
+bool callServer(const std::string& socket_path) {
+    Iodicium::VM::Client client(socket_path);
+    bool succeeded = true;
+    for (std::string line; std::getline(std::cin, line);) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        std::string response = client.call(line);
+        size_t tab = response.find('\t');
+        std::string status = response.substr(0, tab);
+        std::string text = tab == std::string::npos ? "" : Iodicium::VM::Server::unescape(std::string_view(response).substr(tab + 1));
+        if (status == "ok") {
+            std::cout << text << '\n';
+        } else {
+            std::cout.flush();
+            std::cerr << "Error: " << text << std::endl;
+            succeeded = false;
+        }
+    }
+    return succeeded;
+}
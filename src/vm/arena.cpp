@@ -0,0 +1,157 @@
+#include "vm/arena.h"
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// Blocks are mapped directly on Linux, so reset() returns them to the
+// system at once and huge pages can be requested per block.
+#if defined(__linux__)
+#include <sys/mman.h>
+#define IODICIUM_VM_ARENA_MMAP 1
+#else
+#define IODICIUM_VM_ARENA_MMAP 0
+#endif
+
+namespace Iodicium {
+    namespace VM {
+
+        Arena::Arena(size_t limit)
+            : m_limit(limit), m_limit_reserved(&m_shared_reserved), m_charged(std::make_shared<std::atomic<size_t>>(0)) {}
+
+        Arena::Arena(Arena& owner)
+            : m_limit(owner.m_limit), m_limit_reserved(owner.m_limit_reserved), m_charged(owner.m_charged),
+              m_huge_pages(owner.m_huge_pages) {}
+
+        Arena::~Arena() {
+            reset();
+        }
+
+        void* Arena::allocate(size_t size, size_t alignment) {
+            uintptr_t cursor = reinterpret_cast<uintptr_t>(m_cursor);
+            uintptr_t aligned = (cursor + alignment - 1) & ~(uintptr_t(alignment) - 1);
+            if (!m_cursor || aligned + size > reinterpret_cast<uintptr_t>(m_end) || aligned + size < aligned) {
+                grow(size, alignment);
+                cursor = reinterpret_cast<uintptr_t>(m_cursor);
+                aligned = (cursor + alignment - 1) & ~(uintptr_t(alignment) - 1);
+            }
+            m_used += aligned + size - cursor;
+            m_cursor = reinterpret_cast<std::byte*>(aligned + size);
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        // Starts a new block that fits 'size' bytes at 'alignment'. What was
+        // left of the previous block is not used again.
+        void Arena::grow(size_t size, size_t alignment) {
+            if (size > SIZE_MAX - alignment) fail(size);
+            size_t needed = size + alignment - 1;
+            if (m_spare.memory && m_spare.size >= needed) {
+                m_blocks.push_back(m_spare);
+                m_cursor = m_spare.memory;
+                m_end = m_spare.memory + m_spare.size;
+                m_spare = {nullptr, 0};
+                return;
+            }
+            size_t block_size = needed > BLOCK_SIZE ? needed : BLOCK_SIZE;
+            if (m_huge_pages) {
+                block_size = (block_size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+            }
+            if (m_limit) {
+                size_t left = available();
+                if (needed > left) fail(size);
+                if (block_size > left) block_size = left;
+            }
+
+            Block block{nullptr, block_size};
+#if IODICIUM_VM_ARENA_MMAP
+            void* memory = mmap(nullptr, block_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) fail(size);
+#if defined(MADV_HUGEPAGE)
+            if (m_huge_pages) madvise(memory, block_size, MADV_HUGEPAGE);
+#endif
+            block.memory = static_cast<std::byte*>(memory);
+#else
+            block.memory = static_cast<std::byte*>(::operator new(block_size, std::nothrow));
+            if (!block.memory) fail(size);
+#endif
+            m_blocks.push_back(block);
+            m_reserved += block_size;
+            *m_limit_reserved += block_size;
+            m_cursor = block.memory;
+            m_end = block.memory + block_size;
+        }
+
+        void Arena::charge(size_t size) {
+            if (m_limit && size > available()) fail(size);
+            m_charged->fetch_add(size, std::memory_order_relaxed);
+        }
+
+        Arena::Charge::Charge(Arena& arena, size_t size) {
+            arena.charge(size);
+            m_charged = arena.m_charged;
+            m_size = size;
+        }
+
+        void Arena::reset() {
+            for (const Block& block : m_blocks) release(block);
+            m_blocks.clear();
+            if (m_spare.memory) release(m_spare);
+            m_spare = {nullptr, 0};
+            m_cursor = nullptr;
+            m_end = nullptr;
+            m_used = 0;
+            *m_limit_reserved -= m_reserved;
+            m_reserved = 0;
+        }
+
+        void Arena::rewind(const Mark& mark) {
+            // Calls that are rewound each time would otherwise map and unmap
+            // a block apiece.
+            while (m_blocks.size() > mark.blocks) {
+                Block block = m_blocks.back();
+                m_blocks.pop_back();
+                if (m_blocks.size() == mark.blocks && !m_spare.memory) {
+                    m_spare = block;
+                    continue;
+                }
+                m_reserved -= block.size;
+                *m_limit_reserved -= block.size;
+                release(block);
+            }
+            m_cursor = mark.cursor;
+            m_end = m_blocks.empty() ? nullptr : m_blocks.back().memory + m_blocks.back().size;
+            m_used = mark.used;
+        }
+
+        void Arena::swap(Arena& other) {
+            std::swap(m_blocks, other.m_blocks);
+            std::swap(m_spare, other.m_spare);
+            std::swap(m_cursor, other.m_cursor);
+            std::swap(m_end, other.m_end);
+            std::swap(m_used, other.m_used);
+            std::swap(m_reserved, other.m_reserved);
+        }
+
+        void Arena::release(const Block& block) {
+#if IODICIUM_VM_ARENA_MMAP
+            munmap(block.memory, block.size);
+#else
+            ::operator delete(block.memory);
+#endif
+        }
+
+        size_t Arena::available() const {
+            // Charges released on other threads only ever lower the total.
+            size_t taken = *m_limit_reserved + getCharged();
+            return taken < m_limit ? m_limit - taken : 0;
+        }
+
+        void Arena::fail(size_t requested) const {
+            if (m_limit) {
+                throw OutOfMemoryError("Out of memory: cannot allocate " + std::to_string(requested) + " bytes within the VM memory limit of " +
+                                       std::to_string(m_limit) + " bytes (" + std::to_string(*m_limit_reserved + getCharged()) + " taken).");
+            }
+            throw OutOfMemoryError("Out of memory: cannot allocate " + std::to_string(requested) + " bytes.");
+        }
+
+    }
+}
@@ -0,0 +1,285 @@
+#include "vm/instrumentation.h"
+#include "common/opcode.h"
+#include <algorithm>
+#include <iostream>
+#include <iomanip> // For std::setw
+#include <map>
+
+namespace Iodicium {
+    namespace VM {
+
+        static void printStack(const Value* bottom, const Value* top) {
+            std::cout << "          [ ";
+            for (const Value* val = bottom; val < top; val++) {
+                std::cout << *val << " ";
+            }
+            std::cout << "]" << std::endl;
+        }
+
+        static void printName(uint8_t opcode) {
+            std::cout << std::left << std::setw(23) << std::setfill(' ') << getOpcodeName(opcode) << std::right;
+        }
+
+        static void printAddress(size_t address) {
+            std::cout << std::setw(4) << std::setfill('0') << address;
+        }
+
+        // The native named by a string constant, as OP_CALL_NATIVE refers to it.
+        static void printConstantName(const Executable::Chunk& chunk, uint8_t const_index) {
+            if (const_index < chunk.constants.size()) std::cout << chunk.constants[const_index].text;
+            else std::cout << "<constant " << (int)const_index << ">";
+        }
+
+        const char* getOpcodeName(uint8_t opcode) {
+            switch (opcode) {
+                case OP_RETURN: return "OP_RETURN";
+                case OP_CALL: return "OP_CALL";
+                case OP_TAIL_CALL: return "OP_TAIL_CALL";
+                case OP_SLIDE: return "OP_SLIDE";
+                case OP_CALL_NATIVE: return "OP_CALL_NATIVE";
+                case OP_CONST: return "OP_CONST";
+                case OP_CONST_16: return "OP_CONST_16";
+                case OP_WRITE_OUT: return "OP_WRITE_OUT";
+                case OP_WRITE_ERR: return "OP_WRITE_ERR";
+                case OP_FLUSH: return "OP_FLUSH";
+                case OP_ADD: return "OP_ADD";
+                case OP_SUBTRACT: return "OP_SUBTRACT";
+                case OP_MULTIPLY: return "OP_MULTIPLY";
+                case OP_DIVIDE: return "OP_DIVIDE";
+                case OP_DEFINE_GLOBAL: return "OP_DEFINE_GLOBAL";
+                case OP_GET_GLOBAL: return "OP_GET_GLOBAL";
+                case OP_SET_GLOBAL: return "OP_SET_GLOBAL";
+                case OP_GET_LOCAL: return "OP_GET_LOCAL";
+                case OP_SET_LOCAL: return "OP_SET_LOCAL";
+                case OP_CONVERT: return "OP_CONVERT";
+                case OP_CHECK_TYPE: return "OP_CHECK_TYPE";
+                case OP_ADD_INT: return "OP_ADD_INT";
+                case OP_SUBTRACT_INT: return "OP_SUBTRACT_INT";
+                case OP_MULTIPLY_INT: return "OP_MULTIPLY_INT";
+                case OP_DIVIDE_INT: return "OP_DIVIDE_INT";
+                case OP_ADD_DOUBLE: return "OP_ADD_DOUBLE";
+                case OP_SUBTRACT_DOUBLE: return "OP_SUBTRACT_DOUBLE";
+                case OP_MULTIPLY_DOUBLE: return "OP_MULTIPLY_DOUBLE";
+                case OP_DIVIDE_DOUBLE: return "OP_DIVIDE_DOUBLE";
+                case OP_CONCAT: return "OP_CONCAT";
+                case OP_CONCAT_N: return "OP_CONCAT_N";
+                case OP_POP: return "OP_POP";
+                case OP_GET_LOCAL_2: return "OP_GET_LOCAL_2";
+                case OP_GET_LOCAL_CONST: return "OP_GET_LOCAL_CONST";
+                case OP_GET_LOCAL_CALL: return "OP_GET_LOCAL_CALL";
+                case OP_ADD_INT_RETURN: return "OP_ADD_INT_RETURN";
+                case OP_FIBER: return "OP_FIBER";
+                case OP_RESUME: return "OP_RESUME";
+                case OP_YIELD: return "OP_YIELD";
+                case OP_SPAWN: return "OP_SPAWN";
+                case OP_JOIN: return "OP_JOIN";
+                case OP_REG_ENTER: return "OP_REG_ENTER";
+                case OP_REG_LOAD_CONST: return "OP_REG_LOAD_CONST";
+                case OP_REG_MOVE: return "OP_REG_MOVE";
+                case OP_REG_GET_GLOBAL: return "OP_REG_GET_GLOBAL";
+                case OP_REG_DEFINE_GLOBAL: return "OP_REG_DEFINE_GLOBAL";
+                case OP_REG_SET_GLOBAL: return "OP_REG_SET_GLOBAL";
+                case OP_REG_CALL: return "OP_REG_CALL";
+                case OP_REG_RETURN: return "OP_REG_RETURN";
+                case OP_REG_CONVERT: return "OP_REG_CONVERT";
+                case OP_REG_WRITE_OUT: return "OP_REG_WRITE_OUT";
+                case OP_REG_WRITE_ERR: return "OP_REG_WRITE_ERR";
+                case OP_REG_CALL_NATIVE: return "OP_REG_CALL_NATIVE";
+                case OP_REG_ADD: return "OP_REG_ADD";
+                case OP_REG_SUBTRACT: return "OP_REG_SUBTRACT";
+                case OP_REG_MULTIPLY: return "OP_REG_MULTIPLY";
+                case OP_REG_DIVIDE: return "OP_REG_DIVIDE";
+                case OP_REG_ADD_INT: return "OP_REG_ADD_INT";
+                case OP_REG_SUBTRACT_INT: return "OP_REG_SUBTRACT_INT";
+                case OP_REG_MULTIPLY_INT: return "OP_REG_MULTIPLY_INT";
+                case OP_REG_DIVIDE_INT: return "OP_REG_DIVIDE_INT";
+                case OP_REG_ADD_DOUBLE: return "OP_REG_ADD_DOUBLE";
+                case OP_REG_SUBTRACT_DOUBLE: return "OP_REG_SUBTRACT_DOUBLE";
+                case OP_REG_MULTIPLY_DOUBLE: return "OP_REG_MULTIPLY_DOUBLE";
+                case OP_REG_DIVIDE_DOUBLE: return "OP_REG_DIVIDE_DOUBLE";
+                case OP_REG_CONCAT: return "OP_REG_CONCAT";
+                default: return "OP_UNKNOWN";
+            }
+        }
+
+        size_t disassembleInstruction(const Executable::Chunk& chunk, size_t offset) {
+            printAddress(offset);
+            std::cout << " ";
+            uint8_t instruction = chunk.code[offset];
+            int length = getOperandLength(instruction);
+            if (length < 0 || offset + 1 + length > chunk.code.size()) {
+                std::cout << "Unknown Opcode: " << (int)instruction << std::endl;
+                return offset + 1;
+            }
+
+            printName(instruction);
+            auto readShort = [&](size_t at) { return static_cast<uint16_t>((chunk.code[at] << 8) | chunk.code[at + 1]); };
+            switch (instruction) {
+                case OP_CALL:
+                case OP_TAIL_CALL:
+                case OP_FIBER:
+                case OP_SPAWN:
+                    std::cout << "args=" << (int)chunk.code[offset + 1] << " -> ";
+                    printAddress(readShort(offset + 2));
+                    break;
+                case OP_REG_CALL:
+                    std::cout << "r" << (int)chunk.code[offset + 1] << " args=" << (int)chunk.code[offset + 2] << " -> ";
+                    printAddress(readShort(offset + 3));
+                    break;
+                case OP_GET_LOCAL_CALL:
+                    std::cout << (int)chunk.code[offset + 1] << " args=" << (int)chunk.code[offset + 2] << " -> ";
+                    printAddress(readShort(offset + 3));
+                    break;
+                case OP_CALL_NATIVE:
+                    std::cout << "args=" << (int)chunk.code[offset + 1] << " -> ";
+                    printConstantName(chunk, chunk.code[offset + 2]);
+                    break;
+                case OP_REG_CALL_NATIVE:
+                    std::cout << "r" << (int)chunk.code[offset + 1] << " args=" << (int)chunk.code[offset + 2] << " -> ";
+                    printConstantName(chunk, chunk.code[offset + 3]);
+                    break;
+                case OP_DEFINE_GLOBAL:
+                case OP_GET_GLOBAL:
+                case OP_SET_GLOBAL:
+                    std::cout << "slot " << readShort(offset + 1);
+                    break;
+                case OP_REG_GET_GLOBAL:
+                case OP_REG_DEFINE_GLOBAL:
+                case OP_REG_SET_GLOBAL:
+                    std::cout << "r" << (int)chunk.code[offset + 1] << " slot " << readShort(offset + 2);
+                    break;
+                default:
+                    for (int i = 1; i <= length; i++) {
+                        std::cout << (i > 1 ? " " : "") << (int)chunk.code[offset + i];
+                    }
+                    break;
+            }
+            std::cout << std::endl;
+            return offset + 1 + length;
+        }
+
+        void disassembleInstruction(const Instruction& instruction) {
+            printAddress(instruction.offset);
+            std::cout << " ";
+            printName(instruction.opcode);
+            switch (instruction.opcode) {
+                case OP_CALL:
+                case OP_TAIL_CALL:
+                case OP_FIBER:
+                case OP_SPAWN:
+                    std::cout << "args=" << (int)instruction.arg << " -> ";
+                    printAddress(instruction.operand.target->offset);
+                    break;
+                case OP_CONST:
+                    std::cout << "'" << *instruction.operand.constant << "'";
+                    break;
+                case OP_GET_LOCAL_2:
+                    std::cout << (int)instruction.arg << " " << (int)instruction.a;
+                    break;
+                case OP_GET_LOCAL_CONST:
+                    std::cout << (int)instruction.arg << " '" << *instruction.operand.constant << "'";
+                    break;
+                case OP_GET_LOCAL_CALL:
+                    std::cout << (int)instruction.a << " args=" << (int)instruction.arg << " -> ";
+                    printAddress(instruction.operand.target->offset);
+                    break;
+                case OP_CALL_NATIVE:
+                    std::cout << "args=" << (int)instruction.arg << " -> " << instruction.operand.native->name;
+                    break;
+                case OP_DEFINE_GLOBAL:
+                case OP_GET_GLOBAL:
+                case OP_SET_GLOBAL:
+                    std::cout << "slot " << instruction.operand.slot;
+                    break;
+                case OP_GET_LOCAL:
+                case OP_SET_LOCAL:
+                case OP_CONVERT:
+                case OP_CHECK_TYPE:
+                case OP_CONCAT_N:
+                case OP_SLIDE:
+                case OP_REG_ENTER:
+                    std::cout << (int)instruction.arg;
+                    break;
+                case OP_REG_LOAD_CONST:
+                    std::cout << "r" << (int)instruction.arg << " '" << *instruction.operand.constant << "'";
+                    break;
+                case OP_REG_MOVE:
+                    std::cout << "r" << (int)instruction.arg << " r" << (int)instruction.a;
+                    break;
+                case OP_REG_GET_GLOBAL:
+                case OP_REG_DEFINE_GLOBAL:
+                case OP_REG_SET_GLOBAL:
+                    std::cout << "r" << (int)instruction.arg << " slot " << instruction.operand.slot;
+                    break;
+                case OP_REG_CALL:
+                    std::cout << "r" << (int)instruction.arg << " args=" << (int)instruction.a << " -> ";
+                    printAddress(instruction.operand.target[-1].offset); // The callee's OP_REG_ENTER
+                    break;
+                case OP_REG_CALL_NATIVE:
+                    std::cout << "r" << (int)instruction.arg << " args=" << (int)instruction.a << " -> " << instruction.operand.native->name;
+                    break;
+                case OP_REG_RETURN:
+                case OP_REG_WRITE_OUT:
+                case OP_REG_WRITE_ERR:
+                    std::cout << "r" << (int)instruction.arg;
+                    break;
+                case OP_REG_CONVERT:
+                    std::cout << "r" << (int)instruction.arg << " r" << (int)instruction.a << " " << (int)instruction.b;
+                    break;
+                default:
+                    if (instruction.opcode >= OP_REG_ADD) {
+                        std::cout << "r" << (int)instruction.arg << " r" << (int)instruction.a << " r" << (int)instruction.b;
+                    }
+                    break;
+            }
+            std::cout << std::endl;
+        }
+
+        void printOpcodeProfile(const Program& program, const std::vector<uint64_t>& counts, size_t max_length, size_t limit) {
+            const std::vector<Instruction>& code = program.code;
+            uint64_t total = 0;
+            for (uint64_t count : counts) total += count;
+
+            // Instructions reached by a call can only start a sequence.
+            std::vector<bool> is_entry(code.size(), false);
+            for (const Instruction& instruction : code) {
+                if (getCallAddressOperand(instruction.opcode) >= 0) {
+                    is_entry[instruction.operand.target - code.data()] = true;
+                }
+            }
+
+            std::cout << "Opcode profile: " << total << " instructions dispatched" << std::endl;
+            for (size_t length = 2; length <= max_length; length++) {
+                std::map<std::vector<uint8_t>, uint64_t> sequences;
+                for (size_t start = 0; start + length <= code.size(); start++) {
+                    if (counts[start] == 0) continue;
+                    std::vector<uint8_t> opcodes;
+                    for (size_t i = start; i < start + length; i++) {
+                        bool inside = i > start;
+                        if (inside && (is_entry[i] || isControlTransfer(code[i - 1].opcode))) break;
+                        opcodes.push_back(code[i].opcode);
+                    }
+                    if (opcodes.size() == length) sequences[opcodes] += counts[start];
+                }
+
+                std::vector<std::pair<std::vector<uint8_t>, uint64_t>> ranked(sequences.begin(), sequences.end());
+                std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+                if (ranked.size() > limit) ranked.resize(limit);
+
+                std::cout << "  " << length << "-grams" << std::endl;
+                for (const auto& [opcodes, count] : ranked) {
+                    double share = total == 0 ? 0.0 : 100.0 * static_cast<double>(count) / static_cast<double>(total);
+                    std::cout << std::setw(16) << std::setfill(' ') << count << std::setw(8) << std::fixed << std::setprecision(1) << share << "%  ";
+                    for (uint8_t opcode : opcodes) std::cout << " " << getOpcodeName(opcode);
+                    std::cout << std::endl;
+                }
+            }
+        }
+
+        void TracingInstrumentation::beforeInstruction(const Instruction* ip, const Value* stack_bottom, const Value* sp) {
+            printStack(stack_bottom, sp);
+            disassembleInstruction(*ip);
+        }
+
+    }
+}
@@ -0,0 +1,354 @@
+#include "vm/jit.h"
+#include "common/opcode.h"
+#include "vm/opc/base.h" // For DataType
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#if IODICIUM_VM_JIT
+#include <sys/mman.h>
+#endif
+
+namespace Iodicium {
+    namespace VM {
+
+#if IODICIUM_VM_JIT
+
+        namespace {
+
+            // Native code keeps the frame base in rdi for its whole run and
+            // addresses stack slot i as [rdi + 16*i]; a Value's tag is at +0
+            // and its payload at +8. rax, rcx, rdx and xmm0 are scratch. The
+            // stack depth at every instruction is known while compiling, so
+            // no stack pointer is kept at run time.
+            class Assembler {
+            public:
+                std::vector<uint8_t> code;
+
+                static int32_t tag(size_t slot) { return static_cast<int32_t>(slot * sizeof(Value)); }
+                static int32_t payload(size_t slot) { return static_cast<int32_t>(slot * sizeof(Value) + offsetof(Value, as)); }
+
+                void bytes(std::initializer_list<uint8_t> values) { code.insert(code.end(), values); }
+                void imm32(int32_t value) { for (int i = 0; i < 4; i++) code.push_back(static_cast<uint8_t>(value >> (8 * i))); }
+                void imm64(uint64_t value) { for (int i = 0; i < 8; i++) code.push_back(static_cast<uint8_t>(value >> (8 * i))); }
+
+                // <prefix> <modrm for [rdi + disp32] with 'reg'> <disp32>
+                void memory(std::initializer_list<uint8_t> prefix, uint8_t reg, int32_t disp) {
+                    bytes(prefix);
+                    code.push_back(static_cast<uint8_t>(0x80 | (reg << 3) | 7));
+                    imm32(disp);
+                }
+
+                // The type of every slot is known while compiling, so a copy moves
+                // the payload and writes the tag as an immediate. Whole-Value
+                // copies would reload slots just written in two parts, which the
+                // CPU cannot forward from its store buffer.
+                void copySlot(size_t from, size_t to, ValueType type) {
+                    memory({0x48, 0x8B}, 0, payload(from)); // mov rax, [from]
+                    memory({0x48, 0x89}, 0, payload(to));   // mov [to], rax
+                    setTag(to, type);
+                }
+                void storeValue(size_t slot, const Value& value) {
+                    uint64_t bits;
+                    std::memcpy(&bits, &value.as, sizeof(bits));
+                    memory({0xC6}, 0, tag(slot)); // mov byte [slot], type
+                    code.push_back(static_cast<uint8_t>(value.type));
+                    bytes({0x48, 0xB8});          // mov rax, imm64
+                    imm64(bits);
+                    memory({0x48, 0x89}, 0, payload(slot)); // mov [slot], rax
+                }
+                void setTag(size_t slot, ValueType type) {
+                    memory({0xC6}, 0, tag(slot));
+                    code.push_back(static_cast<uint8_t>(type));
+                }
+
+                // Emits a jcc rel32 and returns the position of its displacement.
+                size_t jump(uint8_t condition) {
+                    bytes({0x0F, condition});
+                    imm32(0);
+                    return code.size() - 4;
+                }
+                size_t jump() {
+                    code.push_back(0xE9);
+                    imm32(0);
+                    return code.size() - 4;
+                }
+                void bind(size_t displacement_at) { bind(displacement_at, code.size()); }
+                void bind(size_t displacement_at, size_t target) {
+                    int32_t rel = static_cast<int32_t>(target - (displacement_at + 4));
+                    std::memcpy(&code[displacement_at], &rel, sizeof(rel));
+                }
+
+                // rax = resume, rdx = rdi + 16*depth, ret
+                void exit(const Instruction* resume, size_t depth) {
+                    bytes({0x48, 0xB8});
+                    imm64(reinterpret_cast<uint64_t>(resume));
+                    memory({0x48, 0x8D}, 2, tag(depth)); // lea rdx, [rdi + 16*depth]
+                    code.push_back(0xC3);
+                }
+            };
+
+            constexpr uint8_t JE = 0x84;
+            constexpr uint8_t JNE = 0x85;
+
+            // Bounds the size of what is compiled; hot leaf functions are small.
+            constexpr size_t MAX_INSTRUCTIONS = 512;
+
+        }
+
+        JitCompiler::JitCompiler(Common::Logger& logger) : m_logger(logger) {}
+
+        JitCompiler::~JitCompiler() { reset(); }
+
+        void JitCompiler::reset() {
+            for (const auto& [address, size] : m_regions) {
+                munmap(address, size);
+            }
+            m_regions.clear();
+            m_code = m_end = nullptr;
+            m_functions = nullptr;
+        }
+
+        void JitCompiler::attach(const Program& program, const JitFunction* functions) {
+            m_code = program.code.data();
+            m_end = m_code + program.code.size();
+            m_functions = functions;
+        }
+
+        bool JitCompiler::compile(const Instruction* entry, const Value* args, uint8_t argc, JitFunction& function) {
+            Assembler as;
+            std::vector<ValueType> stack; // Types of the frame's slots, tracked while compiling
+            size_t frame_size = argc;
+            ValueType result = ValueType::NIL;
+            struct PendingExit { size_t displacement_at; const Instruction* resume; size_t depth; };
+            std::vector<PendingExit> exits;
+
+            // Entry guards: the code below assumes the argument types seen now.
+            for (uint8_t i = 0; i < argc; i++) {
+                stack.push_back(args[i].type);
+                as.memory({0x80}, 7, Assembler::tag(i)); // cmp byte [arg], type
+                as.code.push_back(static_cast<uint8_t>(args[i].type));
+                exits.push_back({as.jump(JNE), entry, argc});
+            }
+
+            auto push = [&](ValueType type) {
+                stack.push_back(type);
+                frame_size = std::max(frame_size, stack.size());
+            };
+            auto binaryOperands = [&](ValueType type) {
+                return stack.size() >= 2 && stack[stack.size() - 1] == type && stack[stack.size() - 2] == type;
+            };
+            auto getLocal = [&](uint8_t slot) {
+                if (slot >= stack.size()) return false;
+                as.copySlot(slot, stack.size(), stack[slot]);
+                push(stack[slot]);
+                return true;
+            };
+            auto pushConstant = [&](const Value& constant) {
+                as.storeValue(stack.size(), constant);
+                push(constant.type);
+            };
+            auto intOperation = [&](std::initializer_list<uint8_t> op_rax_memory) {
+                if (!binaryOperands(ValueType::INT)) return false;
+                size_t left = stack.size() - 2;
+                as.memory({0x48, 0x8B}, 0, Assembler::payload(left));         // mov rax, [left]
+                as.memory(op_rax_memory, 0, Assembler::payload(left + 1));     // op rax, [right]
+                as.memory({0x48, 0x89}, 0, Assembler::payload(left));         // mov [left], rax
+                stack.pop_back();
+                return true;
+            };
+            auto doubleOperation = [&](uint8_t sse_op) {
+                if (!binaryOperands(ValueType::DOUBLE)) return false;
+                size_t left = stack.size() - 2;
+                as.memory({0xF2, 0x0F, 0x10}, 0, Assembler::payload(left));   // movsd xmm0, [left]
+                as.memory({0xF2, 0x0F, sse_op}, 0, Assembler::payload(left + 1));
+                as.memory({0xF2, 0x0F, 0x11}, 0, Assembler::payload(left));   // movsd [left], xmm0
+                stack.pop_back();
+                return true;
+            };
+            // Calls the callee's native code on the top 'call_argc' slots. If
+            // it bails out, this function stops with the stack as it was at
+            // 'ip' so that the interpreter makes the call instead.
+            auto call = [&](const Instruction* ip, uint8_t call_argc, size_t resume_depth) {
+                if (call_argc > stack.size()) return false;
+                const JitFunction& callee = m_functions[ip->operand.target - m_code];
+                if (!callee.native) return false;
+                size_t callee_base = stack.size() - call_argc;
+                as.code.push_back(0x57);                                        // push rdi
+                as.memory({0x48, 0x8D}, 7, Assembler::tag(callee_base));       // lea rdi, [rdi + 16*callee_base]
+                as.bytes({0x48, 0xB8});                                         // mov rax, imm64
+                as.imm64(reinterpret_cast<uint64_t>(callee.native));
+                as.bytes({0xFF, 0xD0});                                         // call rax
+                as.code.push_back(0x5F);                                        // pop rdi
+                as.bytes({0x48, 0x85, 0xC0});                                   // test rax, rax
+                exits.push_back({as.jump(JNE), ip, resume_depth});
+                frame_size = std::max(frame_size, callee_base + callee.frame_size);
+                stack.resize(callee_base);
+                push(callee.result);
+                return true;
+            };
+            auto returnTop = [&]() {
+                if (stack.empty()) return false;
+                result = stack.back();
+                if (stack.size() > 1) as.copySlot(stack.size() - 1, 0, result);
+                as.bytes({0x31, 0xC0});                  // xor eax, eax
+                as.memory({0x48, 0x8D}, 2, Assembler::tag(1)); // lea rdx, [rdi + 16]
+                as.code.push_back(0xC3);
+                return true;
+            };
+
+            bool returned = false;
+            for (const Instruction* ip = entry; !returned; ip++) {
+                if (ip == m_end || ip - entry >= static_cast<ptrdiff_t>(MAX_INSTRUCTIONS)) return false;
+                bool ok = true;
+                switch (ip->opcode) {
+                    case OP_GET_LOCAL:
+                        ok = getLocal(ip->arg);
+                        break;
+                    case OP_SET_LOCAL:
+                        ok = !stack.empty() && ip->arg < stack.size() && ip->arg >= argc;
+                        if (ok) {
+                            as.copySlot(stack.size() - 1, ip->arg, stack.back());
+                            stack[ip->arg] = stack.back();
+                        }
+                        break;
+                    case OP_CONST:
+                        pushConstant(*ip->operand.constant);
+                        break;
+                    case OP_POP:
+                        ok = stack.size() > argc;
+                        if (ok) stack.pop_back();
+                        break;
+                    case OP_SLIDE: {
+                        ok = stack.size() > argc + ip->arg;
+                        if (!ok) break;
+                        size_t top = stack.size() - 1;
+                        ValueType type = stack[top];
+                        as.copySlot(top, top - ip->arg, type);
+                        stack.resize(top - ip->arg);
+                        stack.push_back(type);
+                        break;
+                    }
+                    case OP_GET_LOCAL_2:
+                        ok = getLocal(ip->arg) && getLocal(ip->a);
+                        break;
+                    case OP_GET_LOCAL_CONST:
+                        ok = getLocal(ip->arg);
+                        if (ok) pushConstant(*ip->operand.constant);
+                        break;
+                    case OP_CALL:
+                        ok = call(ip, ip->arg, stack.size());
+                        break;
+                    case OP_GET_LOCAL_CALL: {
+                        size_t depth = stack.size();
+                        ok = getLocal(ip->a) && call(ip, ip->arg, depth);
+                        break;
+                    }
+                    case OP_ADD_INT: ok = intOperation({0x48, 0x03}); break;        // add rax, m64
+                    case OP_SUBTRACT_INT: ok = intOperation({0x48, 0x2B}); break;   // sub rax, m64
+                    case OP_MULTIPLY_INT: ok = intOperation({0x48, 0x0F, 0xAF}); break; // imul rax, m64
+                    case OP_DIVIDE_INT: {
+                        // Division by zero raises the interpreter's error, and
+                        // x / -1 is negated rather than trapping on INT64_MIN.
+                        ok = binaryOperands(ValueType::INT);
+                        if (!ok) break;
+                        size_t left = stack.size() - 2;
+                        as.memory({0x48, 0x8B}, 1, Assembler::payload(left + 1)); // mov rcx, [right]
+                        as.bytes({0x48, 0x85, 0xC9});                              // test rcx, rcx
+                        exits.push_back({as.jump(JE), ip, stack.size()});
+                        as.bytes({0x48, 0x83, 0xF9, 0xFF});                        // cmp rcx, -1
+                        size_t negate = as.jump(JE);
+                        as.memory({0x48, 0x8B}, 0, Assembler::payload(left));     // mov rax, [left]
+                        as.bytes({0x48, 0x99, 0x48, 0xF7, 0xF9});                  // cqo; idiv rcx
+                        as.memory({0x48, 0x89}, 0, Assembler::payload(left));     // mov [left], rax
+                        size_t done = as.jump();
+                        as.bind(negate);
+                        as.memory({0x48, 0xF7}, 3, Assembler::payload(left));     // neg qword [left]
+                        as.bind(done);
+                        stack.pop_back();
+                        break;
+                    }
+                    case OP_ADD_DOUBLE: ok = doubleOperation(0x58); break;
+                    case OP_SUBTRACT_DOUBLE: ok = doubleOperation(0x5C); break;
+                    case OP_MULTIPLY_DOUBLE: ok = doubleOperation(0x59); break;
+                    case OP_DIVIDE_DOUBLE: ok = doubleOperation(0x5E); break;
+                    case OP_CONVERT: {
+                        ok = !stack.empty();
+                        if (!ok) break;
+                        size_t top = stack.size() - 1;
+                        ValueType from = stack[top];
+                        if (ip->arg == DataType::INT && from == ValueType::DOUBLE) {
+                            as.memory({0xF2, 0x48, 0x0F, 0x2C}, 0, Assembler::payload(top)); // cvttsd2si rax, [top]
+                            as.memory({0x48, 0x89}, 0, Assembler::payload(top));
+                            as.setTag(top, ValueType::INT);
+                            stack[top] = ValueType::INT;
+                        } else if (ip->arg == DataType::DOUBLE && from == ValueType::INT) {
+                            as.memory({0xF2, 0x48, 0x0F, 0x2A}, 0, Assembler::payload(top)); // cvtsi2sd xmm0, [top]
+                            as.memory({0xF2, 0x0F, 0x11}, 0, Assembler::payload(top));
+                            as.setTag(top, ValueType::DOUBLE);
+                            stack[top] = ValueType::DOUBLE;
+                        } else {
+                            ok = (ip->arg == DataType::INT && from == ValueType::INT) ||
+                                 (ip->arg == DataType::DOUBLE && from == ValueType::DOUBLE);
+                        }
+                        break;
+                    }
+                    case OP_RETURN:
+                        ok = returnTop();
+                        returned = true;
+                        break;
+                    case OP_ADD_INT_RETURN:
+                        ok = intOperation({0x48, 0x03}) && returnTop();
+                        returned = true;
+                        break;
+                    case OP_TAIL_CALL:
+                        // Native callees are compiled before their callers, so
+                        // the chain is finite and an ordinary call will do.
+                        ok = call(ip, ip->arg, stack.size()) && returnTop();
+                        returned = true;
+                        break;
+                    default:
+                        ok = false;
+                        break;
+                }
+                if (!ok) {
+                    m_logger.debug("JIT: Cannot compile the function at offset " + std::to_string(entry->offset) +
+                                   " (" + std::to_string(ip->opcode) + " at offset " + std::to_string(ip->offset) + ").");
+                    return false;
+                }
+            }
+
+            for (const auto& pending : exits) {
+                as.bind(pending.displacement_at);
+                as.exit(pending.resume, pending.depth);
+            }
+
+            size_t size = as.code.size();
+            void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) return false;
+            std::memcpy(memory, as.code.data(), size);
+            if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+                munmap(memory, size);
+                return false;
+            }
+            m_regions.emplace_back(memory, size);
+
+            function.native = reinterpret_cast<NativeFunction>(memory);
+            function.frame_size = static_cast<uint32_t>(frame_size);
+            function.result = result;
+            m_logger.debug("JIT: Compiled the function at offset " + std::to_string(entry->offset) + " to " + std::to_string(size) + " bytes.");
+            return true;
+        }
+
+#else
+
+        JitCompiler::JitCompiler(Common::Logger& logger) : m_logger(logger) {}
+        JitCompiler::~JitCompiler() = default;
+        void JitCompiler::reset() {}
+        void JitCompiler::attach(const Program&, const JitFunction*) {}
+        bool JitCompiler::compile(const Instruction*, const Value*, uint8_t, JitFunction&) { return false; }
+
+#endif
+
+    }
+}
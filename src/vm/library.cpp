@@ -0,0 +1,70 @@
+#include "vm/library.h"
+#include <algorithm>
+#include "common/opcode.h"
+#include "executable/iodl_reader.h"
+#include "vm/natives.h"
+#include "vm/vm.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        namespace {
+
+            // The instruction that starts at byte 'offset' of the program's code, or null.
+            const Instruction* instructionAt(const Program& program, size_t offset) {
+                auto it = std::lower_bound(program.code.begin(), program.code.end(), offset, [](const Instruction& instruction, size_t offset) {
+                    return instruction.offset < offset;
+                });
+                return it != program.code.end() && it->offset == offset ? &*it : nullptr;
+            }
+
+        }
+
+        Library::Library(Common::Logger& logger, const std::string& path) {
+            Executable::IodlReader reader(logger);
+            Executable::LibraryChunk library = reader.readFromFile(path);
+            const Executable::Chunk& chunk = library.code_chunk;
+            if (chunk.isa != ISA_STACK) {
+                throw VirtualMachineError("Only libraries of stack code can be embedded: " + path);
+            }
+
+            Loader loader(logger);
+            m_program = loader.load(chunk);
+
+            // The Loader has checked the code against the function table, so
+            // an export whose types agree with its table entry is safe to call.
+            for (const auto& [name, exported] : library.exports) {
+                const Instruction* entry = instructionAt(m_program, exported.ip);
+                auto function = std::find_if(chunk.functions.begin(), chunk.functions.end(), [&](const Executable::FunctionInfo& info) {
+                    return info.entry == exported.ip;
+                });
+                if (!entry || function == chunk.functions.end() || function->arity != exported.parameters.size()) {
+                    throw VirtualMachineError("Invalid .iodl file: Export '" + name + "' does not match a function.");
+                }
+                m_functions.emplace(name, ExportedFunction{name, entry, exported.parameters, exported.return_type});
+            }
+        }
+
+        const ExportedFunction* Library::find(std::string_view name) const {
+            auto it = m_functions.find(name);
+            return it != m_functions.end() ? &it->second : nullptr;
+        }
+
+        void Library::checkArity(const ExportedFunction& function, size_t argc) {
+            if (argc != function.parameters.size()) {
+                throw VirtualMachineError("'" + function.name + "' takes " + std::to_string(function.parameters.size()) + " arguments, not " + std::to_string(argc) + ".");
+            }
+        }
+
+        void Library::checkArguments(const ExportedFunction& function, const PortableValue* args, size_t argc) {
+            checkArity(function, argc);
+            for (size_t i = 0; i < argc; i++) {
+                uint8_t type = dataTypeOf(args[i].value);
+                if (type != function.parameters[i]) {
+                    throw VirtualMachineError("Argument " + std::to_string(i + 1) + " of '" + function.name + "' must be " + dataTypeName(function.parameters[i]) + ", not " + dataTypeName(type) + ".");
+                }
+            }
+        }
+
+    }
+}
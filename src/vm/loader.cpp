@@ -0,0 +1,354 @@
+#include "vm/loader.h"
+#include "common/opcode.h"
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+namespace Iodicium {
+    namespace VM {
+
+        Loader::Loader(Common::Logger& logger, const NativeRegistry& natives) : m_logger(logger), m_natives(natives) {}
+
+        Program Loader::load(const Executable::Chunk& chunk) {
+            m_logger.debug("Loader: Decoding " + std::to_string(chunk.code.size()) + " bytes of bytecode.");
+
+            Program program;
+            program.isa = chunk.isa;
+            program.global_count = chunk.global_count;
+            program.global_names = chunk.global_names;
+
+            // The constant pool is typed, so every constant becomes a Value
+            // here once and OP_CONST only ever copies one. String constants are
+            // Strings in the program's own storage, laid out once the total
+            // size is known so that none of them moves. Equal strings are
+            // interned: every constant with the same text refers to one String.
+            // The strings of a snapshot's globals are kept the same way.
+            using Executable::Constant;
+            using Executable::SnapshotValue;
+            const std::vector<Constant>& pool = chunk.constants;
+            const Executable::Snapshot& snapshot = chunk.snapshot;
+            program.constants.resize(pool.size());
+            auto words = [](size_t length) { return (String::sizeFor(length) + sizeof(uint64_t) - 1) / sizeof(uint64_t); };
+            std::unordered_map<std::string_view, const String*> interned;
+            size_t string_words = 0;
+            for (size_t i = 0; i < pool.size(); i++) {
+                if (pool[i].type == Constant::INT) program.constants[i] = Value::fromInt(pool[i].integer);
+                else if (pool[i].type == Constant::DOUBLE) program.constants[i] = Value::fromDouble(pool[i].number);
+                else if (interned.emplace(pool[i].text, nullptr).second) string_words += words(pool[i].text.size());
+            }
+            for (const SnapshotValue& global : snapshot.globals) {
+                if (global.type == SnapshotValue::STRING && interned.emplace(global.text, nullptr).second) string_words += words(global.text.size());
+            }
+            program.string_storage.assign(string_words, 0);
+            uint64_t* next_string = program.string_storage.data();
+            auto intern = [&](const std::string& text) {
+                const String*& string = interned[text];
+                if (!string) {
+                    string = String::create(next_string, text);
+                    next_string += words(text.size());
+                }
+                return Value::fromString(string);
+            };
+            for (size_t i = 0; i < pool.size(); i++) {
+                if (pool[i].type == Constant::STRING) program.constants[i] = intern(pool[i].text);
+            }
+
+            // First pass: find instruction boundaries so that call targets can
+            // be mapped from byte offsets to instruction indices.
+            const std::vector<uint8_t>& code = chunk.code;
+            std::vector<int64_t> index_at(code.size(), -1);
+            size_t count = 0;
+            for (size_t offset = 0; offset < code.size(); count++) {
+                int length = getOperandLength(code[offset]);
+                if (length < 0 || !isOpcodeInSet(code[offset], chunk.isa)) {
+                    throw LoaderError("Unknown opcode " + std::to_string(code[offset]) + " at offset " + std::to_string(offset) + ".");
+                }
+                if (offset + 1 + length > code.size()) {
+                    throw LoaderError("Truncated instruction at offset " + std::to_string(offset) + ".");
+                }
+                index_at[offset] = static_cast<int64_t>(count);
+                offset += 1 + length;
+            }
+
+            // Second pass: decode, resolving every operand to what the handler uses.
+            program.code.resize(count);
+            size_t index = 0;
+            int register_count = -1; // Registers in the current function; -1 before the first OP_REG_ENTER
+            for (size_t offset = 0; offset < code.size(); index++) {
+                Instruction& instruction = program.code[index];
+                instruction.handler = nullptr;
+                instruction.opcode = code[offset];
+                instruction.arg = 0;
+                instruction.a = 0;
+                instruction.b = 0;
+                instruction.offset = static_cast<uint32_t>(offset);
+                instruction.operand.constant = nullptr;
+
+                auto fail = [&](const std::string& message) {
+                    throw LoaderError(message + " at offset " + std::to_string(offset) + ".");
+                };
+                auto readConstant = [&](uint8_t const_index) {
+                    if (const_index >= program.constants.size()) fail("Constant index " + std::to_string(const_index) + " out of range");
+                    return &program.constants[const_index];
+                };
+                auto readSlot = [&](size_t at) {
+                    uint32_t slot = static_cast<uint32_t>((code[at] << 8) | code[at + 1]);
+                    if (slot >= program.global_count) fail("Global slot " + std::to_string(slot) + " out of range");
+                    return slot;
+                };
+                auto readTarget = [&](size_t at) {
+                    size_t address = static_cast<size_t>((code[at] << 8) | code[at + 1]);
+                    if (address >= code.size() || index_at[address] < 0) fail("Call targets invalid address " + std::to_string(address));
+                    return program.code.data() + index_at[address];
+                };
+                auto readNative = [&](uint8_t argc, uint8_t const_index) {
+                    const Value& name = *readConstant(const_index);
+                    if (!name.isString()) fail("Native function name is not a string");
+                    std::string_view text(name.as.string->data(), name.as.string->length);
+                    const Native* native = m_natives.find(text);
+                    if (!native) fail("Unknown native function '" + std::string(text) + "'");
+                    if (native->parameters.size() != argc) fail("Native function '" + std::string(text) + "' called with " + std::to_string(argc) + " arguments");
+                    return native;
+                };
+                auto readRegister = [&](size_t at) {
+                    if (code[at] >= register_count) fail("Register " + std::to_string(code[at]) + " out of range");
+                    return code[at];
+                };
+                if (chunk.isa == ISA_REGISTER && register_count < 0 && instruction.opcode != OP_REG_ENTER) {
+                    fail("Register code must begin with OP_REG_ENTER");
+                }
+
+                switch (instruction.opcode) {
+                    case OP_CALL:
+                    case OP_TAIL_CALL:
+                    case OP_FIBER:
+                    case OP_SPAWN:
+                        instruction.arg = code[offset + 1];
+                        instruction.operand.target = readTarget(offset + 2);
+                        break;
+                    case OP_CONST:
+                        instruction.operand.constant = readConstant(code[offset + 1]);
+                        break;
+                    case OP_CALL_NATIVE:
+                        instruction.arg = code[offset + 1];
+                        instruction.operand.native = readNative(code[offset + 1], code[offset + 2]);
+                        break;
+                    case OP_DEFINE_GLOBAL:
+                    case OP_GET_GLOBAL:
+                    case OP_SET_GLOBAL:
+                        instruction.operand.slot = readSlot(offset + 1);
+                        break;
+                    case OP_GET_LOCAL:
+                    case OP_SET_LOCAL:
+                    case OP_CONVERT:
+                    case OP_CHECK_TYPE:
+                    case OP_SLIDE:
+                        instruction.arg = code[offset + 1];
+                        break;
+                    case OP_CONCAT_N:
+                        if (code[offset + 1] < 2) fail("OP_CONCAT_N needs at least two operands");
+                        instruction.arg = code[offset + 1];
+                        break;
+                    case OP_GET_LOCAL_2:
+                        instruction.arg = code[offset + 1];
+                        instruction.a = code[offset + 2];
+                        break;
+                    case OP_GET_LOCAL_CONST:
+                        instruction.arg = code[offset + 1];
+                        instruction.operand.constant = readConstant(code[offset + 2]);
+                        break;
+                    case OP_GET_LOCAL_CALL:
+                        // 'arg' and 'target' are laid out as for OP_CALL so that op_call can finish the job.
+                        instruction.a = code[offset + 1];
+                        instruction.arg = code[offset + 2];
+                        instruction.operand.target = readTarget(offset + 3);
+                        break;
+
+                    case OP_REG_ENTER:
+                        register_count = code[offset + 1];
+                        instruction.arg = code[offset + 1];
+                        break;
+                    case OP_REG_LOAD_CONST:
+                        instruction.arg = readRegister(offset + 1);
+                        instruction.operand.constant = readConstant(code[offset + 2]);
+                        break;
+                    case OP_REG_MOVE:
+                        instruction.arg = readRegister(offset + 1);
+                        instruction.a = readRegister(offset + 2);
+                        break;
+                    case OP_REG_GET_GLOBAL:
+                    case OP_REG_DEFINE_GLOBAL:
+                    case OP_REG_SET_GLOBAL:
+                        instruction.arg = readRegister(offset + 1);
+                        instruction.operand.slot = readSlot(offset + 2);
+                        break;
+                    case OP_REG_CALL: {
+                        instruction.arg = readRegister(offset + 1);
+                        instruction.a = code[offset + 2];
+                        // The callee's frame starts at 'first' and must hold its arguments and result.
+                        int needed = instruction.a > 0 ? instruction.a : 1;
+                        if (instruction.arg + needed > register_count) fail("Call arguments exceed the frame");
+                        size_t address = static_cast<size_t>((code[offset + 3] << 8) | code[offset + 4]);
+                        const Instruction* entry = readTarget(offset + 3);
+                        if (code[address] != OP_REG_ENTER || code[address + 1] < needed) fail("Call target is not a function entry");
+                        // The call sets up the callee's frame itself, so it jumps past OP_REG_ENTER.
+                        instruction.b = code[address + 1];
+                        instruction.operand.target = entry + 1;
+                        break;
+                    }
+                    case OP_REG_CALL_NATIVE:
+                        // 'arg' and 'a' are laid out as for OP_REG_CALL.
+                        instruction.arg = readRegister(offset + 1);
+                        instruction.a = code[offset + 2];
+                        if (instruction.arg + std::max<int>(instruction.a, 1) > register_count) fail("Call arguments exceed the frame");
+                        instruction.operand.native = readNative(code[offset + 2], code[offset + 3]);
+                        break;
+                    case OP_REG_RETURN:
+                    case OP_REG_WRITE_OUT:
+                    case OP_REG_WRITE_ERR:
+                        instruction.arg = readRegister(offset + 1);
+                        break;
+                    case OP_REG_CONVERT:
+                        instruction.arg = readRegister(offset + 1);
+                        instruction.a = readRegister(offset + 2);
+                        instruction.b = code[offset + 3];
+                        break;
+                    case OP_REG_ADD:
+                    case OP_REG_SUBTRACT:
+                    case OP_REG_MULTIPLY:
+                    case OP_REG_DIVIDE:
+                    case OP_REG_ADD_INT:
+                    case OP_REG_SUBTRACT_INT:
+                    case OP_REG_MULTIPLY_INT:
+                    case OP_REG_DIVIDE_INT:
+                    case OP_REG_ADD_DOUBLE:
+                    case OP_REG_SUBTRACT_DOUBLE:
+                    case OP_REG_MULTIPLY_DOUBLE:
+                    case OP_REG_DIVIDE_DOUBLE:
+                    case OP_REG_CONCAT:
+                        instruction.arg = readRegister(offset + 1);
+                        instruction.a = readRegister(offset + 2);
+                        instruction.b = readRegister(offset + 3);
+                        break;
+                    default:
+                        break;
+                }
+                offset += 1 + getOperandLength(instruction.opcode);
+            }
+
+            if (chunk.isa == ISA_STACK) program.max_frame_size = verifyStackCode(chunk);
+
+            // A snapshot's globals become the program's, so a run that
+            // restores them copies values and allocates nothing.
+            if (snapshot.resume != 0) {
+                if (chunk.isa != ISA_STACK || snapshot.resume >= code.size() || snapshot.globals.size() != program.global_count) {
+                    throw LoaderError("The snapshot does not match the code.");
+                }
+                program.start = static_cast<size_t>(index_at[snapshot.resume]);
+                program.start_globals.reserve(program.global_count);
+                for (const SnapshotValue& global : snapshot.globals) {
+                    switch (global.type) {
+                        case SnapshotValue::BOOL: program.start_globals.push_back(Value::fromBool(global.boolean)); break;
+                        case SnapshotValue::INT: program.start_globals.push_back(Value::fromInt(global.integer)); break;
+                        case SnapshotValue::DOUBLE: program.start_globals.push_back(Value::fromDouble(global.number)); break;
+                        case SnapshotValue::STRING: program.start_globals.push_back(intern(global.text)); break;
+                        default: program.start_globals.push_back(Value()); break;
+                    }
+                }
+                m_logger.debug("Loader: Restored " + std::to_string(program.global_count) + " globals from the snapshot; the run starts at offset " + std::to_string(snapshot.resume) + ".");
+            }
+
+            m_logger.debug("Loader: Decoded " + std::to_string(count) + " instructions.");
+            return program;
+        }
+
+        uint32_t Loader::verifyStackCode(const Executable::Chunk& chunk) {
+            const std::vector<uint8_t>& code = chunk.code;
+            if (code.empty()) return 0;
+
+            // Every function the code can enter: the top level at offset 0, and each call target.
+            std::unordered_map<uint32_t, const Executable::FunctionInfo*> entries;
+            for (const auto& function : chunk.functions) {
+                if (function.entry >= code.size() || !entries.emplace(function.entry, &function).second) {
+                    throw LoaderError("Invalid function table entry at offset " + std::to_string(function.entry) + ".");
+                }
+            }
+            auto top_level = entries.find(0);
+            if (top_level == entries.end() || top_level->second->arity != 0) {
+                throw LoaderError("The function table does not describe the top-level code.");
+            }
+
+            // The code has no branches, so each function is the straight run
+            // from its entry to its first return and the stack depth at every
+            // instruction is known. Walking it once here is what lets the VM
+            // push and pop without checks. A snapshot must resume the top
+            // level between two statements, where its stack is empty.
+            uint32_t max_frame_size = 0;
+            uint32_t resume = chunk.snapshot.resume;
+            bool resumes = resume == 0;
+            for (const auto& function : chunk.functions) {
+                uint32_t depth = function.arity;
+                uint32_t max_depth = function.arity;
+                size_t offset = function.entry;
+                for (;;) {
+                    auto fail = [&](const std::string& message) {
+                        throw LoaderError(message + " at offset " + std::to_string(offset) + ".");
+                    };
+                    if (offset >= code.size()) fail("Function runs past the end of the code");
+                    if (offset != function.entry && entries.count(static_cast<uint32_t>(offset))) fail("Function runs into the next one");
+                    if (function.entry == 0 && offset == resume) {
+                        if (depth != 0) fail("The snapshot resumes inside a statement");
+                        resumes = true;
+                    }
+                    uint8_t op = code[offset];
+                    const uint8_t* operands = &code[offset + 1];
+
+                    // The local slot the instruction uses must lie below the
+                    // stack top. OP_SET_LOCAL stores the value on top, so its
+                    // slot must lie below that; the second read of
+                    // OP_GET_LOCAL_2 may take the value the first one pushed.
+                    auto checkLocal = [&](uint8_t slot, uint32_t slots) {
+                        if (slot >= slots) fail("Local slot " + std::to_string(slot) + " out of range");
+                    };
+                    switch (op) {
+                        case OP_GET_LOCAL:
+                        case OP_GET_LOCAL_CONST:
+                        case OP_GET_LOCAL_CALL:
+                            checkLocal(operands[0], depth);
+                            break;
+                        case OP_SET_LOCAL:
+                            checkLocal(operands[0], depth > 0 ? depth - 1 : 0);
+                            break;
+                        case OP_GET_LOCAL_2:
+                            checkLocal(operands[0], depth);
+                            checkLocal(operands[1], depth + 1);
+                            break;
+                        default:
+                            break;
+                    }
+
+                    int address_at = getCallAddressOperand(op);
+                    if (address_at >= 0) {
+                        uint32_t address = static_cast<uint32_t>((operands[address_at] << 8) | operands[address_at + 1]);
+                        auto callee = entries.find(address);
+                        uint8_t argc = operands[address_at - 1];
+                        if (callee == entries.end() || callee->second->arity != argc) fail("Call does not match a function's arity");
+                    }
+
+                    if (!applyStackEffect(op, operands, depth, max_depth)) fail("Stack underflow");
+                    if (isReturn(op)) break;
+                    offset += 1 + getOperandLength(op);
+                }
+                if (max_depth > function.max_stack) {
+                    throw LoaderError("The function at offset " + std::to_string(function.entry) + " uses more stack than its table entry records.");
+                }
+                max_frame_size = std::max(max_frame_size, max_depth);
+            }
+            if (!resumes) {
+                throw LoaderError("The snapshot resumes at offset " + std::to_string(resume) + ", which is not in the top-level code.");
+            }
+            return max_frame_size;
+        }
+
+    }
+}
@@ -0,0 +1,78 @@
+#include "vm/natives.h"
+#include "vm/vm.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        DataType dataTypeOf(const Value& value) {
+            switch (value.type) {
+                case ValueType::NIL: return NIL;
+                case ValueType::BOOL: return BOOL;
+                case ValueType::INT: return INT;
+                case ValueType::DOUBLE: return DOUBLE;
+                case ValueType::STRING: return STRING;
+            }
+            return UNKNOWN;
+        }
+
+        const char* dataTypeName(uint8_t type) {
+            switch (type) {
+                case NIL: return "Nil";
+                case BOOL: return "Bool";
+                case INT: return "Int";
+                case DOUBLE: return "Double";
+                case STRING: return "String";
+                case FUNCTION: return "Function";
+            }
+            return "Unknown";
+        }
+
+        // The builtins compile to their own instructions; these handlers only
+        // run if an image calls one through OP_CALL_NATIVE.
+        static Value nativeWriteOut(VirtualMachine& vm, const Value* args, uint8_t) {
+            vm.write(OUTPUT_OUT, args[0]);
+            return Value();
+        }
+
+        static Value nativeWriteErr(VirtualMachine& vm, const Value* args, uint8_t) {
+            vm.write(OUTPUT_ERR, args[0]);
+            return Value();
+        }
+
+        static Value nativeFlush(VirtualMachine& vm, const Value*, uint8_t) {
+            vm.flushOutput();
+            return Value();
+        }
+
+        static Value nativeJob(VirtualMachine& vm, const Value*, uint8_t) {
+            return vm.makeString(vm.getJob());
+        }
+
+        NativeRegistry::NativeRegistry() {
+            add({"writeOut", {UNKNOWN}, NIL, nativeWriteOut, OP_WRITE_OUT});
+            add({"writeErr", {UNKNOWN}, NIL, nativeWriteErr, OP_WRITE_ERR});
+            add({"flush", {}, NIL, nativeFlush, OP_FLUSH});
+            add({"job", {}, STRING, nativeJob});
+        }
+
+        void NativeRegistry::add(Native native) {
+            if (find(native.name)) throw NativeError("A native function named '" + native.name + "' is already registered.");
+            if (!native.handler) throw NativeError("The native function '" + native.name + "' has no handler.");
+            if (native.parameters.size() > UINT8_MAX) throw NativeError("The native function '" + native.name + "' has too many parameters.");
+            m_functions.push_back(std::move(native));
+        }
+
+        const Native* NativeRegistry::find(std::string_view name) const {
+            for (const Native& native : m_functions) {
+                if (native.name == name) return &native;
+            }
+            return nullptr;
+        }
+
+        const NativeRegistry& NativeRegistry::standard() {
+            static const NativeRegistry registry;
+            return registry;
+        }
+
+    }
+}
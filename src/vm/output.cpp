@@ -0,0 +1,140 @@
+#include "vm/output.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+#define IODICIUM_VM_WRITEV 1
+#else
+#define IODICIUM_VM_WRITEV 0
+#endif
+
+namespace Iodicium {
+    namespace VM {
+
+        OutputBuffer::OutputBuffer(OutputStream stream, size_t capacity) : m_stream(stream), m_capacity(capacity) {}
+
+        OutputBuffer::~OutputBuffer() {
+            flush();
+        }
+
+        void OutputBuffer::setCapacity(size_t capacity) {
+            flush();
+            m_capacity = capacity;
+            m_buffer.resize(capacity);
+            m_buffer.shrink_to_fit();
+        }
+
+        void OutputBuffer::write(const Value& value) {
+            char text[32];
+            switch (value.type) {
+                case ValueType::NIL:
+                    return;
+                case ValueType::BOOL:
+                    if (value.as.boolean) write("true", 4);
+                    else write("false", 5);
+                    return;
+                case ValueType::INT: {
+                    auto result = std::to_chars(text, text + sizeof(text), value.as.integer);
+                    write(text, static_cast<size_t>(result.ptr - text));
+                    return;
+                }
+                case ValueType::DOUBLE: {
+                    // The format std::to_string uses, without building a string.
+                    int length = std::snprintf(text, sizeof(text), "%f", value.as.number);
+                    if (length >= 0 && static_cast<size_t>(length) < sizeof(text)) {
+                        write(text, static_cast<size_t>(length));
+                    } else {
+                        std::string wide = value.toString();
+                        write(wide.data(), wide.size());
+                    }
+                    return;
+                }
+                case ValueType::STRING:
+                    value.as.string->forEachPiece([&](const char* piece, size_t length) { write(piece, length); });
+                    return;
+            }
+        }
+
+        void OutputBuffer::write(const char* data, size_t length) {
+            if (m_failed || length == 0) return;
+            if (length >= WRITEV_MIN_LENGTH || length > m_capacity) {
+                queueBuffered();
+                m_pieces.push_back({data, length});
+            } else {
+                if (m_used + length > m_buffer.size()) {
+                    flush();
+                    if (m_buffer.size() < m_capacity) m_buffer.resize(m_capacity);
+                }
+                std::memcpy(m_buffer.data() + m_used, data, length);
+                m_used += length;
+            }
+            m_pending += length;
+            if (m_pending >= m_capacity) flush();
+        }
+
+        void OutputBuffer::queueBuffered() {
+            if (m_used == m_queued) return;
+            m_pieces.push_back({m_buffer.data() + m_queued, m_used - m_queued});
+            m_queued = m_used;
+        }
+
+        void OutputBuffer::flush() {
+            queueBuffered();
+            if (!m_pieces.empty()) {
+                if (!m_failed) writePieces();
+                m_pieces.clear();
+            }
+            m_used = m_queued = m_pending = 0;
+        }
+
+        void OutputBuffer::writePieces() {
+            // Whatever went through the standard streams came first.
+            std::cout.flush();
+            std::fflush(stdout);
+            if (m_stream == OUTPUT_ERR) {
+                std::cerr.flush();
+                std::fflush(stderr);
+            }
+#if IODICIUM_VM_WRITEV
+            std::vector<iovec> pieces;
+            pieces.reserve(m_pieces.size());
+            for (const Piece& piece : m_pieces) pieces.push_back({const_cast<char*>(piece.data), piece.length});
+            int fd = m_stream == OUTPUT_OUT ? STDOUT_FILENO : STDERR_FILENO;
+            size_t next = 0;
+            while (next < pieces.size()) {
+                int count = static_cast<int>(std::min<size_t>(pieces.size() - next, IOV_MAX));
+                ssize_t written = ::writev(fd, pieces.data() + next, count);
+                if (written < 0) {
+                    if (errno == EINTR) continue;
+                    m_failed = true;
+                    return;
+                }
+                // Skip whatever was written, which may end inside a piece.
+                size_t remaining = static_cast<size_t>(written);
+                while (remaining > 0 && remaining >= pieces[next].iov_len) remaining -= pieces[next++].iov_len;
+                if (remaining > 0) {
+                    pieces[next].iov_base = static_cast<char*>(pieces[next].iov_base) + remaining;
+                    pieces[next].iov_len -= remaining;
+                }
+            }
+#else
+            std::FILE* file = m_stream == OUTPUT_OUT ? stdout : stderr;
+            for (const Piece& piece : m_pieces) {
+                if (std::fwrite(piece.data, 1, piece.length, file) != piece.length) {
+                    m_failed = true;
+                    return;
+                }
+            }
+            if (std::fflush(file) != 0) m_failed = true;
+#endif
+        }
+
+    }
+}
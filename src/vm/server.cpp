@@ -0,0 +1,453 @@
+#include "vm/server.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include "vm/natives.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace Iodicium {
+    namespace VM {
+
+        namespace {
+
+#if !defined(_WIN32)
+#if defined(MSG_NOSIGNAL)
+            constexpr int SEND_FLAGS = MSG_NOSIGNAL; // A client that has gone is an error, not a SIGPIPE
+#else
+            constexpr int SEND_FLAGS = 0;
+#endif
+
+            // Writes all of 'data', returning false if the peer has gone. On
+            // a non-blocking socket, it also gives up once the peer has taken
+            // nothing for Server::SEND_TIMEOUT_MS.
+            bool sendAll(int socket, const char* data, size_t length) {
+                while (length > 0) {
+                    ssize_t sent = ::send(socket, data, length, SEND_FLAGS);
+                    if (sent < 0 && errno == EINTR) continue;
+                    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        pollfd polled{socket, POLLOUT, 0};
+                        int ready = ::poll(&polled, 1, Server::SEND_TIMEOUT_MS);
+                        if (ready > 0 || (ready < 0 && errno == EINTR)) continue;
+                        return false;
+                    }
+                    if (sent <= 0) return false;
+                    data += sent;
+                    length -= static_cast<size_t>(sent);
+                }
+                return true;
+            }
+
+            // Fills 'address' for 'path', raising a VirtualMachineError if it does not fit.
+            void socketAddress(const std::string& path, sockaddr_un& address) {
+                std::memset(&address, 0, sizeof(address));
+                address.sun_family = AF_UNIX;
+                if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+                    throw VirtualMachineError("Invalid socket path (at most " + std::to_string(sizeof(address.sun_path) - 1) + " characters): " + path);
+                }
+                std::memcpy(address.sun_path, path.data(), path.size());
+            }
+
+            std::string systemError(const std::string& what) {
+                return what + ": " + std::strerror(errno);
+            }
+#endif
+
+            // Splits a request line at its tabs.
+            void splitFields(std::string_view line, std::vector<std::string_view>& fields) {
+                fields.clear();
+                size_t start = 0;
+                for (size_t tab = line.find('\t'); tab != std::string_view::npos; tab = line.find('\t', start)) {
+                    fields.push_back(line.substr(start, tab - start));
+                    start = tab + 1;
+                }
+                fields.push_back(line.substr(start));
+            }
+
+        }
+
+        std::string Server::escape(std::string_view text) {
+            std::string escaped;
+            escaped.reserve(text.size());
+            for (char c : text) {
+                switch (c) {
+                    case '\\': escaped += "\\\\"; break;
+                    case '\t': escaped += "\\t"; break;
+                    case '\n': escaped += "\\n"; break;
+                    case '\r': escaped += "\\r"; break;
+                    default: escaped += c;
+                }
+            }
+            return escaped;
+        }
+
+        std::string Server::unescape(std::string_view text) {
+            std::string unescaped;
+            unescaped.reserve(text.size());
+            for (size_t i = 0; i < text.size(); i++) {
+                if (text[i] != '\\' || i + 1 == text.size()) {
+                    unescaped += text[i];
+                    continue;
+                }
+                switch (text[++i]) {
+                    case 't': unescaped += '\t'; break;
+                    case 'n': unescaped += '\n'; break;
+                    case 'r': unescaped += '\r'; break;
+                    case '\\': unescaped += '\\'; break;
+                    default: unescaped += '\\'; unescaped += text[i]; // Not an escape; kept as written
+                }
+            }
+            return unescaped;
+        }
+
+        void Server::answer(VirtualMachine& vm, std::vector<PortableValue>& args, std::string_view request, std::string& response) {
+            std::vector<std::string_view> fields;
+            splitFields(request, fields);
+            try {
+                const ExportedFunction* function = m_library.find(fields[0]);
+                if (!function) {
+                    throw VirtualMachineError("No function named '" + std::string(fields[0]) + "' is exported.");
+                }
+
+                size_t argc = fields.size() - 1;
+                Library::checkArity(*function, argc);
+                args.resize(argc);
+                for (size_t i = 0; i < argc; i++) {
+                    PortableValue& arg = args[i];
+                    std::string text = unescape(fields[i + 1]);
+                    uint8_t type = function->parameters[i];
+                    bool valid = true;
+                    switch (type) {
+                        case BOOL:
+                            valid = text == "true" || text == "false";
+                            arg.value = Value::fromBool(text == "true");
+                            break;
+                        case INT: {
+                            int64_t integer = 0;
+                            valid = parseInt(text, integer);
+                            arg.value = Value::fromInt(integer);
+                            break;
+                        }
+                        case DOUBLE: {
+                            double number = 0.0;
+                            valid = parseDouble(text, number);
+                            arg.value = Value::fromDouble(number);
+                            break;
+                        }
+                        case STRING:
+                            arg.value = Value::fromString(nullptr);
+                            arg.text = std::move(text);
+                            break;
+                        default:
+                            throw VirtualMachineError("'" + function->name + "' cannot be called here: parameter " + std::to_string(i + 1) + " is of type " + dataTypeName(type) + ".");
+                    }
+                    if (!valid) {
+                        throw VirtualMachineError("Argument " + std::to_string(i + 1) + " of '" + function->name + "' must be " + dataTypeName(type) + ", not '" + text + "'.");
+                    }
+                }
+
+                Value result = vm.convert(vm.call(function->entry, args.data(), argc), STRING);
+                response += "ok\t";
+                response += escape(std::string_view(vm.flatten(result.as.string), result.as.string->length));
+            } catch (const std::exception& e) {
+                response += "error\t";
+                response += escape(e.what());
+            }
+            response += '\n';
+        }
+
+#if defined(_WIN32)
+
+        Server::Server(Common::Logger& logger, const Library& library, size_t workers, size_t memory_limit)
+            : m_logger(logger), m_library(library), m_workers(std::max<size_t>(workers, 1)), m_memory_limit(memory_limit) {}
+
+        Server::~Server() = default;
+        Server::Connection::~Connection() = default;
+
+        void Server::serve(const std::string&) {
+            throw VirtualMachineError("Serving needs Unix domain sockets, which this platform does not provide.");
+        }
+
+        void Server::stop() {}
+
+        Client::Client(const std::string&) {
+            throw VirtualMachineError("Calling a server needs Unix domain sockets, which this platform does not provide.");
+        }
+
+        Client::~Client() = default;
+        void Client::send(std::string_view) {}
+        std::string Client::receive() { return {}; }
+
+#else
+
+        Server::Server(Common::Logger& logger, const Library& library, size_t workers, size_t memory_limit)
+            : m_logger(logger), m_library(library), m_workers(std::max<size_t>(workers, 1)), m_memory_limit(memory_limit) {
+            // The stop pipe is never drained: once stopped, a server stays
+            // stopped. The wake pipe is drained by serve().
+            if (::pipe(m_stop_pipe) != 0) throw VirtualMachineError(systemError("Could not create a pipe"));
+            if (::pipe(m_wake_pipe) != 0) {
+                std::string error = systemError("Could not create a pipe");
+                ::close(m_stop_pipe[0]);
+                ::close(m_stop_pipe[1]);
+                throw VirtualMachineError(error);
+            }
+            ::fcntl(m_stop_pipe[1], F_SETFL, O_NONBLOCK);
+            ::fcntl(m_wake_pipe[0], F_SETFL, O_NONBLOCK);
+            ::fcntl(m_wake_pipe[1], F_SETFL, O_NONBLOCK);
+        }
+
+        Server::~Server() {
+            ::close(m_stop_pipe[0]);
+            ::close(m_stop_pipe[1]);
+            ::close(m_wake_pipe[0]);
+            ::close(m_wake_pipe[1]);
+        }
+
+        Server::Connection::~Connection() {
+            ::close(socket);
+        }
+
+        void Server::stop() {
+            char byte = 0;
+            ssize_t written = ::write(m_stop_pipe[1], &byte, 1); // Full only if stop() was called already
+            (void)written;
+        }
+
+        void Server::work(size_t worker) {
+            VirtualMachine vm(m_logger, m_memory_limit);
+            std::vector<PortableValue> args; // Kept from call to call, so that their strings keep their capacity
+            try {
+                if (m_configure) m_configure(vm);
+                vm.run(m_library.getProgram());
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_error.empty()) m_error = e.what();
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_initialized++;
+            }
+            m_initialized_changed.notify_all();
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_error.empty()) return;
+            while (true) {
+                m_ready.wait(lock, [&] { return m_stopping || !m_pending.empty(); });
+                if (m_pending.empty()) return;
+                std::unique_ptr<Connection> connection = std::move(m_pending.front());
+                m_pending.pop_front();
+                m_active[worker] = connection->socket;
+                lock.unlock();
+
+                auto taken = std::chrono::steady_clock::now();
+                bool open = serveConnection(vm, args, *connection);
+                while (open && awaitInput(*connection, taken)) open = serveConnection(vm, args, *connection);
+
+                lock.lock();
+                m_active[worker] = -1;
+                if (open && !m_stopping) {
+                    m_idle.push_back(std::move(connection));
+                    char byte = 0;
+                    ssize_t written = ::write(m_wake_pipe[1], &byte, 1); // Full only if serve() has yet to wake
+                    (void)written;
+                }
+            }
+        }
+
+        bool Server::serveConnection(VirtualMachine& vm, std::vector<PortableValue>& args, Connection& connection) {
+            // One read at a time, so that a client that keeps sending
+            // cannot keep the worker from others waiting for one.
+            char buffer[16384];
+            ssize_t received;
+            do {
+                received = ::recv(connection.socket, buffer, sizeof(buffer), 0);
+            } while (received < 0 && errno == EINTR);
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            bool closed = received <= 0;
+            if (!closed) {
+                connection.input.append(buffer, static_cast<size_t>(received));
+            } else if (!connection.input.empty()) {
+                connection.input += '\n'; // The last request need not end in a newline
+            }
+
+            // Everything that arrived is answered before the responses are
+            // sent, so a client that sends many requests at once gets their
+            // responses in one write.
+            std::string response;
+            std::string& input = connection.input;
+            size_t start = 0;
+            for (size_t end = input.find('\n'); end != std::string::npos; end = input.find('\n', start)) {
+                std::string_view request(input.data() + start, end - start);
+                if (!request.empty() && request.back() == '\r') request.remove_suffix(1);
+                answer(vm, args, request, response);
+                start = end + 1;
+            }
+            input.erase(0, start);
+            if (!response.empty() && !sendAll(connection.socket, response.data(), response.size())) return false;
+            if (input.size() > MAX_REQUEST_LENGTH) {
+                response = "error\tRequest longer than " + std::to_string(MAX_REQUEST_LENGTH) + " bytes.\n";
+                sendAll(connection.socket, response.data(), response.size());
+                return false;
+            }
+            return !closed;
+        }
+
+        bool Server::awaitInput(const Connection& connection, std::chrono::steady_clock::time_point taken) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_stopping) return false;
+                if (!m_pending.empty() && std::chrono::steady_clock::now() - taken >= std::chrono::milliseconds(HANDBACK_MS)) return false;
+            }
+            pollfd polled{connection.socket, POLLIN, 0};
+            return ::poll(&polled, 1, HANDBACK_MS) > 0;
+        }
+
+        void Server::serve(const std::string& socket_path) {
+            sockaddr_un address;
+            socketAddress(socket_path, address);
+
+            // A socket nothing answers on is left by a server that was
+            // killed; anything else at the path is not ours to remove.
+            struct stat status;
+            if (::lstat(socket_path.c_str(), &status) == 0) {
+                if (!S_ISSOCK(status.st_mode)) throw VirtualMachineError("Not a socket: " + socket_path);
+                int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                bool live = probe >= 0 && ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+                if (probe >= 0) ::close(probe);
+                if (live) throw VirtualMachineError("Another server is listening on " + socket_path);
+                ::unlink(socket_path.c_str());
+            }
+
+            int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listener < 0) throw VirtualMachineError(systemError("Could not create a socket"));
+            if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+                std::string error = systemError("Could not listen on " + socket_path);
+                ::close(listener);
+                throw VirtualMachineError(error);
+            }
+
+            m_stopping = false;
+            m_initialized = 0;
+            m_error.clear();
+            m_active.assign(m_workers, -1);
+            std::vector<std::thread> threads;
+            threads.reserve(m_workers);
+            for (size_t i = 0; i < m_workers; i++) threads.emplace_back(&Server::work, this, i);
+
+            // Clients may connect while the workers run the library; they
+            // are answered once it has run everywhere.
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_initialized_changed.wait(lock, [&] { return m_initialized == m_workers; });
+            }
+            // Connections waiting for input are polled here, along with the
+            // listener and the pipes, and go to the workers once readable.
+            std::vector<std::unique_ptr<Connection>> idle;
+            if (m_error.empty()) {
+                size_t functions = m_library.getFunctions().size();
+                m_logger.info("Serving " + std::to_string(functions) + (functions == 1 ? " function" : " functions") + " on " + socket_path + " with " +
+                              std::to_string(m_workers) + (m_workers == 1 ? " worker." : " workers."));
+                std::vector<pollfd> polled;
+                while (true) {
+                    polled.assign({{listener, POLLIN, 0}, {m_stop_pipe[0], POLLIN, 0}, {m_wake_pipe[0], POLLIN, 0}});
+                    for (const auto& connection : idle) polled.push_back({connection->socket, POLLIN, 0});
+                    if (::poll(polled.data(), polled.size(), -1) < 0) {
+                        if (errno == EINTR) continue;
+                        break;
+                    }
+                    if (polled[1].revents != 0) break;
+
+                    std::vector<std::unique_ptr<Connection>> ready;
+                    for (size_t i = idle.size(); i-- > 0;) {
+                        if (polled[3 + i].revents == 0) continue;
+                        ready.push_back(std::move(idle[i]));
+                        idle.erase(idle.begin() + static_cast<std::ptrdiff_t>(i));
+                    }
+                    if (polled[2].revents != 0) {
+                        char drained[64];
+                        while (::read(m_wake_pipe[0], drained, sizeof(drained)) > 0) {}
+                    }
+                    if (polled[0].revents != 0) {
+                        int socket = ::accept(listener, nullptr, nullptr);
+                        if (socket >= 0) {
+                            ::fcntl(socket, F_SETFL, O_NONBLOCK);
+                            idle.push_back(std::make_unique<Connection>(socket));
+                        }
+                    }
+
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    for (auto& connection : m_idle) idle.push_back(std::move(connection));
+                    m_idle.clear();
+                    if (ready.empty()) continue;
+                    for (auto& connection : ready) m_pending.push_back(std::move(connection));
+                    m_ready.notify_all();
+                }
+            }
+
+            // Connections stop being read, so each worker finishes once it
+            // has answered what it has read.
+            ::close(listener);
+            ::unlink(socket_path.c_str());
+            idle.clear();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+                for (int socket : m_active) {
+                    if (socket >= 0) ::shutdown(socket, SHUT_RD);
+                }
+                m_pending.clear();
+                m_idle.clear();
+            }
+            m_ready.notify_all();
+            for (std::thread& thread : threads) thread.join();
+            if (!m_error.empty()) throw VirtualMachineError(m_error);
+        }
+
+        Client::Client(const std::string& socket_path) {
+            sockaddr_un address;
+            socketAddress(socket_path, address);
+            m_socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (m_socket < 0 || ::connect(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                std::string error = systemError("Could not connect to " + socket_path);
+                if (m_socket >= 0) ::close(m_socket);
+                throw VirtualMachineError(error);
+            }
+        }
+
+        Client::~Client() {
+            ::close(m_socket);
+        }
+
+        void Client::send(std::string_view request) {
+            std::string line(request);
+            line += '\n';
+            if (!sendAll(m_socket, line.data(), line.size())) throw VirtualMachineError("The server closed the connection.");
+        }
+
+        std::string Client::receive() {
+            char buffer[16384];
+            size_t end;
+            while ((end = m_buffer.find('\n')) == std::string::npos) {
+                ssize_t received = ::recv(m_socket, buffer, sizeof(buffer), 0);
+                if (received < 0 && errno == EINTR) continue;
+                if (received <= 0) throw VirtualMachineError("The server closed the connection.");
+                m_buffer.append(buffer, static_cast<size_t>(received));
+            }
+            std::string response = m_buffer.substr(0, end);
+            m_buffer.erase(0, end + 1);
+            return response;
+        }
+
+#endif
+
+    }
+}
@@ -0,0 +1,166 @@
+#include "vm/snapshot.h"
+#include <algorithm>
+#include <unordered_map>
+#include "common/opcode.h"
+#include "vm/vm.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        namespace {
+
+            // Instructions whose only effects are on the stack and the globals.
+            bool isPure(uint8_t op) {
+                switch (op) {
+                    case OP_CONST:
+                    case OP_ADD:
+                    case OP_SUBTRACT:
+                    case OP_MULTIPLY:
+                    case OP_DIVIDE:
+                    case OP_ADD_INT:
+                    case OP_SUBTRACT_INT:
+                    case OP_MULTIPLY_INT:
+                    case OP_DIVIDE_INT:
+                    case OP_ADD_DOUBLE:
+                    case OP_SUBTRACT_DOUBLE:
+                    case OP_MULTIPLY_DOUBLE:
+                    case OP_DIVIDE_DOUBLE:
+                    case OP_CONCAT:
+                    case OP_CONCAT_N:
+                    case OP_CONVERT:
+                    case OP_CHECK_TYPE:
+                    case OP_DEFINE_GLOBAL:
+                    case OP_GET_GLOBAL:
+                    case OP_SET_GLOBAL:
+                    case OP_GET_LOCAL:
+                    case OP_SET_LOCAL:
+                    case OP_GET_LOCAL_2:
+                    case OP_GET_LOCAL_CONST:
+                    case OP_POP:
+                    case OP_SLIDE:
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            // Finds the functions initialization may call: those whose code
+            // is pure and calls only functions that are. The code has been
+            // verified by the Loader, so every function ends in a return and
+            // every call lands on a function.
+            class PureFunctions {
+            public:
+                explicit PureFunctions(const std::vector<uint8_t>& code) : m_code(code) {}
+
+                // True if 'op', at 'offset', is pure or calls a pure function.
+                bool allows(uint8_t op, size_t offset) {
+                    if (isPure(op)) return true;
+                    if (op != OP_CALL && op != OP_TAIL_CALL && op != OP_GET_LOCAL_CALL) return false;
+                    int at = getCallAddressOperand(op);
+                    return isPureFunction(static_cast<uint32_t>((m_code[offset + 1 + at] << 8) | m_code[offset + 2 + at]));
+                }
+
+            private:
+                enum State : uint8_t { CHECKING, PURE, IMPURE };
+
+                bool isPureFunction(uint32_t entry) {
+                    auto [it, added] = m_states.emplace(entry, CHECKING);
+                    if (!added) return it->second == PURE; // A recursive call never returns, as nothing branches
+                    State state = PURE;
+                    for (size_t offset = entry;; offset += 1 + getOperandLength(m_code[offset])) {
+                        uint8_t op = m_code[offset];
+                        if (op == OP_RETURN || op == OP_ADD_INT_RETURN) break;
+                        if (!allows(op, offset)) {
+                            state = IMPURE;
+                            break;
+                        }
+                        if (isReturn(op)) break; // A tail call to a pure function
+                    }
+                    m_states[entry] = state;
+                    return state == PURE;
+                }
+
+                const std::vector<uint8_t>& m_code;
+                std::unordered_map<uint32_t, State> m_states;
+            };
+
+            Executable::SnapshotValue toSnapshotValue(const Value& value) {
+                Executable::SnapshotValue global;
+                switch (value.type) {
+                    case ValueType::NIL: break;
+                    case ValueType::BOOL:
+                        global.type = Executable::SnapshotValue::BOOL;
+                        global.boolean = value.as.boolean;
+                        break;
+                    case ValueType::INT:
+                        global.type = Executable::SnapshotValue::INT;
+                        global.integer = value.as.integer;
+                        break;
+                    case ValueType::DOUBLE:
+                        global.type = Executable::SnapshotValue::DOUBLE;
+                        global.number = value.as.number;
+                        break;
+                    case ValueType::STRING:
+                        global.type = Executable::SnapshotValue::STRING;
+                        global.text = value.as.string->toStdString();
+                        break;
+                }
+                return global;
+            }
+
+        }
+
+        Executable::Snapshot takeSnapshot(Common::Logger& logger, const Executable::Chunk& chunk) {
+            if (chunk.isa != ISA_STACK) {
+                throw VirtualMachineError("Only executables of stack code can be snapshotted.");
+            }
+
+            // Any earlier snapshot is replaced, so the run starts from the top.
+            Executable::Chunk fresh = chunk;
+            fresh.snapshot = Executable::Snapshot();
+            Loader loader(logger);
+            Program program = loader.load(fresh);
+
+            // Initialization ends after the last statement that keeps to it,
+            // which is one that leaves the stack empty by defining a global
+            // or discarding the value of an expression.
+            const std::vector<uint8_t>& code = fresh.code;
+            PureFunctions functions(code);
+            uint32_t depth = 0;
+            uint32_t max_depth = 0;
+            size_t last = code.size(); // The offset of that statement's last instruction
+            for (size_t offset = 0; offset < code.size(); offset += 1 + getOperandLength(code[offset])) {
+                uint8_t op = code[offset];
+                if (isReturn(op) || !functions.allows(op, offset)) break;
+                applyStackEffect(op, &code[offset + 1], depth, max_depth);
+                if (depth == 0 && (op == OP_DEFINE_GLOBAL || op == OP_POP)) last = offset;
+            }
+            if (last == code.size()) {
+                throw VirtualMachineError("The top-level code has no initialization to snapshot: its first statement writes output, calls a native or starts a fiber or task.");
+            }
+
+            // The run stops at that instruction: a return in its place pops
+            // the same value, which becomes the run's result rather than
+            // the global it would have defined.
+            auto stop = std::lower_bound(program.code.begin(), program.code.end(), last, [](const Instruction& instruction, size_t offset) {
+                return instruction.offset < offset;
+            });
+            Instruction defined = *stop;
+            stop->opcode = OP_RETURN;
+
+            VirtualMachine vm(logger);
+            vm.setJitEnabled(false);
+            vm.run(program);
+
+            Executable::Snapshot snapshot;
+            snapshot.resume = static_cast<uint32_t>(last + 1 + getOperandLength(code[last]));
+            snapshot.globals.reserve(program.global_count);
+            for (uint32_t slot = 0; slot < program.global_count; slot++) {
+                bool stopped_here = defined.opcode == OP_DEFINE_GLOBAL && defined.operand.slot == slot;
+                snapshot.globals.push_back(toSnapshotValue(stopped_here ? vm.getResult() : vm.getGlobals()[slot]));
+            }
+            return snapshot;
+        }
+
+    }
+}
@@ -0,0 +1,136 @@
+#include "vm/tasks.h"
+#include "vm/vm.h"
+
+namespace Iodicium {
+    namespace VM {
+
+        TaskScheduler::TaskScheduler(Program& program, size_t helpers, const MakeWorker& make_worker) : m_program(program) {
+            m_workers.resize(helpers + 1);
+            for (size_t worker = 1; worker <= helpers; worker++) m_vms.push_back(make_worker(*this, worker));
+            for (size_t worker = 1; worker <= helpers; worker++) m_threads.emplace_back([this, worker] { work(worker); });
+        }
+
+        TaskScheduler::~TaskScheduler() {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+            }
+            m_work.notify_all();
+            m_finished.notify_all();
+            for (std::thread& thread : m_threads) thread.join();
+        }
+
+        int64_t TaskScheduler::spawn(size_t worker, std::shared_ptr<Task> task) {
+            int64_t handle;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                handle = static_cast<int64_t>(m_tasks.size());
+                m_tasks.push_back(task);
+            }
+            if (m_threads.empty()) return handle;
+
+            {
+                std::lock_guard<std::mutex> lock(m_workers[worker].mutex);
+                m_workers[worker].tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queued++;
+            }
+            m_work.notify_one();
+            return handle;
+        }
+
+        std::shared_ptr<Task> TaskScheduler::find(int64_t handle) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (handle < 0 || static_cast<uint64_t>(handle) >= m_tasks.size()) return nullptr;
+            return m_tasks[handle];
+        }
+
+        void TaskScheduler::release(int64_t handle) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks[handle].reset();
+        }
+
+        bool TaskScheduler::claim(Task& task) {
+            Task::Status queued = Task::QUEUED;
+            return task.status.compare_exchange_strong(queued, Task::RUNNING, std::memory_order_acq_rel);
+        }
+
+        void TaskScheduler::finish(Task& task, PortableValue result, Arena::Charge charge) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                task.result = std::move(result);
+                task.result_charge = std::move(charge);
+                std::vector<PortableValue>().swap(task.args);
+                task.args_charge = {};
+                task.globals.reset();
+                task.status.store(Task::DONE, std::memory_order_release);
+            }
+            m_finished.notify_all();
+        }
+
+        void TaskScheduler::fail(Task& task, const std::string& error) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                task.error = error;
+                std::vector<PortableValue>().swap(task.args);
+                task.args_charge = {};
+                task.globals.reset();
+                task.status.store(Task::FAILED, std::memory_order_release);
+            }
+            m_finished.notify_all();
+        }
+
+        bool TaskScheduler::wait(Task& task) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_finished.wait(lock, [&] { return task.status.load(std::memory_order_acquire) >= Task::DONE || m_stopping; });
+            return task.status.load(std::memory_order_acquire) >= Task::DONE;
+        }
+
+        std::shared_ptr<Task> TaskScheduler::take(size_t worker) {
+            // The worker's own newest task first, then the oldest of each other worker.
+            for (size_t i = 0; i < m_workers.size(); i++) {
+                Worker& victim = m_workers[(worker + i) % m_workers.size()];
+                for (;;) {
+                    std::shared_ptr<Task> task;
+                    {
+                        std::lock_guard<std::mutex> lock(victim.mutex);
+                        if (victim.tasks.empty()) break;
+                        if (i == 0) {
+                            task = std::move(victim.tasks.back());
+                            victim.tasks.pop_back();
+                        } else {
+                            task = std::move(victim.tasks.front());
+                            victim.tasks.pop_front();
+                        }
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_queued--;
+                    }
+                    if (claim(*task)) return task;
+                }
+            }
+            return nullptr;
+        }
+
+        void TaskScheduler::work(size_t worker) {
+            VirtualMachine& vm = *m_vms[worker - 1];
+            for (;;) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (m_stopping) return;
+                }
+                if (std::shared_ptr<Task> task = take(worker)) {
+                    vm.runTask(m_program, *task);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_work.wait(lock, [&] { return m_stopping || m_queued > 0; });
+                if (m_stopping) return;
+            }
+        }
+
+    }
+}
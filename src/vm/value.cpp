@@ -1,23 +1,97 @@
 #include "vm/value.h"
-#include <variant>
-#include <sstream>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 
 namespace Iodicium {
     namespace VM {
 
+        const String* String::create(void* memory, std::string_view text) {
+            std::memcpy(createUninitialized(memory, text.size()), text.data(), text.size());
+            return static_cast<const String*>(memory);
+        }
+
+        char* String::createUninitialized(void* memory, size_t length) {
+            String* string = static_cast<String*>(memory);
+            char* chars = reinterpret_cast<char*>(string + 1);
+            chars[length] = '\0';
+            string->length = length;
+            string->chars = chars;
+            string->left = nullptr;
+            string->right = nullptr;
+            return chars;
+        }
+
+        const String* String::concat(void* memory, const String* left, const String* right) {
+            String* string = static_cast<String*>(memory);
+            string->length = left->length + right->length;
+            string->chars = nullptr;
+            string->left = left;
+            string->right = right;
+            return string;
+        }
+
+        void String::copyTo(char* out) const {
+            forEachPiece([&](const char* piece, size_t length) {
+                std::memcpy(out, piece, length);
+                out += length;
+            });
+        }
+
+        std::string String::toStdString() const {
+            std::string text;
+            text.reserve(length);
+            forEachPiece([&](const char* piece, size_t length) { text.append(piece, length); });
+            return text;
+        }
+
+        bool parseInt(const std::string& text, int64_t& out) {
+            if (text.empty()) return false;
+            errno = 0;
+            char* end = nullptr;
+            long long parsed = std::strtoll(text.c_str(), &end, 10);
+            if (errno != 0 || *end != '\0') return false;
+            out = static_cast<int64_t>(parsed);
+            return true;
+        }
+
+        bool parseDouble(const std::string& text, double& out) {
+            if (text.empty()) return false;
+            char* end = nullptr;
+            double parsed = std::strtod(text.c_str(), &end);
+            if (*end != '\0') return false;
+            out = parsed;
+            return true;
+        }
+
         std::ostream& operator<<(std::ostream& os, const Value& value) {
-            std::visit([&](auto&& arg) {
-                os << arg;
-            }, value.data);
-            return os;
+            if (value.isString()) {
+                value.as.string->forEachPiece([&](const char* piece, size_t length) { os.write(piece, static_cast<std::streamsize>(length)); });
+                return os;
+            }
+            return os << value.toString();
+        }
+
+        std::string Value::getTypeString() const {
+            switch (type) {
+                case ValueType::NIL: return "nil";
+                case ValueType::BOOL: return "bool";
+                case ValueType::INT: return "int";
+                case ValueType::DOUBLE: return "double";
+                case ValueType::STRING: return "string";
+            }
+            return "unknown";
         }
 
         std::string Value::toString() const {
-            std::stringstream ss;
-            std::visit([&](auto&& arg) {
-                ss << arg;
-            }, data);
-            return ss.str();
+            switch (type) {
+                case ValueType::NIL: return "";
+                case ValueType::BOOL: return as.boolean ? "true" : "false";
+                case ValueType::INT: return std::to_string(as.integer);
+                case ValueType::DOUBLE: return std::to_string(as.number);
+                case ValueType::STRING: return as.string->toStdString();
+            }
+            return "";
         }
 
     } // namespace VM
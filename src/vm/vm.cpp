@@ -1,191 +1,915 @@
 #include "vm/vm.h"
 #include "common/opcode.h"
+#include "vm/opc/base.h"
+#include "vm/opc/arithmetic.h"
+#include "vm/opc/globals.h"
+#include "vm/opc/io.h"
+#include "vm/opc/registers.h"
+#include "vm/opc/superinstructions.h"
+#include "vm/opc/fibers.h"
+#include "vm/opc/tasks.h"
+#include "vm/instrumentation.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
 #include <iostream>
-#include <iomanip> // For std::setw
-
-enum DataType : uint8_t {
-    UNKNOWN,
-    NIL,
-    BOOL,
-    INT,
-    DOUBLE,
-    STRING,
-    FUNCTION
-};
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace Iodicium {
     namespace VM {
 
-        void printStack(const std::vector<std::string>& stack) {
-            std::cout << "          [ ";
-            for (const auto& val : stack) {
-                std::cout << val << " ";
+        // Selects the computed-goto dispatcher where the compiler supports
+        // labels-as-values; define IODICIUM_VM_SWITCH_DISPATCH to force the portable loop.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(IODICIUM_VM_SWITCH_DISPATCH)
+#define IODICIUM_VM_COMPUTED_GOTO 1
+#else
+#define IODICIUM_VM_COMPUTED_GOTO 0
+#endif
+
+        // Whether 'a' and 'b' are the same value, and not merely equal: strings must be the same object.
+        static bool sameBits(const Value& a, const Value& b) {
+            return a.type == b.type && std::memcmp(&a.as, &b.as, sizeof(a.as)) == 0;
+        }
+
+        // Bytes 'values' take on the C++ heap (see PortableValue::footprint).
+        static size_t footprint(const std::vector<PortableValue>& values) {
+            size_t size = 0;
+            for (const PortableValue& value : values) size += value.footprint();
+            return size;
+        }
+
+        namespace {
+            // The globals of the tasks spawned while they were unchanged, and their charge.
+            struct TaskGlobals {
+                std::vector<PortableValue> globals;
+                Arena::Charge charge;
+            };
+        }
+
+        VirtualMachine::VirtualMachine(Common::Logger& logger, size_t memory_limit)
+            : m_logger(logger), m_memory_limit(memory_limit), m_arena(memory_limit), m_jit(logger) {}
+
+        void VirtualMachine::run(const Executable::Chunk& chunk) {
+            Loader loader(m_logger, *m_natives);
+            Program program = loader.load(chunk);
+            run(program);
+        }
+
+        ExecutionState VirtualMachine::prepare(Program& program) {
+            m_logger.debug("VM: Preparing a run.");
+
+            m_program = &program;
+
+            // Nothing survives from an earlier run. The stacks are fixed in
+            // size and never read above their top, so they are left uninitialized.
+            // Stack code never needs more than one largest frame per call in
+            // progress plus the top level, so its operand stack is sized for
+            // that and the call depth limit is the only check made at run time.
+            m_strings.reset();
+            m_arena.reset();
+            m_stdout.setCapacity(m_logger.getLevel() == Common::LogLevel::Debug ? 0 : m_output_buffer);
+            size_t frame_count = STACK_MAX;
+            size_t stack_size = STACK_MAX;
+            m_fiber_frame_count = m_fiber_stack_size = 0; // Register code has no fibers
+            if (program.isa == ISA_STACK) {
+                size_t frame_size = std::max<size_t>(program.max_frame_size, 1);
+                frame_count = m_max_call_depth;
+                if (m_memory_limit) frame_count = std::min(frame_count, m_memory_limit / 2 / (sizeof(Value) * frame_size + sizeof(CallFrame)));
+                stack_size = (frame_count + 1) * frame_size;
+                m_fiber_frame_count = std::min(m_fiber_call_depth, frame_count);
+                m_fiber_stack_size = (m_fiber_frame_count + 1) * frame_size;
+            } else if (m_memory_limit) {
+                stack_size = frame_count = std::min(stack_size, m_memory_limit / 2 / (sizeof(Value) + sizeof(CallFrame)));
+            }
+            Value* stack = m_arena.allocateArray<Value>(stack_size);
+            // A collection scans all of register code's stack, as a frame's
+            // registers are not written until they are used.
+            if (program.isa != ISA_STACK) std::uninitialized_fill_n(stack, stack_size, Value());
+            m_frames = m_arena.allocateArray<CallFrame>(frame_count);
+            m_frame_top = m_frames;
+            m_frame_limit = m_frames + frame_count;
+            Value* globals = m_arena.allocateArray<Value>(program.global_count);
+            if (program.start_globals.empty()) {
+                std::uninitialized_fill_n(globals, program.global_count, Value());
+            } else {
+                std::uninitialized_copy(program.start_globals.begin(), program.start_globals.end(), globals);
+            }
+
+            // Native code refers to the instructions it was compiled from, so
+            // nothing carries over from an earlier run.
+            m_jit.reset();
+            bool use_jit = m_jit_enabled && program.isa == ISA_STACK;
+            m_jit_functions.assign(use_jit ? program.code.size() : 0, JitFunction());
+            if (use_jit) m_jit.attach(program, m_jit_functions.data());
+
+            ExecutionState state;
+            state.ip = program.code.data() + program.start;
+            state.stack_bottom = stack;
+            state.stack_limit = stack + stack_size;
+            state.sp = state.stack_bottom;
+            state.base = state.stack_bottom;
+            state.globals = globals;
+            state.code = program.code.data();
+            state.functions = use_jit ? m_jit_functions.data() : nullptr;
+
+            startFiber(state);
+            m_start = state;
+            m_call_marked = false;
+            scheduleCollection(0);
+            return state;
+        }
+
+        void VirtualMachine::startFiber(const ExecutionState& state) {
+            m_frame_top = m_frames;
+            m_fibers.clear();
+            m_fibers.push_back({Fiber::RUNNING, 0, 0, state, m_frames, m_frame_top, m_frame_limit, nullptr});
+            m_fiber = 0;
+            m_free_fiber_stacks.clear();
+            m_free_fibers.clear();
+            m_result = Value();
+            m_snapshot.reset();
+            m_snapshot_source.clear();
+        }
+
+        void VirtualMachine::execute(Program& program, ExecutionState& state) {
+            if (m_tracing) {
+                TracingInstrumentation tracing;
+                execute(program, state, tracing);
+            } else {
+                NoInstrumentation none;
+                execute(program, state, none);
             }
-            std::cout << "]" << std::endl;
         }
 
-        void disassembleInstruction(const Executable::Chunk* chunk, size_t ip) {
-            std::cout << std::setw(4) << std::setfill('0') << ip << " ";
-            uint8_t instruction = chunk->code[ip];
+        void VirtualMachine::run(Program& program) {
+            m_tracing = m_logger.getLevel() == Common::LogLevel::Debug;
+            m_task_threads_allowed = true;
+            ExecutionState state = prepare(program);
+            if (program.code.empty()) return;
+
+            // The tracing loop is a separate instantiation, so the production
+            // loop pays nothing for -d support. Output still buffered when
+            // the run ends, by an error or otherwise, is written before the
+            // caller can report anything.
+            try {
+                execute(program, state);
+            } catch (const std::exception& e) {
+                flushOutput();
+                failTaskFibers(e.what());
+                stopTasks();
+                throw;
+            }
+            flushOutput();
+            stopTasks();
+            m_logger.debug("VM: " + std::to_string(getMemoryUsed()) + " bytes of memory in use, " + std::to_string(m_arena.getReserved() + m_strings.getReserved()) + " reserved.");
+        }
+
+        template <typename Instrumentation>
+        void VirtualMachine::run(Program& program, Instrumentation& instrumentation) {
+            // Task threads would need an instrumentation of their own, so
+            // every task runs here when it is joined.
+            m_tracing = false;
+            m_task_threads_allowed = false;
+            ExecutionState state = prepare(program);
+            if (program.code.empty()) return;
+            try {
+                execute(program, state, instrumentation);
+            } catch (const std::exception& e) {
+                flushOutput();
+                failTaskFibers(e.what());
+                stopTasks();
+                throw;
+            }
+            flushOutput();
+            stopTasks();
+        }
 
-            switch (instruction) {
-                case OP_RETURN: std::cout << "OP_RETURN" << std::endl; break;
-                case OP_CALL: std::cout << "OP_CALL" << std::endl; break;
-                case OP_CONST: std::cout << "OP_CONST" << std::endl; break;
-                case OP_WRITE_OUT: std::cout << "OP_WRITE_OUT" << std::endl; break;
-                case OP_WRITE_ERR: std::cout << "OP_WRITE_ERR" << std::endl; break;
-                case OP_FLUSH: std::cout << "OP_FLUSH" << std::endl; break;
-                case OP_ADD: std::cout << "OP_ADD" << std::endl; break;
-                case OP_SUBTRACT: std::cout << "OP_SUBTRACT" << std::endl; break;
-                case OP_MULTIPLY: std::cout << "OP_MULTIPLY" << std::endl; break;
-                case OP_DIVIDE: std::cout << "OP_DIVIDE" << std::endl; break;
-                case OP_DEFINE_GLOBAL: std::cout << "OP_DEFINE_GLOBAL" << std::endl; break;
-                case OP_GET_GLOBAL: std::cout << "OP_GET_GLOBAL" << std::endl; break;
-                case OP_SET_GLOBAL: std::cout << "OP_SET_GLOBAL" << std::endl; break;
-                case OP_GET_LOCAL: std::cout << "OP_GET_LOCAL" << std::endl; break;
-                case OP_SET_LOCAL: std::cout << "OP_SET_LOCAL" << std::endl; break;
-                case OP_CONVERT: std::cout << "OP_CONVERT" << std::endl; break;
-                default: std::cout << "Unknown Opcode: " << (int)instruction << std::endl; break;
+        void VirtualMachine::runTask(Program& program, Task& task) {
+            try {
+                ExecutionState state = prepare(program);
+                const std::vector<PortableValue>& globals = *task.globals;
+                for (size_t i = 0; i < globals.size(); i++) state.globals[i] = fromPortable(globals[i]);
+                for (const PortableValue& arg : task.args) state.push(fromPortable(arg));
+                state.ip = task.entry;
+                execute(program, state);
+                flushOutput();
+                PortableValue result = toPortable(m_result);
+                Arena::Charge charge(m_arena, result.footprint());
+                m_scheduler->finish(task, std::move(result), std::move(charge));
+            } catch (const std::exception& e) {
+                flushOutput();
+                failTaskFibers(e.what());
+                m_scheduler->fail(task, e.what());
             }
         }
 
-        VirtualMachine::VirtualMachine(Common::Logger& logger, size_t memory_limit) 
-            : m_logger(logger), m_memory_limit(memory_limit) {}
+        Value VirtualMachine::call(const Instruction* entry, const PortableValue* args, size_t argc) {
+            if (!m_program || m_program->isa != ISA_STACK) {
+                throw VirtualMachineError("Only functions of stack code can be called, once their program has run.");
+            }
+
+            // Unless the last call changed a global, nothing it allocated can
+            // still be reached, and its memory is taken back.
+            size_t count = m_program->global_count;
+            if (m_call_marked && std::equal(m_start.globals, m_start.globals + count, m_call_globals.begin(), sameBits)) {
+                m_arena.rewind(m_call_mark);
+                m_strings.rewind(m_call_strings_mark);
+            } else {
+                m_call_mark = m_arena.mark();
+                m_call_strings_mark = m_strings.mark();
+                m_call_globals.assign(m_start.globals, m_start.globals + count);
+                m_call_marked = true;
+            }
 
-        void VirtualMachine::run(Executable::Chunk& main_chunk) {
-            m_logger.info("Initializing Iodicium VM...");
+            // The function runs as the top level of a run would, in fiber 0,
+            // and its return ends the call.
+            ExecutionState state = m_start;
+            m_frames = m_fibers.front().frames;
+            m_frame_limit = m_fibers.front().frame_limit;
+            state.sp = state.stack_bottom;
+            for (size_t i = 0; i < argc; i++) state.push(fromPortable(args[i]));
+            state.ip = entry;
+            startFiber(state);
 
-            m_call_stack.clear();
-            m_call_stack.push_back({&main_chunk, 0, 0});
+            // Only the VM's own buffers are flushed, as they may refer to
+            // strings the next call frees; flushing std::cout as well would
+            // cost more than a short call. The host's streams are its own.
+            try {
+                execute(*m_program, state);
+            } catch (const std::exception& e) {
+                m_stdout.flush();
+                m_stderr.flush();
+                failTaskFibers(e.what());
+                stopTasks();
+                throw;
+            }
+            m_stdout.flush();
+            m_stderr.flush();
+            stopTasks();
+            return m_result;
+        }
 
-            m_stack.clear();
-            m_globals.clear();
+        template <typename Instrumentation>
+        void VirtualMachine::execute([[maybe_unused]] Program& program, ExecutionState& registers, Instrumentation& instrumentation) {
+            // Work on a local copy so the compiler can keep ip and sp in registers.
+            ExecutionState state = registers;
+            // Instrumented runs must see every instruction, so they never enter native code.
+            if constexpr (Instrumentation::enabled) state.functions = nullptr;
 
-            while (true) {
-                CallFrame& frame = m_call_stack.back();
+#define INSTRUMENT() do { if constexpr (Instrumentation::enabled) instrumentation.beforeInstruction(state.ip, state.stack_bottom, state.sp); } while (0)
 
-                if (m_logger.getLevel() == Common::LogLevel::Debug) {
-                    printStack(m_stack);
-                    disassembleInstruction(frame.chunk, frame.ip);
+#if IODICIUM_VM_COMPUTED_GOTO
+            // Decoded instructions carry their handler address, so the table
+            // of labels is only built to bind them. Each instantiation of this
+            // loop has its own labels, so rebind the program when it was last
+            // run by a different one.
+            // Worker threads share one program, so the first of them to get
+            // here binds it and the others wait until it is done.
+            static const char binding = 0;
+            std::atomic_ref<const void*> bound(program.dispatch_binding);
+            if (bound.load(std::memory_order_acquire) != &binding) {
+                static std::mutex binding_mutex;
+                std::lock_guard<std::mutex> lock(binding_mutex);
+                if (bound.load(std::memory_order_relaxed) != &binding) {
+                    const void* dispatch_table[256];
+                    for (auto& target : dispatch_table) target = &&TARGET_UNKNOWN;
+#define IODICIUM_VM_REGISTER(op) dispatch_table[op] = &&TARGET_##op;
+                    IODICIUM_VM_REGISTER(OP_RETURN)
+                    IODICIUM_VM_REGISTER(OP_CALL)
+                    IODICIUM_VM_REGISTER(OP_CONST)
+                    IODICIUM_VM_REGISTER(OP_WRITE_OUT)
+                    IODICIUM_VM_REGISTER(OP_WRITE_ERR)
+                    IODICIUM_VM_REGISTER(OP_FLUSH)
+                    IODICIUM_VM_REGISTER(OP_ADD)
+                    IODICIUM_VM_REGISTER(OP_SUBTRACT)
+                    IODICIUM_VM_REGISTER(OP_MULTIPLY)
+                    IODICIUM_VM_REGISTER(OP_DIVIDE)
+                    IODICIUM_VM_REGISTER(OP_DEFINE_GLOBAL)
+                    IODICIUM_VM_REGISTER(OP_GET_GLOBAL)
+                    IODICIUM_VM_REGISTER(OP_SET_GLOBAL)
+                    IODICIUM_VM_REGISTER(OP_GET_LOCAL)
+                    IODICIUM_VM_REGISTER(OP_SET_LOCAL)
+                    IODICIUM_VM_REGISTER(OP_CONVERT)
+                    IODICIUM_VM_REGISTER(OP_ADD_INT)
+                    IODICIUM_VM_REGISTER(OP_SUBTRACT_INT)
+                    IODICIUM_VM_REGISTER(OP_MULTIPLY_INT)
+                    IODICIUM_VM_REGISTER(OP_DIVIDE_INT)
+                    IODICIUM_VM_REGISTER(OP_ADD_DOUBLE)
+                    IODICIUM_VM_REGISTER(OP_SUBTRACT_DOUBLE)
+                    IODICIUM_VM_REGISTER(OP_MULTIPLY_DOUBLE)
+                    IODICIUM_VM_REGISTER(OP_DIVIDE_DOUBLE)
+                    IODICIUM_VM_REGISTER(OP_CONCAT)
+                    IODICIUM_VM_REGISTER(OP_CONCAT_N)
+                    IODICIUM_VM_REGISTER(OP_POP)
+                    IODICIUM_VM_REGISTER(OP_TAIL_CALL)
+                    IODICIUM_VM_REGISTER(OP_SLIDE)
+                    IODICIUM_VM_REGISTER(OP_CALL_NATIVE)
+                    IODICIUM_VM_REGISTER(OP_CHECK_TYPE)
+                    IODICIUM_VM_REGISTER(OP_GET_LOCAL_2)
+                    IODICIUM_VM_REGISTER(OP_GET_LOCAL_CONST)
+                    IODICIUM_VM_REGISTER(OP_GET_LOCAL_CALL)
+                    IODICIUM_VM_REGISTER(OP_ADD_INT_RETURN)
+                    IODICIUM_VM_REGISTER(OP_FIBER)
+                    IODICIUM_VM_REGISTER(OP_RESUME)
+                    IODICIUM_VM_REGISTER(OP_YIELD)
+                    IODICIUM_VM_REGISTER(OP_SPAWN)
+                    IODICIUM_VM_REGISTER(OP_JOIN)
+                    IODICIUM_VM_REGISTER(OP_REG_ENTER)
+                    IODICIUM_VM_REGISTER(OP_REG_LOAD_CONST)
+                    IODICIUM_VM_REGISTER(OP_REG_MOVE)
+                    IODICIUM_VM_REGISTER(OP_REG_GET_GLOBAL)
+                    IODICIUM_VM_REGISTER(OP_REG_DEFINE_GLOBAL)
+                    IODICIUM_VM_REGISTER(OP_REG_SET_GLOBAL)
+                    IODICIUM_VM_REGISTER(OP_REG_CALL)
+                    IODICIUM_VM_REGISTER(OP_REG_RETURN)
+                    IODICIUM_VM_REGISTER(OP_REG_CONVERT)
+                    IODICIUM_VM_REGISTER(OP_REG_WRITE_OUT)
+                    IODICIUM_VM_REGISTER(OP_REG_WRITE_ERR)
+                    IODICIUM_VM_REGISTER(OP_REG_CALL_NATIVE)
+                    IODICIUM_VM_REGISTER(OP_REG_ADD)
+                    IODICIUM_VM_REGISTER(OP_REG_SUBTRACT)
+                    IODICIUM_VM_REGISTER(OP_REG_MULTIPLY)
+                    IODICIUM_VM_REGISTER(OP_REG_DIVIDE)
+                    IODICIUM_VM_REGISTER(OP_REG_ADD_INT)
+                    IODICIUM_VM_REGISTER(OP_REG_SUBTRACT_INT)
+                    IODICIUM_VM_REGISTER(OP_REG_MULTIPLY_INT)
+                    IODICIUM_VM_REGISTER(OP_REG_DIVIDE_INT)
+                    IODICIUM_VM_REGISTER(OP_REG_ADD_DOUBLE)
+                    IODICIUM_VM_REGISTER(OP_REG_SUBTRACT_DOUBLE)
+                    IODICIUM_VM_REGISTER(OP_REG_MULTIPLY_DOUBLE)
+                    IODICIUM_VM_REGISTER(OP_REG_DIVIDE_DOUBLE)
+                    IODICIUM_VM_REGISTER(OP_REG_CONCAT)
+#undef IODICIUM_VM_REGISTER
+                    for (auto& instruction : program.code) instruction.handler = dispatch_table[instruction.opcode];
+                    bound.store(&binding, std::memory_order_release);
                 }
+            }
+#define DISPATCH() do { INSTRUMENT(); goto *(state.ip++)->handler; } while (0)
+#define TARGET(op) TARGET_##op:
+#define TARGET_DEFAULT TARGET_UNKNOWN:
+#else
+#define DISPATCH() goto dispatch
+#define TARGET(op) case op:
+#define TARGET_DEFAULT default:
+#endif
+#define HANDLE(op, handler) TARGET(op) if (!handler(*this, state)) goto halt; DISPATCH();
 
-                uint8_t instruction = frame.chunk->code[frame.ip++];
+#if IODICIUM_VM_COMPUTED_GOTO
+            DISPATCH();
+#else
+        dispatch:
+            INSTRUMENT();
+            switch ((state.ip++)->opcode) {
+#endif
+                HANDLE(OP_RETURN, op_return)
+                HANDLE(OP_CALL, op_call)
+                HANDLE(OP_CONST, op_const)
+                HANDLE(OP_WRITE_OUT, op_write_out)
+                HANDLE(OP_WRITE_ERR, op_write_err)
+                HANDLE(OP_FLUSH, op_flush)
+                HANDLE(OP_ADD, op_add)
+                HANDLE(OP_SUBTRACT, op_subtract)
+                HANDLE(OP_MULTIPLY, op_multiply)
+                HANDLE(OP_DIVIDE, op_divide)
+                HANDLE(OP_DEFINE_GLOBAL, op_define_global)
+                HANDLE(OP_GET_GLOBAL, op_get_global)
+                HANDLE(OP_SET_GLOBAL, op_set_global)
+                HANDLE(OP_GET_LOCAL, op_get_local)
+                HANDLE(OP_SET_LOCAL, op_set_local)
+                HANDLE(OP_CONVERT, op_convert)
+                HANDLE(OP_ADD_INT, op_add_int)
+                HANDLE(OP_SUBTRACT_INT, op_subtract_int)
+                HANDLE(OP_MULTIPLY_INT, op_multiply_int)
+                HANDLE(OP_DIVIDE_INT, op_divide_int)
+                HANDLE(OP_ADD_DOUBLE, op_add_double)
+                HANDLE(OP_SUBTRACT_DOUBLE, op_subtract_double)
+                HANDLE(OP_MULTIPLY_DOUBLE, op_multiply_double)
+                HANDLE(OP_DIVIDE_DOUBLE, op_divide_double)
+                HANDLE(OP_CONCAT, op_concat)
+                HANDLE(OP_CONCAT_N, op_concat_n)
+                HANDLE(OP_POP, op_pop)
+                HANDLE(OP_TAIL_CALL, op_tail_call)
+                HANDLE(OP_SLIDE, op_slide)
+                HANDLE(OP_CALL_NATIVE, op_call_native)
+                HANDLE(OP_CHECK_TYPE, op_check_type)
+                HANDLE(OP_GET_LOCAL_2, op_get_local_2)
+                HANDLE(OP_GET_LOCAL_CONST, op_get_local_const)
+                HANDLE(OP_GET_LOCAL_CALL, op_get_local_call)
+                HANDLE(OP_ADD_INT_RETURN, op_add_int_return)
+                HANDLE(OP_FIBER, op_fiber)
+                HANDLE(OP_RESUME, op_resume)
+                HANDLE(OP_YIELD, op_yield)
+                HANDLE(OP_SPAWN, op_spawn)
+                HANDLE(OP_JOIN, op_join)
+                HANDLE(OP_REG_ENTER, op_reg_enter)
+                HANDLE(OP_REG_LOAD_CONST, op_reg_load_const)
+                HANDLE(OP_REG_MOVE, op_reg_move)
+                HANDLE(OP_REG_GET_GLOBAL, op_reg_get_global)
+                HANDLE(OP_REG_DEFINE_GLOBAL, op_reg_define_global)
+                HANDLE(OP_REG_SET_GLOBAL, op_reg_set_global)
+                HANDLE(OP_REG_CALL, op_reg_call)
+                HANDLE(OP_REG_RETURN, op_reg_return)
+                HANDLE(OP_REG_CONVERT, op_reg_convert)
+                HANDLE(OP_REG_WRITE_OUT, op_reg_write_out)
+                HANDLE(OP_REG_WRITE_ERR, op_reg_write_err)
+                HANDLE(OP_REG_CALL_NATIVE, op_reg_call_native)
+                HANDLE(OP_REG_ADD, op_reg_add)
+                HANDLE(OP_REG_SUBTRACT, op_reg_subtract)
+                HANDLE(OP_REG_MULTIPLY, op_reg_multiply)
+                HANDLE(OP_REG_DIVIDE, op_reg_divide)
+                HANDLE(OP_REG_ADD_INT, op_reg_add_int)
+                HANDLE(OP_REG_SUBTRACT_INT, op_reg_subtract_int)
+                HANDLE(OP_REG_MULTIPLY_INT, op_reg_multiply_int)
+                HANDLE(OP_REG_DIVIDE_INT, op_reg_divide_int)
+                HANDLE(OP_REG_ADD_DOUBLE, op_reg_add_double)
+                HANDLE(OP_REG_SUBTRACT_DOUBLE, op_reg_subtract_double)
+                HANDLE(OP_REG_MULTIPLY_DOUBLE, op_reg_multiply_double)
+                HANDLE(OP_REG_DIVIDE_DOUBLE, op_reg_divide_double)
+                HANDLE(OP_REG_CONCAT, op_reg_concat)
+                TARGET_DEFAULT {
+                    throw VirtualMachineError("Unknown opcode: " + std::to_string(state.current().opcode));
+                }
+#if !IODICIUM_VM_COMPUTED_GOTO
+            }
+#endif
+#undef HANDLE
+#undef TARGET_DEFAULT
+#undef TARGET
+#undef DISPATCH
+#undef INSTRUMENT
 
-                switch (instruction) {
-                    case OP_RETURN: {
-                        std::string return_value = pop();
-                        m_call_stack.pop_back();
-                        if (m_call_stack.empty()) {
-                            return;
-                        }
-                        m_stack.resize(m_call_stack.back().stack_base);
-                        push(return_value);
-                        break;
-                    }
-                    case OP_CALL: {
-                        uint8_t arg_count = frame.chunk->code[frame.ip++];
-                        uint8_t high_byte = frame.chunk->code[frame.ip];
-                        uint8_t low_byte = frame.chunk->code[frame.ip + 1];
-                        uint16_t address = (high_byte << 8) | low_byte;
-                        frame.ip += 2;
-
-                        m_logger.debug("  [VM_CALL] Arg count: " + std::to_string(arg_count));
-                        m_logger.debug("  [VM_CALL] Raw address bytes: " + std::to_string(high_byte) + ", " + std::to_string(low_byte));
-                        m_logger.debug("  [VM_CALL] Jumping to address: " + std::to_string(address));
-                        
-                        CallFrame new_frame = {frame.chunk, address, m_stack.size() - arg_count};
-                        m_call_stack.push_back(new_frame);
-                        break;
-                    }
-                    case OP_CONST: {
-                        uint8_t const_index = frame.chunk->code[frame.ip++];
-                        push(frame.chunk->constants[const_index]);
-                        break;
+        halt:
+            registers = state;
+        }
+
+        VirtualMachine::FiberStacks VirtualMachine::takeFiberStacks() {
+            if (m_fibers.size() > INT32_MAX) throw VirtualMachineError("Too many fibers.");
+            if (!m_free_fiber_stacks.empty()) {
+                FiberStacks stacks = m_free_fiber_stacks.back();
+                m_free_fiber_stacks.pop_back();
+                return stacks;
+            }
+            return {m_arena.allocateArray<Value>(m_fiber_stack_size), m_arena.allocateArray<CallFrame>(m_fiber_frame_count), nullptr};
+        }
+
+        Value VirtualMachine::createFiber(const ExecutionState& state, const Instruction* entry, uint8_t argc) {
+            FiberStacks stacks = takeFiberStacks();
+
+            // The arguments become the bottom of the new stack, as a call would leave them.
+            Fiber fiber{Fiber::SUSPENDED, 0, 0, state, stacks.frames, stacks.frames, stacks.frames + m_fiber_frame_count, nullptr};
+            fiber.state.ip = entry;
+            fiber.state.stack_bottom = stacks.stack;
+            fiber.state.stack_limit = stacks.stack + m_fiber_stack_size;
+            fiber.state.base = stacks.stack;
+            fiber.state.sp = std::copy(state.sp - argc, state.sp, stacks.stack);
+            uint32_t id = addFiber(std::move(fiber));
+            return Value::fromInt(static_cast<int64_t>(m_fibers[id].generation) << 32 | id);
+        }
+
+        uint32_t VirtualMachine::addFiber(Fiber fiber) {
+            if (m_free_fibers.empty()) {
+                m_fibers.push_back(std::move(fiber));
+                return static_cast<uint32_t>(m_fibers.size() - 1);
+            }
+            uint32_t id = m_free_fibers.back();
+            m_free_fibers.pop_back();
+            fiber.generation = m_fibers[id].generation + 1;
+            m_fibers[id] = std::move(fiber);
+            return id;
+        }
+
+        void VirtualMachine::switchFiber(ExecutionState& state, uint32_t fiber) {
+            Fiber& from = m_fibers[m_fiber];
+            from.state = state;
+            from.frames = m_frames;
+            from.frame_top = m_frame_top;
+            from.frame_limit = m_frame_limit;
+
+            Fiber& to = m_fibers[fiber];
+            to.status = Fiber::RUNNING;
+            state = to.state;
+            m_frames = to.frames;
+            m_frame_top = to.frame_top;
+            m_frame_limit = to.frame_limit;
+            m_fiber = fiber;
+        }
+
+        void VirtualMachine::resumeFiber(ExecutionState& state, const Value& handle) {
+            uint32_t fiber = static_cast<uint32_t>(handle.as.integer);
+            uint32_t generation = static_cast<uint32_t>(static_cast<uint64_t>(handle.as.integer) >> 32);
+            if (!handle.isInt() || handle.as.integer < 0 || fiber >= m_fibers.size() || generation > m_fibers[fiber].generation) {
+                throw VirtualMachineError("Cannot resume '" + handle.toString() + "': it is not a fiber.");
+            }
+            // An older generation's fiber returned before the record was reused.
+            Fiber::Status status = generation < m_fibers[fiber].generation ? Fiber::DEAD : m_fibers[fiber].status;
+            if (status == Fiber::DEAD) throw VirtualMachineError("Cannot resume fiber " + handle.toString() + ": it has returned.");
+            if (status != Fiber::SUSPENDED) throw VirtualMachineError("Cannot resume fiber " + handle.toString() + ": it is running.");
+            m_fibers[m_fiber].status = Fiber::RESUMING;
+            m_fibers[fiber].resumer = m_fiber;
+            switchFiber(state, fiber);
+        }
+
+        void VirtualMachine::yieldFiber(ExecutionState& state, const Value& value) {
+            if (m_fiber == 0 || m_fibers[m_fiber].task) throw VirtualMachineError("Cannot yield outside a fiber.");
+            m_fibers[m_fiber].status = Fiber::SUSPENDED;
+            state.push(Value()); // What yield() evaluates to once the fiber is resumed
+            switchFiber(state, m_fibers[m_fiber].resumer);
+            state.push(value);
+        }
+
+        bool VirtualMachine::finishFiber(ExecutionState& state, const Value& result) {
+            if (m_fiber == 0) {
+                m_result = result;
+                return false;
+            }
+            Fiber& fiber = m_fibers[m_fiber];
+            fiber.status = Fiber::DEAD;
+            m_free_fiber_stacks.push_back({state.stack_bottom, m_frames, fiber.task ? state.globals : nullptr});
+            // A record whose generation would not fit a handle is retired instead.
+            if (fiber.generation < INT32_MAX) m_free_fibers.push_back(m_fiber);
+            if (fiber.task) {
+                // Anyone else waiting for the task gets a copy of the result.
+                PortableValue portable = toPortable(result);
+                Arena::Charge charge(m_arena, portable.footprint());
+                m_scheduler->finish(*fiber.task, std::move(portable), std::move(charge));
+                fiber.task.reset();
+            }
+            switchFiber(state, fiber.resumer);
+            state.push(result);
+            return true;
+        }
+
+        Value VirtualMachine::spawnTask(const ExecutionState& state, const Instruction* entry, uint8_t argc) {
+            if (!m_scheduler) {
+                size_t threads = m_task_threads ? m_task_threads : std::max(1u, std::thread::hardware_concurrency());
+                size_t helpers = m_task_threads_allowed ? threads - 1 : 0;
+                m_task_scheduler = std::make_unique<TaskScheduler>(*m_program, helpers, [this](TaskScheduler& scheduler, size_t worker) {
+                    auto vm = std::make_unique<VirtualMachine>(m_logger, m_memory_limit);
+                    vm->m_max_call_depth = m_max_call_depth;
+                    vm->m_fiber_call_depth = m_fiber_call_depth;
+                    vm->m_natives = m_natives;
+                    vm->m_job = m_job;
+                    vm->m_output_buffer = m_output_buffer;
+                    vm->m_jit_enabled = m_jit_enabled;
+                    vm->m_tracing = m_tracing;
+                    vm->m_scheduler = &scheduler;
+                    vm->m_worker = worker;
+                    return vm;
+                });
+                m_scheduler = m_task_scheduler.get();
+                m_worker = 0;
+                m_logger.debug("VM: Running tasks on " + std::to_string(helpers + 1) + " threads.");
+            }
+
+            // Tasks see the globals as they are now. Most spawns find them
+            // unchanged since the last one and share its copy.
+            size_t count = m_program->global_count;
+            bool unchanged = m_snapshot && std::equal(state.globals, state.globals + count, m_snapshot_source.begin(), sameBits);
+            if (!unchanged) {
+                auto snapshot = std::make_shared<TaskGlobals>();
+                snapshot->globals.reserve(count);
+                for (size_t i = 0; i < count; i++) snapshot->globals.push_back(toPortable(state.globals[i]));
+                snapshot->charge = Arena::Charge(m_arena, footprint(snapshot->globals));
+                m_snapshot = std::shared_ptr<const std::vector<PortableValue>>(snapshot, &snapshot->globals);
+                m_snapshot_source.assign(state.globals, state.globals + count);
+            }
+
+            auto task = std::make_shared<Task>();
+            task->entry = entry;
+            task->globals = m_snapshot;
+            task->args.reserve(argc);
+            for (const Value* arg = state.sp - argc; arg < state.sp; arg++) task->args.push_back(toPortable(*arg));
+            task->args_charge = Arena::Charge(m_arena, footprint(task->args));
+            // What this VM wrote so far comes before anything the task writes.
+            flushOutput();
+            return Value::fromInt(m_scheduler->spawn(m_worker, std::move(task)));
+        }
+
+        void VirtualMachine::joinTask(ExecutionState& state, const Value& handle) {
+            std::shared_ptr<Task> task = m_scheduler && handle.isInt() ? m_scheduler->find(handle.as.integer) : nullptr;
+            if (!task) throw VirtualMachineError("Cannot join '" + handle.toString() + "': it is not a task, or it has been joined.");
+            m_scheduler->release(handle.as.integer);
+
+            if (TaskScheduler::claim(*task)) {
+                // Nobody has started it, so it runs here, in a fiber with the
+                // task's globals; finishFiber pushes its result.
+                FiberStacks stacks = takeFiberStacks();
+                if (!stacks.globals) stacks.globals = m_arena.allocateArray<Value>(m_program->global_count);
+                const std::vector<PortableValue>& globals = *task->globals;
+                for (size_t i = 0; i < globals.size(); i++) stacks.globals[i] = fromPortable(globals[i]);
+
+                Fiber fiber{Fiber::SUSPENDED, 0, m_fiber, state, stacks.frames, stacks.frames, stacks.frames + m_fiber_frame_count, task};
+                fiber.state.ip = task->entry;
+                fiber.state.stack_bottom = stacks.stack;
+                fiber.state.stack_limit = stacks.stack + m_fiber_stack_size;
+                fiber.state.base = stacks.stack;
+                fiber.state.sp = stacks.stack;
+                fiber.state.globals = stacks.globals;
+                for (const PortableValue& arg : task->args) fiber.state.push(fromPortable(arg));
+                uint32_t id = addFiber(std::move(fiber));
+                m_fibers[m_fiber].status = Fiber::RESUMING;
+                switchFiber(state, id);
+                return;
+            }
+
+            if (!m_scheduler->wait(*task)) {
+                throw VirtualMachineError("The run ended before task " + std::to_string(handle.as.integer) + " finished.");
+            }
+            if (task->status.load(std::memory_order_acquire) == Task::FAILED) {
+                throw VirtualMachineError("Task " + std::to_string(handle.as.integer) + " failed: " + task->error);
+            }
+            state.push(fromPortable(task->result));
+        }
+
+        PortableValue VirtualMachine::toPortable(const Value& value) const {
+            PortableValue portable{value, {}};
+            if (value.isString()) {
+                // String constants belong to the program, which every VM shares.
+                const void* string = value.as.string;
+                const std::vector<uint64_t>& storage = m_program->string_storage;
+                std::less<const void*> before;
+                bool constant = !storage.empty() && !before(string, storage.data()) && before(string, storage.data() + storage.size());
+                if (!constant) {
+                    portable.text = value.as.string->toStdString();
+                    portable.value.as.string = nullptr;
+                }
+            }
+            return portable;
+        }
+
+        Value VirtualMachine::fromPortable(const PortableValue& value) {
+            if (value.value.isString() && !value.value.as.string) return makeString(value.text);
+            return value.value;
+        }
+
+        void VirtualMachine::failTaskFibers(const std::string& error) {
+            for (Fiber& fiber : m_fibers) {
+                if (fiber.task) {
+                    m_scheduler->fail(*fiber.task, error);
+                    fiber.task.reset();
+                }
+            }
+        }
+
+        void VirtualMachine::stopTasks() {
+            m_task_scheduler.reset();
+            m_scheduler = nullptr;
+        }
+
+        void VirtualMachine::undefinedGlobal(uint32_t slot) const {
+            if (m_program && slot < m_program->global_names.size()) {
+                throw VirtualMachineError("Undefined global variable '" + m_program->global_names[slot] + "'.");
+            }
+            throw VirtualMachineError("Undefined global variable in slot " + std::to_string(slot) + ".");
+        }
+
+        void VirtualMachine::callStackOverflow() const {
+            throw VirtualMachineError("VM Stack Overflow: more than " + std::to_string(m_frame_limit - m_frames) + " calls in progress.");
+        }
+
+        namespace {
+
+            // Copies the strings a collection finds in use out of the arena
+            // being collected. The header of a string that has been copied is
+            // overwritten to point to its copy, so values that shared a string
+            // share the copy. A forwarded header has neither characters nor a
+            // left half, which no string in use can lack, and the copy as its
+            // right half.
+            class StringEvacuator {
+            public:
+                StringEvacuator(const Arena& from, Arena& to) : m_blocks(from.getBlocks()), m_to(to) {
+                    std::sort(m_blocks.begin(), m_blocks.end(), [](const Arena::Block& a, const Arena::Block& b) {
+                        return reinterpret_cast<uintptr_t>(a.memory) < reinterpret_cast<uintptr_t>(b.memory);
+                    });
+                }
+
+                void visit(Value* begin, Value* end) {
+                    for (Value* value = begin; value < end; value++) {
+                        if (value->isString()) value->as.string = evacuate(value->as.string);
                     }
-                    case OP_WRITE_OUT: { std::cout << pop(); break; }
-                    case OP_WRITE_ERR: { std::cerr << pop(); break; }
-                    case OP_FLUSH: { std::cout.flush(); std::cerr.flush(); break; }
-                    case OP_ADD: {
-                        std::string b = pop();
-                        std::string a = pop();
-                        try {
-                            double result = std::stod(a) + std::stod(b);
-                            push(std::to_string(result));
-                        } catch (const std::invalid_argument&) {
-                            push(a + b);
+                }
+
+            private:
+                std::vector<Arena::Block> m_blocks; // Of the arena being collected, by address
+                Arena& m_to;
+                std::vector<const String*> m_pending;
+
+                // Strings outside the arena, such as the program's constants, stay where they are.
+                bool isOld(const String* string) const {
+                    uintptr_t address = reinterpret_cast<uintptr_t>(string);
+                    auto after = std::upper_bound(m_blocks.begin(), m_blocks.end(), address, [](uintptr_t a, const Arena::Block& block) {
+                        return a < reinterpret_cast<uintptr_t>(block.memory);
+                    });
+                    if (after == m_blocks.begin()) return false;
+                    --after;
+                    return address - reinterpret_cast<uintptr_t>(after->memory) < after->size;
+                }
+
+                // Where 'string' is now, or null if it has yet to be copied.
+                const String* moved(const String* string) const {
+                    if (!isOld(string)) return string;
+                    return !string->chars && !string->left ? string->right : nullptr;
+                }
+
+                // A rope is copied after its halves, and without recursion, so
+                // any depth is fine. A flattened rope is copied flat.
+                const String* evacuate(const String* string) {
+                    if (const String* copy = moved(string)) return copy;
+                    m_pending.push_back(string);
+                    while (!m_pending.empty()) {
+                        const String* next = m_pending.back();
+                        if (moved(next)) {
+                            m_pending.pop_back();
+                            continue;
                         }
-                        break;
-                    }
-                    case OP_DEFINE_GLOBAL: {
-                        uint8_t name_index = frame.chunk->code[frame.ip++];
-                        m_globals[frame.chunk->constants[name_index]] = pop();
-                        break;
-                    }
-                    case OP_GET_GLOBAL: {
-                        uint8_t name_index = frame.chunk->code[frame.ip++];
-                        push(m_globals[frame.chunk->constants[name_index]]);
-                        break;
-                    }
-                    case OP_SET_GLOBAL: {
-                        uint8_t name_index = frame.chunk->code[frame.ip++];
-                        m_globals[frame.chunk->constants[name_index]] = m_stack.back();
-                        break;
-                    }
-                    case OP_GET_LOCAL: {
-                        uint8_t slot_index = frame.chunk->code[frame.ip++];
-                        push(m_stack[frame.stack_base + slot_index]);
-                        break;
-                    }
-                    case OP_SET_LOCAL: {
-                        uint8_t slot_index = frame.chunk->code[frame.ip++];
-                        m_stack[frame.stack_base + slot_index] = m_stack.back(); // Peek
-                        break;
-                    }
-                    case OP_CONVERT: {
-                        DataType target_type = (DataType)frame.chunk->code[frame.ip++];
-                        std::string value = pop();
-                        try {
-                            switch (target_type) {
-                                case DataType::INT: {
-                                    double num_val = std::stod(value);
-                                    push(std::to_string((int)num_val));
-                                    break;
-                                }
-                                case DataType::DOUBLE: {
-                                    double double_val = std::stod(value);
-                                    push(std::to_string(double_val));
-                                    break;
-                                }
-                                case DataType::STRING: {
-                                    push(value);
-                                    break;
-                                }
-                                default:
-                                    throw std::runtime_error("Unsupported conversion type requested in VM.");
+                        const String* copy;
+                        if (next->isFlat()) {
+                            copy = String::create(m_to.allocate(String::sizeFor(next->length), alignof(String)), next->view());
+                        } else {
+                            const String* left = moved(next->left);
+                            const String* right = moved(next->right);
+                            if (!left || !right) {
+                                if (!left) m_pending.push_back(next->left);
+                                if (!right) m_pending.push_back(next->right);
+                                continue;
                             }
-                        } catch (const std::invalid_argument&) {
-                            throw std::runtime_error("Cannot convert '" + value + "' to the requested numeric type.");
+                            copy = String::concat(m_to.allocate(sizeof(String), alignof(String)), left, right);
                         }
-                        break;
+                        String* old = const_cast<String*>(next);
+                        old->chars = nullptr;
+                        old->left = nullptr;
+                        old->right = copy;
+                        m_pending.pop_back();
                     }
-                    default: {
-                        m_logger.error("Unknown opcode: " + std::to_string(instruction));
-                        return;
+                    return moved(string);
+                }
+            };
+
+        }
+
+        void VirtualMachine::collectStrings(ExecutionState& state) {
+            // Queued output refers to strings by address.
+            m_stdout.flush();
+            m_stderr.flush();
+
+            // The roots are every fiber's operand stack and globals, and the
+            // result. Stack code never leaves a slot below the top unwritten,
+            // but register code's frames can, so all of its stack is scanned;
+            // prepare() starts it out as nil.
+            Arena strings(m_arena);
+            StringEvacuator evacuator(m_strings, strings);
+            size_t global_count = m_program->global_count;
+            auto visit = [&](const ExecutionState& fiber) {
+                evacuator.visit(fiber.stack_bottom, m_program->isa == ISA_STACK ? fiber.sp : fiber.stack_limit);
+                evacuator.visit(fiber.globals, fiber.globals + global_count);
+            };
+            visit(state);
+            for (uint32_t i = 0; i < m_fibers.size(); i++) {
+                if (i != m_fiber && m_fibers[i].status != Fiber::DEAD) visit(m_fibers[i].state);
+            }
+            evacuator.visit(&m_result, &m_result + 1);
+            m_strings.swap(strings); // The old strings go back to the system with 'strings'
+
+            // Copies of the globals compared by address could now match
+            // different strings at the same addresses.
+            m_snapshot.reset();
+            m_snapshot_source.clear();
+            m_call_marked = false;
+            m_logger.debug("VM: Collected strings; " + std::to_string(m_strings.getUsed()) + " bytes in use.");
+            scheduleCollection(m_strings.getUsed());
+        }
+
+        void VirtualMachine::scheduleCollection(size_t live) {
+            // Collecting once the strings have doubled keeps the copying in
+            // proportion to what is allocated. Under a limit the strings must
+            // not outgrow half of what the rest of the VM leaves, so that
+            // what survives can be copied, but at least a block is allocated
+            // between collections.
+            size_t next = std::max(MIN_COLLECTION_SIZE, live * 2);
+            if (m_memory_limit) {
+                size_t others = m_arena.getReserved();
+                size_t room = m_memory_limit > others ? (m_memory_limit - others) / 2 : 0;
+                next = std::max(std::min(next, room), live + Arena::BLOCK_SIZE);
+            }
+            m_collect_at = next;
+        }
+
+        Value VirtualMachine::makeString(std::string_view text) {
+            void* memory = m_strings.allocate(String::sizeFor(text.size()), alignof(String));
+            return Value::fromString(String::create(memory, text));
+        }
+
+        Value VirtualMachine::concat(const Value& a, const Value& b) {
+            const String* left = a.isString() ? a.as.string : makeString(a.toString()).as.string;
+            const String* right = b.isString() ? b.as.string : makeString(b.toString()).as.string;
+            if (left->length == 0) return Value::fromString(right);
+            if (right->length == 0) return Value::fromString(left);
+
+            size_t length = left->length + right->length;
+            if (length < String::ROPE_MIN_LENGTH) {
+                char text[String::ROPE_MIN_LENGTH];
+                left->copyTo(text);
+                right->copyTo(text + left->length);
+                return makeString(std::string_view(text, length));
+            }
+            return Value::fromString(String::concat(m_strings.allocate(sizeof(String), alignof(String)), left, right));
+        }
+
+        Value VirtualMachine::concat(Value* values, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                if (!values[i].isString()) values[i] = makeString(values[i].toString());
+            }
+            const String* result = nullptr;
+            auto append = [&](const String* piece) {
+                if (piece->length == 0) return;
+                result = result ? String::concat(m_strings.allocate(sizeof(String), alignof(String)), result, piece) : piece;
+            };
+            for (size_t i = 0; i < count;) {
+                size_t end = i;
+                size_t length = 0;
+                while (end < count && values[end].as.string->length < String::ROPE_MIN_LENGTH) {
+                    length += values[end++].as.string->length;
+                }
+                if (end - i <= 1) {
+                    append(values[i].as.string); // A long piece, or a short one with nothing to join
+                    i++;
+                    continue;
+                }
+                if (length > 0) {
+                    void* memory = m_strings.allocate(String::sizeFor(length), alignof(String));
+                    char* chars = String::createUninitialized(memory, length);
+                    for (size_t j = i; j < end; j++) {
+                        values[j].as.string->copyTo(chars);
+                        chars += values[j].as.string->length;
                     }
+                    append(static_cast<const String*>(memory));
                 }
+                i = end;
             }
+            return result ? Value::fromString(result) : values[0];
         }
 
-        void VirtualMachine::push(const std::string& value) {
-            m_stack.push_back(value);
+        const char* VirtualMachine::flatten(const String* string) {
+            if (string->isFlat()) return string->chars;
+            char* chars = static_cast<char*>(m_strings.allocate(string->length + 1, 1));
+            string->copyTo(chars);
+            chars[string->length] = '\0';
+            string->chars = chars;
+            return chars;
         }
 
-        std::string VirtualMachine::pop() {
-            if (m_stack.empty()) throw std::runtime_error("VM Stack Underflow");
-            std::string value = m_stack.back();
-            m_stack.pop_back();
-            return value;
+        void VirtualMachine::write(OutputStream stream, const Value& value) {
+            if (stream == OUTPUT_OUT) {
+                m_stdout.write(value);
+                return;
+            }
+            m_stdout.flush();
+            m_stderr.write(value);
+        }
+
+        void VirtualMachine::flushOutput() {
+            m_stdout.flush();
+            m_stderr.flush();
+            std::cout.flush();
+            std::cerr.flush();
         }
 
+        void VirtualMachine::compileHot(const Instruction* entry, const Value* args, uint8_t argc, JitFunction& function) {
+            m_jit.compile(entry, args, argc, function);
+        }
+
+        Value VirtualMachine::convert(const Value& value, uint8_t target_type) {
+            int64_t int_val;
+            double double_val;
+            switch (target_type) {
+                case DataType::INT:
+                    if (value.isInt()) return value;
+                    if (value.isDouble()) return Value::fromInt(static_cast<int64_t>(value.as.number));
+                    if (value.isString() && parseInt(flatten(value.as.string), int_val)) return Value::fromInt(int_val);
+                    if (value.isString() && parseDouble(flatten(value.as.string), double_val)) return Value::fromInt(static_cast<int64_t>(double_val));
+                    throw VirtualMachineError("Cannot convert '" + value.toString() + "' to the requested numeric type.");
+                case DataType::DOUBLE:
+                    if (value.isNumber()) return Value::fromDouble(value.asNumber());
+                    if (value.isString() && parseDouble(flatten(value.as.string), double_val)) return Value::fromDouble(double_val);
+                    throw VirtualMachineError("Cannot convert '" + value.toString() + "' to the requested numeric type.");
+                case DataType::STRING:
+                    return value.isString() ? value : makeString(value.toString());
+                default:
+                    throw VirtualMachineError("Unsupported conversion type requested in VM.");
+            }
+        }
+
+        void VirtualMachine::checkType(const Value& value, uint8_t type) {
+            if (dataTypeOf(value) != type) {
+                throw VirtualMachineError(std::string("Expected a value of type ") + dataTypeName(type) + ", not " + dataTypeName(dataTypeOf(value)) + " '" + value.toString() + "'.");
+            }
+        }
+
+        template void VirtualMachine::run<CountingInstrumentation>(Program&, CountingInstrumentation&);
+        template void VirtualMachine::run<ProfilingInstrumentation>(Program&, ProfilingInstrumentation&);
+
     }
 }
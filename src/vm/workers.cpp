@@ -0,0 +1,45 @@
+#include "vm/workers.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace Iodicium {
+    namespace VM {
+
+        WorkerPool::WorkerPool(Common::Logger& logger, Program& program, size_t workers, size_t memory_limit)
+            : m_logger(logger), m_program(program), m_workers(std::max<size_t>(workers, 1)), m_memory_limit(memory_limit) {}
+
+        size_t WorkerPool::run(const std::vector<std::string>& jobs) {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> failed{0};
+            std::mutex report_mutex;
+
+            auto work = [&]() {
+                VirtualMachine vm(m_logger, m_memory_limit);
+                if (m_configure) m_configure(vm);
+                for (size_t job = next++; job < jobs.size(); job = next++) {
+                    vm.setJob(jobs[job]);
+                    try {
+                        vm.run(m_program);
+                    } catch (const std::exception& e) {
+                        failed++;
+                        std::lock_guard<std::mutex> lock(report_mutex);
+                        std::cerr << "Error: Job " << job + 1 << " (" << jobs[job] << "): " << e.what() << std::endl;
+                    }
+                }
+            };
+
+            size_t count = std::min(m_workers, jobs.size());
+            m_logger.debug("WorkerPool: Running " + std::to_string(jobs.size()) + " jobs on " + std::to_string(count) + " threads.");
+            std::vector<std::thread> threads;
+            threads.reserve(count);
+            for (size_t i = 0; i < count; i++) threads.emplace_back(work);
+            for (std::thread& thread : threads) thread.join();
+            return failed;
+        }
+
+    }
+}